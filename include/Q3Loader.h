@@ -13,10 +13,16 @@
 #ifndef Q3LOADER_H
 #define Q3LOADER_H
 
+#include <cstddef>
 #include <vector>
 #include <string>
 #include <sstream>
 
+namespace shooter
+{
+  class JobSystem;
+}
+
 /**
  * Description of a lump.
  * 
@@ -308,13 +314,19 @@ enum Q3MapPostProcessSteps
 void debugInformations(const TMapQ3& pMap, FILE* pFile);
 
 /**
- * Read the map.
+ * Read the map from the Q3 file data in memory.
+ * Each lump is copied with a single memcpy and converted in place, the lumps are read in parallel.
  *
- * @param pFilename  The filename of the map to read.
+ * @param bspData  The Q3 file data.
+ * @param bspSize  The size of the Q3 file data.
+ * @param pMap  The map structure to fill.
+ * @param scale  The scale applied to the positions.
+ * @param postProcessSteps  The Q3MapPostProcessSteps to apply.
+ * @param jobs  The job system reading the lumps in parallel, nullptr to read them on the calling thread.
  *
  * @return true if the loading successed, false otherwise.
  */
-bool readMap(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, unsigned postProcessSteps = 0u);
+bool readMap(const char* bspData, size_t bspSize, TMapQ3& pMap, float scale = 1.f, unsigned postProcessSteps = 0u, shooter::JobSystem* jobs = nullptr);
 
 /**
  * Check if the header of the map is valid.
@@ -16,7 +16,6 @@
 #include <memory>
 #include <string>
 #include <vector>
-#include <unordered_set>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -25,11 +24,15 @@
 
 #include "Q3Loader.h"
 
+struct SDL_Surface;
+
 namespace shooter {
 
   struct CompCamera;
   class Resources;
+  class VirtualFileSystem;
   class NavMesh;
+  class JobSystem;
 
   /// Data describing the intersection of a moving point/shape with the Q3 map
   struct TraceData
@@ -60,6 +63,9 @@ namespace shooter {
     const glm::vec3 mMaxBounds; ///< Shape maximum bounds position
     const glm::vec3 mExtends; ///< Shape extends on X,Y and Z axii
 
+    const glm::vec3 mSweepMinBounds; ///< Minimum bounds of the whole volume swept from mStart to mEnd
+    const glm::vec3 mSweepMaxBounds; ///< Maximum bounds of the whole volume swept from mStart to mEnd
+
     /// Output data
     bool mCollision; ///< True if there was a collision with the map, false otherwise
     bool mStartsOut; ///< True if the trace starts outside a Q3 Map Brush, false otherwise
@@ -69,17 +75,39 @@ namespace shooter {
     float mFraction; ///< Describes the intersection point which is (mEnd - mStart) * mFraction
     int mContents; ///< Contents Flag of the intersected surface
     glm::vec3 mPlaneProj; ///< Projection of the ray on the intersecting plane 
+  };
 
-    std::unordered_set<uint32_t> mCheckedBrushes; ///< indices of Brushes checked 
+  /// Map data walked by Q3Map::Trace(). ETraceBackendMapData is the original BSP walk, kept as the reference.
+  /// All the backends return the same TraceData: they check the brushes the reference walk reaches, 
+  /// and among the brushes entered at the closest fraction the last one it checks wins.
+  enum TraceBackend
+  {
+    ETraceBackendMapData = 0, ///< BSP nodes, brushes, brush sides and planes as read from the map file (default)
+    ETraceBackendCollisionMap, ///< Flattened copy of the solid brushes built at load time
+    ETraceBackendBvh, ///< Bounding Volume Hierarchy over the collision map's solid brushes
   };
 
   /// Class describing the map. Contains methods to do ray/volume tracing and rendering of the map.
   class Q3Map
   {
   public:
-    Q3Map(const std::string& mapZipPath);
+    /// Load the map from the mapZipPath archive, mounted in fileSystem, on the CPU side only (no OpenGL calls are made).
+    /// If decodeTextures is false, the textures are not read from the archive (headless mode).
+    /// The post processed map is cached in cookedMapPath, the next loads with the same archive and parameters read it instead.
+    /// The lumps and the textures are read in parallel on jobs, or on the calling thread if it's nullptr.
+    Q3Map(
+      const VirtualFileSystem& fileSystem, 
+      const std::string& mapZipPath, 
+      const std::string& cookedMapPath, 
+      bool decodeTextures = true,
+      JobSystem* jobs = nullptr);
     ~Q3Map();
 
+    /// Upload the decoded textures, lightmaps and vertex buffers to the GPU
+    /// and resolve the ids of the programs used by Render(). 
+    /// Needs a valid OpenGL context.
+    void InitGL(const Resources& resources);
+
     const TMapQ3& GetMapQ3() const { return mMap; }
 
     /// Render the map
@@ -93,9 +121,35 @@ namespace shooter {
     /// Trace a moving point or volume intersection with the map 
     bool Trace(TraceData& data) const;
 
+    /// Select the map data walked by Trace(). Not thread safe, don't call it while tracing.
+    void SetTraceBackend(TraceBackend backend) { mTraceBackend = backend; }
+    TraceBackend GetTraceBackend() const { return mTraceBackend; }
+
+    /// Trace a batch of moving points or volumes, with the same results as calling Trace() for each.
+    /// With the ETraceBackendMapData backend it calls Trace() for each. The other backends walk the collision map once for each
+    /// packet of cTracePacketSize traces and test the brush planes on all the traces of a packet at once (SSE). 
+    /// Traces close to each other should be consecutive.
+    void TraceBatch(TraceData* traces, uint32_t nrTraces) const;
+
+    /// Number of traces tested together by TraceBatch()
+    static const uint32_t cTracePacketSize = 4;
+
+    /// Visibility cluster of the BSP leaf containing pos (negative inside the solid brushes)
+    int FindCluster(const glm::vec3& pos) const { return mMap.mLeaves[FindLeaf(pos)].mCluster; }
+
+    /// False if the map's Potentially Visible Set proves that no point of visCluster sees testCluster.
+    /// Negative clusters, and maps without visibility data, are always visible.
+    bool IsClusterVisible(int visCluster, int testCluster) const;
+
     /// Get the unindexed vertices, normals and indices
     void GetVerticesAndIndices(std::vector<float>& outVertices, std::vector<float>& outNormals, std::vector<int>& outIndices);
 
+    typedef std::pair<uint32_t, uint32_t> FaceIdAndHash;
+    typedef std::vector<std::vector<FaceIdAndHash> > VisibleFacesByType; ///< Visible faces, indexed by FaceType
+
+    /// Find all visible faces (CPU only, called by Render())
+    VisibleFacesByType FindVisibleFaces(const glm::vec3& camPos, const glm::mat4& mvpMat) const;
+
   private:
     enum FaceType
     {
@@ -109,37 +163,176 @@ namespace shooter {
       EFaceTypeMax
     };
 
-    typedef std::pair<uint32_t, uint32_t> FaceIdAndHash;
-    typedef std::vector<std::vector<FaceIdAndHash> > VisibleFacesByType;
-
     /// Update the flame vertices and indexes in the mMap to use rotating billboards
     void UpdateFlameQuads();
 
+    /// Read mMap and mTexturesTypeBits from the cooked map file written by WriteCookedMap().
+    /// Returns false if the file is missing or invalid, or if it was cooked with another key (archive or load parameters).
+    /// outTexturesKey is the key of the decoded textures the map was cooked with (0 without them), checked by the caller
+    /// once the textures are decoded.
+    bool ReadCookedMap(const std::string& filePath, uint64_t key, uint64_t& outTexturesKey);
+    void WriteCookedMap(const std::string& filePath, uint64_t key, uint64_t texturesKey) const;
+
+    /// Decode the textures into CPU memory, one job each, or on the calling thread if jobs is nullptr.
+    /// outSourcesKey is a hash of the files the textures were decoded from.
+    /// @return decoded surfaces, nullptr for the textures that couldn't be decoded
+    static std::vector<SDL_Surface*> DecodeTextures(
+      const std::vector<TTexture>& textures, 
+      const VirtualFileSystem& fileSystem, 
+      JobSystem* jobs, 
+      uint64_t& outSourcesKey);
+
+    /// Free the decoded textures and the OpenGL objects
+    void ReleaseGL();
+
     /// Init OpenGL buffers needed for rendering
     void InitBuffers();
 
     /// Render a face
     void RenderFace(uint32_t faceIndex) const;
 
-    /// Find all visible faces
-    VisibleFacesByType FindVisibleFaces(const glm::vec3& camPos, const glm::mat4& mvpMat) const;
-
     /// Functions inspired from (http://graphics.cs.brown.edu/games/quake/quake3.html)
     int FindLeaf(const glm::vec3& camPos) const;
-    bool IsClusterVisible(int visCluster, int testCluster) const;
+
+    /// Brushes already checked by the current trace of a thread (see BeginCheckedBrushes())
+    struct CheckedBrushes
+    {
+      CheckedBrushes() : stamp(0) {}
+
+      std::vector<uint32_t> stamps; ///< Stamp of the last trace that checked each brush
+      std::vector<uint8_t> lanes; ///< Traces of the packet which checked each brush, valid if the stamp is current (see TraceBatch())
+      uint32_t stamp; ///< Stamp of the current trace
+      std::vector<int> bspStack; ///< Nodes left to visit by TraceCollisionMap(), reused by all the traces of the thread
+    };
+
+    /// Start a trace on the calling thread with a new stamp, so no brush is marked as checked
+    /// and the array doesn't need clearing
+    static CheckedBrushes& BeginCheckedBrushes(uint32_t nrBrushes);
 
     // Recursive functions called by Trace()
-    void CheckNode(int nodeIndex, TraceData& data) const;
-    void CheckLeaf(int leafIndex, TraceData& data) const;
+    void CheckNode(int nodeIndex, TraceData& data, CheckedBrushes& checked) const;
+    void CheckLeaf(int leafIndex, TraceData& data, CheckedBrushes& checked) const;
     void CheckBrush(int brushIndex, TraceData& data) const;
 
+    /// Split plane of the collision map's BSP tree, with the same children as TNode
+    struct CollisionNode
+    {
+      glm::vec3 normal;
+      float distance;
+      int children[2];
+    };
+
+    /// Range of the solid brushes of a BSP leaf in CollisionMap::leafBrushes
+    struct CollisionLeaf
+    {
+      uint32_t firstBrush;
+      uint32_t nrBrushes;
+    };
+
+    /// Brush of the collision map
+    struct CollisionBrush
+    {
+      glm::vec3 minBounds; ///< Bounds from the axis aligned sides, grown by a small margin (infinite on the missing sides)
+      glm::vec3 maxBounds;
+      uint32_t firstSide; ///< First side in the CollisionMap sides arrays
+      uint32_t nrSides; ///< 0 if the brush is not solid
+      int contents;
+    };
+
+    /// Node of the collision map's Bounding Volume Hierarchy. The nodes are stored depth first,
+    /// so the left child of an inner node follows it.
+    struct BvhNode
+    {
+      glm::vec3 minBounds;
+      uint32_t index; ///< First brush in CollisionMap::bvhBrushes for leaves, right child for inner nodes
+      glm::vec3 maxBounds;
+      uint32_t nrBrushes; ///< 0 for inner nodes
+    };
+
+    /// Copy of the map data used by the traces, built once at load time (see BuildCollisionMap()).
+    /// The brushes keep the map's indices, but only the solid ones have sides and are listed in the leaves.
+    /// The sides of a brush are contiguous, stored as Structure of Arrays with normalized normals.
+    struct CollisionMap
+    {
+      std::vector<CollisionNode> nodes;
+      std::vector<CollisionLeaf> leaves;
+      std::vector<uint32_t> leafBrushes;
+      std::vector<CollisionBrush> brushes;
+      uint32_t bspDepth; ///< Number of nodes on the longest path from the root to a leaf
+
+      std::vector<int32_t> nodeParents; ///< Parent node * 2 + side of the child in it, for each node and leaf (see IsBrushReached())
+      std::vector<int32_t> leafParents;
+      std::vector<uint32_t> brushLeaves; ///< Leaves listing each solid brush, from brushLeaves[brushFirstLeaves[brush]]
+      std::vector<uint32_t> brushFirstLeaves; ///< One more than the number of brushes
+
+      std::vector<float> sideNormalsX;
+      std::vector<float> sideNormalsY;
+      std::vector<float> sideNormalsZ;
+      std::vector<float> sideDistances;
+      std::vector<int32_t> sidePlanes; ///< Index of the map plane of each side (reported by TraceData::mPlaneIndex)
+
+      std::vector<BvhNode> bvhNodes; ///< Built with the Surface Area Heuristic, the root is the first node
+      std::vector<uint32_t> bvhBrushes; ///< Solid brushes referenced by the BVH leaves, each one once
+      std::vector<uint32_t> unboundedBrushes; ///< Solid brushes without 6 axis aligned sides, checked by all the BVH traces
+    };
+
+    /// Build mCollisionMap from mMap
+    void BuildCollisionMap();
+
+    /// Build the BVH node over the brushes bvhBrushes[first, first + count) and its children, return its index
+    static uint32_t BuildBvhNode(CollisionMap& collision, uint32_t first, uint32_t count, uint32_t depth);
+
+    /// Intersection of a trace with a collision map brush, computed like in CheckBrush()
+    struct BrushClip
+    {
+      float enterFraction;
+      float leaveFraction;
+      int32_t startPlaneIndex;
+      int contents;
+      bool startsOut;
+      bool endsOut;
+    };
+
+    /// True if ClipToBrush() changes the trace, or ties its closest brush
+    static bool ClipChangesTrace(const BrushClip& clip, const TraceData& data);
+
+    /// Update the trace with a brush intersection, like CheckBrush(): the last brush entered at the closest fraction wins.
+    /// tied tells if an earlier brush entered at that fraction has another plane or contents, so the result depends on the 
+    /// order of the brushes.
+    static void ClipToBrush(const BrushClip& clip, TraceData& data, bool& tied);
+
+    // Trace() with the ETraceBackendCollisionMap and ETraceBackendBvh backends, specialized for each trace type.
+    // TraceCollisionMap() walks the BSP in the same order as CheckNode(), with an explicit stack.
+    // CheckCollisionBrush() returns false if the brush doesn't change the trace.
+    template<TraceData::TraceType TType> void TraceCollisionMap(TraceData& data, CheckedBrushes& checked) const;
+    template<TraceData::TraceType TType> void TraceBvh(TraceData& data) const;
+    template<TraceData::TraceType TType> bool CheckCollisionBrush(int brushIndex, const TraceData& data, BrushClip& clip) const;
+
+    /// True if the CheckNode() walk of the trace reaches a leaf listing the brush
+    template<TraceData::TraceType TType> bool IsBrushReached(uint32_t brushIndex, const TraceData& data) const;
+
+    /// Traces of TraceBatch() tested together, in Structure of Arrays layout (see Q3Map.cpp)
+    struct TracePacket;
+
+    // Recursive functions called by TraceBatch(), for the traces of the packet in the lanes bit mask
+    void CheckNodePacket(int nodeIndex, TracePacket& packet, uint32_t lanes, CheckedBrushes& checked) const;
+    void CheckLeafPacket(int leafIndex, TracePacket& packet, uint32_t lanes, CheckedBrushes& checked) const;
+    void CheckBrushPacket(int brushIndex, TracePacket& packet, uint32_t lanes) const;
+
     TMapQ3 mMap;
+    CollisionMap mCollisionMap;
+    TraceBackend mTraceBackend;
+    std::vector<SDL_Surface*> mTexturesSurfaces; ///< Decoded Diffuse Textures, waiting to be uploaded by InitGL()
     std::vector<GLuint> mLightMaps; ///< OpenGL texture objs for the Light Map Textures
     std::vector<GLuint> mTextures; ///< OpenGL texture objs for the Diffuse Textures
     std::vector<uint64_t> mTexturesTypeBits; ///< Bit Mask containing the texture type for each texture in mTextures (2 bit/texture)
     
     GLuint mVao; ///< OpenGL vertex array object of the map
     std::vector<GLuint> mBufferObjects; ///< OpenGL buffer objs
+
+    uint32_t mSimpleProgram; ///< ProgramId used for the opaque and transparent faces
+    uint32_t mFlameProgram; ///< ProgramId used for the flames
+    uint32_t mSwirlProgram; ///< ProgramId used for the swirls
   };
 }
 
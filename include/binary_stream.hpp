@@ -0,0 +1,154 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef BINARY_STREAM_HPP
+#define BINARY_STREAM_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace shooter {
+
+  /// Appends values to a byte buffer, in the host byte order. 
+  /// Only trivially copyable types are written, as raw memory.
+  class BinaryWriter
+  {
+  public:
+    explicit BinaryWriter(std::vector<uint8_t>& data) : mData(data) {}
+
+    void WriteBytes(const void* bytes, size_t size)
+    {
+      const uint8_t* begin = static_cast<const uint8_t*>(bytes);
+      mData.insert(mData.end(), begin, begin + size);
+    }
+
+    template<typename T>
+    void Write(const T& value)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "T must be copyable with memcpy");
+      WriteBytes(&value, sizeof(T));
+    }
+
+    /// Write the number of elements followed by the elements
+    template<typename T>
+    void WriteVector(const std::vector<T>& values)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "T must be copyable with memcpy");
+      Write(static_cast<uint32_t>(values.size()));
+      WriteBytes(values.data(), values.size() * sizeof(T));
+    }
+
+    void WriteString(const std::string& str)
+    {
+      Write(static_cast<uint32_t>(str.size()));
+      WriteBytes(str.data(), str.size());
+    }
+
+    /// Number of bytes in the buffer
+    size_t GetSize() const { return mData.size(); }
+
+  private:
+    std::vector<uint8_t>& mData;
+  };
+
+  /// Reads the values written by a BinaryWriter. 
+  /// Reading past the end of the buffer fails and leaves the value unchanged.
+  class BinaryReader
+  {
+  public:
+    BinaryReader(const uint8_t* data, size_t size) : mData(data), mSize(size), mPos(0) {}
+
+    bool ReadBytes(void* bytes, size_t size)
+    {
+      if (size > mSize - mPos) { return false; }
+      if (size == 0) { return true; } // bytes can be null for an empty vector
+
+      std::memcpy(bytes, mData + mPos, size);
+      mPos += size;
+      return true;
+    }
+
+    template<typename T>
+    bool Read(T& value)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "T must be copyable with memcpy");
+      return ReadBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    bool ReadVector(std::vector<T>& values)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "T must be copyable with memcpy");
+      uint32_t size = 0;
+      if (!Read(size) || (size > (mSize - mPos) / sizeof(T))) { return false; }
+
+      values.resize(size);
+      return ReadBytes(values.data(), size * sizeof(T));
+    }
+
+    bool ReadString(std::string& str)
+    {
+      uint32_t size = 0;
+      if (!Read(size) || (size > mSize - mPos)) { return false; }
+
+      str.assign(reinterpret_cast<const char*>(mData + mPos), size);
+      mPos += size;
+      return true;
+    }
+
+    /// Move the read position
+    bool Seek(size_t pos)
+    {
+      if (pos > mSize) { return false; }
+
+      mPos = pos;
+      return true;
+    }
+
+    size_t GetPos() const { return mPos; }
+    size_t GetSize() const { return mSize; }
+    bool IsEnd() const { return mPos == mSize; }
+
+  private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mPos;
+  };
+
+  /// FNV-1a style hash of size bytes, continuing from hash, 8 bytes at a time. 
+  /// Used to key the files cached from larger inputs (see Q3Map and NavMesh)
+  inline uint64_t HashWords(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, bytes + i, sizeof(uint64_t));
+      hash = (hash ^ word) * 1099511628211ULL;
+      hash ^= hash >> 32; // the product only carries the low bits of the word up
+    }
+    for (; i < size; i++)
+    {
+      hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+}
+
+#endif // BINARY_STREAM_HPP
@@ -13,7 +13,9 @@
 #ifndef COMPONENTS_HPP
 #define COMPONENTS_HPP
 
+#include <algorithm>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <glm/vec3.hpp>
@@ -31,7 +33,9 @@ namespace shooter {
   /// Component containing data necessary for rendering an entity.
   struct CompRenderable
   {
-    std::string modelName; ///< Name of the 3D model
+    CompRenderable() : modelId(cInvalidId) {}
+
+    ModelId modelId; ///< Id of the 3D model (see Resources::GetModelId())
   };
 
   /// Component containing data necessary for scaling, rotating and translating an entity.
@@ -107,30 +111,52 @@ namespace shooter {
   /// The transition time between 2 different animations in seconds
   const float cAnimationTransitionTime = .2f;
 
+  /// Types of animations played by the Systems. 
+  /// Resolved to the model's AnimationIds at initialization (see Scene::animationIds)
+  enum AnimationType
+  {
+    EAnimIdle = 0,
+    EAnimIdleFiring,
+    EAnimWalk,
+    EAnimWalkFiring,
+    EAnimWalkBackwards,
+    EAnimRunForwards,
+    EAnimRunFiring,
+    EAnimRunBackwards,
+    EAnimStrafeLeft,
+    EAnimLeftFire,
+    EAnimStrafeRight,
+    EAnimRightFire,
+    EAnimJump,
+    EAnimStanding2,
+    EAnimTypeMax,
+  };
+
   /// Component containing data data necessary for animating an entity.
+  /// The animation nodes data (global transformations and previous frames) is stored 
+  /// in the Scene::animationsGlobalTrans and Scene::animationsLastFrames columns.
   struct CompAnimation
   {
     CompAnimation() 
-      : timeInSeconds(0.f)
+      : id(cInvalidId)
+      , timeInSeconds(0.f)
       , lastTimeInSeconds(0.f)
     {}
 
-    void Set(const std::string& pName, 
+    void Set(AnimationId pId, 
       float pTimeInSeconds = 0.f, 
       float pLastTimeInSeconds = -cAnimationTransitionTime)
     {
-      name = pName;
+      id = pId;
       timeInSeconds = pTimeInSeconds;
       lastTimeInSeconds = pLastTimeInSeconds;
     }
 
-    std::string name; ///< Name of the animation
+    AnimationId id; ///< Id of the animation (see Resources::GetAnimationId())
     float timeInSeconds; ///< Time of the animation, in seconds
-    std::vector<glm::mat4> globalTrans; ///< Global transformation matrices of all the animation nodes
 
     /// Needed when transitioning between 2 animation types
     float lastTimeInSeconds; ///< Time of previous frame's animation
-    std::vector<AnimationFrame> lastAnimationFrames; ///< Data describing the previous animation frames
   };
 
   /// Component containing data data necessary for describing a path between 2 points on the NavMesh.
@@ -148,6 +174,14 @@ namespace shooter {
     int nrPathPolys; ///< Number of polygons in the path
   };
 
+  /// Component referencing a CompNavMeshPath allocated from the Scene's NavMeshPathPool.
+  struct CompNavMeshPathRef
+  {
+    CompNavMeshPathRef() : pathIx(-1) {}
+
+    int32_t pathIx; ///< Index of the path in the pool or -1 if the entity doesn't follow a path
+  };
+
   /// Enum of different states bit masks.
   enum StateBitMask
   {
@@ -168,8 +202,6 @@ namespace shooter {
     uint32_t state; ///< Bit mask of states
   };
 
-  typedef std::vector<int32_t> TStateTargets;
-  
   enum StatesTargetIndex
   {
     EStateAttackTargetIx = 0,
@@ -182,13 +214,11 @@ namespace shooter {
   /// For example the Target Entity of the Hunt state can be found in targets[EStateHuntTargetIx]
   struct CompStatesTargets
   {
-    CompStatesTargets() : targets(EStateTargetMax, -1) {}
+    CompStatesTargets() { std::fill_n(targets, EStateTargetMax, -1); }
 
-    TStateTargets targets;
+    int32_t targets[EStateTargetMax];
   };
 
-  typedef std::vector<float> TStateTimeInts;
-
   enum StatesTimeIntervalIndex
   {
     EStateDeadTimeIntIx = 0,
@@ -202,11 +232,23 @@ namespace shooter {
   /// For example the Time Interval of the Hunt state can be found in timeInts[EStateHuntTimeIntIx]
   struct CompStatesTimeIntervals
   {
-    CompStatesTimeIntervals() : timeInts(EStateTimeIntMax, 0.f) {}
+    CompStatesTimeIntervals() { std::fill_n(timeInts, EStateTimeIntMax, 0.f); }
 
-    TStateTimeInts timeInts;
+    float timeInts[EStateTimeIntMax];
   };
 
+  static_assert(std::is_trivially_copyable<CompRenderable>::value, "CompRenderable must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompAnimation>::value, "CompAnimation must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompTransform>::value, "CompTransform must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompMovable>::value, "CompMovable must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompNavMeshPos>::value, "CompNavMeshPos must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompState>::value, "CompState must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompStatesTargets>::value, "CompStatesTargets must be copyable with memcpy");
+  static_assert(std::is_trivially_copyable<CompStatesTimeIntervals>::value, "CompStatesTimeIntervals must be copyable with memcpy");
+
+  /// SysStatesTimeInts processes the time intervals of all entities as one contiguous float array
+  static_assert(sizeof(CompStatesTimeIntervals) == EStateTimeIntMax * sizeof(float), "CompStatesTimeIntervals must not be padded");
+
   /// Component containing data necessary for rendering a bullet.
   struct CompBullet
   {
@@ -258,6 +300,20 @@ namespace shooter {
     float health; ///< Health in percentage [0.f, 100.f]
   };
 
+  /// Component containing the state of an entity's random number generator (PCG32, see http://www.pcg-random.org).
+  /// Each entity draws from its own stream, so Systems updating entities in parallel 
+  /// don't share any state and give the same results whatever the number of threads.
+  struct CompRandom
+  {
+    CompRandom() 
+      : state(0x853c49e6748fea9bULL)
+      , inc(0xda3e39cb94b95bdbULL) 
+    {}
+
+    uint64_t state; ///< Current state of the generator
+    uint64_t inc; ///< Stream selector (always odd)
+  };
+
   /// Component containing the score of an entity.
   struct CompScore
   {
@@ -17,6 +17,8 @@
 #pragma warning(disable : 4503)
 #endif
 
+#include <cstdint>
+
 #include <glm/vec3.hpp>
 
 namespace shooter
@@ -48,6 +50,13 @@ namespace shooter
 
   const float cMaxWalkingSpeed = 3.5f;
 
+  /// Number of entities updated by one job (see JobSystem::GetStats() when tuning)
+  const uint32_t cEvadeJobGrain = 4;
+  const uint32_t cAnimationJobGrain = 2;
+
+  /// Number of frames written by the profiler trace dump (F4)
+  const uint32_t cProfilerTraceFrames = 120;
+
   const glm::vec3 cWorldUp(0.f, 1.f, 0.f);
   const glm::vec3 cGravity(0.f, -10.f, 0.f);
   const glm::vec3 cJumpVel(0.f, 4.2f, 3.f);
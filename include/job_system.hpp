@@ -0,0 +1,163 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace shooter {
+
+  /// Job function, called for the [begin, end) range of the job
+  typedef void(*JobFunc)(const void* data, uint32_t begin, uint32_t end);
+
+  /// Job statistics of one thread, used to tune the jobs grain size
+  struct JobStats
+  {
+    JobStats() : nrJobs(0), nrStolen(0), queueWaitNs(0), jobNs(0) {}
+
+    uint64_t nrJobs; ///< Number of jobs executed
+    uint64_t nrStolen; ///< Number of jobs stolen from other threads
+    uint64_t queueWaitNs; ///< Total time the jobs waited in the queues, from Push() until they started
+    uint64_t jobNs; ///< Total time spent running the jobs
+  };
+
+  /// Work stealing job system.
+  /// Each thread owns a lock free deque (Chase-Lev): the owner pushes and pops jobs at the bottom,
+  /// the other threads steal them from the top. Jobs don't allocate memory, they are taken from
+  /// a ring buffer owned by the pushing thread, and completion is tracked with atomic counters.
+  /// The thread that creates the JobSystem is thread 0 and runs jobs while it waits.
+  class JobSystem
+  {
+  public:
+
+    JobSystem(uint32_t nrWorkers); ///< Number of threads created, besides the calling thread
+    ~JobSystem();
+
+    /// Number of threads running jobs, including the thread that created the JobSystem
+    uint32_t GetNrThreads() const { return mNrThreads; }
+
+    /// Add a job to the current thread's queue and increment counter.
+    /// counter is decremented when the job finishes.
+    /// Called from a thread not belonging to the JobSystem, or when the pushing thread's ring buffer
+    /// has no free job (cMaxJobs jobs pushed and not started yet), the job runs immediately.
+    void Push(JobFunc func, const void* data, uint32_t begin, uint32_t end, std::atomic<uint32_t>& counter);
+
+    /// Run jobs until counter reaches 0
+    void Wait(const std::atomic<uint32_t>& counter);
+
+    /// Call func(i) for each i in [begin, end), in chunks of grain indices run in parallel.
+    /// Returns when all the chunks are finished.
+    template<typename TFunc>
+    void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, const TFunc& func)
+    {
+      std::atomic<uint32_t> counter(0);
+      grain = (grain > 0) ? grain : 1;
+
+      for (uint32_t chunkBegin = begin; chunkBegin < end; chunkBegin += grain)
+      {
+        uint32_t chunkEnd = (end - chunkBegin > grain) ? (chunkBegin + grain) : end;
+        Push(RunRange<TFunc>, &func, chunkBegin, chunkEnd, counter);
+      }
+
+      Wait(counter);
+    }
+
+    /// Job statistics for each thread (thread 0 is the thread that created the JobSystem)
+    std::vector<JobStats> GetStats() const;
+    void ResetStats();
+
+  private:
+
+    struct Job
+    {
+      Job() : inUse(false) {}
+
+      std::atomic<bool> inUse; ///< Set by Push(), cleared when the job starts running (its fields are copied)
+      JobFunc func;
+      const void* data;
+      uint32_t begin, end;
+      std::atomic<uint32_t>* counter;
+      int64_t pushTime; ///< Time of the Push() (in ns), for the queue wait statistics
+    };
+
+    /// Lock free work stealing deque (see "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al.)
+    class JobDeque
+    {
+    public:
+      JobDeque() : mTop(0), mBottom(0) {}
+
+      bool Push(Job* job); ///< Owner only, returns false if the deque is full
+      Job* Pop(); ///< Owner only
+      Job* Steal(); ///< Any thread
+
+    private:
+      static const int64_t cCapacity = 4096;
+
+      std::atomic<int64_t> mTop;
+      char mPad[64]; ///< Keep the thieves and the owner on different cache lines
+      std::atomic<int64_t> mBottom;
+      std::atomic<Job*> mJobs[cCapacity];
+    };
+
+    /// Data owned by each thread
+    struct Worker
+    {
+      Worker() : nrAllocatedJobs(0), nrJobs(0), nrStolen(0), queueWaitNs(0), jobNs(0) {}
+
+      static const uint32_t cMaxJobs = 4096; ///< Power of 2. A job is reused cMaxJobs pushes later, if it started running
+
+      JobDeque deque;
+      Job jobs[cMaxJobs];
+      uint32_t nrAllocatedJobs;
+
+      std::atomic<uint64_t> nrJobs;
+      std::atomic<uint64_t> nrStolen;
+      std::atomic<uint64_t> queueWaitNs;
+      std::atomic<uint64_t> jobNs;
+    };
+
+    template<typename TFunc>
+    static void RunRange(const void* data, uint32_t begin, uint32_t end)
+    {
+      const TFunc& func = *static_cast<const TFunc*>(data);
+      for (uint32_t i = begin; i < end; i++)
+      {
+        func(i);
+      }
+    }
+
+    void WorkerLoop(uint32_t workerIx);
+    Job* GetJob(uint32_t workerIx); ///< Pop a job from the worker's deque, or steal one from the other workers
+    void Execute(uint32_t workerIx, Job* job);
+    void WakeWorkers();
+
+    uint32_t mNrThreads;
+    std::unique_ptr<Worker[]> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    std::atomic<int32_t> mNrQueuedJobs; ///< Jobs pushed and not yet taken by a thread
+    std::atomic<uint32_t> mNrSleeping; ///< Workers waiting for jobs
+    std::atomic<bool> mStop;
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCond;
+  };
+
+}
+
+#endif // JOB_SYSTEM_HPP
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef LINE_OF_SIGHT_HPP
+#define LINE_OF_SIGHT_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include <DetourNavMesh.h> // for dtPolyRef
+
+namespace shooter
+{
+  class Q3Map;
+  class NavMesh;
+  class BinaryWriter;
+  class BinaryReader;
+  struct TraceData;
+
+  /// Line of sight queries between entities, used by the AI Systems instead of tracing the map directly.
+  /// A query is answered by the first of:
+  /// - the result cached for the same pair in the last cCacheTicks ticks, if neither entity moved more than cCacheMoveDist since;
+  /// - the map's Potentially Visible Set, when the clusters of the 2 eye positions can't see each other;
+  /// - a NavMesh raycast, when a straight walkable line joins the 2 entities;
+  /// - a sphere trace between the 2 eye positions, in packets (see Q3Map::TraceBatch()).
+  /// The cached results change the simulation, so they are part of the Scene state. The cache is a hash table of
+  /// cCachedPairsPerEntity pairs for each entity slot (at most cMaxCachedPairs), a new result replaces the one in its slot.
+  class LineOfSight
+  {
+  public:
+
+    /// Number of ticks a result is reused
+    static const uint32_t cCacheTicks = 6;
+
+    /// Size of the cache
+    static const uint32_t cCachedPairsPerEntity = 16;
+    static const uint32_t cMaxCachedPairs = 1 << 16;
+
+    /// Maximum distance moved by each entity of a pair before its cached result is recomputed
+    static const float cCacheMoveDist;
+
+    /// Height of the eye positions above the entities positions, and radius of the traced sphere
+    static const float cEyeHeight;
+    static const float cTraceRadius;
+
+    /// Line of sight query between the entities src and dst
+    struct Query
+    {
+      uint32_t src;
+      uint32_t dst;
+      glm::vec3 srcPos; ///< Entity position, on the floor
+      glm::vec3 dstPos;
+      dtPolyRef srcPoly; ///< NavMesh polygon of srcPos, 0 to skip the NavMesh test
+      dtPolyRef dstPoly;
+      bool visible; ///< [out] True if src sees dst
+    };
+
+    /// Cache for a Scene with capacity entity slots
+    explicit LineOfSight(uint32_t capacity);
+    ~LineOfSight();
+
+    /// Start a new simulation tick, expiring the old results
+    void BeginTick() { mTick++; }
+
+    /// Answer the queries. Not thread safe, it updates the cache.
+    void Run(Query* queries, uint32_t nrQueries, const Q3Map& map, const NavMesh& navMesh);
+
+    /// Forget all the cached results of an entity (when its slot is reused)
+    void Clear(uint32_t entity);
+
+    /// Write the cached results which can still be reused (see Scene::SaveState())
+    void SaveState(BinaryWriter& writer) const;
+    bool LoadState(BinaryReader& reader);
+
+  private:
+
+    /// Cached result of a pair of entities
+    struct CachedPair
+    {
+      uint32_t src;
+      uint32_t dst;
+      glm::vec3 srcPos;
+      glm::vec3 dstPos;
+      uint32_t tick; ///< Tick of the query, 0 if empty
+      uint32_t visible;
+    };
+
+    /// Cluster of an entity's eye position. The cluster only depends on the position, so it's not part of the Scene state.
+    struct CachedCluster
+    {
+      CachedCluster() : pos(0.f), cluster(-1), valid(false) {}
+
+      glm::vec3 pos;
+      int32_t cluster;
+      bool valid;
+    };
+
+    /// Slot of the pair (src, dst) in mPairs
+    size_t FindSlot(uint32_t src, uint32_t dst) const;
+
+    /// True if the pair holds a result which can still be reused
+    bool IsLive(const CachedPair& pair) const;
+
+    int32_t FindCluster(uint32_t entity, const glm::vec3& eyePos, const Q3Map& map);
+
+    void Store(const Query& query);
+
+    uint32_t mCapacity;
+    uint32_t mTick;
+    std::vector<CachedPair> mPairs; ///< Hash table of the results, its size is a power of 2
+    std::vector<uint32_t> mClearTicks; ///< Tick of the last Clear() of each entity, its older results are ignored
+    std::vector<CachedCluster> mClusters; ///< One for each entity
+
+    // Reused by Run(), to not allocate them on every query
+    std::vector<TraceData> mTraces;
+    std::vector<uint32_t> mTracedQueries;
+  };
+}
+
+#endif // LINE_OF_SIGHT_HPP
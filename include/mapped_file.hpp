@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace shooter {
+
+  /// Read only memory mapping of a whole file.
+  /// The pages are read from the disk (or the OS file cache) when they are first accessed.
+  class MappedFile
+  {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    /// Map the file, unmapping the previous one. Returns false if the file can't be opened or is empty.
+    bool Open(const std::string& filePath);
+    void Close();
+
+    bool IsOpen() const { return mData != nullptr; }
+    const uint8_t* GetData() const { return mData; }
+    size_t GetSize() const { return mSize; }
+
+  private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const uint8_t* mData;
+    size_t mSize;
+#ifdef _WIN32
+    void* mFileHandle; ///< File HANDLE
+    void* mMappingHandle; ///< File mapping HANDLE
+#endif
+  };
+
+  /// Write size bytes to filePath through a temporary file renamed at the end, 
+  /// so an interrupted write doesn't leave a partial file behind. The temporary file name is unique
+  /// to the process and the call, so concurrent writers of the same file don't mix their data.
+  bool WriteFileAtomically(const std::string& filePath, const void* data, size_t size);
+
+}
+
+#endif // MAPPED_FILE_HPP
@@ -13,11 +13,12 @@
 #ifndef MATH_UTILS_HPP
 #define MATH_UTILS_HPP
 
-#include <stdlib.h>
+#include <cstdint>
 
 #include <glm/glm.hpp>
 
 #include "constants.hpp"
+#include "components.hpp"
 
 namespace shooter {
 
@@ -59,16 +60,57 @@ namespace shooter {
     return (len < FLT_EPSILON ? v0 : v / len);
   }
 
+  /// Return an uniformly distributed 32 bit random number (PCG32 XSH RR)
+  inline uint32_t RandNext(CompRandom& rnd)
+  {
+    uint64_t oldState = rnd.state;
+    rnd.state = oldState * 6364136223846793005ULL + rnd.inc;
+    uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+    uint32_t rot = (uint32_t)(oldState >> 59u);
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+  }
+
+  /// Seed a random number generator. 
+  /// Generators seeded with the same seed but different streams produce independent sequences.
+  inline void RandSeed(CompRandom& rnd, uint64_t seed, uint64_t stream)
+  {
+    rnd.state = 0U;
+    rnd.inc = (stream << 1u) | 1u;
+    RandNext(rnd);
+    rnd.state += seed;
+    RandNext(rnd);
+  }
+
   /// Return a random number between min and max
-  inline float RandRange(float min, float max)
+  inline float RandRange(CompRandom& rnd, float min, float max)
   {
-    return min + rand() / (float)RAND_MAX * (max - min);
+    // use the upper 24 bits, which fit exactly in the float mantissa
+    return min + (RandNext(rnd) >> 8) * (1.f / 16777216.f) * (max - min);
   }
 
   /// Return + or - 1 randomly
-  inline float RandSgn()
+  inline float RandSgn(CompRandom& rnd)
   {
-    return ((rand() & 1) << 1) - 1.f;
+    return ((RandNext(rnd) >> 31) << 1) - 1.f;
+  }
+
+  /// Return a random index in the [0, count) interval
+  inline uint32_t RandIndex(CompRandom& rnd, uint32_t count)
+  {
+    return (uint32_t)(((uint64_t)RandNext(rnd) * count) >> 32);
+  }
+
+  const uint64_t cHashSeed = 14695981039346656037ULL;
+
+  /// FNV-1a hash of size bytes, continuing from hash
+  inline uint64_t Hash(const void* data, size_t size, uint64_t hash = cHashSeed)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+      hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
   }
 }
 #endif // MATH_UTILS_HPP
\ No newline at end of file
@@ -13,6 +13,8 @@
 #ifndef NAV_MESH_HPP
 #define NAV_MESH_HPP
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include <DetourNavMesh.h> // for dtPolyRef
@@ -61,6 +63,8 @@ namespace shooter
     /// creates OffMesh links for all positions where the agent can Jump Down
     /// and calculates the node intersections positions (where the agent can be revived).
     /// Most parameters are recast & detour specific config variables in world units (see rcConfig). 
+    /// With a cache file, the NavMesh is loaded from it instead, if it was built from the same geometry and parameters,
+    /// otherwise the NavMesh is built and the cache file (re)written.
     NavMesh(
       float agentHeight,
       float agentRadius,
@@ -85,7 +89,8 @@ namespace shooter
       float initialJumpForwardSpeed, ///< Initial jump down forward speed
       float initialJumpUpSpeed, ///< Initial jump down upward speed
       float idealJumpPointsDist, ///< Ideal distance between jump down points on a NavMesh edge
-      float maxIntersectionPosHeight); ///< Maximum height of the intersection positions
+      float maxIntersectionPosHeight, ///< Maximum height of the intersection positions
+      const std::string& cacheFilePath = std::string()); ///< NavMesh cache file (see WriteCache()), not used if empty
     
     /// Destructor
     ~NavMesh();
@@ -94,6 +99,10 @@ namespace shooter
     const dtNavMeshQuery* GetNavMeshQuery() const { return m_navQuery; }
     const dtQueryFilter* GetQueryFilter() const { return m_filter; }
     const std::vector<float>& GetIntersectionPositions() const { return m_IntersectionPositions; }
+    /// Time spent building the NavMesh, or loading it from the cache file, in milliseconds
+    float GetBuildTimeMs() const { return m_totalBuildTimeMs; }
+    /// Build time saved by loading the NavMesh from the cache file, in milliseconds (0 if it was built)
+    float GetSavedBuildTimeMs() const { return m_savedBuildTimeMs; }
 
     /// Debug Rendering function. 
     /// Render the NavMesh, OffMesh connections and the intersection positions. 
@@ -123,6 +132,14 @@ namespace shooter
       bool& outEndOfPath ///< true if outSteerPos is within minTargetDist from endPathPos
     ) const;
 
+    /// Check if a straight line on the NavMesh joins 2 positions, without hitting a wall or leaving the walkable polygons
+    bool IsWalkableLine(
+      dtPolyRef startPoly, ///< Polygon containing startPos
+      const float* startPos, ///< Line's start position
+      dtPolyRef endPoly, ///< Polygon containing endPos, the line must end on it
+      const float* endPos ///< Line's end position
+    ) const;
+
     /// Return the floor information for a world position.
     bool GetFloorInfo(
       const float* pos, ///< Position in world coordinates
@@ -185,6 +202,24 @@ namespace shooter
     void CalcIntersectionPositions(
       float maxIntersectionPosHeight);
 
+    /// Create the query and the query filter of m_navMesh
+    bool InitQuery();
+
+    /// Load the Detour tile data, the OffMesh connections, the intersection positions and
+    /// the compact heightfield (used by GetFloorInfo()) written by WriteCache().
+    /// Fails if the file is missing, invalid, of another version or built for another key.
+    bool ReadCache(
+      const std::string& filePath,
+      uint64_t key, ///< Hash of the geometry and the build parameters
+      float& outBuildTimeMs); ///< Build time of the cached NavMesh
+
+    /// Write the NavMesh cache file
+    void WriteCache(
+      const std::string& filePath,
+      uint64_t key, ///< Hash of the geometry and the build parameters
+      float buildTimeMs,
+      const std::vector<unsigned char>& navData) const; ///< Detour tile data, as created by dtCreateNavMeshData()
+
     unsigned char* m_triareas;
     rcHeightfield* m_hf;
     rcCompactHeightfield* m_chf;
@@ -211,6 +246,7 @@ namespace shooter
 
     bool m_keepInterResults;
     float m_totalBuildTimeMs;
+    float m_savedBuildTimeMs;
   };
 
 }
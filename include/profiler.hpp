@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace shooter {
+
+  /// Time spent in one zone during a frame
+  struct ProfilerZoneStats
+  {
+    ProfilerZoneStats() : name(nullptr), count(0), totalNs(0) {}
+
+    const char* name; ///< Zone name
+    uint32_t count; ///< Number of times the zone was entered
+    int64_t totalNs; ///< Total time spent in the zone, summed over all threads
+  };
+
+  /// Frame profiler.
+  /// Zones (see ProfilerZone) record their begin and end time into a ring buffer owned by the
+  /// recording thread, so recording doesn't lock or allocate. When capturing is off, a zone
+  /// costs one relaxed atomic load.
+  /// The buffers are read by GetFrameStats() and WriteChromeTrace(). They can be called while
+  /// other threads record, each buffer is read up to its last complete event, as long as
+  /// no thread records a full buffer (cMaxEventsPerThread events) during the call.
+  class Profiler
+  {
+  public:
+
+    /// Number of events kept for each thread
+    static const uint32_t cMaxEventsPerThread = 1 << 16;
+
+    static void SetCapturing(bool capturing) { sCapturing.store(capturing, std::memory_order_relaxed); }
+    static bool IsCapturing() { return sCapturing.load(std::memory_order_relaxed); }
+
+    /// Start a new frame. Events are tagged with the current frame index.
+    static void BeginFrame() { sFrame.fetch_add(1, std::memory_order_relaxed); }
+    static uint32_t GetFrame() { return sFrame.load(std::memory_order_relaxed); }
+
+    /// Current time, in nanoseconds
+    static int64_t Now()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// Add an event to the calling thread's buffer
+    static void Record(const char* name, int64_t beginNs, int64_t endNs);
+
+    /// Time spent in each zone during frame, sorted by decreasing time
+    static std::vector<ProfilerZoneStats> GetFrameStats(uint32_t frame);
+
+    /// Write the events of the last nrFrames frames (the current one included)
+    /// as Chrome trace JSON (open it in chrome://tracing)
+    static bool WriteChromeTrace(const std::string& filePath, uint32_t nrFrames);
+
+  private:
+
+    static std::atomic<bool> sCapturing;
+    static std::atomic<uint32_t> sFrame;
+  };
+
+  /// Scoped zone. name must be a string literal (or outlive the profiler).
+  class ProfilerZone
+  {
+  public:
+    explicit ProfilerZone(const char* name)
+      : mName(name)
+      , mBeginNs(Profiler::IsCapturing() ? Profiler::Now() : 0)
+    {}
+
+    ~ProfilerZone()
+    {
+      if (mBeginNs != 0)
+      {
+        Profiler::Record(mName, mBeginNs, Profiler::Now());
+      }
+    }
+
+  private:
+    ProfilerZone(const ProfilerZone&);
+    ProfilerZone& operator=(const ProfilerZone&);
+
+    const char* mName;
+    int64_t mBeginNs; ///< 0 if capturing was off when the zone started
+  };
+
+}
+
+#define PROFILER_ZONE_CONCAT2(a, b) a##b
+#define PROFILER_ZONE_CONCAT(a, b) PROFILER_ZONE_CONCAT2(a, b)
+
+/// Profile the enclosing scope
+#define PROFILER_ZONE(name) shooter::ProfilerZone PROFILER_ZONE_CONCAT(profilerZone, __LINE__)(name)
+
+#endif // PROFILER_HPP
@@ -0,0 +1,169 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "components.hpp"
+
+union SDL_Event;
+
+namespace shooter {
+
+  struct Scene;
+
+  /// Input event handled by the PlayerController, in a compact form
+  struct InputEvent
+  {
+    enum Type : uint8_t
+    {
+      EKeyDown = 0,
+      EKeyUp,
+      EMouseMotion,
+      EMouseButtonDown,
+      EMouseButtonUp,
+    };
+
+    uint8_t type; ///< Type
+    uint8_t repeat; ///< Key repeat
+    uint8_t button; ///< Mouse button
+    uint8_t pressed; ///< Mouse button state
+    int32_t key; ///< Key symbol
+    int32_t xrel; ///< Mouse motion
+    int32_t yrel;
+
+    /// Convert an SDL event. Returns false for the events not changing the simulation 
+    /// (the window events, the debug keys, the camera only events).
+    static bool FromSdl(const SDL_Event& e, InputEvent& input);
+
+    /// Convert back to the SDL event handled by the PlayerController
+    SDL_Event ToSdl() const;
+  };
+
+  /// Replay file header
+  struct ReplayHeader
+  {
+    ReplayHeader() : seed(0), nrEntities(0), keyframeInterval(600) {}
+
+    uint64_t seed; ///< Seed passed to SeedSimulation()
+    uint32_t nrEntities; ///< Number of entities passed to InitEntities()
+    uint32_t keyframeInterval; ///< Number of ticks between the keyframes
+    std::string mapPath;
+    std::string modelName;
+  };
+
+  /// Inputs of one simulation tick, and the Scene checksum after it
+  struct ReplayTick
+  {
+    enum Flags : uint8_t
+    {
+      EFlagDoubleBuffering = 1 << 0, ///< Scene::doubleBuffering
+      EFlagCamera = 1 << 1, ///< The camera changed before the tick
+    };
+
+    ReplayTick() : tick(0), flags(0), checksum(0) {}
+
+    /// Apply the inputs to scene, before running the tick
+    void Apply(Scene& scene) const;
+
+    uint32_t tick; ///< Tick index
+    uint8_t flags; ///< Flags
+    std::vector<InputEvent> events; ///< Events handled before the tick
+    CompCamera camera; ///< Camera used by the tick, valid if EFlagCamera is set
+    uint64_t checksum; ///< Scene::Checksum() after the tick
+  };
+
+  /// Records the inputs of each simulation tick into a file.
+  ///
+  /// File format (host byte order): the header, followed by records starting with a type byte.
+  /// - Tick record: the ReplayTick of each tick, in order.
+  /// - Keyframe record: the tick index and the Scene state before that tick and its events (Scene::SaveState()),
+  ///   written every keyframeInterval ticks, so a replay can start from any keyframe.
+  /// - Index record: the tick and file offset of all the keyframes, written by Close(). 
+  ///   The file ends with the offset of the index, so it can be found without reading the records.
+  class ReplayRecorder
+  {
+  public:
+    ReplayRecorder() : mFileSize(0), mTick(0) {}
+    ~ReplayRecorder() { Close(); }
+
+    /// Create the file, write the header and the first keyframe
+    bool Open(const std::string& filePath, const ReplayHeader& header, const Scene& scene);
+
+    bool IsOpen() const { return mFile.is_open(); }
+
+    /// Record an event handled before the next tick
+    void AddEvent(const SDL_Event& e);
+
+    /// Called before each tick, records the camera
+    void BeginTick(const Scene& scene);
+
+    /// Called after each tick, writes the tick record and the keyframes
+    void EndTick(const Scene& scene);
+
+    /// Write the keyframes index and close the file
+    void Close();
+
+  private:
+    /// Write the buffered records to the file
+    void Flush();
+
+    /// Write the Scene state before the tick mTick
+    void WriteKeyframe(const Scene& scene);
+
+    std::ofstream mFile;
+    uint64_t mFileSize; ///< Bytes written to the file
+    std::vector<uint8_t> mBuffer; ///< Records not written yet
+    ReplayHeader mHeader;
+    ReplayTick mCurrent; ///< Inputs of the next tick
+    CompCamera mLastCamera; ///< Last camera recorded
+    uint32_t mTick; ///< Index of the next tick
+    std::vector<std::pair<uint32_t, uint64_t> > mKeyframes; ///< Tick and file offset of each keyframe
+  };
+
+  /// Reads a file written by ReplayRecorder. The whole file is loaded in memory.
+  class ReplayReader
+  {
+  public:
+    ReplayReader() : mPos(0), mRecordsEnd(0), mTick(0) {}
+
+    /// Load the file and find the keyframes
+    bool Open(const std::string& filePath);
+
+    const ReplayHeader& GetHeader() const { return mHeader; }
+
+    /// Load the Scene state from the last keyframe before or at tick and move to it
+    /// @return the tick of the keyframe, or -1 if there are no keyframes before tick
+    int64_t Seek(uint32_t tick, Scene& scene);
+
+    /// Read the next tick record, skipping the keyframes
+    /// @return false at the end of the file
+    bool ReadTick(ReplayTick& tick);
+
+  private:
+    std::vector<uint8_t> mData;
+    size_t mPos; ///< Read position
+    size_t mRecordsEnd; ///< End of the records (start of the index)
+    uint32_t mTick; ///< Index of the next tick record
+    ReplayHeader mHeader;
+    std::vector<std::pair<uint32_t, uint64_t> > mKeyframes; ///< Tick and file offset of each keyframe
+  };
+
+}
+
+#endif // REPLAY_HPP
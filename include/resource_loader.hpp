@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef RESOURCE_LOADER_HPP
+#define RESOURCE_LOADER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace shooter {
+
+  class JobSystem;
+  class Resources;
+
+  /// Loads the startup resources in parallel.
+  /// The CPU side of each resource (shader sources reads, image decoding, Assimp import, BSP parsing, 
+  /// NavMesh build) runs as a job, and its OpenGL objects are created on the thread calling Run(), 
+  /// as soon as the resource is loaded. The OpenGL steps run in the order the resources were added, 
+  /// so add the programs first (the map needs their ids).
+  class ResourceLoader
+  {
+  public:
+
+    /// Called on the thread calling Run() after each step, with the fraction of the steps done and the resource name
+    typedef std::function<void(float progress, const std::string& name)> ProgressFunc;
+
+    explicit ResourceLoader(Resources& resources) : mResources(resources) {}
+
+    /// Resources to load (see Resources). All paths are relative to the resource folder.
+    void AddPrograms(const std::string& folderPath);
+    void AddSkyBox(const std::string& prefix);
+    void AddModel(const std::string& filePath);
+    void AddMap(const std::string& zipFilePath); ///< Loads the map and then its NavMesh
+
+    /// Load all the added resources. The calling thread must own the OpenGL context and the JobSystem.
+    /// It only runs the OpenGL steps, unless the JobSystem has no workers.
+    /// @return false if any resource failed to load
+    bool Run(JobSystem& jobs, const ProgressFunc& progress);
+
+  private:
+
+    enum ELoadState
+    {
+      ELoadPending,
+      ELoadDone,
+      ELoadFailed,
+    };
+
+    struct Step
+    {
+      std::string name; ///< Resource name, passed to the ProgressFunc
+      std::function<bool(JobSystem&)> load; ///< CPU side, runs on a job and can push more jobs
+      std::function<void()> initGL; ///< OpenGL side (empty if none), runs on the thread calling Run()
+      uint32_t after; ///< Step that must be loaded before this one (cInvalidId if none)
+    };
+
+    /// Data shared by the jobs of one Run()
+    struct RunData
+    {
+      ResourceLoader* loader;
+      JobSystem* jobs;
+      std::atomic<uint32_t>* counter; ///< Number of unfinished jobs
+    };
+
+    /// Job loading the step stepIx, and pushing the steps waiting for it
+    static void LoadStep(const void* data, uint32_t stepIx, uint32_t);
+
+    /// @return the step index
+    uint32_t AddStep(const std::string& name, const std::function<bool(JobSystem&)>& load, const std::function<void()>& initGL, uint32_t after);
+
+    Resources& mResources;
+    std::vector<Step> mSteps;
+    std::vector<std::string> mArchives; ///< Mounted before the jobs start
+
+    std::mutex mMutex; ///< Guards the load states
+    std::condition_variable mLoadedCond; ///< Signaled when a step is loaded
+    std::vector<ELoadState> mLoadStates; ///< Load state of each step
+    std::vector<uint32_t> mLoadedSteps; ///< Loaded (or failed) steps, in the order they finished
+  };
+
+}
+
+#endif // RESOURCE_LOADER_HPP
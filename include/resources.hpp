@@ -13,10 +13,12 @@
 #ifndef RESOURCES_HPP
 #define RESOURCES_HPP
 
+#include <mutex>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
@@ -28,12 +30,14 @@
 
 #include "Q3Map.hpp"
 #include "nav_mesh.hpp"
+#include "virtual_file_system.hpp"
 
 struct aiScene;
 struct aiNode;
 struct aiAnimation;
 struct aiVertexWeight;
 struct aiMesh;
+struct SDL_Surface;
 
 namespace shooter {
 
@@ -144,8 +148,48 @@ namespace shooter {
     glm::vec4 specular;
   };
 
+  /// CPU side copy of a mesh, kept until it's uploaded to the GPU
+  struct MeshData
+  {
+    uint32_t materialIndex; ///< Index of the material used for this mesh
+    uint32_t numFaces; ///< Number of triangles this mesh contains
+    std::vector<uint32_t> indices; ///< Triangles indices
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<VertexBoneData> bonesData;
+  };
+
+  /// CPU side description of a material, kept until it's uploaded to the GPU
+  struct MaterialData
+  {
+    std::vector<std::pair<TextureType, std::string> > textures; ///< Texture type and path ("*Index" for embedded textures)
+    std::vector<SDL_Surface*> surfaces; ///< Decoded textures (nullptr for embedded textures, or if not found)
+    MaterialColors colors;
+  };
+
   typedef std::unordered_map<std::string, uint32_t> NamesAndIdsMap;
 
+  typedef uint32_t ModelId; ///< Index of a Model in Resources
+  typedef uint32_t AnimationId; ///< Index of an animation name, shared by all the Models
+  typedef uint32_t ProgramId; ///< Index of an OpenGL program in Resources
+  const uint32_t cInvalidId = 0xFFFFFFFF;
+
+  /// Interns names as dense ids (0, 1, 2, ...), in the order they are registered.
+  /// Names are resolved once at load time, so the hot paths only index arrays.
+  class NamesRegistry
+  {
+  public:
+    uint32_t Register(const std::string& name); ///< Returns the id of name, adding it if not found
+    uint32_t Find(const std::string& name) const; ///< Returns the id of name, or cInvalidId if not found
+    const std::string& GetName(uint32_t id) const { return mNames[id]; }
+    uint32_t Size() const { return mNames.size(); }
+
+  private:
+    NamesAndIdsMap mIds; ///< Map of names and ids
+    std::vector<std::string> mNames; ///< Names, indexed by id
+  };
+
   /// Describes a 3D model. Contains all the data needed to render and animate it.
   /// Data is stored as Structure of Arrays.
   struct Model 
@@ -170,7 +214,7 @@ namespace shooter {
     std::vector<glm::mat4> bonesOffsets; ///< Transforms from the Mesh Local Space, into the Bone Space (assimp_mesh::mBones[i]::mOffsetMatrix)
     std::vector<glm::mat4> invBonesOffsets; ///< Precalculated inverse matrices for bonesOffsets
 
-    std::unordered_map<std::string, Animation> animationsMap; ///< Map with all the animations available for this model
+    std::vector<Animation> animations; ///< Animations indexed by AnimationId (empty if the model doesn't have it)
 
     /// Rendering data 
     NamesAndIdsMap textureMap; ///< Map of Texture names and indices
@@ -182,10 +226,14 @@ namespace shooter {
 
     glm::vec3 minBound, maxBound; ///< Minimum and maximum bound of the model
     float normScale; ///< Normalized scale (multiplied by this, the scale of the model becomes 1.0f)
+
+    /// CPU side rendering data, released after it's uploaded to the GPU by Resources::InitGL()
+    std::string texturesAltPath; ///< Alternative folder where to look for the materials textures
+    std::vector<SDL_Surface*> embeddedTextures; ///< Decoded embedded textures (nullptr if not compressed)
+    std::vector<MaterialData> materialsData; ///< Materials, indexed by Material Index
+    std::vector<MeshData> meshesData; ///< Meshes vertices and indices
   };
 
-  typedef std::unordered_map<std::string, Model> ModelsMap;
-  typedef std::unordered_map<std::string, GLuint> ProgramsMap;
   typedef std::unordered_map<std::string, GLuint> TextureMap;
 
   /// Manages all resources used by other Systems (Map, Models, shaders, etc.)
@@ -193,55 +241,116 @@ namespace shooter {
   {
   public:
 
+    /// All the resources are read through the file system, with resourcePath mounted at its root
     Resources(const std::string& resourcePath)
       : mResourceFolder(resourcePath)
+      , mSkyBoxFaces()
       , mSkyBoxTexture(0)
-    {}
+      , mEmptyModel()
+    {
+      mFileSystem.Mount(resourcePath);
+    }
 
     ~Resources();
 
     /// All folders are relative to resourcePath
-    bool LoadPrograms(const std::string& folderPath); /// Load all shaders from folderPath
-    bool LoadSkyBox(const std::string& folderPath); /// Load the skybox texture from folderPath
-    bool LoadMap(const std::string& zipFilePath); /// Load the Q3Map from zipFilePath
-    bool LoadModel(const std::string& filePath); /// Load the Player/NPC 3D model from filePath
+    /// The Load functions read and decode the resources on the CPU side only, InitGL() creates their OpenGL objects.
+    /// Use ResourceLoader to load them in parallel.
+    bool LoadPrograms(const std::string& folderPath); /// Read the sources of all shaders from folderPath
+    bool LoadSkyBox(const std::string& folderPath); /// Decode the skybox faces from folderPath
+    bool LoadMap(const std::string& zipFilePath, bool decodeTextures = true, JobSystem* jobs = nullptr); /// Mount the map archive zipFilePath and load the Q3Map (on jobs if not nullptr) and the NavMesh from it
+    bool LoadModel(const std::string& filePath, bool decodeTextures = true); /// Load the Player/NPC 3D model from filePath, or from its cooked file
+
+    /// Compile the programs and upload the loaded skybox, map and models to the GPU. Needs a valid OpenGL context.
+    /// Not called when running headless.
+    void InitGL();
     
+    /// Ids of the loaded resources (cInvalidId if not found). 
+    /// Resolve them once, at initialization, and use the id accessors in the Systems.
+    ProgramId GetProgramId(const std::string& programName) const { return mProgramsNames.Find(programName); }
+    ModelId GetModelId(const std::string& modelName) const { return mModelsNames.Find(modelName); }
+    AnimationId GetAnimationId(const std::string& animationName) const { return mAnimationsNames.Find(animationName); }
+
     /// Accessors
-    GLuint GetProgram(const std::string& programName) const;
+    GLuint GetProgram(ProgramId programId) const;
+    const std::string& GetResourceFolder() const { return mResourceFolder; }
+    const VirtualFileSystem& GetFileSystem() const { return mFileSystem; }
     GLuint GetSkyBoxTexture() const { return mSkyBoxTexture; }
     const Q3Map& GetMap() const { return *mMap; }
+    Q3Map& GetMap() { return *mMap; }
     const NavMesh& GetNavMesh() const { return *mNavMesh; }
-    const ModelsMap& GetModels() const { return mModels; }
-    const Model& GetModel(const std::string& modelName) const;
-    const Animation& GetAnimation(const Model& model, const std::string& animationName) const;
+    const std::vector<Model>& GetModels() const { return mModels; }
+    const Model& GetModel(ModelId modelId) const;
+    const Animation& GetAnimation(const Model& model, AnimationId animationId) const;
+
+    /// Accessors by name, for tools and debugging (not for the per frame code)
+    GLuint GetProgram(const std::string& programName) const { return GetProgram(GetProgramId(programName)); }
+    const Model& GetModel(const std::string& modelName) const { return GetModel(GetModelId(modelName)); }
     const Animation& GetAnimation(const std::string& modelName, const std::string& animationName) const;
 
     /// Get the global transformation matrices for the current animation
     void GetSkeletonTransforms(
       const Model& model,
-      const std::string& animationName,
+      AnimationId animationId,
       float animationTimeInSeconds, /// Current animation time
       float& inoutLastAnimationTimeInSeconds, /// [in] Previous animation time, [out] Current animation time
-      std::vector<AnimationFrame>& inoutLastAnimationFrames, /// [in] Previous animation frames, [out] Current animation frames)
-      std::vector<glm::mat4>& outGlobalTransforms /// [out] global transformation matrices for all the nodes
+      AnimationFrame* inoutLastAnimationFrames, /// [in] Previous animation frames, [out] Current animation frames (one for each node)
+      glm::mat4* outGlobalTransforms /// [out] global transformation matrices for all the nodes
     ) const;
 
   private:
+    friend class ResourceLoader;
+
+    /// Loading steps of LoadMap(), the map archive must be mounted first
+    bool LoadMountedMap(const std::string& zipFilePath, bool decodeTextures, JobSystem* jobs);
+    void LoadNavMesh(const std::string& zipFilePath);
+
+    /// Loading steps of InitGL(), on the OpenGL context thread
+    void InitProgramsGL();
+    void InitSkyBoxGL();
+    void InitModelGL(ModelId modelId);
+
+    /// Free the decoded textures and the OpenGL objects
+    void ReleaseGL();
+
+    /// Model as read from the model file. Its animations are in the file order, 
+    /// until they are indexed by AnimationId when the Model is added to mModels.
+    struct ImportedModel
+    {
+      Model model;
+      std::vector<std::string> animationsNames; ///< Animation names, in the file order
+      std::vector<std::vector<uint8_t> > embeddedTexturesData; ///< Compressed embedded textures (empty if not compressed)
+    };
+
+    /// Read the Model from filePath with Assimp
+    static bool ImportModel(const VirtualFileSystem& fileSystem, const std::string& filePath, ImportedModel& outModel);
+
+    /// Cooked model file, the ImportedModel arrays written as they are, so the model loads without Assimp
+    static bool ReadCookedModel(const std::string& filePath, uint64_t key, ImportedModel& outModel);
+    static void WriteCookedModel(const std::string& filePath, uint64_t key, const ImportedModel& model);
+
     /// Functions needed to read a Model from aiScene
 
     static const aiNodeAnim* FindNodeAnim(const aiAnimation* pAnimation, const std::string& NodeName);
 
     static void ProcessNodeAnim(const std::string& nodeName, const aiAnimation* anim, Animation& animation);
 
-    static void ProcessNode(const aiScene* scene, const aiNode* pNode, Model& model, int32_t parentNodeIndex, int32_t nodeIndex);
-
-    static void ProcessNodeHierarchy(const aiScene* scene, const aiNode* pNode, Model& model, int32_t parentNodeIndex);
+    static void ProcessNode(
+      const aiScene* scene, 
+      const aiNode* pNode, 
+      Model& model, 
+      int32_t parentNodeIndex, 
+      int32_t nodeIndex);
 
-    static GLuint LoadTexture(std::string name, TextureMap& textureMap);
+    static void ProcessNodeHierarchy(
+      const aiScene* scene, 
+      const aiNode* pNode, 
+      Model& model, 
+      int32_t parentNodeIndex);
 
-    static void LoadEmbeddedTextures(const aiScene* scene, Model& model);
+    static void LoadEmbeddedTextures(const aiScene* scene, std::vector<std::vector<uint8_t> >& outTexturesData);
 
-    static void LoadMaterials(const aiScene* scene, const std::string& altPath, Model& model);
+    static void LoadMaterials(const aiScene* scene, Model& model);
 
     static std::vector<VertexBoneData> LoadBones(
       const aiMesh* pMesh, 
@@ -249,19 +358,36 @@ namespace shooter {
       std::vector<glm::mat4>& bonesOffset, 
       std::vector<glm::mat4>& invBonesOffset);
 
-    static void LoadMeshes(
-      const aiScene* scene, 
-      const std::string& modelPath, 
-      Model& model, 
-      std::vector<GLuint>& inoutBufferObjs);
+    static void LoadMeshes(const aiScene* scene, Model& model);
+
+    void DecodeTextures(const std::vector<std::vector<uint8_t> >& embeddedTexturesData, Model& model) const;
+
+    /// Functions needed to upload a Model to the GPU
+
+    static void UploadTextures(Model& model);
+
+    static void UploadMaterials(Model& model);
+
+    static void UploadMeshes(Model& model, std::vector<GLuint>& inoutBufferObjs);
 
     std::string mResourceFolder; ///< Path to the resource folder
+    VirtualFileSystem mFileSystem; ///< Resource folder and map archives
 
     std::unique_ptr<Q3Map> mMap; ///< Q3 Map
     std::unique_ptr<NavMesh> mNavMesh; ///< Navigation Mesh
 
-    ProgramsMap mPrograms; ///< Map of Program names and OpenGL objs
-    ModelsMap mModels; ///< Map of Model names and objs
+    NamesRegistry mProgramsNames; ///< Program names and ids
+    NamesRegistry mModelsNames; ///< Model names (file paths) and ids
+    NamesRegistry mAnimationsNames; ///< Animation names and ids, of all the Models
+
+    std::vector<GLuint> mPrograms; ///< OpenGL program objs, indexed by ProgramId
+    std::vector<Model> mModels; ///< Models, indexed by ModelId
+    std::mutex mModelsMutex; ///< Guards mModels and the Models names registries, when the Models load in parallel
+
+    /// CPU side data, released after it's uploaded to the GPU by InitGL()
+    std::unordered_map<std::string, std::vector<std::pair<std::string, std::string> > > mProgramsSources; ///< Shaders (path, source) of each program
+    std::string mShaderDefines; ///< Inserted in all the shaders
+    SDL_Surface* mSkyBoxFaces[6]; ///< Decoded skybox faces
 
     GLuint mSkyBoxTexture; ///< Skybox OpenGL texture obj 
     std::vector<uint32_t> mBufferObjects; ///< OpenGL buffer objs refferences by the Meshes vertex array objs
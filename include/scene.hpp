@@ -13,55 +13,171 @@
 #ifndef SCENE_HPP
 #define SCENE_HPP
 
+#include <deque>
 #include <string>
+#include <vector>
 
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 
 #include "components.hpp"
 #include "controllers.hpp"
+#include "line_of_sight.hpp"
 
 namespace shooter {
 
+  class BinaryWriter;
+  class BinaryReader;
+
   /// Entities (see https://en.wikipedia.org/wiki/Entity_component_system). 
+  /// An entity is an index in the Scene's component arrays.
   enum Entities
   {
     EnPlayer = 0,
     EnNpcMin = 1,
-    EnNpcMax = 8,
+  };
+
+  /// Default number of entity slots (Player + NPCs)
+  const uint32_t cDefaultEntitiesCapacity = 8;
+
+  /// Pool of NavMesh paths. A CompNavMeshPath is over 1KB, so paths are allocated only for 
+  /// the entities following one, and the memory grows with the number of active paths, not with the Scene capacity.
+  class NavMeshPathPool
+  {
+  public:
+    /// Allocate an empty path
+    /// @return index of the path
+    uint32_t Alloc();
+
+    /// Return a path to the pool
+    void Free(uint32_t pathIx);
+
+    CompNavMeshPath& operator[](uint32_t pathIx) { return mPaths[pathIx]; }
+    const CompNavMeshPath& operator[](uint32_t pathIx) const { return mPaths[pathIx]; }
+
+    /// Number of allocated paths
+    uint32_t Size() const { return mPaths.size() - mFreePaths.size(); }
+
+    /// Write all the paths and the free list
+    void SaveState(BinaryWriter& writer) const;
+    bool LoadState(BinaryReader& reader);
+
+  private:
+    std::deque<CompNavMeshPath> mPaths; ///< std::deque never moves the elements when growing
+    std::vector<uint32_t> mFreePaths; ///< Indices of the free paths
+  };
+
+  /// Copy of the Scene columns read across Systems, taken at the start of a tick (see Scene::doubleBuffering)
+  struct SceneFrame
+  {
+    std::vector<CompAnimation> animations;
+    std::vector<glm::mat4> animationsGlobalTrans;
+    std::vector<CompTransform> transforms;
+    std::vector<CompMovable> movables;
+    std::vector<CompNavMeshPos> navMeshPos;
+    std::vector<CompState> states;
+    std::vector<CompStatesTargets> statesTargets;
+  };
+
+  /// Copy of the Scene data read by the renderer, published by the simulation thread (see SimulationThread)
+  struct RenderFrame
+  {
+    RenderFrame() : nrAnimationNodes(0), nrValidBullets(0), debugging(false), multithreading(false), doubleBuffering(false) {}
+
+    std::vector<uint32_t> entities;
+    std::vector<CompRenderable> renderables;
+    std::vector<CompTransform> transforms;
+    std::vector<CompState> states;
+    std::vector<CompDamagebleSkeleton> damagebles; ///< Only copied when debugging
+
+    uint32_t nrAnimationNodes;
+    std::vector<glm::mat4> animationsGlobalTrans;
+
+    std::vector<CompBullet> bullets;
+    unsigned nrValidBullets;
+
+    CompCamera camera;
+
+    bool debugging;
+    bool multithreading;
+    bool doubleBuffering;
   };
 
   /// Structure containing the current game state
   struct Scene
   {
-    Scene() 
-      : renderables(EnNpcMax)
-      , animations(EnNpcMax)
-      , transforms(EnNpcMax)
-      , bounds(EnNpcMax)
-      , movables(EnNpcMax)
-      , navMeshPath(EnNpcMax)
-      , navMeshPos(EnNpcMax)
-      , states(EnNpcMax)
-      , statesTargets(EnNpcMax)
-      , statesTimeInts(EnNpcMax)
-      , damagebles(EnNpcMax)
-      , health(EnNpcMax, CompHealth(100.f))
-      , scores(EnNpcMax)
-      , bullets(100)
-      , nrValidBullets(0u)
-      , cameraController(0.1f, 1.f)
-      , debugging(false)
-      , multithreading(true)
-    {}
-
-    /// Preallocated arrays containing components, one for each entity. 
+    Scene(uint32_t capacity = cDefaultEntitiesCapacity);
+
+    /// Number of entity slots
+    uint32_t Capacity() const { return states.size(); }
+
+    /// Spawn a new entity in a free slot, with all its components reset.
+    /// The entity starts as dead, so SysRevive will place it on the map.
+    /// @return the new entity or -1 if there are no free slots
+    int32_t Spawn();
+
+    /// Despawn an entity, returning its slot and its NavMesh path to the free lists.
+    /// The Systems stop iterating it, and the slot keeps its components until it's spawned again.
+    void Despawn(uint32_t entity);
+
+    /// Spawn a despawned entity again in its own slot, keeping its components.
+    /// @return false if Spawn() has reused the slot
+    bool Respawn(uint32_t entity);
+
+    /// Resize the animation nodes columns to fit models with up to nrNodes animation nodes
+    void SetNrAnimationNodes(uint32_t nrNodes);
+
+    /// Animation nodes data of an entity (nrAnimationNodes elements)
+    glm::mat4* GetGlobalTrans(uint32_t entity) { return animationsGlobalTrans.data() + entity * nrAnimationNodes; }
+    const glm::mat4* GetGlobalTrans(uint32_t entity) const { return animationsGlobalTrans.data() + entity * nrAnimationNodes; }
+    AnimationFrame* GetLastAnimationFrames(uint32_t entity) { return animationsLastFrames.data() + entity * nrAnimationNodes; }
+
+    /// Copy the double buffered columns into the previous frame. 
+    /// Called at the start of each tick when doubleBuffering is on.
+    void SwapFrames();
+
+    /// Write the state modified by the simulation (see ReplayRecorder keyframes).
+    /// The components set only by InitEntities() (renderables, bounds, damagebles) are not written.
+    void SaveState(BinaryWriter& writer) const;
+
+    /// Read a state written by SaveState() into a Scene with the same capacity, initialized by InitEntities()
+    bool LoadState(BinaryReader& reader);
+
+    /// Hash of the state modified by the simulation, used to find where two runs diverge
+    uint64_t Checksum() const;
+
+    /// Copy the data needed for rendering into frame. The vectors keep their capacity, so it doesn't allocate after the first copies.
+    void CopyRenderFrame(RenderFrame& frame) const;
+
+    /// Read accessors of the double buffered columns. 
+    /// Systems use them for the columns they don't write, and to read the other entities.
+    /// With doubleBuffering on, they return the state at the start of the tick, which is not modified
+    /// during the tick, otherwise the current state.
+    const std::vector<CompAnimation>& ReadAnimations() const { return doubleBuffering ? mPrevFrame.animations : animations; }
+    const glm::mat4* ReadGlobalTrans(uint32_t entity) const 
+    { 
+      return (doubleBuffering ? mPrevFrame.animationsGlobalTrans : animationsGlobalTrans).data() + entity * nrAnimationNodes; 
+    }
+    const std::vector<CompTransform>& ReadTransforms() const { return doubleBuffering ? mPrevFrame.transforms : transforms; }
+    const std::vector<CompMovable>& ReadMovables() const { return doubleBuffering ? mPrevFrame.movables : movables; }
+    const std::vector<CompNavMeshPos>& ReadNavMeshPos() const { return doubleBuffering ? mPrevFrame.navMeshPos : navMeshPos; }
+    const std::vector<CompState>& ReadStates() const { return doubleBuffering ? mPrevFrame.states : states; }
+    const std::vector<CompStatesTargets>& ReadStatesTargets() const { return doubleBuffering ? mPrevFrame.statesTargets : statesTargets; }
+
+    /// Spawned entities. Systems iterate only these.
+    std::vector<uint32_t> entities;
+
+    /// Entities despawned when they died, waiting for SysRevive to respawn them
+    std::vector<uint32_t> deadEntities;
+
+    /// Preallocated arrays containing components, one for each entity slot. 
     
     std::vector<CompRenderable> renderables;
     std::vector<CompAnimation> animations;
     std::vector<CompTransform> transforms;
     std::vector<CompBounds> bounds;
     std::vector<CompMovable> movables;
-    std::vector<CompNavMeshPath> navMeshPath;
+    std::vector<CompNavMeshPathRef> navMeshPathRefs;
     std::vector<CompNavMeshPos> navMeshPos;
     std::vector<CompState> states;
     std::vector<CompStatesTargets> statesTargets;
@@ -69,6 +185,16 @@ namespace shooter {
     std::vector<CompDamagebleSkeleton> damagebles;
     std::vector<CompHealth> health;
     std::vector<CompScore> scores;
+    std::vector<CompRandom> randoms;
+
+    /// Animation nodes columns, nrAnimationNodes consecutive elements for each entity slot
+    uint32_t nrAnimationNodes;
+    std::vector<glm::mat4> animationsGlobalTrans; ///< Global transformation matrices of all the animation nodes
+    std::vector<AnimationFrame> animationsLastFrames; ///< Previous animation frames, needed when transitioning between 2 animations
+
+    NavMeshPathPool navMeshPaths; ///< Paths referenced by navMeshPathRefs
+
+    LineOfSight lineOfSight; ///< Line of sight queries between the entities, with their cached results
 
     std::vector<CompBullet> bullets; ///< Preallocated bullets
     unsigned nrValidBullets; ///< Number of valid bullets
@@ -79,11 +205,22 @@ namespace shooter {
     CameraController cameraController; ///< Controls the camera movement
 
     uint32_t weaponBoneIx; ///< Bone index of the model's weapon
+    AnimationId animationIds[EAnimTypeMax]; ///< Id of each AnimationType, resolved from the animation names by InitEntities()
 
     std::string mapPath; ///< Path to the map zip file
 
     bool debugging; ///< Toggle debugging information
     bool multithreading; ///< Toggle multithreading
+
+    /// Toggle double buffering. When on, the Systems read the state of the previous tick (the Read* accessors) 
+    /// and write the next one, so they see a consistent world and fewer Systems depend on each other.
+    bool doubleBuffering; 
+
+  private:
+    std::vector<int32_t> mEntitiesIx; ///< Position of each entity slot in entities, or -1 if the slot is free
+    std::vector<uint32_t> mFreeEntities; ///< Free entity slots, used as a stack
+
+    SceneFrame mPrevFrame; ///< State at the start of the tick (see doubleBuffering)
   };
 
 }
@@ -0,0 +1,125 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <atomic>
+
+namespace shooter {
+
+  class JobSystem;
+  class Resources;
+  struct Scene;
+
+  /// Scene data accessed by the Systems, used to declare the inputs and outputs of each System
+  enum SceneAccessBitMask
+  {
+    EAccessEntities = 1 << 0, ///< Scene::entities and Scene::deadEntities
+    EAccessRenderables = 1 << 1,
+    EAccessAnimations = 1 << 2, ///< Scene::animations and the animation nodes columns
+    EAccessTransforms = 1 << 3,
+    EAccessBounds = 1 << 4,
+    EAccessMovables = 1 << 5,
+    EAccessNavMeshPaths = 1 << 6, ///< Scene::navMeshPathRefs and Scene::navMeshPaths
+    EAccessNavMeshPos = 1 << 7,
+    EAccessStates = 1 << 8,
+    EAccessStatesTargets = 1 << 9,
+    EAccessStatesTimeInts = 1 << 10,
+    EAccessDamagebles = 1 << 11,
+    EAccessHealth = 1 << 12,
+    EAccessScores = 1 << 13,
+    EAccessRandoms = 1 << 14,
+    EAccessBullets = 1 << 15, ///< Scene::bullets and Scene::nrValidBullets
+    EAccessCamera = 1 << 16,
+    EAccessNavMeshQuery = 1 << 17, ///< Detour's dtNavMeshQuery is not thread safe, so it's treated as written data
+    EAccessLineOfSight = 1 << 18, ///< Scene::lineOfSight, its queries update the cached results
+  };
+
+  /// Data copied in the Scene's previous frame (see Scene::doubleBuffering). 
+  /// With double buffering on, reading it doesn't depend on the Systems writing it.
+  const uint32_t cDoubleBufferedAccess = EAccessAnimations | EAccessTransforms | EAccessMovables 
+    | EAccessNavMeshPos | EAccessStates | EAccessStatesTargets;
+
+  /// Runs the Systems of one simulation step as a task graph.
+  /// Each System declares the Scene data it reads and writes. A System depends on all the Systems
+  /// added before it that write the data it reads or writes, or read the data it writes,
+  /// so independent Systems run at the same time while the results stay identical to the sequential order.
+  /// Each System is a job, and a System finishing pushes the jobs of the Systems waiting only for it.
+  /// With Scene::doubleBuffering on, the reads of cDoubleBufferedAccess data don't add dependencies,
+  /// so a second graph is built for this mode.
+  class SystemScheduler
+  {
+  public:
+
+    /// System update function
+    typedef void(*SystemFunc)(float dt, const Resources& resources, Scene& scene, JobSystem& jobs);
+
+    /// Add a System. Systems must be added in their sequential order.
+    void Add(
+      const std::string& name, ///< System name (for debugging)
+      uint32_t reads, ///< SceneAccessBitMask of the data read
+      uint32_t writes, ///< SceneAccessBitMask of the data written
+      SystemFunc func);
+
+    /// Run all Systems. With multithreading off, the Systems run sequentially on the calling thread.
+    /// With double buffering on, the Scene's previous frame is updated first.
+    void Run(float dt, const Resources& resources, Scene& scene, JobSystem& jobs) const;
+
+  private:
+
+    struct System
+    {
+      std::string name;
+      uint32_t reads;
+      uint32_t writes;
+      SystemFunc func;
+    };
+
+    /// Dependencies between the Systems
+    struct Graph
+    {
+      std::vector<std::vector<uint32_t> > dependents; ///< Systems waiting for each System to finish
+      std::vector<uint32_t> nrDeps; ///< Number of Systems each System waits for
+    };
+
+    /// Data shared by the jobs of one Run()
+    struct RunData
+    {
+      const SystemScheduler* scheduler;
+      const Graph* graph;
+      float dt;
+      const Resources* resources;
+      Scene* scene;
+      JobSystem* jobs;
+      std::atomic<uint32_t>* nrDeps; ///< Number of unfinished Systems each System waits for
+      std::atomic<uint32_t>* counter; ///< Number of unfinished System jobs
+    };
+
+    /// Job running the System sysIx
+    static void RunSystem(const void* data, uint32_t sysIx, uint32_t);
+
+    /// Add the dependencies of the System sysIx to graph. Only the reads in readsMask are hazards.
+    static void AddDependencies(const std::vector<System>& systems, uint32_t sysIx, uint32_t readsMask, Graph& graph);
+
+    std::vector<System> mSystems;
+    Graph mGraph; ///< Dependencies when the Systems update the Scene in place
+    Graph mDoubleBufferedGraph; ///< Dependencies with Scene::doubleBuffering on
+  };
+
+}
+
+#endif // SCHEDULER_HPP
@@ -15,6 +15,7 @@
 
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 struct aiTexture;
@@ -22,17 +23,14 @@ struct SDL_Surface;
 
 namespace ShaderUtils {
 
-  /// Load a shader from a file
+  /// Load a shader from its source. The shader type is given by the shaderPath extension.
+  /// The shaderDefines are inserted after the #version line.
   /// @return OpenGL shader object or 0 if error 
-  uint32_t LoadShader(const std::string& shaderPath, const std::string& definesPath);
+  uint32_t LoadShader(const std::string& shaderPath, const std::string& source, const std::string& shaderDefines);
   
-  /// Load a Program containing vertex, fragment, geometry, etc. shaders as files
+  /// Load a Program containing vertex, fragment, geometry, etc. shaders, as (path, source) pairs
   /// @return OpenGL program object or 0 if error 
-  uint32_t LoadProgram(const std::vector<std::string>& shaderPaths, const std::string& definesPath);
-
-  /// Load Texture from a file
-  /// @return OpenGL texture object or 0 if error 
-  uint32_t LoadTexture(const std::string& filePath, uint32_t& outBpp);
+  uint32_t LoadProgram(const std::vector<std::pair<std::string, std::string> >& shaders, const std::string& shaderDefines);
   
   /// Load embeded texture
   /// @return OpenGL texture object or 0 if error 
@@ -46,15 +44,9 @@ namespace ShaderUtils {
   /// @return OpenGL texture object or 0 if error 
   uint32_t LoadTexture(SDL_Surface* surface);
   
-  /// Load cube map texture
+  /// Load cube map texture from its right, left, up, down, back and front faces (frees the surfaces)
   /// @return OpenGL texture object or 0 if error 
-  uint32_t LoadCubeMapTexture(
-    const std::string& cubeMapRight,
-    const std::string& cubeMapLeft,
-    const std::string& cubeMapUp,
-    const std::string& cubeMapDown,
-    const std::string& cubeMapBack,
-    const std::string& cubeMapFront);
+  uint32_t LoadCubeMapTexture(SDL_Surface* const faces[6]);
 }
 
 #endif //SHADERS_UTILS_HPP
\ No newline at end of file
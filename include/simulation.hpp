@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace shooter {
+
+  class JobSystem;
+  class Resources;
+  struct Scene;
+
+  /// Spawn nrEntities entities (the Player and NPCs) and init their components. 
+  /// The model must be already loaded in resources.
+  bool InitEntities(const Resources& resources, const std::string& modelName, uint32_t nrEntities, Scene& scene);
+
+  /// Seed the random number generators of all entities, each entity using its own stream.
+  void SeedSimulation(uint64_t seed, Scene& scene);
+
+  /// Advance the simulation by one step, running the Systems as a task graph (see SystemScheduler).
+  /// Independent Systems run at the same time when scene.multithreading is on.
+  /// Called from the game loop at cFixedTimeStep time intervals. Makes no OpenGL calls.
+  void UpdateSimulation(float dt, const Resources& resources, Scene& scene, JobSystem& jobs);
+
+}
+
+#endif // SIMULATION_HPP
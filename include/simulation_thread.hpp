@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef SIMULATION_THREAD_HPP
+#define SIMULATION_THREAD_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <SDL_events.h>
+
+#include "scene.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+
+namespace shooter {
+
+  class Resources;
+  class ReplayRecorder;
+
+  /// Runs the fixed step simulation on its own thread, so the simulation of the next frame overlaps with the rendering of the current one.
+  /// The render thread forwards the SDL events through a lock free queue, and takes the latest completed frame
+  /// from a lock free triple buffer. The Scene belongs to the simulation thread while it runs.
+  class SimulationThread
+  {
+  public:
+
+    /// Publish the first frame and start the thread. 
+    /// The thread creates a JobSystem with nrWorkers workers, so it runs jobs too.
+    /// When recorder is not null, the inputs of each tick are recorded (it's used by the simulation thread until Stop()).
+    SimulationThread(const Resources& resources, Scene& scene, uint32_t nrWorkers, ReplayRecorder* recorder = nullptr);
+
+    /// Stop the thread
+    ~SimulationThread();
+
+    /// Render thread only. Forward an input event to the simulation. Waits if the queue is full.
+    void PushEvent(const SDL_Event& e);
+
+    /// Render thread only. Latest frame published by the simulation.
+    const RenderFrame& AcquireFrame();
+
+    /// Stop the thread and wait for it. The Scene can be accessed again afterwards.
+    void Stop();
+
+  private:
+    SimulationThread(const SimulationThread&);
+    SimulationThread& operator=(const SimulationThread&);
+
+    /// Simulation thread main loop
+    void Run();
+
+    /// Number of events the render thread can push before the simulation handles them
+    static const uint32_t cEventQueueCapacity = 256;
+
+    const Resources& mResources;
+    Scene& mScene;
+    uint32_t mNrWorkers;
+    ReplayRecorder* mRecorder;
+
+    SpscQueue<SDL_Event, cEventQueueCapacity> mEvents; ///< Render thread -> simulation thread
+    TripleBuffer<RenderFrame> mFrames; ///< Simulation thread -> render thread
+
+    std::atomic<bool> mStop;
+    std::thread mThread;
+  };
+
+}
+
+#endif // SIMULATION_THREAD_HPP
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace shooter {
+
+  /// Lock free bounded queue with a single producer thread and a single consumer thread.
+  /// TCapacity must be a power of 2.
+  template<typename T, uint32_t TCapacity>
+  class SpscQueue
+  {
+    static_assert((TCapacity & (TCapacity - 1)) == 0, "TCapacity must be a power of 2");
+
+  public:
+    SpscQueue() : mHead(0), mTail(0) {}
+
+    /// Producer only. Returns false if the queue is full.
+    bool TryPush(const T& value)
+    {
+      const uint32_t tail = mTail.load(std::memory_order_relaxed);
+      if (tail - mHead.load(std::memory_order_acquire) == TCapacity)
+      {
+        return false;
+      }
+
+      mItems[tail & (TCapacity - 1)] = value;
+      mTail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// Consumer only. Returns false if the queue is empty.
+    bool TryPop(T& value)
+    {
+      const uint32_t head = mHead.load(std::memory_order_relaxed);
+      if (head == mTail.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+
+      value = mItems[head & (TCapacity - 1)];
+      mHead.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+    T mItems[TCapacity];
+    std::atomic<uint32_t> mHead; ///< Next item to pop, written by the consumer
+    char mPad[64]; ///< Keep the producer and the consumer on different cache lines
+    std::atomic<uint32_t> mTail; ///< Next item to push, written by the producer
+  };
+
+}
+
+#endif // SPSC_QUEUE_HPP
@@ -13,14 +13,14 @@
 #ifndef ANIMATION_HPP
 #define ANIMATION_HPP
 
-#include <string>
-
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 
-#include <ctpl/ctpl_stl.h>
+#include "components.hpp" // AnimationType, AnimationId
 
 namespace shooter {
 
+  class JobSystem;
   class Resources;
   struct CompCamera;
   struct Model;
@@ -29,6 +29,7 @@ namespace shooter {
   struct CompRenderable;
   struct CompMovable;
   struct CompAnimation;
+  struct AnimationFrame;
 
   /// Animation System (see https://en.wikipedia.org/wiki/Entity_component_system). 
   /// Animates the 3D models, interpolating smoothly when changing between different animations. 
@@ -37,16 +38,18 @@ namespace shooter {
   public:
     
     /// Update function. Called from the game loop at cFixedTimeStep time intervals.
-    static void Update(float timeInSeconds, const Resources& resources, Scene& scene, ctpl::thread_pool& tp);
+    static void Update(float timeInSeconds, const Resources& resources, Scene& scene, JobSystem& jobs);
 
     /// Determine the type of the animation based on different parameters.
-    static std::string GetAnimation(const glm::vec3& vel, uint32_t state, float absCamPitch, bool isNPC);
+    static AnimationType GetAnimation(const glm::vec3& vel, uint32_t state, float absCamPitch, bool isNPC);
+
+    /// Name of the model animation played for each AnimationType (a string literal).
+    static const char* GetAnimationName(AnimationType type);
 
   private:
 
     /// Thread safe update function.
     static void UpdateEntity(
-      int /*ThreadId*/,
       float timeInSeconds,
       uint32_t entity,
       const Resources& resources,
@@ -54,7 +57,10 @@ namespace shooter {
       const CompRenderable& renderable,
       const CompMovable& movable,
       const CompCamera& camera,
-      CompAnimation& anim);
+      const AnimationId* animationIds, ///< Scene::animationIds
+      CompAnimation& anim,
+      AnimationFrame* lastAnimationFrames,
+      glm::mat4* globalTrans);
   };
 
 }
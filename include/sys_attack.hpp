@@ -14,11 +14,14 @@
 #define SYS_ATTACK_HPP
 
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 
 namespace shooter
 {
   class Resources;
   class Q3Map;
+  class NavMesh;
+  class LineOfSight;
   struct Scene;
   struct Model;
   struct CompState;
@@ -26,11 +29,12 @@ namespace shooter
   struct CompStatesTimeIntervals;
   struct CompRenderable;
   struct CompTransform;
+  struct CompNavMeshPos;
   struct CompBounds;
-  struct CompAnimation;
   struct CompDamagebleSkeleton;
   struct CompHealth;
   struct CompScore;
+  struct CompRandom;
 
   /// Attack System (see https://en.wikipedia.org/wiki/Entity_component_system).
   /// Contains the logic of how NPCs are attacking other NPCs
@@ -60,7 +64,7 @@ namespace shooter
       uint32_t weaponBoneIx,
       const Model& model,
       const CompTransform& trans,
-      const CompAnimation& anim);
+      const glm::mat4* globalTrans); ///< Animation nodes global transformations of the entity
 
     /// Intersect Ray with the map and all the Entities
     static void IntersectRayEntities(
@@ -71,9 +75,11 @@ namespace shooter
       const CompRenderable* renderables,
       const CompTransform* transforms,
       const CompBounds* bounds,
-      const CompAnimation* anim,
+      const glm::mat4* animGlobalTrans, ///< Animation nodes global transformations, nrAnimNodes for each entity
+      uint32_t nrAnimNodes,
       const CompDamagebleSkeleton* damSkeleton,
-      uint32_t nrEntities,
+      const uint32_t* entities, ///< Entities to check
+      uint32_t nrEntities, ///< Number of entities to check
       int32_t& outIntersectEntity, ///< [out] Intersected entity
       float& outIntersectDistance, ///< [out] Distance to the intersected entity
       float& outDamageMultiplier ///< [out] Damage multiplyier (based on the bodypart hit by the ray)
@@ -89,7 +95,16 @@ namespace shooter
     );
     
     /// Return the visible target entity with the highest priority or -1 if none was found.
-    static int32_t FindTarget(int32_t srcEntity, const Q3Map& map, const CompTransform* transforms, const CompState* states, uint32_t nrEntities);
+    static int32_t FindTarget(
+      int32_t srcEntity, 
+      const Q3Map& map, 
+      const NavMesh& navMesh, 
+      LineOfSight& lineOfSight, 
+      const CompTransform* transforms, 
+      const CompState* states, 
+      const CompNavMeshPos* navMeshPos, 
+      const uint32_t* entities, 
+      uint32_t nrEntities);
     
     /// Starts hunting or attacking if we have a new target.
     static void CheckTarget(int32_t enNewTarget, CompState& states, CompStatesTargets& statesTargets, CompStatesTimeIntervals& statesTimeInts);
@@ -101,7 +116,7 @@ namespace shooter
     static bool TryShootingAtTarget(uint32_t& state, float& shootTimeInt, bool lookingAtTarget);
     
     /// Calculate the bullet's direction based on different parameters.
-    static glm::vec3 BulletDirection(glm::vec3 bulletOrigin, const CompTransform& attackerTrans, const CompTransform& targetTrans);
+    static glm::vec3 BulletDirection(glm::vec3 bulletOrigin, const CompTransform& attackerTrans, const CompTransform& targetTrans, CompRandom& attackerRnd);
   };
 }
 
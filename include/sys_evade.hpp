@@ -15,10 +15,9 @@
 
 #include <glm/vec3.hpp>
 
-#include <ctpl/ctpl_stl.h>
-
 namespace shooter
 {
+  class JobSystem;
   class NavMesh;
   struct CompTransform;
   struct CompMovable;
@@ -28,6 +27,7 @@ namespace shooter
   struct CompStatesTimeIntervals;
   struct CompHealth;
   struct CompScore;
+  struct CompRandom;
 
   /// Evade System (see https://en.wikipedia.org/wiki/Entity_component_system).
   /// Contains the logic related to evasion when a NPC attacks another NPC or the Player
@@ -36,13 +36,12 @@ namespace shooter
   public:
 
     /// Update function. Called from the game loop at cFixedTimeStep time intervals.
-    static void Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp);
+    static void Update(float dt, const NavMesh& navMesh, Scene& scene, JobSystem& jobs);
 
   private:
 
     /// Thread safe update function.
     static void UpdateEntity(
-      int /*ThreadId*/,
       const NavMesh& navMesh,
       const glm::vec3& targetPos,
       const CompTransform& trans,
@@ -51,7 +50,8 @@ namespace shooter
       CompStatesTimeIntervals& stTimeInt,
       CompMovable& movable,
       CompHealth& health,
-      CompScore& score);
+      CompScore& score,
+      CompRandom& rnd);
 
     /// Return a valid direction an entity can move towards when it reached the NavMesh border
     static bool GetSidewaysWalkableDir(
@@ -63,7 +63,7 @@ namespace shooter
       glm::vec3 &outNormDir);
 
     /// Change Entity's velocity and timeInt to make it harder to shoot by an enemy Entity
-    static void Evade(float targetDist, float borderDist, glm::vec3& vel, float& timeInt);
+    static void Evade(float targetDist, float borderDist, CompRandom& rnd, glm::vec3& vel, float& timeInt);
   };
 
 }
@@ -15,10 +15,9 @@
 
 #include <glm/vec3.hpp>
 
-#include <ctpl/ctpl_stl.h>
-
 namespace shooter
 {
+  class JobSystem;
   class NavMesh;
   struct Scene;
   struct CompState;
@@ -29,6 +28,7 @@ namespace shooter
   struct CompNavMeshPos;
   struct CompMovable;
   struct CompAnimation;
+  struct CompRandom;
 
   /// Patrol System (see https://en.wikipedia.org/wiki/Entity_component_system).
   /// Contains the logic related to NPCs randomly patroling the map or hunting another NPC
@@ -37,13 +37,12 @@ namespace shooter
   public:
 
     /// Update function. Called from the game loop at cFixedTimeStep time intervals.
-    static void Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp);
+    static void Update(float dt, const NavMesh& navMesh, Scene& scene, JobSystem& jobs);
 
   private:
 
     /// Thread safe update function.
     static void UpdateEntity(
-      int /*ThreadId*/,
       const NavMesh& navMesh,
       glm::vec3 huntTargetPos,
       const CompState& st,
@@ -51,8 +50,9 @@ namespace shooter
       glm::vec3& transFront,
       CompStatesTargets& stTargets,
       CompNavMeshPath& patrol,
-      CompNavMeshPos& navMeshPos,
-      CompMovable& movable);
+      const CompNavMeshPos& navMeshPos,
+      CompMovable& movable,
+      CompRandom& rnd);
   };
 }
 
@@ -15,10 +15,9 @@
 
 #include <glm/vec3.hpp>
 
-#include <ctpl/ctpl_stl.h>
-
 namespace shooter
 {
+  class JobSystem;
   class Q3Map;
   class NavMesh;
   struct Scene;
@@ -36,13 +35,12 @@ namespace shooter
   public:
 
     /// Update function. Called from the game loop at cFixedTimeStep time intervals.
-    static void Update(float dt, const Q3Map& map, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp);
+    static void Update(float dt, const Q3Map& map, const NavMesh& navMesh, Scene& scene, JobSystem& jobs);
 
   private:
 
     /// Thread safe update function.
     static void UpdateEntity(
-      int /*ThreadId*/,
       float dt,
       const Q3Map& map,
       const NavMesh& navMesh,
@@ -92,7 +90,8 @@ namespace shooter
     static void FixEntityCollisions(
       const CompBounds* bounds,
       CompTransform* transforms,
-      uint32_t nrEntities);
+      const uint32_t* entities, ///< Entities to collide
+      uint32_t nrEntities); ///< Number of entities to collide
   };
 }
 #endif // SYS_PHYSICS_HPP
\ No newline at end of file
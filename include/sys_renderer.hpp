@@ -22,10 +22,9 @@ namespace shooter {
 
   class Resources;
   class NavMesh;
-  struct Scene;
+  struct RenderFrame;
   struct Model;
   struct CompTransform;
-  struct CompAnimation;
   struct CompRenderable;
   struct CompState;
   struct CompDamagebleSkeleton;
@@ -36,14 +35,15 @@ namespace shooter {
   {
   public:
 
-      /// Initialize different OpenGL buffers needed for rendering
-      SysRenderer();
+      /// Initialize different OpenGL buffers needed for rendering.
+      /// The programs must already be loaded in resources.
+      SysRenderer(const Resources& resources);
 
       /// Clean up
       ~SysRenderer();
 
-      /// Render the scene. Called from the game loop.
-      void Render(const Resources& resources, const Scene& scene) const;
+      /// Render a frame published by the simulation. Called from the game loop.
+      void Render(const Resources& resources, const RenderFrame& frame) const;
 
   private:
   
@@ -53,12 +53,15 @@ namespace shooter {
       const glm::mat4& projMat,
       uint32_t glMVPUniBuf, 
       uint32_t glBonesUniBuf,
+      uint32_t glProgram,
       const Resources& resources,
       const CompTransform* transforms,
       const CompRenderable* renderables,
-      const CompAnimation* animations,
+      const glm::mat4* animGlobalTrans, ///< Animation nodes global transformations, nrAnimNodes for each entity
+      uint32_t nrAnimNodes,
       const CompState* states,
-      uint32_t nrModels);
+      const uint32_t* entities, ///< Entities to render
+      uint32_t nrEntities); ///< Number of entities to render
 
     /// Render bullets
     static void RenderBullets(
@@ -84,9 +87,11 @@ namespace shooter {
       const Resources& resources,
       const CompTransform* transforms,
       const CompRenderable* renderables,
-      const CompAnimation* animations,
+      const glm::mat4* animGlobalTrans, ///< Animation nodes global transformations, nrAnimNodes for each entity
+      uint32_t nrAnimNodes,
       const CompDamagebleSkeleton* damagebles,
-      uint32_t nrModels);
+      const uint32_t* entities, ///< Entities to render
+      uint32_t nrEntities); ///< Number of entities to render
 
     /// Render NavMesh debug info
     static void DebugRenderNavMesh(
@@ -110,7 +115,7 @@ namespace shooter {
       const glm::mat4& proj, 
       const Model& model, 
       const CompTransform& trans, 
-      const CompAnimation& anim, 
+      const glm::mat4* globalTrans, 
       const CompDamagebleSkeleton& damSkeleton);
 
     uint32_t mMVPUniBuf; ///< Model-View-Projection matrices OpenGL uniform buffer
@@ -119,6 +124,10 @@ namespace shooter {
     uint32_t mBulletVao; ///< Bullet's OpenGL vertex array object
     uint32_t mSkyBoxVao; ///< Skybox's OpenGL vertex array object
 
+    uint32_t mSimpleProgram; ///< ProgramId used for the entities
+    uint32_t mFlameProgram; ///< ProgramId used for the bullets
+    uint32_t mSkyBoxProgram; ///< ProgramId used for the skybox
+
     std::vector<uint32_t> mUniBufs; ///< All the OpenGL uniform buffers (used for easy deallocation)
   };
 
@@ -19,7 +19,7 @@ namespace shooter
   struct Scene;
 
   /// Entity Revival System (see https://en.wikipedia.org/wiki/Entity_component_system).
-  /// Revives dead entities.
+  /// Despawns the dead entities, and revives them in their slots once their dead time interval ends.
   class SysRevive
   {
   public:
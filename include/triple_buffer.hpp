@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace shooter {
+
+  /// Lock free triple buffer, passing the latest value from one writer thread to one reader thread.
+  /// The writer fills the write buffer and publishes it, swapping it with the middle buffer.
+  /// The reader swaps the read buffer with the middle buffer when a new value was published.
+  /// Neither thread ever waits for the other, and the reader always sees the latest complete value.
+  template<typename T>
+  class TripleBuffer
+  {
+  public:
+    TripleBuffer() : mWriteIx(0), mMiddle(1), mReadIx(2) {}
+
+    /// Writer only. Buffer to fill before Publish(). It holds the value published 2 times ago, or older.
+    T& GetWriteBuffer() { return mBuffers[mWriteIx]; }
+
+    /// Writer only. Make the write buffer the latest value.
+    void Publish()
+    {
+      mWriteIx = mMiddle.exchange(mWriteIx | cNewBit, std::memory_order_acq_rel) & cIxMask;
+    }
+
+    /// Reader only. Take the latest published value, if there is a new one.
+    /// @return true if the read buffer changed
+    bool Acquire()
+    {
+      if ((mMiddle.load(std::memory_order_relaxed) & cNewBit) == 0)
+      {
+        return false;
+      }
+
+      mReadIx = mMiddle.exchange(mReadIx, std::memory_order_acq_rel) & cIxMask;
+      return true;
+    }
+
+    /// Reader only. Latest value taken by Acquire().
+    const T& GetReadBuffer() const { return mBuffers[mReadIx]; }
+
+  private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+
+    static const uint32_t cIxMask = 3;
+    static const uint32_t cNewBit = 4; ///< Set in mMiddle when the middle buffer wasn't read yet
+
+    T mBuffers[3];
+    uint32_t mWriteIx; ///< Owned by the writer
+    char mPad1[64]; ///< Keep the writer, the reader and the shared index on different cache lines
+    std::atomic<uint32_t> mMiddle; ///< Index of the middle buffer, and cNewBit
+    char mPad2[64];
+    uint32_t mReadIx; ///< Owned by the reader
+  };
+
+}
+
+#endif // TRIPLE_BUFFER_HPP
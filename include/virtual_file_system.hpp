@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#ifndef VIRTUAL_FILE_SYSTEM_HPP
+#define VIRTUAL_FILE_SYSTEM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace shooter {
+
+  /// Read only view of a file's bytes. 
+  /// It shares the ownership of the memory it points to (a mapped file or a pooled buffer), 
+  /// so it stays valid after the VirtualFileSystem is destroyed.
+  class FileView
+  {
+  public:
+    FileView() : mData(nullptr), mSize(0) {}
+
+    const uint8_t* GetData() const { return mData; }
+    size_t GetSize() const { return mSize; }
+
+  private:
+    friend class VirtualFileSystem;
+
+    const uint8_t* mData;
+    size_t mSize;
+    std::shared_ptr<const void> mOwner; ///< Keeps mData alive
+  };
+
+  /// Files of directories and zip/pk3 archives, mounted in priority order under a single hashed path index: 
+  /// a file of a later mount hides the file with the same path of an earlier mount.
+  /// Paths are relative to the mount root, separated by '/', and case sensitive. 
+  /// Opening a file doesn't copy it: files of directories and stored archive entries are memory mapped,
+  /// deflated archive entries are inflated into pooled buffers.
+  /// Open(), Exists() and List() are thread safe, the mounting isn't.
+  class VirtualFileSystem
+  {
+  public:
+    VirtualFileSystem();
+
+    /// Mount a directory, or a zip/pk3 archive, from the disk. 
+    /// The directory files are indexed when mounted, the files added later aren't seen.
+    /// @return false if diskPath isn't a directory or a valid archive
+    bool Mount(const std::string& diskPath);
+
+    /// Mount a zip/pk3 archive found in the already mounted files (e.g. a map archive in a mounted directory)
+    /// @return false if path isn't found or isn't a valid archive
+    bool MountArchive(const std::string& path);
+
+    bool Exists(const std::string& path) const;
+
+    /// Open a file. 
+    /// @return false if the file isn't found or can't be read
+    bool Open(const std::string& path, FileView& outView) const;
+
+    /// Sorted paths of the files in folder and its subfolders, ending with extension ("" for all the files). 
+    /// With mountPath set, only the files found in that mount (its Mount() or MountArchive() path) are listed, 
+    /// even if they're hidden by later mounts.
+    std::vector<std::string> List(
+      const std::string& folder, 
+      const std::string& extension = std::string(), 
+      const std::string& mountPath = std::string()) const;
+
+    /// Remove the "." and ".." parts, the duplicated and leading separators and replace '\' with '/'
+    static std::string NormalizePath(const std::string& path);
+
+  private:
+
+    enum EEntryType
+    {
+      EEntryFile, ///< File of a mounted directory
+      EEntryStored, ///< Uncompressed archive entry
+      EEntryDeflated, ///< Deflate compressed archive entry
+    };
+
+    struct Entry
+    {
+      uint32_t mountIx;
+      EEntryType type;
+      size_t offset; ///< Offset of the data in the archive
+      size_t compressedSize;
+      size_t size;
+    };
+
+    struct MountInfo
+    {
+      std::string path; ///< Mount() or MountArchive() path
+      FileView archive; ///< Archive data (empty for a directory)
+      std::vector<std::string> paths; ///< Paths of the mounted files (hidden ones included)
+    };
+
+    class BufferPool;
+
+    /// Index the entries of the archive, from its central directory
+    bool AddArchive(const std::string& path, const FileView& archive);
+
+    /// Add the entry to the mount at the back of mMounts, hiding the entry with the same path
+    void AddEntry(const std::string& path, const Entry& entry);
+
+    std::vector<MountInfo> mMounts;
+    std::unordered_map<std::string, Entry> mIndex; ///< Visible entry of each path
+    std::shared_ptr<BufferPool> mBufferPool; ///< Buffers of the inflated entries
+  };
+
+}
+
+#endif // VIRTUAL_FILE_SYSTEM_HPP
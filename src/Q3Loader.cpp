@@ -11,9 +11,11 @@
 */
 
 #include "Q3Loader.h"
+#include "job_system.hpp"
 
 #include <cstdio>
 #include <cstring>
+#include <functional>
 
 template <class taType>
 void swizzle3(taType* const t) {
@@ -165,111 +167,120 @@ bool isValid(const TMapQ3& pMap)
 /**
  * Read the header of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
+ * @param bspSize  The size of the Q3 file data.
  * @param pMap  The map structure to fill.
  */
-bool readHeader(std::istream& bspData, TMapQ3& pMap)
+bool readHeader(const char* bspData, size_t bspSize, TMapQ3& pMap)
 {
-  bspData.read((char*)&pMap.mHeader, sizeof(THeader));
+  if (bspSize < sizeof(THeader))
+  {
+    return false;
+  }
+
+  memcpy(&pMap.mHeader, bspData, sizeof(THeader));
 
   return isValid(pMap);
 }
 
 /**
- * Read the texture lump of the Q3 map.
+ * Check that all the lumps of the Q3 map are inside the file data.
  *
- * @param pFile  The stream on the Q3 file data.
- * @param pMap  The map structure to fill.
+ * @param pMap  The map, with its header read.
+ * @param bspSize  The size of the Q3 file data.
  */
-void readTexture(std::istream& bspData, TMapQ3& pMap)
+bool areLumpsValid(const TMapQ3& pMap, size_t bspSize)
 {
-  int  lNbTextures = pMap.mHeader.mLumpes[cTextureLump].mLength / sizeof(TTexture);
+  for (const TLump& lLump : pMap.mHeader.mLumpes)
+  {
+    if ((lLump.mOffset < 0) || (lLump.mLength < 0) || ((size_t)lLump.mOffset + (size_t)lLump.mLength > bspSize))
+    {
+      return false;
+    }
+  }
 
-  bspData.seekg(pMap.mHeader.mLumpes[cTextureLump].mOffset, std::ios_base::beg);
+  return true;
+}
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cTextureLump].mOffset);
+/**
+ * Copy all the elements of a lump with a single memcpy.
+ *
+ * @param bspData  The Q3 file data.
+ * @param pMap  The map, with its header read.
+ * @param pLumpIndex  The lump to copy.
+ * @param pElements  The array to fill.
+ */
+template <class taType>
+void readLump(const char* bspData, const TMapQ3& pMap, int pLumpIndex, std::vector<taType>& pElements)
+{
+  const TLump& lLump = pMap.mHeader.mLumpes[pLumpIndex];
 
-  for  (int lTextureCounter = 0; lTextureCounter < lNbTextures; ++lTextureCounter)
+  pElements.resize(lLump.mLength / sizeof(taType));
+  if (!pElements.empty())
   {
-    TTexture lTexture;
-    
-    bspData.read((char*)&lTexture, sizeof(TTexture));
-
-    pMap.mTextures.push_back(lTexture);
+    memcpy(&pElements[0], bspData + lLump.mOffset, pElements.size() * sizeof(taType));
   }
 }
 
+/**
+ * Read the texture lump of the Q3 map.
+ *
+ * @param bspData  The Q3 file data.
+ * @param pMap  The map structure to fill.
+ */
+void readTexture(const char* bspData, TMapQ3& pMap)
+{
+  readLump(bspData, pMap, cTextureLump, pMap.mTextures);
+}
+
 /**
  * Read the entity lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readEntity(std::istream& bspData, TMapQ3& pMap)
+void readEntity(const char* bspData, TMapQ3& pMap)
 {
   // Set the entity size.
   pMap.mEntity.mSize = pMap.mHeader.mLumpes[cEntityLump].mLength;
   
-  // Allocate the entity buffer.
-  pMap.mEntity.mBuffer.assign(pMap.mEntity.mSize, 0);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cEntityLump].mOffset, std::ios_base::beg);
-  
-  // Read the buffer.
-  bspData.read(&pMap.mEntity.mBuffer[0], pMap.mEntity.mSize);
+  // Copy the buffer.
+  pMap.mEntity.mBuffer.assign(bspData + pMap.mHeader.mLumpes[cEntityLump].mOffset, pMap.mEntity.mSize);
 };
 
 /**
  * Read the plane lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readPlane(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readPlane(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbPlanes = pMap.mHeader.mLumpes[cPlaneLump].mLength / sizeof(TPlane);
+  readLump(bspData, pMap, cPlaneLump, pMap.mPlanes);
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cPlaneLump].mOffset, std::ios_base::beg);
-
-  for  (int lPlaneCounter = 0; lPlaneCounter < lNbPlanes; ++lPlaneCounter)
+  for (TPlane& lPlane : pMap.mPlanes)
   {
-    TPlane lPlane;
-    
-    bspData.read((char*)&lPlane, sizeof(TPlane));
-
     lPlane.mDistance *= scale;
     
     if (coordSysOpenGL)
     {
       swizzle3(lPlane.mNormal);
     }
-    
-    pMap.mPlanes.push_back(lPlane);
   }
 }
 
 /**
  * Read the node lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readNode(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readNode(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbNodes = pMap.mHeader.mLumpes[cNodeLump].mLength / sizeof(TNode);
+  readLump(bspData, pMap, cNodeLump, pMap.mNodes);
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cNodeLump].mOffset, std::ios_base::beg);
-
-  for  (int lNodeCounter = 0; lNodeCounter < lNbNodes; ++lNodeCounter)
+  for (TNode& lNode : pMap.mNodes)
   {
-    TNode lNode;
-    
-    bspData.read((char*)&lNode, sizeof(TNode));
-
     fix_int_bound(lNode.mMaxs);
     fix_int_bound(lNode.mMins);
     scale3(lNode.mMaxs, scale);
@@ -281,30 +292,21 @@ void readNode(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coord
       swizzle3(lNode.mMins);
       swap(lNode.mMaxs[2], lNode.mMins[2]);
     }
-
-    pMap.mNodes.push_back(lNode);
   }  
 }
 
 /**
  * Read the leaf lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readLeaf(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readLeaf(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbLeaves = pMap.mHeader.mLumpes[cLeafLump].mLength / sizeof(TLeaf);
+  readLump(bspData, pMap, cLeafLump, pMap.mLeaves);
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cLeafLump].mOffset, std::ios_base::beg);
-
-  for  (int lLeafCounter = 0; lLeafCounter < lNbLeaves; ++lLeafCounter)
+  for (TLeaf& lLeaf : pMap.mLeaves)
   {
-    TLeaf lLeaf;
-    
-    bspData.read((char*)&lLeaf, sizeof(TLeaf));
-
     fix_int_bound(lLeaf.mMaxs);
     fix_int_bound(lLeaf.mMins);
     scale3(lLeaf.mMaxs, scale);
@@ -316,76 +318,43 @@ void readLeaf(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coord
       swizzle3(lLeaf.mMins);
       swap(lLeaf.mMaxs[2], lLeaf.mMins[2]);
     }
-
-    pMap.mLeaves.push_back(lLeaf);
   }  
 }
 
 /**
  * Read the leafface lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readLeafFace(std::istream& bspData, TMapQ3& pMap)
+void readLeafFace(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbLeafFaces = pMap.mHeader.mLumpes[cLeafFaceLump].mLength / sizeof(TLeafFace);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cLeafFaceLump].mOffset, std::ios_base::beg);
-
-  for  (int lLeafFaceCounter = 0; lLeafFaceCounter < lNbLeafFaces; ++lLeafFaceCounter)
-  {
-    TLeafFace lLeafFace;
-    
-    bspData.read((char*)&lLeafFace, sizeof(TLeafFace));
-
-    pMap.mLeafFaces.push_back(lLeafFace);
-  }      
+  readLump(bspData, pMap, cLeafFaceLump, pMap.mLeafFaces);
 }
 
 /**
  * Read the leafbrush lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readLeafBrush(std::istream& bspData, TMapQ3& pMap)
+void readLeafBrush(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbLeafBrushes = pMap.mHeader.mLumpes[cLeafBrushLump].mLength / sizeof(TLeafBrush);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cLeafBrushLump].mOffset, std::ios_base::beg);
-
-  for  (int lLeafBrusheCounter = 0; lLeafBrusheCounter < lNbLeafBrushes; ++lLeafBrusheCounter)
-  {
-    TLeafBrush lLeafBrush;
-    
-    bspData.read((char*)&lLeafBrush, sizeof(TLeafBrush));
-
-    pMap.mLeafBrushes.push_back(lLeafBrush);
-  }  
+  readLump(bspData, pMap, cLeafBrushLump, pMap.mLeafBrushes);
 }
 
 /**
  * Read the model lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readModel(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readModel(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbModels = pMap.mHeader.mLumpes[cModelLump].mLength / sizeof(TModel);
+  readLump(bspData, pMap, cModelLump, pMap.mModels);
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cModelLump].mOffset, std::ios_base::beg);
-
-  for  (int lModelCounter = 0; lModelCounter < lNbModels; ++lModelCounter)
+  for (TModel& lModel : pMap.mModels)
   {
-    TModel lModel;
-    
-    bspData.read((char*)&lModel, sizeof(TModel));
-
     scale3(lModel.mMaxs, scale);
     scale3(lModel.mMins, scale);
 
@@ -394,76 +363,43 @@ void readModel(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coor
       swizzle3(lModel.mMaxs);
       swizzle3(lModel.mMins);
     }
-
-    pMap.mModels.push_back(lModel);
   }
 }
 
 /**
  * Read the brush lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readBrush(std::istream& bspData, TMapQ3& pMap)
+void readBrush(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbBrushes = pMap.mHeader.mLumpes[cBrushLump].mLength / sizeof(TBrush);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cBrushLump].mOffset, std::ios_base::beg);
-
-  for  (int lBrusheCounter = 0; lBrusheCounter < lNbBrushes; ++lBrusheCounter)
-  {
-    TBrush lBrush;
-    
-    bspData.read((char*)&lBrush, sizeof(TBrush));
-
-    pMap.mBrushes.push_back(lBrush);
-  }
+  readLump(bspData, pMap, cBrushLump, pMap.mBrushes);
 }
 
 /**
  * Read the brush side lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readBrushSide(std::istream& bspData, TMapQ3& pMap)
+void readBrushSide(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbBrushSides = pMap.mHeader.mLumpes[cBrushSideLump].mLength / sizeof(TBrushSide);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cBrushSideLump].mOffset, std::ios_base::beg);
-
-  for (int lBrushSideCounter = 0; lBrushSideCounter < lNbBrushSides; ++lBrushSideCounter)
-  {
-    TBrushSide lBrushSide;
-    
-    bspData.read((char*)&lBrushSide, sizeof(TBrushSide));
-
-    pMap.mBrushSides.push_back(lBrushSide);
-  }
+  readLump(bspData, pMap, cBrushSideLump, pMap.mBrushSides);
 }
 
 /**
  * Read the vertex lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readVertex(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readVertex(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbVertices = pMap.mHeader.mLumpes[cVertexLump].mLength / sizeof(TVertex);
+  readLump(bspData, pMap, cVertexLump, pMap.mVertices);
 
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cVertexLump].mOffset, std::ios_base::beg);
-
-  for  (int lVerticeCounter = 0; lVerticeCounter < lNbVertices; ++lVerticeCounter)
+  for (TVertex& lVertex : pMap.mVertices)
   {
-    TVertex lVertex;
-    
-    bspData.read((char*)&lVertex, sizeof(TVertex));
-
     scale3(lVertex.mPosition, scale);
 
     if (coordSysOpenGL)
@@ -471,76 +407,43 @@ void readVertex(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coo
       swizzle3(lVertex.mPosition);
       swizzle3(lVertex.mNormal);
     }
-
-    pMap.mVertices.push_back(lVertex);
   }
 }
 
 /**
  * Read the meshvert lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readMeshVert(std::istream& bspData, TMapQ3& pMap)
+void readMeshVert(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbMeshVertices = pMap.mHeader.mLumpes[cMeshVertLump].mLength / sizeof(TMeshVert);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cMeshVertLump].mOffset, std::ios_base::beg);
-
-  for  (int lVerticeCounter = 0; lVerticeCounter < lNbMeshVertices; ++lVerticeCounter)
-  {
-    TMeshVert lMeshVertex;
-    
-    bspData.read((char*)&lMeshVertex, sizeof(TMeshVert));
-
-    pMap.mMeshVertices.push_back(lMeshVertex);
-  }
+  readLump(bspData, pMap, cMeshVertLump, pMap.mMeshVertices);
 }
 
 /**
  * Read the effect lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readEffect(std::istream& bspData, TMapQ3& pMap)
+void readEffect(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbEffects = pMap.mHeader.mLumpes[cEffectLump].mLength / sizeof(TEffect);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cEffectLump].mOffset, std::ios_base::beg);
-
-  for  (int lEffectCounter = 0; lEffectCounter < lNbEffects; ++lEffectCounter)
-  {
-    TEffect lEffect;
-    
-    bspData.read((char*)&lEffect, sizeof(TEffect));
-
-    pMap.mEffects.push_back(lEffect);
-  }  
+  readLump(bspData, pMap, cEffectLump, pMap.mEffects);
 }
 
 /**
  * Read the face lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readFace(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
+void readFace(const char* bspData, TMapQ3& pMap, float scale = 1.f, bool coordSysOpenGL = false)
 {
-  int  lNbFaces = pMap.mHeader.mLumpes[cFaceLump].mLength / sizeof(TFace);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cFaceLump].mOffset, std::ios_base::beg);
+  readLump(bspData, pMap, cFaceLump, pMap.mFaces);
 
-  for  (int lFaceCounter = 0; lFaceCounter < lNbFaces; ++lFaceCounter)
+  for (TFace& lFace : pMap.mFaces)
   {
-    TFace lFace;
-    
-    bspData.read((char*)&lFace, sizeof(TFace));
-
     if (lFace.mLightmapIndex < 0) { lFace.mLightmapIndex = -1; }
     if (lFace.mTextureIndex < 0) { lFace.mTextureIndex = -1; }
 
@@ -552,84 +455,74 @@ void readFace(std::istream& bspData, TMapQ3& pMap, float scale = 1.f, bool coord
     {
       swizzle3(lFace.mNormal);
     }
-
-    pMap.mFaces.push_back(lFace);
   }
 }
 
 /**
  * Read the lightmap lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readLightMap(std::istream& bspData, TMapQ3& pMap)
+void readLightMap(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbLightMaps = pMap.mHeader.mLumpes[cLightMapLump].mLength / sizeof(TLightMap);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cLightMapLump].mOffset, std::ios_base::beg);
-
-  for  (int lLightMapCounter = 0; lLightMapCounter < lNbLightMaps; ++lLightMapCounter)
-  {
-    TLightMap lLightMap;
-    
-    bspData.read((char*)&lLightMap, sizeof(TLightMap));
-
-    pMap.mLightMaps.push_back(lLightMap);
-  }
+  readLump(bspData, pMap, cLightMapLump, pMap.mLightMaps);
 }
 
 /**
  * Read the lightvol lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
  */
-void readLightVol(std::istream& bspData, TMapQ3& pMap)
+void readLightVol(const char* bspData, TMapQ3& pMap)
 {
-  int  lNbLightVols = pMap.mHeader.mLumpes[cLightVolLump].mLength / sizeof(TLightVol);
-
-  // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cLightVolLump].mOffset, std::ios_base::beg);
-
-  for  (int lLightVolCounter = 0; lLightVolCounter < lNbLightVols; ++lLightVolCounter)
-  {
-    TLightVol lLightVol;
-    
-    bspData.read((char*)&lLightVol, sizeof(TLightVol));
-
-    pMap.mLightVols.push_back(lLightVol);
-  }
+  readLump(bspData, pMap, cLightVolLump, pMap.mLightVols);
 }
 
 /**
  * Read the visdata lump of the Q3 map.
  *
- * @param pFile  The stream on the Q3 file data.
+ * @param bspData  The Q3 file data.
  * @param pMap  The map structure to fill.
+ *
+ * @return false if the lump is too small for its clusters.
  */
-void readVisData(std::istream& bspData, TMapQ3& pMap)
+bool readVisData(const char* bspData, TMapQ3& pMap)
 {
   pMap.mVisData.mNbClusters = 0;
   pMap.mVisData.mBytesPerCluster = 0;
 
-  if (pMap.mHeader.mLumpes[cVisDataLump].mLength <= 0)
+  const TLump& lLump = pMap.mHeader.mLumpes[cVisDataLump];
+  if (lLump.mLength <= 0)
   {
-    return;
+    return true;
+  }
+
+  if ((size_t)lLump.mLength < 2 * sizeof(int))
+  {
+    return false;
   }
 
   // Go to the start of the chunk.
-  bspData.seekg(pMap.mHeader.mLumpes[cVisDataLump].mOffset, std::ios_base::beg);
+  const char* lData = bspData + lLump.mOffset;
+
+  memcpy(&pMap.mVisData.mNbClusters, lData, sizeof(int));
+  memcpy(&pMap.mVisData.mBytesPerCluster, lData + sizeof(int), sizeof(int));
 
-  bspData.read((char*)&pMap.mVisData.mNbClusters, sizeof(int));
-  bspData.read((char*)&pMap.mVisData.mBytesPerCluster, sizeof(int));
+  // Copy the buffer.
+  const int64_t lBufferSize = (int64_t)pMap.mVisData.mNbClusters * pMap.mVisData.mBytesPerCluster;
+  if ((pMap.mVisData.mNbClusters < 0) || (pMap.mVisData.mBytesPerCluster < 0) || 
+    (lBufferSize > lLump.mLength - (int64_t)(2 * sizeof(int))))
+  {
+    pMap.mVisData.mNbClusters = 0;
+    pMap.mVisData.mBytesPerCluster = 0;
+    return false;
+  }
 
-  // Allocate the buffer.
-  int lBufferSize = pMap.mVisData.mNbClusters * pMap.mVisData.mBytesPerCluster;
-  pMap.mVisData.mBuffer.assign(lBufferSize, 0);
+  pMap.mVisData.mBuffer.assign(lData + 2 * sizeof(int), lData + 2 * sizeof(int) + lBufferSize);
 
-  bspData.read((char*)&pMap.mVisData.mBuffer[0], lBufferSize);
+  return true;
 }
 
 /**
@@ -1080,74 +973,77 @@ void indexBezierPatches(TMapQ3& pMap)
 }
 
 /**
- * Read the map.
+ * Read the map from the Q3 file data in memory.
+ * Each lump is copied with a single memcpy and converted in place, the lumps are read in parallel.
  *
- * @param pFilename  The filename of the map to read.
+ * @param bspData  The Q3 file data.
+ * @param bspSize  The size of the Q3 file data.
+ * @param pMap  The map structure to fill.
+ * @param scale  The scale applied to the positions.
+ * @param postProcessSteps  The Q3MapPostProcessSteps to apply.
+ * @param jobs  The job system reading the lumps in parallel, nullptr to read them on the calling thread.
  *
  * @return true if the loading successed, false otherwise.
  */
-bool readMap(std::istream& bspData, TMapQ3& pMap, float scale, unsigned postProcessSteps)
+bool readMap(const char* bspData, size_t bspSize, TMapQ3& pMap, float scale, unsigned postProcessSteps, shooter::JobSystem* jobs)
 {
 
   // Read the header.
-  if (!readHeader(bspData, pMap))
+  if (!readHeader(bspData, bspSize, pMap))
   {
     printf("readMap :: Invalid Q3 map header.\n");
     return false;
   }
 
-  bool coordSysOpenGL = ((postProcessSteps & PostProcess_CoordSysOpenGL) != 0);
-
-  // Read the entity lump.
-  readEntity(bspData, pMap);
-
-  // Read the texture lump.
-  readTexture(bspData, pMap);
-
-  // Read the plane lump.
-  readPlane(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the node lump.
-  readNode(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the leaf lump.
-  readLeaf(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the leaf face lump.
-  readLeafFace(bspData, pMap);
-
-  // Read the leaf brush lump.
-  readLeafBrush(bspData, pMap);
-
-  // Read the model lump.
-  readModel(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the brush lump.
-  readBrush(bspData, pMap);
-
-  // Read the brushside lump.
-  readBrushSide(bspData, pMap);
-
-  // Read the vertex lump.
-  readVertex(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the meshvert lump.
-  readMeshVert(bspData, pMap);
-
-  // Read the effect lump.
-  readEffect(bspData, pMap);
-
-  // Read the face lump.
-  readFace(bspData, pMap, scale, coordSysOpenGL);
-
-  // Read the lightmap lump.
-  readLightMap(bspData, pMap);
+  if (!areLumpsValid(pMap, bspSize))
+  {
+    printf("readMap :: Q3 map lump out of the file.\n");
+    return false;
+  }
 
-  // Read the lightvol lump.
-  readLightVol(bspData, pMap);
+  bool coordSysOpenGL = ((postProcessSteps & PostProcess_CoordSysOpenGL) != 0);
+  bool visDataValid = true;
+
+  // The lumps are independent, each one fills its own array, and each one is a job. 
+  // The largest ones are pushed first, so the other threads steal them first.
+  const std::vector<std::function<void()> > lReaders = {
+    [&]() { readVertex(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { readLightMap(bspData, pMap); },
+    [&]() { readFace(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { visDataValid = readVisData(bspData, pMap); },
+    [&]() { readMeshVert(bspData, pMap); },
+    [&]() { readLightVol(bspData, pMap); },
+    [&]() { readBrushSide(bspData, pMap); },
+    [&]() { readLeaf(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { readNode(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { readPlane(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { readBrush(bspData, pMap); },
+    [&]() { readLeafFace(bspData, pMap); },
+    [&]() { readLeafBrush(bspData, pMap); },
+    [&]() { readEntity(bspData, pMap); },
+    [&]() { readTexture(bspData, pMap); },
+    [&]() { readModel(bspData, pMap, scale, coordSysOpenGL); },
+    [&]() { readEffect(bspData, pMap); },
+  };
+
+  auto lReadLump = [&](uint32_t lReader) { lReaders[lReader](); };
+  if (jobs != nullptr)
+  {
+    jobs->ParallelFor(0, uint32_t(lReaders.size()), 1, lReadLump);
+  }
+  else
+  {
+    for (uint32_t lReader = 0; lReader < lReaders.size(); ++lReader)
+    {
+      lReadLump(lReader);
+    }
+  }
 
-  // read the visdata lump.
-  readVisData(bspData, pMap);
+  if (!visDataValid)
+  {
+    printf("readMap :: Invalid Q3 map visdata.\n");
+    return false;
+  }
 
   if (postProcessSteps & PostProcess_TriangulateBezierPatches)
   {
@@ -14,23 +14,30 @@
 #include "nav_mesh.hpp"
 #include "Q3SurfaceFlags.hpp"
 #include "resources.hpp"
-#include "shader_defines.h"
-#include "shader_utils.hpp"
 #include "camera_utils.hpp"
+#include "profiler.hpp"
+#include "binary_stream.hpp"
+#include "mapped_file.hpp"
+#include "virtual_file_system.hpp"
+#include "job_system.hpp"
 
 #include <algorithm>
+#include <cfloat>
+#include <cstdio>
 #include <iostream>
-#include <unordered_set>
 #include <unordered_map>
 
-#include <unzip.h>
-#include <SDL_image.h>
+#include <SDL_surface.h> // for the bytes per pixel of the decoded textures
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define Q3MAP_TRACE_SSE
+#include <emmintrin.h>
+#endif
 #include <glm/gtx/vector_angle.hpp>
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace shooter;
-using namespace ShaderUtils;
 using namespace glm;
 using namespace std;
 
@@ -97,132 +104,37 @@ namespace
     return lowerStr;
   }
 
-  typedef pair<unz64_file_pos, uint32_t> TFilePosAndLen;
-  typedef unordered_map<string, TFilePosAndLen> TArchivedFilesInfoMap;
-
-  /// Read files names and positions from a zip archive
-  TArchivedFilesInfoMap ReadArchiveFileNames(unzFile zipFileHandle, TFilePosAndLen& bspFilePosAndLen)
-  {
-    TArchivedFilesInfoMap result;
-
-    if (zipFileHandle == NULL)
-    {
-      return result;
-    }
-
-    //  At first ensure file is already open
-    if (unzGoToFirstFile(zipFileHandle) == UNZ_OK)
-    {
-      // Loop over all files
-      do
-      {
-        char filename[255];
-        unz_file_info64 fileInfo;
-        unz64_file_pos filePos;
-
-        if ((unzGetCurrentFileInfo64(zipFileHandle, &fileInfo, filename, 255, NULL, 0, NULL, 0) == UNZ_OK) &&
-            (fileInfo.uncompressed_size > 0) &&
-            (unzGetFilePos64(zipFileHandle, &filePos) == UNZ_OK))
-        {
-          TFilePosAndLen posAndLen(filePos, (uint32_t)fileInfo.uncompressed_size);
-
-          result[filename] = posAndLen;
-
-          if ((fileInfo.size_filename > 3) &&
-            (filename[fileInfo.size_filename - 1] == 'p') &&
-            (filename[fileInfo.size_filename - 2] == 's') &&
-            (filename[fileInfo.size_filename - 3] == 'b'))
-          {
-            bspFilePosAndLen = posAndLen;
-          }
-        }
-      } while (unzGoToNextFile(zipFileHandle) != UNZ_END_OF_LIST_OF_FILE);
-    }
+  /// Scale and post processing steps applied to the map data by readMap()
+  const float cMapScale = 0.03f;
+  const unsigned cMapPostProcessSteps = PostProcess_CoordSysOpenGL | PostProcess_FlipWindingOrder | PostProcess_TriangulateBezierPatches;
 
-    return result;
-  }
+  /// Cooked map file (see Q3Map::WriteCookedMap())
+  const uint32_t cCookedMapMagic = 0x4d434453; // "SDCM"
+  const uint32_t cCookedMapVersion = 2; ///< 2: the key of the decoded textures
 
-  /// Read the contents of a file from a zip archive
-  void* ReadFileAtPos(unzFile zipFileHandle, const TFilePosAndLen& filePosAndLen)
+  /// Key of the cooked map: hash of the map archive and of the load parameters, never 0
+  uint64_t ComputeCookedMapKey(const FileView& mapZip, bool decodeTextures)
   {
-    if ((unzGoToFilePos64(zipFileHandle, &filePosAndLen.first) == UNZ_OK) &&
-      (unzOpenCurrentFile(zipFileHandle) == UNZ_OK))
+    // The flame quads depend on the texture types, which depend on the decoded textures
+    const struct
     {
-      void *p = malloc(filePosAndLen.second);
-      if (unzReadCurrentFile(zipFileHandle, p, filePosAndLen.second) == filePosAndLen.second)
-      {
-        return p;
-      }
-      free(p);
-    }
+      float scale;
+      uint32_t postProcessSteps;
+      uint32_t decodeTextures;
+    } params = { cMapScale, cMapPostProcessSteps, decodeTextures ? 1u : 0u };
 
-    return nullptr;
+    const uint64_t key = HashWords(&params, sizeof(params), HashWords(mapZip.GetData(), mapZip.GetSize()));
+    return (key != 0) ? key : 1;
   }
 }
 
-/// Load a texture from a zip archive to the GPU memory
-void LoadTexture(
-  const TTexture& texture, 
-  const unzFile fileHandle, 
-  const TArchivedFilesInfoMap& filesMap,
-  std::vector<GLuint>& textures,
+/// Set the texture type, based on the texture name and bytes per pixel
+void SetTexType(
+  uint32_t texIx,
+  const TTexture& texture,
+  uint32_t bpp,
   std::vector<uint64_t>& texturesTypeBits)
 {
-  static const vector<string> cExtensions = { ".jpg", ".tga", ".png" };
-  GLuint tex = 0;
-  uint32_t bpp = 0;
-  bool found = false;
-  auto itFile = filesMap.end();
-
-  const char* pExt = NULL;
-  for (const string& ext : cExtensions)
-  {
-    itFile = filesMap.find(texture.mName + ext);
-    if (itFile != filesMap.end())
-    {
-      found = true;
-      pExt = ext.c_str() + 1;
-      break;
-    }
-  }
-
-  if (!found)
-  {
-    itFile = filesMap.find("transparent.png");
-    if (itFile != filesMap.end())
-    {
-      found = true;
-      pExt = cExtensions[2].c_str() + 1;
-    }
-  }
-
-  if (found)
-  {
-    void* pFile = ReadFileAtPos(fileHandle, itFile->second);
-    if (pFile != nullptr)
-    {
-      SDL_Surface* surface = IMG_LoadTyped_RW(SDL_RWFromConstMem(pFile, itFile->second.second), 0, pExt);
-      free(pFile); //ToDo: avoid copying
-      if (surface != nullptr)
-      {
-        bpp = surface->format->BytesPerPixel;
-        tex = LoadTexture(surface);
-      }
-      else
-      {
-        std::cout << "Couldn't Load " << texture.mName << std::endl;
-      }
-    }
-  }
-  else
-  {
-    std::cout << "Couldn't Find " << texture.mName << std::endl;
-  }
-
-  uint32_t texIx = textures.size();
-
-  textures.push_back(tex);
-
   string texName = toLower(texture.mName);
   if (bpp == 4)
   {
@@ -238,63 +150,82 @@ void LoadTexture(
   }
 }
 
-Q3Map::Q3Map(const std::string& mapZipPath)
+Q3Map::Q3Map(const VirtualFileSystem& fileSystem, const std::string& mapZipPath, const std::string& cookedMapPath, bool decodeTextures, JobSystem* jobs)
+  : mTraceBackend(ETraceBackendMapData)
+  , mVao(0)
+  , mSimpleProgram(cInvalidId)
+  , mFlameProgram(cInvalidId)
+  , mSwirlProgram(cInvalidId)
 {
-  unzFile mapFileHandle = unzOpen(mapZipPath.c_str());
-  TFilePosAndLen bspFilePosAndLen;
-  TArchivedFilesInfoMap filesMap = ReadArchiveFileNames(mapFileHandle, bspFilePosAndLen);
-
-  if (bspFilePosAndLen.second <= 0)
+  const std::vector<std::string> bspPaths = fileSystem.List("", ".bsp", mapZipPath);
+  FileView mapZip;
+  if (bspPaths.empty() || !fileSystem.Open(mapZipPath, mapZip))
   {
     std::cout << "Couldn't read map file: " << mapZipPath << std::endl;
     return;
   }
 
-  void* pFile = ReadFileAtPos(mapFileHandle, bspFilePosAndLen);
+  auto readMapFile = [&]()
+  {
+    // The lumps are parsed straight from the inflated file, replacing a stale cooked map
+    mMap = TMapQ3();
+    FileView bspFile;
+    const bool mapRead = fileSystem.Open(bspPaths.front(), bspFile) 
+      && readMap((const char*)bspFile.GetData(), bspFile.GetSize(), mMap, cMapScale, cMapPostProcessSteps, jobs);
+
+    mTexturesTypeBits.assign(mMap.mTextures.size() / 32 + 1, 0ULL);
+    return mapRead;
+  };
 
-  // ToDo: Optimization - avoid the copying of the file buffer
-  std::stringstream localStream(string((char*)pFile, (char*)pFile + bspFilePosAndLen.second));
-  //localStream.rdbuf()->pubsetbuf((char*)pFile, bspFilePosAndLen.second);
+  // The cooked map is stale when the archive or the load parameters change
+  const uint64_t cookedMapKey = ComputeCookedMapKey(mapZip, decodeTextures);
+  uint64_t cookedTexturesKey = 0;
+  bool cooked = ReadCookedMap(cookedMapPath, cookedMapKey, cookedTexturesKey);
 
-  free(pFile);
+  if (!cooked && !readMapFile()) { return; }
 
-  if (!readMap(localStream, mMap, 0.03f, PostProcess_CoordSysOpenGL|PostProcess_FlipWindingOrder|PostProcess_TriangulateBezierPatches))
+  // Decode textures in parallel, they're uploaded to the GPU later by InitGL() on the OpenGL context thread.
+  uint64_t texturesKey = 0;
+  if (decodeTextures)
   {
-    return;
-  }
+    mTexturesSurfaces = DecodeTextures(mMap.mTextures, fileSystem, jobs, texturesKey);
 
-  uint32_t bpp = 0;
+    // The texture types of the cooked map are stale too when the files of its textures change.
+    // The texture names come from the archive, so the decoded textures stay valid.
+    if (cooked && (texturesKey != cookedTexturesKey))
+    {
+      std::cout << "Stale cooked map textures: " << cookedMapPath << std::endl;
+      cooked = false;
+      if (!readMapFile()) { return; }
+    }
+  }
 
-  // Load textures
-  mTextures.reserve(mMap.mTextures.size());
-  mTexturesTypeBits.assign(mMap.mTextures.size() / 32 + 1, 0ULL);
-  for (const TTexture& texture : mMap.mTextures) 
+  // Without the pixel data (headless mode), the texture type is guessed only by name.
+  // The cooked map has the texture types already.
+  if (!cooked)
   {
-    LoadTexture(texture, mapFileHandle, filesMap, mTextures, mTexturesTypeBits);
+    for (uint32_t texIx = 0; texIx < mMap.mTextures.size(); texIx++) 
+    {
+      const SDL_Surface* surface = decodeTextures ? mTexturesSurfaces[texIx] : nullptr;
+      uint32_t bpp = (surface != nullptr) ? surface->format->BytesPerPixel : 0;
+      SetTexType(texIx, mMap.mTextures[texIx], bpp, mTexturesTypeBits);
+    }
   }
 
-  unzClose(mapFileHandle);
+  BuildCollisionMap();
 
-  // Load lightmaps
-  mLightMaps.reserve(mMap.mLightMaps.size());
-  for (const TLightMap& lightMap : mMap.mLightMaps) 
+  if (!cooked)
   {
-    mLightMaps.push_back(LoadTexture((const void *)lightMap.mMapData, 128));
-  }
-
-  // Update flame quads to use rotating billboards facing towards the camera
-  UpdateFlameQuads();
+    // Update flame quads to use rotating billboards facing towards the camera
+    UpdateFlameQuads();
 
-  // Init OpenGL buffers
-  InitBuffers(); 
+    WriteCookedMap(cookedMapPath, cookedMapKey, texturesKey);
+  }
 }
 
 Q3Map::~Q3Map() 
 {
-  glDeleteVertexArrays(1, &mVao);
-  glDeleteBuffers(mBufferObjects.size(), mBufferObjects.data());
-  glDeleteTextures(mTextures.size(), mTextures.data());
-  glDeleteTextures(mLightMaps.size(), mLightMaps.data());
+  ReleaseGL();
 }
 
 void Q3Map::UpdateFlameQuads()
@@ -345,185 +276,99 @@ void Q3Map::UpdateFlameQuads()
   }
 }
 
-void Q3Map::InitBuffers() 
-{
-  GLuint buffer = 0;
-
-  // Generate Vertex Array Object
-  glGenVertexArrays(1, &mVao);
-  glBindVertexArray(mVao);
-
-  glGenBuffers(1, &buffer);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(TMeshVert) * mMap.mMeshVertices.size(), mMap.mMeshVertices.data(), GL_STATIC_DRAW);
-  mBufferObjects.push_back(buffer);
-
-  glGenBuffers(1, &buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(TVertex) * mMap.mVertices.size(), mMap.mVertices.data(), GL_STATIC_DRAW);
-  mBufferObjects.push_back(buffer);
-
-  glEnableVertexAttribArray(VERT_POSITION_LOC);
-  glVertexAttribPointer(VERT_POSITION_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(TVertex), 0);
-
-  glEnableVertexAttribArray(VERT_DIFFUSE_TEX_COORD_LOC);
-  glVertexAttribPointer(VERT_DIFFUSE_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)12);
-
-  glEnableVertexAttribArray(VERT_LIGHTMAP_TEX_COORD_LOC);
-  glVertexAttribPointer(VERT_LIGHTMAP_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)20);
-
-  glEnableVertexAttribArray(VERT_NORMAL_LOC);
-  glVertexAttribPointer(VERT_NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)28);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
-}
-
-void Q3Map::Render(
-  const Resources& resources, 
-  const mat4& viewMat, 
-  const mat4& projMat, 
-  const vec3& camPos,
-  uint32 matUniformBuffer) const
+bool Q3Map::ReadCookedMap(const std::string& filePath, uint64_t key, uint64_t& outTexturesKey)
 {
-  VisibleFacesByType faces = FindVisibleFaces(camPos, projMat * viewMat);
-  if (faces.empty())
-  {
-    return;
-  }
-
-  // Set the tesselation inner and outer levels for the patches
-  vec4 tessOuterLvl(10.0f);
-  vec2 tessInnerLvl(10.0f);
-  glPatchParameterfv(GL_PATCH_DEFAULT_OUTER_LEVEL, value_ptr(tessOuterLvl));
-  glPatchParameterfv(GL_PATCH_DEFAULT_INNER_LEVEL, value_ptr(tessInnerLvl));
-  glPatchParameteri(GL_PATCH_VERTICES, 9);
-
-  // Enable blending
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-  glPointSize(5.0f);
-  glLineWidth(5.f);
-  glActiveTexture(GL_TEXTURE0 + DIFFUSE_TEX_UNIT);
-  glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEX_UNIT);
-  glUseProgram(resources.GetProgram("simple"));
-
-  glBindVertexArray(mVao);
-
-  for (auto pair : faces[EFaceTypeBsp1]) 
-  {
-    RenderFace(pair.first);
-  }
-
-  for (auto pair : faces[EFaceTypeBsp3]) 
-  {
-    RenderFace(pair.first);
-  }
-  
-  for (auto pair : faces[EFaceTypeBsp2]) 
-  {
-    RenderFace(pair.first);
-  }
-  
-  glDisable(GL_CULL_FACE);
-
-  glUseProgram(resources.GetProgram("flame"));
-
-  float time = SDL_GetTicks() * 0.001f;
-  
-  glUniform3fv(CAMERA_POS_LOC, 1, value_ptr(camPos));
-  glUniform3fv(BILLBOARD_ROTATION_AXIS, 1, value_ptr(vec3(0.f, 1.f, 0.f)));
-  glUniform1i(BILLBOARD_IN_WORLD_SPACE, GL_TRUE);
-
-  for (auto pair : faces[EFaceTypeFlame]) 
-  {
-    const TFace& face = mMap.mFaces[pair.first];
-
-    vec3 p1 = make_vec3(mMap.mVertices[face.mVertex + 1].mPosition);
-    vec3 p2 = make_vec3(mMap.mVertices[face.mVertex + 2].mPosition);
-    vec3 c = p1 + (p2 - p1) * 0.5f;
-
-    glUniform1f(GLOBAL_TIME_LOC, time + 0.3345f * pair.first);
-    glUniform3fv(BILLBOARD_ORIGIN_LOC, 1, value_ptr(c));
-
-    RenderFace(pair.first);
-  }
+  MappedFile file;
+  if (!file.Open(filePath)) { return false; }
 
-  glUseProgram(resources.GetProgram("swirl"));
+  BinaryReader reader(file.GetData(), file.GetSize());
 
-  for (auto pair : faces[EFaceTypeSwirl]) 
+  uint32_t magic = 0, version = 0;
+  uint64_t fileKey = 0;
+  if (!reader.Read(magic) || (magic != cCookedMapMagic) || !reader.Read(version) || (version != cCookedMapVersion)
+    || !reader.Read(fileKey) || (fileKey != key))
   {
-    const TFace& face = mMap.mFaces[pair.first];
-
-    glUniform1f(GLOBAL_TIME_LOC, time + 0.3345f * pair.first);
-
-    RenderFace(pair.first);
+    std::cout << "Stale cooked map: " << filePath << std::endl;
+    return false;
   }
 
-  glUseProgram(resources.GetProgram("simple"));
-  glBindVertexArray(mVao);
-
-  for (auto pair : faces[EFaceTypeTransparent]) 
+  uint64_t texturesKey = 0;
+
+  // The arrays are copied from the mapped file as they are
+  TMapQ3 map;
+  std::vector<uint64_t> texturesTypeBits;
+  if (!reader.Read(texturesKey)
+    || !reader.Read(map.mHeader)
+    || !reader.Read(map.mEntity.mSize)
+    || !reader.ReadString(map.mEntity.mBuffer)
+    || !reader.ReadVector(map.mTextures)
+    || !reader.ReadVector(map.mPlanes)
+    || !reader.ReadVector(map.mNodes)
+    || !reader.ReadVector(map.mLeaves)
+    || !reader.ReadVector(map.mLeafFaces)
+    || !reader.ReadVector(map.mLeafBrushes)
+    || !reader.ReadVector(map.mModels)
+    || !reader.ReadVector(map.mBrushes)
+    || !reader.ReadVector(map.mBrushSides)
+    || !reader.ReadVector(map.mVertices)
+    || !reader.ReadVector(map.mMeshVertices)
+    || !reader.ReadVector(map.mEffects)
+    || !reader.ReadVector(map.mFaces)
+    || !reader.ReadVector(map.mLightMaps)
+    || !reader.ReadVector(map.mLightVols)
+    || !reader.Read(map.mVisData.mNbClusters)
+    || !reader.Read(map.mVisData.mBytesPerCluster)
+    || !reader.ReadVector(map.mVisData.mBuffer)
+    || !reader.ReadVector(texturesTypeBits)
+    || !reader.IsEnd())
   {
-    RenderFace(pair.first);
+    std::cout << "Invalid cooked map: " << filePath << std::endl;
+    return false;
   }
 
-  glDisable(GL_CULL_FACE);
+  mMap = std::move(map);
+  mTexturesTypeBits.swap(texturesTypeBits);
+  outTexturesKey = texturesKey;
+  return true;
 }
 
-void Q3Map::RenderFace(uint32_t faceIndex) const 
+void Q3Map::WriteCookedMap(const std::string& filePath, uint64_t key, uint64_t texturesKey) const
 {
-  const TFace& face = mMap.mFaces[faceIndex];
-
-  static int32_t lastDiffuseTex = -1;
-  if (face.mTextureIndex != lastDiffuseTex) 
-  {
-    glActiveTexture(GL_TEXTURE0 + DIFFUSE_TEX_UNIT);
-    if (face.mTextureIndex >= 0) 
-    {
-      glBindTexture(GL_TEXTURE_2D, mTextures[face.mTextureIndex]);
-    } 
-    else 
-    {
-      glBindTexture(GL_TEXTURE_2D, 0);
-    }
-    lastDiffuseTex = face.mTextureIndex;
-  }
-
-  static int32_t lastLightmapTex = -1;
-  if (face.mLightmapIndex != lastLightmapTex) 
-  {
-    glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEX_UNIT);
-    if (face.mLightmapIndex >= 0) 
-    {
-      glBindTexture(GL_TEXTURE_2D, mLightMaps[face.mLightmapIndex]);
-    } 
-    else 
-    {
-      glBindTexture(GL_TEXTURE_2D, 0);
-    }
-    lastLightmapTex = face.mLightmapIndex;
-  }
-
-  if (face.mType == 1 || face.mType == 3 || face.mType == 2) 
+  if (key == 0) { return; }
+
+  std::vector<uint8_t> data;
+  BinaryWriter writer(data);
+  writer.Write(cCookedMapMagic);
+  writer.Write(cCookedMapVersion);
+  writer.Write(key);
+  writer.Write(texturesKey);
+  writer.Write(mMap.mHeader);
+  writer.Write(mMap.mEntity.mSize);
+  writer.WriteString(mMap.mEntity.mBuffer);
+  writer.WriteVector(mMap.mTextures);
+  writer.WriteVector(mMap.mPlanes);
+  writer.WriteVector(mMap.mNodes);
+  writer.WriteVector(mMap.mLeaves);
+  writer.WriteVector(mMap.mLeafFaces);
+  writer.WriteVector(mMap.mLeafBrushes);
+  writer.WriteVector(mMap.mModels);
+  writer.WriteVector(mMap.mBrushes);
+  writer.WriteVector(mMap.mBrushSides);
+  writer.WriteVector(mMap.mVertices);
+  writer.WriteVector(mMap.mMeshVertices);
+  writer.WriteVector(mMap.mEffects);
+  writer.WriteVector(mMap.mFaces);
+  writer.WriteVector(mMap.mLightMaps);
+  writer.WriteVector(mMap.mLightVols);
+  writer.Write(mMap.mVisData.mNbClusters);
+  writer.Write(mMap.mVisData.mBytesPerCluster);
+  writer.WriteVector(mMap.mVisData.mBuffer);
+  writer.WriteVector(mTexturesTypeBits);
+
+  if (!WriteFileAtomically(filePath, data.data(), data.size()))
   {
-    glDrawElementsBaseVertex(
-      GL_TRIANGLES,
-      face.mNbMeshVertices,
-      GL_UNSIGNED_INT,
-      (void *)(face.mMeshVertex * sizeof(uint32_t)),
-      face.mVertex);
+    std::cout << "Couldn't write the cooked map: " << filePath << std::endl;
   }
-  /*else if (face.mType == 2) 
-  {
-    glDrawElementsBaseVertex(
-      GL_PATCHES,
-      face.mNbMeshVertices,
-      GL_UNSIGNED_INT,
-      (void *)(face.mMeshVertex * sizeof(uint32_t)),
-      face.mVertex);
-  }*/
 }
 
 Q3Map::VisibleFacesByType Q3Map::FindVisibleFaces(const vec3& camPos, const mat4& mvpMat) const
@@ -643,19 +488,106 @@ bool Q3Map::IsClusterVisible(int visCluster, int testCluster) const
   return (visSet & (1 << (testCluster & 7))) != 0;
 }
 
+namespace
+{
+  /// Margin added to the collision brushes bounds. A trace whose swept volume is farther than this
+  /// from a brush ends more than the 0.0001 entry epsilon of CheckBrush() in front of a side, so it can't hit the brush.
+  const float cBrushBoundsMargin = 0.1f;
+
+  /// CollisionMap::nodeParents of the BSP root, and of the nodes and leaves no node links to
+  const int32_t cBspRoot = -1;
+  const int32_t cNotInBsp = -2;
+
+  /// Maximum number of brushes in a BVH leaf and depth of the BVH (the traversal stack size)
+  const uint32_t cBvhMaxLeafBrushes = 4;
+  const uint32_t cBvhMaxDepth = 48;
+
+  /// Number of bins used to evaluate the Surface Area Heuristic of the BVH splits
+  const uint32_t cBvhNrBins = 16;
+
+  /// Half the surface area of a box
+  inline float HalfArea(const vec3& minBounds, const vec3& maxBounds)
+  {
+    vec3 size = max(maxBounds - minBounds, vec3(0.f));
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+  }
+
+  /// Set the output of a trace back to the values of the TraceData constructors
+  inline void ResetTraceOutput(TraceData& data)
+  {
+    data.mCollision = false;
+    data.mStartsOut = true;
+    data.mAllSolid = false;
+    data.mPlaneIndex = -1;
+    data.mFraction = 1.f;
+  }
+}
+
+bool Q3Map::ClipChangesTrace(const BrushClip& clip, const TraceData& data)
+{
+  if (clip.startsOut == false)
+  {
+    return data.mStartsOut || ((clip.endsOut == false) && (data.mAllSolid == false));
+  }
+
+  return (clip.enterFraction < clip.leaveFraction) && (clip.enterFraction > -1) && (clip.enterFraction <= data.mFraction);
+}
+
+void Q3Map::ClipToBrush(const BrushClip& clip, TraceData& data, bool& tied)
+{
+  if (clip.startsOut == false)
+  {
+    data.mStartsOut = false;
+    if (clip.endsOut == false)
+    {
+      data.mAllSolid = true;
+    }
+    return;
+  }
+
+  float enterFraction = clip.enterFraction;
+  if (enterFraction < clip.leaveFraction)
+  {
+    if (enterFraction > -1 && enterFraction <= data.mFraction)
+    {
+      if (enterFraction < 0.f) {
+        enterFraction = 0;
+      }
+
+      if ((data.mCollision == false) || (enterFraction < data.mFraction))
+      {
+        tied = false;
+      }
+      else if ((clip.startPlaneIndex != data.mPlaneIndex) || (clip.contents != data.mContents))
+      {
+        tied = true;
+      }
+
+      assert(clip.startPlaneIndex >= 0);
+      data.mPlaneIndex = clip.startPlaneIndex;
+      data.mFraction = enterFraction;
+      data.mContents = clip.contents;
+      data.mCollision = true;
+    }
+  }
+}
+
 TraceData::TraceData(const vec3& start, const vec3& end)
   : mTraceType(TracePoint), mStart(start), mEnd(end), mRadius(0.f)
+  , mSweepMinBounds(min(start, end)), mSweepMaxBounds(max(start, end))
   , mPlaneIndex(-1), mFraction(1.f), mStartsOut(true), mAllSolid(false), mCollision(false)
 {}
 
 TraceData::TraceData(const vec3& start, const vec3& end, float radius)
   : mTraceType(TraceSphere), mStart(start), mEnd(end), mRadius(radius)
+  , mSweepMinBounds(min(start, end) - radius), mSweepMaxBounds(max(start, end) + radius)
   , mPlaneIndex(-1), mFraction(1.f), mStartsOut(true), mAllSolid(false), mCollision(false)
 {}
 
 TraceData::TraceData(const vec3& start, const vec3& end, const vec3& minBounds, const vec3& maxBounds)
   : mTraceType(TraceBox), mStart(start), mEnd(end), mRadius(0.f)
   , mMinBounds(minBounds), mMaxBounds(maxBounds), mExtends(max(-minBounds, maxBounds))
+  , mSweepMinBounds(min(start, end) + minBounds), mSweepMaxBounds(max(start, end) + maxBounds)
   , mPlaneIndex(-1), mFraction(1.f), mStartsOut(true), mAllSolid(false), mCollision(false)
 {
   assert(sign(mExtends) == vec3(1.f));
@@ -663,7 +595,33 @@ TraceData::TraceData(const vec3& start, const vec3& end, const vec3& minBounds,
 
 bool Q3Map::Trace(TraceData& data) const
 {
-  CheckNode(0, data);
+  PROFILER_ZONE("Q3Map::Trace");
+
+  switch (mTraceBackend)
+  {
+  case ETraceBackendMapData:
+    CheckNode(0, data, BeginCheckedBrushes(mMap.mBrushes.size()));
+    break;
+  case ETraceBackendCollisionMap:
+  {
+    CheckedBrushes& checked = BeginCheckedBrushes(mMap.mBrushes.size());
+    switch (data.mTraceType)
+    {
+    case TraceData::TracePoint: TraceCollisionMap<TraceData::TracePoint>(data, checked); break;
+    case TraceData::TraceSphere: TraceCollisionMap<TraceData::TraceSphere>(data, checked); break;
+    case TraceData::TraceBox: TraceCollisionMap<TraceData::TraceBox>(data, checked); break;
+    }
+    break;
+  }
+  case ETraceBackendBvh:
+    switch (data.mTraceType)
+    {
+    case TraceData::TracePoint: TraceBvh<TraceData::TracePoint>(data); break;
+    case TraceData::TraceSphere: TraceBvh<TraceData::TraceSphere>(data); break;
+    case TraceData::TraceBox: TraceBvh<TraceData::TraceBox>(data); break;
+    }
+    break;
+  }
 
   if (data.mCollision)
   {
@@ -706,12 +664,33 @@ void Q3Map::GetVerticesAndIndices(std::vector<float>& outVertices, std::vector<f
   }
 }
 
-void Q3Map::CheckNode(int nodeIndex, TraceData& data) const
+Q3Map::CheckedBrushes& Q3Map::BeginCheckedBrushes(uint32_t nrBrushes)
+{
+  // One array for each thread, reused by all its traces
+  static thread_local CheckedBrushes checked;
+
+  if (checked.stamps.size() < nrBrushes)
+  {
+    checked.stamps.resize(nrBrushes, 0);
+    checked.lanes.resize(nrBrushes, 0);
+  }
+
+  if (++checked.stamp == 0)
+  {
+    // The stamp wrapped around, forget the old stamps
+    std::fill(checked.stamps.begin(), checked.stamps.end(), 0);
+    checked.stamp = 1;
+  }
+
+  return checked;
+}
+
+void Q3Map::CheckNode(int nodeIndex, TraceData& data, CheckedBrushes& checked) const
 {
   if (nodeIndex < 0)
   {   // this is a leaf
     const uint32_t leafIndex = -(nodeIndex + 1);
-    CheckLeaf(leafIndex, data);
+    CheckLeaf(leafIndex, data, checked);
     return;
   }
 
@@ -731,26 +710,26 @@ void Q3Map::CheckNode(int nodeIndex, TraceData& data) const
   if (startDistance >= offset && endDistance >= offset)
   {   // both points are in front of the plane
     // so check the front child
-    CheckNode(node.mChildren[0], data);
+    CheckNode(node.mChildren[0], data, checked);
   }
   else if (startDistance < -offset && endDistance < -offset)
   {   // both points are behind the plane
     // so check the back child
-    CheckNode(node.mChildren[1], data);
+    CheckNode(node.mChildren[1], data, checked);
   }
   else
   {   // the line spans the splitting plane
     int side = (startDistance < endDistance ? 1 : 0);
 
     // Check the first side
-    CheckNode(node.mChildren[side], data);
+    CheckNode(node.mChildren[side], data, checked);
 
     // Check the second side
-    CheckNode(node.mChildren[!side], data);
+    CheckNode(node.mChildren[!side], data, checked);
   }
 }
 
-void Q3Map::CheckLeaf(int leafIndex, TraceData& data) const
+void Q3Map::CheckLeaf(int leafIndex, TraceData& data, CheckedBrushes& checked) const
 {
   const TLeaf& leaf = mMap.mLeaves[leafIndex];
 
@@ -758,10 +737,12 @@ void Q3Map::CheckLeaf(int leafIndex, TraceData& data) const
   {
     int brushIndex = mMap.mLeafBrushes[leaf.mLeafBrush + i].mBrushIndex;
 
-    // avoid checking the same brush more then once
-    if (data.mCheckedBrushes.find(brushIndex) != end(data.mCheckedBrushes)) { continue; }
+    // avoid checking the same brush more then once. Like the set of checked brushes it replaces,
+    // only the first visit counts, which decides the winner of equal fraction ties in CheckBrush().
+    uint32_t& brushStamp = checked.stamps[brushIndex];
+    if (brushStamp == checked.stamp) { continue; }
 
-    data.mCheckedBrushes.insert(brushIndex);
+    brushStamp = checked.stamp;
 
     CheckBrush(brushIndex, data);
   }
@@ -867,3 +848,874 @@ void Q3Map::CheckBrush(int brushIndex, TraceData& data) const
     }
   }
 }
+
+void Q3Map::BuildCollisionMap()
+{
+  CollisionMap& collision = mCollisionMap;
+  collision = CollisionMap();
+
+  collision.nodes.reserve(mMap.mNodes.size());
+  for (const TNode& node : mMap.mNodes)
+  {
+    const TPlane& plane = mMap.mPlanes[node.mPlane];
+    CollisionNode collisionNode = { make_vec3(plane.mNormal), plane.mDistance, { node.mChildren[0], node.mChildren[1] } };
+    collision.nodes.push_back(collisionNode);
+  }
+
+  // Depth of the BSP, sizes the traversal stack of TraceCollisionMap()
+  collision.bspDepth = 0;
+  std::vector<std::pair<int, uint32_t> > depthStack;
+  if (!collision.nodes.empty())
+  {
+    depthStack.push_back(std::make_pair(0, 1u));
+  }
+  while (!depthStack.empty())
+  {
+    const std::pair<int, uint32_t> entry = depthStack.back();
+    depthStack.pop_back();
+
+    collision.bspDepth = std::max(collision.bspDepth, entry.second);
+    for (int child : collision.nodes[entry.first].children)
+    {
+      if (child >= 0) { depthStack.push_back(std::make_pair(child, entry.second + 1)); }
+    }
+  }
+
+  collision.brushes.reserve(mMap.mBrushes.size());
+  for (const TBrush& brush : mMap.mBrushes)
+  {
+    CollisionBrush collisionBrush = { vec3(-FLT_MAX), vec3(FLT_MAX), (uint32_t)collision.sidePlanes.size(), 0, 
+      mMap.mTextures[brush.mTextureIndex].mContents };
+
+    if (brush.mNbBrushSides > 0 && (collisionBrush.contents & CONTENTS_SOLID))
+    {
+      collisionBrush.nrSides = brush.mNbBrushSides;
+
+      for (int i = 0; i < brush.mNbBrushSides; i++)
+      {
+        const TBrushSide& brushSide = mMap.mBrushSides[brush.mBrushSide + i];
+        const TPlane& plane = mMap.mPlanes[brushSide.mPlaneIndex];
+        vec3 planeNormal = normalize(make_vec3(plane.mNormal));
+
+        collision.sideNormalsX.push_back(planeNormal.x);
+        collision.sideNormalsY.push_back(planeNormal.y);
+        collision.sideNormalsZ.push_back(planeNormal.z);
+        collision.sideDistances.push_back(plane.mDistance);
+        collision.sidePlanes.push_back(brushSide.mPlaneIndex);
+
+        // The brush is behind all its sides, so the axis aligned ones bound it
+        for (int j = 0; j < 3; j++)
+        {
+          if (planeNormal[(j + 1) % 3] != 0.f || planeNormal[(j + 2) % 3] != 0.f) { continue; }
+
+          if (planeNormal[j] == 1.f)
+          {
+            collisionBrush.maxBounds[j] = std::min(collisionBrush.maxBounds[j], plane.mDistance + cBrushBoundsMargin);
+          }
+          else if (planeNormal[j] == -1.f)
+          {
+            collisionBrush.minBounds[j] = std::max(collisionBrush.minBounds[j], -plane.mDistance - cBrushBoundsMargin);
+          }
+        }
+      }
+    }
+
+    collision.brushes.push_back(collisionBrush);
+  }
+
+  collision.leaves.reserve(mMap.mLeaves.size());
+  for (const TLeaf& leaf : mMap.mLeaves)
+  {
+    CollisionLeaf collisionLeaf = { (uint32_t)collision.leafBrushes.size(), 0 };
+
+    for (int i = 0; i < leaf.mNbLeafBrushes; i++)
+    {
+      int brushIndex = mMap.mLeafBrushes[leaf.mLeafBrush + i].mBrushIndex;
+      if (collision.brushes[brushIndex].nrSides > 0)
+      {
+        collision.leafBrushes.push_back(brushIndex);
+      }
+    }
+
+    collisionLeaf.nrBrushes = collision.leafBrushes.size() - collisionLeaf.firstBrush;
+    collision.leaves.push_back(collisionLeaf);
+  }
+
+  // Parents of the BSP nodes and leaves, to follow the CheckNode() walk back from a leaf
+  collision.nodeParents.assign(collision.nodes.size(), cNotInBsp);
+  collision.leafParents.assign(collision.leaves.size(), cNotInBsp);
+  if (!collision.nodes.empty())
+  {
+    collision.nodeParents[0] = cBspRoot;
+  }
+  for (uint32_t nodeIndex = 0; nodeIndex < collision.nodes.size(); nodeIndex++)
+  {
+    for (int32_t side = 0; side < 2; side++)
+    {
+      const int child = collision.nodes[nodeIndex].children[side];
+      int32_t& parent = (child < 0) ? collision.leafParents[-(child + 1)] : collision.nodeParents[child];
+      parent = nodeIndex * 2 + side;
+    }
+  }
+
+  // Leaves listing each solid brush
+  collision.brushFirstLeaves.assign(collision.brushes.size() + 1, 0);
+  for (uint32_t brushIndex : collision.leafBrushes)
+  {
+    collision.brushFirstLeaves[brushIndex + 1]++;
+  }
+  for (uint32_t brushIndex = 0; brushIndex < collision.brushes.size(); brushIndex++)
+  {
+    collision.brushFirstLeaves[brushIndex + 1] += collision.brushFirstLeaves[brushIndex];
+  }
+
+  collision.brushLeaves.resize(collision.leafBrushes.size());
+  std::vector<uint32_t> nrBrushLeaves(collision.brushes.size(), 0);
+  for (uint32_t leafIndex = 0; leafIndex < collision.leaves.size(); leafIndex++)
+  {
+    const CollisionLeaf& leaf = collision.leaves[leafIndex];
+    for (uint32_t i = leaf.firstBrush; i < leaf.firstBrush + leaf.nrBrushes; i++)
+    {
+      const uint32_t brushIndex = collision.leafBrushes[i];
+      collision.brushLeaves[collision.brushFirstLeaves[brushIndex] + nrBrushLeaves[brushIndex]++] = leafIndex;
+    }
+  }
+
+  // BVH over the solid brushes with finite bounds
+  for (uint32_t brushIndex = 0; brushIndex < collision.brushes.size(); brushIndex++)
+  {
+    const CollisionBrush& brush = collision.brushes[brushIndex];
+    if (brush.nrSides == 0) { continue; }
+
+    const bool bounded = all(greaterThan(brush.minBounds, vec3(-FLT_MAX))) && all(lessThan(brush.maxBounds, vec3(FLT_MAX)));
+    (bounded ? collision.bvhBrushes : collision.unboundedBrushes).push_back(brushIndex);
+  }
+
+  collision.bvhNodes.reserve(2 * collision.bvhBrushes.size() / cBvhMaxLeafBrushes + 1);
+  BuildBvhNode(collision, 0, collision.bvhBrushes.size(), 0);
+}
+
+uint32_t Q3Map::BuildBvhNode(CollisionMap& collision, uint32_t first, uint32_t count, uint32_t depth)
+{
+  const uint32_t nodeIndex = collision.bvhNodes.size();
+  collision.bvhNodes.push_back(BvhNode());
+
+  uint32_t* brushes = collision.bvhBrushes.data() + first;
+  auto centroid = [&](uint32_t brushIndex) {
+    const CollisionBrush& brush = collision.brushes[brushIndex];
+    return (brush.minBounds + brush.maxBounds) * 0.5f;
+  };
+
+  vec3 minBounds(FLT_MAX), maxBounds(-FLT_MAX);
+  vec3 minCentroid(FLT_MAX), maxCentroid(-FLT_MAX);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const CollisionBrush& brush = collision.brushes[brushes[i]];
+    minBounds = min(minBounds, brush.minBounds);
+    maxBounds = max(maxBounds, brush.maxBounds);
+    minCentroid = min(minCentroid, centroid(brushes[i]));
+    maxCentroid = max(maxCentroid, centroid(brushes[i]));
+  }
+
+  collision.bvhNodes[nodeIndex].minBounds = minBounds;
+  collision.bvhNodes[nodeIndex].maxBounds = maxBounds;
+
+  // Find the cheapest split in cBvhNrBins bins along each axis
+  float bestCost = FLT_MAX;
+  int bestAxis = -1;
+  uint32_t bestBin = 0;
+
+  for (int axis = 0; (axis < 3) && (count > cBvhMaxLeafBrushes) && (depth < cBvhMaxDepth); axis++)
+  {
+    const float extent = maxCentroid[axis] - minCentroid[axis];
+    if (extent <= 0.f) { continue; }
+
+    uint32_t binCounts[cBvhNrBins] = {};
+    vec3 binMins[cBvhNrBins], binMaxs[cBvhNrBins];
+    std::fill(binMins, binMins + cBvhNrBins, vec3(FLT_MAX));
+    std::fill(binMaxs, binMaxs + cBvhNrBins, vec3(-FLT_MAX));
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      const CollisionBrush& brush = collision.brushes[brushes[i]];
+      uint32_t bin = std::min(cBvhNrBins - 1, uint32_t((centroid(brushes[i])[axis] - minCentroid[axis]) / extent * cBvhNrBins));
+      binCounts[bin]++;
+      binMins[bin] = min(binMins[bin], brush.minBounds);
+      binMaxs[bin] = max(binMaxs[bin], brush.maxBounds);
+    }
+
+    // Cost of the right side of each split, then sweep from the left
+    float rightCosts[cBvhNrBins];
+    vec3 rightMin(FLT_MAX), rightMax(-FLT_MAX);
+    uint32_t rightCount = 0;
+    for (uint32_t bin = cBvhNrBins - 1; bin > 0; bin--)
+    {
+      rightMin = min(rightMin, binMins[bin]);
+      rightMax = max(rightMax, binMaxs[bin]);
+      rightCount += binCounts[bin];
+      rightCosts[bin] = HalfArea(rightMin, rightMax) * rightCount;
+    }
+
+    vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX);
+    uint32_t leftCount = 0;
+    for (uint32_t bin = 1; bin < cBvhNrBins; bin++)
+    {
+      leftMin = min(leftMin, binMins[bin - 1]);
+      leftMax = max(leftMax, binMaxs[bin - 1]);
+      leftCount += binCounts[bin - 1];
+      if ((leftCount == 0) || (leftCount == count)) { continue; }
+
+      float cost = HalfArea(leftMin, leftMax) * leftCount + rightCosts[bin];
+      if (cost < bestCost)
+      {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = bin;
+      }
+    }
+  }
+
+  // Keep the brushes in a leaf if no split is cheaper than testing all of them
+  if ((bestAxis < 0) || ((bestCost >= HalfArea(minBounds, maxBounds) * count) && (count <= 4 * cBvhMaxLeafBrushes)))
+  {
+    collision.bvhNodes[nodeIndex].index = first;
+    collision.bvhNodes[nodeIndex].nrBrushes = count;
+    return nodeIndex;
+  }
+
+  const float extent = maxCentroid[bestAxis] - minCentroid[bestAxis];
+  uint32_t* middle = std::partition(brushes, brushes + count, [&](uint32_t brushIndex) {
+    return std::min(cBvhNrBins - 1, uint32_t((centroid(brushIndex)[bestAxis] - minCentroid[bestAxis]) / extent * cBvhNrBins)) < bestBin;
+  });
+  const uint32_t leftCount = middle - brushes;
+
+  BuildBvhNode(collision, first, leftCount, depth + 1);
+  const uint32_t right = BuildBvhNode(collision, first + leftCount, count - leftCount, depth + 1);
+
+  collision.bvhNodes[nodeIndex].index = right;
+  collision.bvhNodes[nodeIndex].nrBrushes = 0;
+  return nodeIndex;
+}
+
+namespace
+{
+  /// Traced volume, relative to the trace position, and inverse trace direction used by EnterBox()
+  struct BvhRay
+  {
+    BvhRay(const TraceData& data)
+      : start(data.mStart)
+      , dir(data.mEnd - data.mStart)
+      , invDir(1.f / dir)
+      , lowExtends(data.mSweepMinBounds - min(data.mStart, data.mEnd))
+      , highExtends(data.mSweepMaxBounds - max(data.mStart, data.mEnd))
+    {}
+
+    vec3 start;
+    vec3 dir;
+    vec3 invDir; ///< Infinite on the axes the trace doesn't move along
+    vec3 lowExtends;
+    vec3 highExtends;
+  };
+
+  /// Fraction of the trace where the moving volume starts to overlap the box, or a value > 1 if it never does
+  inline float EnterBox(const BvhRay& ray, const vec3& minBounds, const vec3& maxBounds)
+  {
+    float enter = 0.f, leave = 1.f;
+    for (int j = 0; j < 3; j++)
+    {
+      // Box grown by the traced volume, so the volume overlaps the box when the trace position is inside
+      const float lo = minBounds[j] - ray.highExtends[j];
+      const float hi = maxBounds[j] - ray.lowExtends[j];
+
+      if (ray.dir[j] == 0.f)
+      {
+        if ((ray.start[j] < lo) || (ray.start[j] > hi)) { return 2.f; }
+        continue;
+      }
+
+      float t1 = (lo - ray.start[j]) * ray.invDir[j];
+      float t2 = (hi - ray.start[j]) * ray.invDir[j];
+      if (t1 > t2) { std::swap(t1, t2); }
+
+      enter = std::max(enter, t1);
+      leave = std::min(leave, t2);
+      if (enter > leave) { return 2.f; }
+    }
+
+    return enter;
+  }
+
+  /// Distances from the trace position to the planes a traced shape touches, specialized for each trace type
+  template<TraceData::TraceType TType>
+  struct TraceShape
+  {
+    /// Distance from the trace position to the farthest point of the shape along +-normal (for the BSP split planes)
+    static float NodeOffset(const TraceData& data, const vec3& normal) { return data.mRadius; }
+
+    /// Distance in front of a brush side where the shape starts touching it (for the brush sides)
+    static float SideDistance(const TraceData& data, const vec3& normal) { return data.mRadius; }
+  };
+
+  template<>
+  struct TraceShape<TraceData::TracePoint>
+  {
+    static float NodeOffset(const TraceData&, const vec3&) { return 0.f; }
+    static float SideDistance(const TraceData&, const vec3&) { return 0.f; }
+  };
+
+  template<>
+  struct TraceShape<TraceData::TraceBox>
+  {
+    static float NodeOffset(const TraceData& data, const vec3& normal) { return dot(data.mExtends, abs(normal)); }
+
+    static float SideDistance(const TraceData& data, const vec3& normal)
+    {
+      // the box corner closest to the plane
+      vec3 offset;
+      for (int j = 0; j < 3; j++)
+      {
+        offset[j] = (normal[j] < 0.f) ? data.mMaxBounds[j] : data.mMinBounds[j];
+      }
+
+      return -dot(offset, normal);
+    }
+  };
+}
+
+template<TraceData::TraceType TType>
+void Q3Map::TraceCollisionMap(TraceData& data, CheckedBrushes& checked) const
+{
+  const CollisionMap& collision = mCollisionMap;
+
+  // Each node pops its entry and pushes at most its 2 children
+  std::vector<int>& stack = checked.bspStack;
+  if (stack.size() < collision.bspDepth + 1)
+  {
+    stack.resize(collision.bspDepth + 1);
+  }
+
+  uint32_t stackSize = 0;
+  stack[stackSize++] = 0;
+
+  // The brushes are checked in the order of CheckNode(), so the last one entered at the closest fraction is the same
+  bool tied = false;
+
+  while (stackSize > 0)
+  {
+    const int nodeIndex = stack[--stackSize];
+
+    if (nodeIndex < 0)
+    {   // this is a leaf
+      const CollisionLeaf& leaf = collision.leaves[-(nodeIndex + 1)];
+
+      for (uint32_t i = 0; i < leaf.nrBrushes; i++)
+      {
+        uint32_t brushIndex = collision.leafBrushes[leaf.firstBrush + i];
+
+        // avoid checking the same brush more then once
+        uint32_t& brushStamp = checked.stamps[brushIndex];
+        if (brushStamp == checked.stamp) { continue; }
+
+        brushStamp = checked.stamp;
+
+        BrushClip clip;
+        if (CheckCollisionBrush<TType>(brushIndex, data, clip))
+        {
+          ClipToBrush(clip, data, tied);
+        }
+      }
+      continue;
+    }
+
+    const CollisionNode& node = collision.nodes[nodeIndex];
+    const float offset = TraceShape<TType>::NodeOffset(data, node.normal);
+
+    const float startDistance = dot(data.mStart, node.normal) - node.distance;
+    const float endDistance = dot(data.mEnd, node.normal) - node.distance;
+
+    if (startDistance >= offset && endDistance >= offset)
+    {   // both points are in front of the plane
+      stack[stackSize++] = node.children[0];
+    }
+    else if (startDistance < -offset && endDistance < -offset)
+    {   // both points are behind the plane
+      stack[stackSize++] = node.children[1];
+    }
+    else
+    {   // the line spans the splitting plane, push the side of the start point last so it's visited first
+      const int side = (startDistance < endDistance ? 1 : 0);
+      stack[stackSize++] = node.children[!side];
+      stack[stackSize++] = node.children[side];
+    }
+    assert(stackSize <= collision.bspDepth + 1);
+  }
+}
+
+template<TraceData::TraceType TType>
+bool Q3Map::IsBrushReached(uint32_t brushIndex, const TraceData& data) const
+{
+  const CollisionMap& collision = mCollisionMap;
+
+  for (uint32_t i = collision.brushFirstLeaves[brushIndex]; i < collision.brushFirstLeaves[brushIndex + 1]; i++)
+  {
+    // Go up to the root while CheckNode() visits the child on the path
+    int32_t parent = collision.leafParents[collision.brushLeaves[i]];
+    while (parent >= 0)
+    {
+      const CollisionNode& node = collision.nodes[parent / 2];
+      const float offset = TraceShape<TType>::NodeOffset(data, node.normal);
+
+      const float startDistance = dot(data.mStart, node.normal) - node.distance;
+      const float endDistance = dot(data.mEnd, node.normal) - node.distance;
+
+      const bool skipped = (parent % 2 == 0)
+        ? (startDistance < -offset && endDistance < -offset) // the front child, unless both points are behind the plane
+        : (startDistance >= offset && endDistance >= offset); // the back child, unless both points are in front of it
+      if (skipped) { break; }
+
+      parent = collision.nodeParents[parent / 2];
+    }
+
+    if (parent == cBspRoot)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+template<TraceData::TraceType TType>
+void Q3Map::TraceBvh(TraceData& data) const
+{
+  const CollisionMap& collision = mCollisionMap;
+
+  // The BVH finds more brushes than CheckNode() reaches (the BSP doesn't list a brush in the leaves that only 
+  // touch it within the entry epsilon), so the brushes which change the trace must be reached by CheckNode() too.
+  // Only the traces starting inside a brush or hitting one need the check.
+  bool tied = false;
+  auto checkBrush = [&](uint32_t brushIndex) {
+    BrushClip clip;
+    if (CheckCollisionBrush<TType>(brushIndex, data, clip) && ClipChangesTrace(clip, data) && IsBrushReached<TType>(brushIndex, data))
+    {
+      ClipToBrush(clip, data, tied);
+    }
+  };
+
+  for (uint32_t brushIndex : collision.unboundedBrushes)
+  {
+    checkBrush(brushIndex);
+  }
+
+  if (!collision.bvhNodes.empty())
+  {
+    const BvhRay ray(data);
+
+    // Nodes left to visit, with the fraction where the trace enters them.
+    // Each brush is in one leaf, so no brush is checked twice.
+    struct StackEntry
+    {
+      uint32_t node;
+      float enter;
+    };
+    StackEntry stack[cBvhMaxDepth + 2];
+    uint32_t stackSize = 0;
+
+    float rootEnter = EnterBox(ray, collision.bvhNodes[0].minBounds, collision.bvhNodes[0].maxBounds);
+    if (rootEnter <= 1.f)
+    {
+      stack[stackSize++] = { 0, rootEnter };
+    }
+
+    while (stackSize > 0)
+    {
+      const StackEntry entry = stack[--stackSize];
+
+      // The brushes of the node can't be entered before the closest collision found so far.
+      // Their bounds margin is larger than the entry epsilon, so the comparison is conservative,
+      // and the brushes entered at the same fraction are still checked.
+      if (entry.enter > data.mFraction) { continue; }
+
+      const BvhNode& node = collision.bvhNodes[entry.node];
+      if (node.nrBrushes > 0)
+      {
+        for (uint32_t i = 0; i < node.nrBrushes; i++)
+        {
+          checkBrush(collision.bvhBrushes[node.index + i]);
+        }
+        continue;
+      }
+
+      // Visit the closest child first, so the other one is more likely to be skipped
+      const uint32_t left = entry.node + 1, right = node.index;
+      const float leftEnter = EnterBox(ray, collision.bvhNodes[left].minBounds, collision.bvhNodes[left].maxBounds);
+      const float rightEnter = EnterBox(ray, collision.bvhNodes[right].minBounds, collision.bvhNodes[right].maxBounds);
+
+      const bool leftFirst = leftEnter <= rightEnter;
+      const StackEntry first = { leftFirst ? left : right, leftFirst ? leftEnter : rightEnter };
+      const StackEntry second = { leftFirst ? right : left, leftFirst ? rightEnter : leftEnter };
+
+      if (second.enter <= 1.f) { stack[stackSize++] = second; }
+      if (first.enter <= 1.f) { stack[stackSize++] = first; }
+      assert(stackSize <= cBvhMaxDepth + 2);
+    }
+  }
+
+  if (tied)
+  {
+    // The winner depends on the order of the brushes, walk the BSP in the order of CheckNode() instead
+    ResetTraceOutput(data);
+    TraceCollisionMap<TType>(data, BeginCheckedBrushes(mMap.mBrushes.size()));
+  }
+}
+
+template<TraceData::TraceType TType>
+bool Q3Map::CheckCollisionBrush(int brushIndex, const TraceData& data, BrushClip& clip) const
+{
+  const CollisionBrush& brush = mCollisionMap.brushes[brushIndex];
+
+  // Same tests as CheckBrush(), after rejecting the brushes away from the swept volume
+  if (any(lessThan(data.mSweepMaxBounds, brush.minBounds)) || any(greaterThan(data.mSweepMinBounds, brush.maxBounds)))
+  {
+    return false;
+  }
+
+  const float* normalsX = &mCollisionMap.sideNormalsX[brush.firstSide];
+  const float* normalsY = &mCollisionMap.sideNormalsY[brush.firstSide];
+  const float* normalsZ = &mCollisionMap.sideNormalsZ[brush.firstSide];
+  const float* distances = &mCollisionMap.sideDistances[brush.firstSide];
+
+  float enterFraction = -1.f, leaveFraction = 1.f;
+  int32_t startPlaneIndex = -1;
+  bool startsOut = false, endsOut = false;
+
+  for (uint32_t i = 0; i < brush.nrSides; i++)
+  {
+    vec3 planeNormal(normalsX[i], normalsY[i], normalsZ[i]);
+
+    const float dist = TraceShape<TType>::SideDistance(data, planeNormal);
+
+    float startDistance = dot(data.mStart, planeNormal) - (distances[i] + dist);
+    float endDistance = dot(data.mEnd, planeNormal) - (distances[i] + dist);
+
+    if (startDistance > 0.f) { startsOut = true; }
+    if (endDistance > 0.f) { endsOut = true; }
+
+    // make sure the trace isn't completely on one side of the brush
+    if (startDistance > 0.f && endDistance >= startDistance)
+    {   // if completely in front of face, no intersection
+      return false;
+    }
+    if (startDistance <= 0.f && endDistance <= 0.f)
+    {   // both are behind this plane, it will get clipped by another one
+      continue;
+    }
+
+    // crosses face
+    if (startDistance > endDistance)
+    {   // line is entering into the brush
+      float fraction = (startDistance - 0.0001f) / (startDistance - endDistance);
+      if (fraction > enterFraction)
+      {
+        enterFraction = fraction;
+        startPlaneIndex = mCollisionMap.sidePlanes[brush.firstSide + i];
+      }
+    }
+    else
+    {   // line is leaving the brush
+      float fraction = (startDistance + 0.0001f) / (startDistance - endDistance);
+      if (fraction < leaveFraction)
+      {
+        leaveFraction = fraction;
+      }
+    }
+  }
+
+  clip.enterFraction = enterFraction;
+  clip.leaveFraction = leaveFraction;
+  clip.startPlaneIndex = startPlaneIndex;
+  clip.contents = brush.contents;
+  clip.startsOut = startsOut;
+  clip.endsOut = endsOut;
+  return true;
+}
+
+const uint32_t Q3Map::cTracePacketSize;
+
+#ifdef Q3MAP_TRACE_SSE
+
+struct Q3Map::TracePacket
+{
+  /// Copy the input data of nrLanes traces. The unused lanes repeat the last trace.
+  void Init(TraceData* pTraces, uint32_t nrLanes)
+  {
+    for (uint32_t l = 0; l < cTracePacketSize; l++)
+    {
+      TraceData& data = pTraces[std::min(l, nrLanes - 1)];
+      traces[l] = &data;
+
+      // Spheres and points have no bounds, and boxes no radius, so all the types use the same formulas
+      const bool box = (data.mTraceType == TraceData::TraceBox);
+      for (int j = 0; j < 3; j++)
+      {
+        start[j][l] = data.mStart[j];
+        end[j][l] = data.mEnd[j];
+        minBounds[j][l] = box ? data.mMinBounds[j] : 0.f;
+        maxBounds[j][l] = box ? data.mMaxBounds[j] : 0.f;
+        extends[j][l] = box ? data.mExtends[j] : 0.f;
+        sweepMinBounds[j][l] = data.mSweepMinBounds[j];
+        sweepMaxBounds[j][l] = data.mSweepMaxBounds[j];
+      }
+      radius[l] = data.mRadius;
+      tied[l] = false;
+    }
+  }
+
+  TraceData* traces[cTracePacketSize];
+  bool tied[cTracePacketSize]; ///< See ClipToBrush(), the lanes visit the brushes in another order than Trace()
+
+  alignas(16) float start[3][cTracePacketSize]; ///< Start position of each lane, for each axis
+  alignas(16) float end[3][cTracePacketSize];
+  alignas(16) float minBounds[3][cTracePacketSize];
+  alignas(16) float maxBounds[3][cTracePacketSize];
+  alignas(16) float extends[3][cTracePacketSize];
+  alignas(16) float radius[cTracePacketSize];
+  alignas(16) float sweepMinBounds[3][cTracePacketSize];
+  alignas(16) float sweepMaxBounds[3][cTracePacketSize];
+};
+
+static_assert(Q3Map::cTracePacketSize == 4, "The packet functions use 4 wide SSE vectors");
+
+namespace
+{
+  /// a.x * b.x + a.y * b.y + a.z * b.z for 4 lanes of a, in the same order as glm::dot()
+  inline __m128 Dot4(const float (&a)[3][4], __m128 bx, __m128 by, __m128 bz)
+  {
+    __m128 xy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(a[0]), bx), _mm_mul_ps(_mm_load_ps(a[1]), by));
+    return _mm_add_ps(xy, _mm_mul_ps(_mm_load_ps(a[2]), bz));
+  }
+
+  inline __m128 Select4(__m128 mask, __m128 a, __m128 b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+}
+
+void Q3Map::CheckNodePacket(int nodeIndex, TracePacket& packet, uint32_t lanes, CheckedBrushes& checked) const
+{
+  if (nodeIndex < 0)
+  {   // this is a leaf
+    CheckLeafPacket(-(nodeIndex + 1), packet, lanes, checked);
+    return;
+  }
+
+  const CollisionNode& node = mCollisionMap.nodes[nodeIndex];
+
+  const __m128 nx = _mm_set1_ps(node.normal.x);
+  const __m128 ny = _mm_set1_ps(node.normal.y);
+  const __m128 nz = _mm_set1_ps(node.normal.z);
+  const __m128 distance = _mm_set1_ps(node.distance);
+
+  // offset = radius + dot(extends, abs(normal)), one of the terms is 0
+  const __m128 offset = _mm_add_ps(_mm_load_ps(packet.radius), Dot4(packet.extends,
+    _mm_set1_ps(std::abs(node.normal.x)), _mm_set1_ps(std::abs(node.normal.y)), _mm_set1_ps(std::abs(node.normal.z))));
+  const __m128 minusOffset = _mm_sub_ps(_mm_setzero_ps(), offset);
+
+  const __m128 startDistance = _mm_sub_ps(Dot4(packet.start, nx, ny, nz), distance);
+  const __m128 endDistance = _mm_sub_ps(Dot4(packet.end, nx, ny, nz), distance);
+
+  const uint32_t front = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(startDistance, offset), _mm_cmpge_ps(endDistance, offset)));
+  const uint32_t back = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(startDistance, minusOffset), _mm_cmplt_ps(endDistance, minusOffset)));
+
+  // The traces spanning the splitting plane check both children, so each lane reaches the same leaves as in CheckNode()
+  const uint32_t frontLanes = lanes & ~back;
+  const uint32_t backLanes = lanes & ~front;
+
+  if (frontLanes != 0)
+  {
+    CheckNodePacket(node.children[0], packet, frontLanes, checked);
+  }
+
+  if (backLanes != 0)
+  {
+    CheckNodePacket(node.children[1], packet, backLanes, checked);
+  }
+}
+
+void Q3Map::CheckLeafPacket(int leafIndex, TracePacket& packet, uint32_t lanes, CheckedBrushes& checked) const
+{
+  const CollisionLeaf& leaf = mCollisionMap.leaves[leafIndex];
+
+  for (uint32_t i = 0; i < leaf.nrBrushes; i++)
+  {
+    uint32_t brushIndex = mCollisionMap.leafBrushes[leaf.firstBrush + i];
+
+    // avoid checking the same brush more then once for each trace
+    uint32_t& brushStamp = checked.stamps[brushIndex];
+    uint8_t& brushLanes = checked.lanes[brushIndex];
+    if (brushStamp != checked.stamp)
+    {
+      brushStamp = checked.stamp;
+      brushLanes = 0;
+    }
+
+    const uint32_t newLanes = lanes & ~brushLanes;
+    if (newLanes == 0) { continue; }
+
+    brushLanes |= newLanes;
+
+    CheckBrushPacket(brushIndex, packet, newLanes);
+  }
+}
+
+void Q3Map::CheckBrushPacket(int brushIndex, TracePacket& packet, uint32_t lanes) const
+{
+  const CollisionBrush& brush = mCollisionMap.brushes[brushIndex];
+
+  // reject the traces whose swept volume is away from the brush bounds
+  __m128 outside = _mm_setzero_ps();
+  for (int j = 0; j < 3; j++)
+  {
+    outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_load_ps(packet.sweepMaxBounds[j]), _mm_set1_ps(brush.minBounds[j])));
+    outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_load_ps(packet.sweepMinBounds[j]), _mm_set1_ps(brush.maxBounds[j])));
+  }
+
+  lanes &= ~_mm_movemask_ps(outside);
+  if (lanes == 0)
+  {
+    return;
+  }
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 epsilon = _mm_set1_ps(0.0001f);
+  const __m128 radius = _mm_load_ps(packet.radius);
+
+  __m128 enterFraction = _mm_set1_ps(-1.f), leaveFraction = _mm_set1_ps(1.f);
+  int32_t startPlaneIndex[cTracePacketSize] = { -1, -1, -1, -1 };
+  uint32_t startsOut = 0, endsOut = 0;
+
+  for (uint32_t i = brush.firstSide; i < brush.firstSide + brush.nrSides; i++)
+  {
+    const vec3 planeNormal(mCollisionMap.sideNormalsX[i], mCollisionMap.sideNormalsY[i], mCollisionMap.sideNormalsZ[i]);
+
+    const __m128 nx = _mm_set1_ps(planeNormal.x);
+    const __m128 ny = _mm_set1_ps(planeNormal.y);
+    const __m128 nz = _mm_set1_ps(planeNormal.z);
+
+    // dist = radius - dot(offset, planeNormal), the offset is the box corner behind the plane
+    const __m128 offsetX = _mm_load_ps(planeNormal.x < 0.f ? packet.maxBounds[0] : packet.minBounds[0]);
+    const __m128 offsetY = _mm_load_ps(planeNormal.y < 0.f ? packet.maxBounds[1] : packet.minBounds[1]);
+    const __m128 offsetZ = _mm_load_ps(planeNormal.z < 0.f ? packet.maxBounds[2] : packet.minBounds[2]);
+    const __m128 offsetDot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, nx), _mm_mul_ps(offsetY, ny)), _mm_mul_ps(offsetZ, nz));
+    const __m128 distance = _mm_add_ps(_mm_set1_ps(mCollisionMap.sideDistances[i]), _mm_sub_ps(radius, offsetDot));
+
+    const __m128 startDistance = _mm_sub_ps(Dot4(packet.start, nx, ny, nz), distance);
+    const __m128 endDistance = _mm_sub_ps(Dot4(packet.end, nx, ny, nz), distance);
+
+    const __m128 startOut = _mm_cmpgt_ps(startDistance, zero);
+    startsOut |= _mm_movemask_ps(startOut);
+    endsOut |= _mm_movemask_ps(_mm_cmpgt_ps(endDistance, zero));
+
+    // the traces completely in front of a face don't intersect the brush
+    lanes &= ~_mm_movemask_ps(_mm_and_ps(startOut, _mm_cmpge_ps(endDistance, startDistance)));
+    if (lanes == 0)
+    {
+      return;
+    }
+
+    // the traces crossing the face (the ones behind it get clipped by another face)
+    const uint32_t crossing = lanes & ~_mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(startDistance, zero), _mm_cmple_ps(endDistance, zero)));
+    if (crossing == 0)
+    {
+      continue;
+    }
+
+    const __m128 entering = _mm_cmpgt_ps(startDistance, endDistance);
+    const __m128 delta = _mm_sub_ps(startDistance, endDistance);
+
+    // the traces entering into the brush
+    const __m128 enter = _mm_div_ps(_mm_sub_ps(startDistance, epsilon), delta);
+    const uint32_t enterLanes = crossing & _mm_movemask_ps(_mm_and_ps(entering, _mm_cmpgt_ps(enter, enterFraction)));
+    if (enterLanes != 0)
+    {
+      const __m128 enterMask = _mm_castsi128_ps(_mm_set_epi32(
+        (enterLanes & 8) ? -1 : 0, (enterLanes & 4) ? -1 : 0, (enterLanes & 2) ? -1 : 0, (enterLanes & 1) ? -1 : 0));
+      enterFraction = Select4(enterMask, enter, enterFraction);
+
+      for (uint32_t l = 0; l < cTracePacketSize; l++)
+      {
+        if (enterLanes & (1u << l)) { startPlaneIndex[l] = mCollisionMap.sidePlanes[i]; }
+      }
+    }
+
+    // the traces leaving the brush
+    const __m128 leave = _mm_div_ps(_mm_add_ps(startDistance, epsilon), delta);
+    const uint32_t leaveLanes = crossing & ~_mm_movemask_ps(entering) & _mm_movemask_ps(_mm_cmplt_ps(leave, leaveFraction));
+    if (leaveLanes != 0)
+    {
+      const __m128 leaveMask = _mm_castsi128_ps(_mm_set_epi32(
+        (leaveLanes & 8) ? -1 : 0, (leaveLanes & 4) ? -1 : 0, (leaveLanes & 2) ? -1 : 0, (leaveLanes & 1) ? -1 : 0));
+      leaveFraction = Select4(leaveMask, leave, leaveFraction);
+    }
+  }
+
+  alignas(16) float enterFractions[cTracePacketSize], leaveFractions[cTracePacketSize];
+  _mm_store_ps(enterFractions, enterFraction);
+  _mm_store_ps(leaveFractions, leaveFraction);
+
+  for (uint32_t l = 0; l < cTracePacketSize; l++)
+  {
+    if (lanes & (1u << l))
+    {
+      const uint32_t bit = 1u << l;
+      const BrushClip clip = { enterFractions[l], leaveFractions[l], startPlaneIndex[l], brush.contents,
+        (startsOut & bit) != 0, (endsOut & bit) != 0 };
+      ClipToBrush(clip, *packet.traces[l], packet.tied[l]);
+    }
+  }
+}
+
+#endif // Q3MAP_TRACE_SSE
+
+void Q3Map::TraceBatch(TraceData* traces, uint32_t nrTraces) const
+{
+  PROFILER_ZONE("Q3Map::TraceBatch");
+
+#ifdef Q3MAP_TRACE_SSE
+  if (mTraceBackend != ETraceBackendMapData)
+  {
+    TracePacket packet;
+
+    for (uint32_t first = 0; first < nrTraces; first += cTracePacketSize)
+    {
+      const uint32_t nrLanes = std::min(cTracePacketSize, nrTraces - first);
+      packet.Init(traces + first, nrLanes);
+
+      CheckNodePacket(0, packet, (1u << nrLanes) - 1, BeginCheckedBrushes(mMap.mBrushes.size()));
+
+      for (uint32_t l = 0; l < nrLanes; l++)
+      {
+        TraceData& data = traces[first + l];
+        if (packet.tied[l])
+        {
+          // The winner depends on the order of the brushes, trace it alone in the order of CheckNode()
+          ResetTraceOutput(data);
+          Trace(data);
+        }
+        else if (data.mCollision)
+        {
+          vec3 innerBrushVec = (data.mEnd - data.mStart) * (1.f - data.mFraction);
+          const TPlane& plane = mMap.mPlanes[data.mPlaneIndex];
+          data.mPlaneProj = proj(make_vec3(plane.mNormal), innerBrushVec);
+        }
+      }
+    }
+    return;
+  }
+#endif
+
+  for (uint32_t i = 0; i < nrTraces; i++)
+  {
+    Trace(traces[i]);
+  }
+}
@@ -0,0 +1,335 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// The parts of Q3Map that call SDL_image and OpenGL. The targets without a renderer link tools/no_renderer.cpp instead.
+
+#include "Q3Map.hpp"
+#include "resources.hpp"
+#include "shader_defines.h"
+#include "shader_utils.hpp"
+#include "binary_stream.hpp"
+#include "virtual_file_system.hpp"
+#include "job_system.hpp"
+
+#include <iostream>
+
+#include <SDL_image.h>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace shooter;
+using namespace ShaderUtils;
+using namespace glm;
+using namespace std;
+
+namespace 
+{
+  /// Decode a texture of the map into CPU memory
+  /// @param outSourceKey hash of the path and of the data of the decoded file, 0 if it isn't found
+  /// @return decoded surface or nullptr if error
+  SDL_Surface* DecodeTexture(const TTexture& texture, const VirtualFileSystem& fileSystem, uint64_t& outSourceKey)
+  {
+    outSourceKey = 0;
+
+    static const vector<string> cExtensions = { ".jpg", ".tga", ".png" };
+
+    string texPath;
+    const char* pExt = NULL;
+    for (const string& ext : cExtensions)
+    {
+      if (fileSystem.Exists(texture.mName + ext))
+      {
+        texPath = texture.mName + ext;
+        pExt = ext.c_str() + 1;
+        break;
+      }
+    }
+
+    if (pExt == NULL)
+    {
+      if (!fileSystem.Exists("transparent.png"))
+      {
+        std::cout << "Couldn't Find " << texture.mName << std::endl;
+        return nullptr;
+      }
+
+      texPath = "transparent.png";
+      pExt = cExtensions[2].c_str() + 1;
+    }
+
+    // Decoded straight from the archive's memory
+    SDL_Surface* surface = nullptr;
+    FileView file;
+    if (fileSystem.Open(texPath, file))
+    {
+      // The same path can be found in another mount, or change in a mounted directory
+      outSourceKey = HashWords(file.GetData(), file.GetSize(), HashWords(texPath.data(), texPath.size()));
+      surface = IMG_LoadTyped_RW(SDL_RWFromConstMem(file.GetData(), int(file.GetSize())), 1, pExt);
+    }
+    if (surface == nullptr)
+    {
+      std::cout << "Couldn't Load " << texture.mName << std::endl;
+    }
+
+    return surface;
+  }
+}
+
+std::vector<SDL_Surface*> Q3Map::DecodeTextures(
+  const std::vector<TTexture>& textures,
+  const VirtualFileSystem& fileSystem,
+  JobSystem* jobs,
+  uint64_t& outSourcesKey)
+{
+  std::vector<SDL_Surface*> surfaces(textures.size(), nullptr);
+  std::vector<uint64_t> sourceKeys(textures.size(), 0);
+
+  // The image libraries are loaded on their first use, which isn't thread safe
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  // The decoding times vary a lot, so each texture is a job
+  auto decode = [&](uint32_t texIx) { surfaces[texIx] = DecodeTexture(textures[texIx], fileSystem, sourceKeys[texIx]); };
+  if (jobs != nullptr)
+  {
+    jobs->ParallelFor(0, uint32_t(textures.size()), 1, decode);
+  }
+  else
+  {
+    for (uint32_t texIx = 0; texIx < textures.size(); texIx++)
+    {
+      decode(texIx);
+    }
+  }
+
+  outSourcesKey = HashWords(sourceKeys.data(), sourceKeys.size() * sizeof(uint64_t));
+  return surfaces;
+}
+
+void Q3Map::ReleaseGL()
+{
+  for (SDL_Surface* surface : mTexturesSurfaces) { SDL_FreeSurface(surface); }
+
+  // Nothing was uploaded to the GPU (headless mode)
+  if (mVao == 0) { return; }
+
+  glDeleteVertexArrays(1, &mVao);
+  glDeleteBuffers(mBufferObjects.size(), mBufferObjects.data());
+  glDeleteTextures(mTextures.size(), mTextures.data());
+  glDeleteTextures(mLightMaps.size(), mLightMaps.data());
+}
+
+void Q3Map::InitGL(const Resources& resources)
+{
+  if (mVao != 0) { return; }
+
+  mSimpleProgram = resources.GetProgramId("simple");
+  mFlameProgram = resources.GetProgramId("flame");
+  mSwirlProgram = resources.GetProgramId("swirl");
+
+  // Load textures (LoadTexture frees the surfaces)
+  mTextures.assign(mMap.mTextures.size(), 0);
+  for (uint32_t texIx = 0; texIx < mTexturesSurfaces.size(); texIx++)
+  {
+    mTextures[texIx] = LoadTexture(mTexturesSurfaces[texIx]);
+  }
+  mTexturesSurfaces.clear();
+
+  // Load lightmaps
+  mLightMaps.reserve(mMap.mLightMaps.size());
+  for (const TLightMap& lightMap : mMap.mLightMaps) 
+  {
+    mLightMaps.push_back(LoadTexture((const void *)lightMap.mMapData, 128));
+  }
+
+  // Init OpenGL buffers
+  InitBuffers(); 
+}
+
+void Q3Map::InitBuffers() 
+{
+  GLuint buffer = 0;
+
+  // Generate Vertex Array Object
+  glGenVertexArrays(1, &mVao);
+  glBindVertexArray(mVao);
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(TMeshVert) * mMap.mMeshVertices.size(), mMap.mMeshVertices.data(), GL_STATIC_DRAW);
+  mBufferObjects.push_back(buffer);
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(TVertex) * mMap.mVertices.size(), mMap.mVertices.data(), GL_STATIC_DRAW);
+  mBufferObjects.push_back(buffer);
+
+  glEnableVertexAttribArray(VERT_POSITION_LOC);
+  glVertexAttribPointer(VERT_POSITION_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(TVertex), 0);
+
+  glEnableVertexAttribArray(VERT_DIFFUSE_TEX_COORD_LOC);
+  glVertexAttribPointer(VERT_DIFFUSE_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)12);
+
+  glEnableVertexAttribArray(VERT_LIGHTMAP_TEX_COORD_LOC);
+  glVertexAttribPointer(VERT_LIGHTMAP_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)20);
+
+  glEnableVertexAttribArray(VERT_NORMAL_LOC);
+  glVertexAttribPointer(VERT_NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(TVertex), (void *)28);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+}
+
+void Q3Map::Render(
+  const Resources& resources, 
+  const mat4& viewMat, 
+  const mat4& projMat, 
+  const vec3& camPos,
+  uint32 matUniformBuffer) const
+{
+  VisibleFacesByType faces = FindVisibleFaces(camPos, projMat * viewMat);
+  if (faces.empty())
+  {
+    return;
+  }
+
+  // Set the tesselation inner and outer levels for the patches
+  vec4 tessOuterLvl(10.0f);
+  vec2 tessInnerLvl(10.0f);
+  glPatchParameterfv(GL_PATCH_DEFAULT_OUTER_LEVEL, value_ptr(tessOuterLvl));
+  glPatchParameterfv(GL_PATCH_DEFAULT_INNER_LEVEL, value_ptr(tessInnerLvl));
+  glPatchParameteri(GL_PATCH_VERTICES, 9);
+
+  // Enable blending
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  glPointSize(5.0f);
+  glLineWidth(5.f);
+  glActiveTexture(GL_TEXTURE0 + DIFFUSE_TEX_UNIT);
+  glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEX_UNIT);
+  glUseProgram(resources.GetProgram(mSimpleProgram));
+
+  glBindVertexArray(mVao);
+
+  for (auto pair : faces[EFaceTypeBsp1]) 
+  {
+    RenderFace(pair.first);
+  }
+
+  for (auto pair : faces[EFaceTypeBsp3]) 
+  {
+    RenderFace(pair.first);
+  }
+  
+  for (auto pair : faces[EFaceTypeBsp2]) 
+  {
+    RenderFace(pair.first);
+  }
+  
+  glDisable(GL_CULL_FACE);
+
+  glUseProgram(resources.GetProgram(mFlameProgram));
+
+  float time = SDL_GetTicks() * 0.001f;
+  
+  glUniform3fv(CAMERA_POS_LOC, 1, value_ptr(camPos));
+  glUniform3fv(BILLBOARD_ROTATION_AXIS, 1, value_ptr(vec3(0.f, 1.f, 0.f)));
+  glUniform1i(BILLBOARD_IN_WORLD_SPACE, GL_TRUE);
+
+  for (auto pair : faces[EFaceTypeFlame]) 
+  {
+    const TFace& face = mMap.mFaces[pair.first];
+
+    vec3 p1 = make_vec3(mMap.mVertices[face.mVertex + 1].mPosition);
+    vec3 p2 = make_vec3(mMap.mVertices[face.mVertex + 2].mPosition);
+    vec3 c = p1 + (p2 - p1) * 0.5f;
+
+    glUniform1f(GLOBAL_TIME_LOC, time + 0.3345f * pair.first);
+    glUniform3fv(BILLBOARD_ORIGIN_LOC, 1, value_ptr(c));
+
+    RenderFace(pair.first);
+  }
+
+  glUseProgram(resources.GetProgram(mSwirlProgram));
+
+  for (auto pair : faces[EFaceTypeSwirl]) 
+  {
+    const TFace& face = mMap.mFaces[pair.first];
+
+    glUniform1f(GLOBAL_TIME_LOC, time + 0.3345f * pair.first);
+
+    RenderFace(pair.first);
+  }
+
+  glUseProgram(resources.GetProgram(mSimpleProgram));
+  glBindVertexArray(mVao);
+
+  for (auto pair : faces[EFaceTypeTransparent]) 
+  {
+    RenderFace(pair.first);
+  }
+
+  glDisable(GL_CULL_FACE);
+}
+
+void Q3Map::RenderFace(uint32_t faceIndex) const 
+{
+  const TFace& face = mMap.mFaces[faceIndex];
+
+  static int32_t lastDiffuseTex = -1;
+  if (face.mTextureIndex != lastDiffuseTex) 
+  {
+    glActiveTexture(GL_TEXTURE0 + DIFFUSE_TEX_UNIT);
+    if (face.mTextureIndex >= 0) 
+    {
+      glBindTexture(GL_TEXTURE_2D, mTextures[face.mTextureIndex]);
+    } 
+    else 
+    {
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    lastDiffuseTex = face.mTextureIndex;
+  }
+
+  static int32_t lastLightmapTex = -1;
+  if (face.mLightmapIndex != lastLightmapTex) 
+  {
+    glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEX_UNIT);
+    if (face.mLightmapIndex >= 0) 
+    {
+      glBindTexture(GL_TEXTURE_2D, mLightMaps[face.mLightmapIndex]);
+    } 
+    else 
+    {
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    lastLightmapTex = face.mLightmapIndex;
+  }
+
+  if (face.mType == 1 || face.mType == 3 || face.mType == 2) 
+  {
+    glDrawElementsBaseVertex(
+      GL_TRIANGLES,
+      face.mNbMeshVertices,
+      GL_UNSIGNED_INT,
+      (void *)(face.mMeshVertex * sizeof(uint32_t)),
+      face.mVertex);
+  }
+  /*else if (face.mType == 2) 
+  {
+    glDrawElementsBaseVertex(
+      GL_PATCHES,
+      face.mNbMeshVertices,
+      GL_UNSIGNED_INT,
+      (void *)(face.mMeshVertex * sizeof(uint32_t)),
+      face.mVertex);
+  }*/
+}
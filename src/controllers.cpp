@@ -15,6 +15,8 @@
 #include "Q3Map.hpp"
 #include "sys_animation.hpp"
 #include "resources.hpp"
+#include "profiler.hpp"
+#include "constants.hpp"
 
 #include <iostream>
 
@@ -54,6 +56,21 @@ void PlayerController::HandleEvent(
         scene.multithreading = !scene.multithreading;
         break;
 
+      case SDLK_F3:
+        Profiler::SetCapturing(!Profiler::IsCapturing());
+        break;
+
+      case SDLK_F4:
+        if (Profiler::WriteChromeTrace("profiler_trace.json", cProfilerTraceFrames))
+        {
+          cout << "Profiler trace written to profiler_trace.json" << endl;
+        }
+        break;
+
+      case SDLK_F5:
+        scene.doubleBuffering = !scene.doubleBuffering;
+        break;
+
       case SDLK_SPACE:
         if ((st.state & EStateOffGround) == 0)
         {
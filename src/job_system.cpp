@@ -0,0 +1,317 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#include <cassert>
+
+using namespace shooter;
+
+namespace {
+
+  /// The JobSystem and the worker index of the current thread
+  thread_local const void* tJobSystem = nullptr;
+  thread_local uint32_t tWorkerIx = 0;
+
+  /// Spins before a worker goes to sleep
+  const uint32_t cIdleSpins = 64;
+
+  inline int64_t NowNs()
+  {
+    return Profiler::Now();
+  }
+
+}
+
+bool JobSystem::JobDeque::Push(Job* job)
+{
+  int64_t b = mBottom.load(std::memory_order_relaxed);
+  int64_t t = mTop.load(std::memory_order_acquire);
+  if (b - t >= cCapacity)
+  {
+    return false;
+  }
+
+  mJobs[b & (cCapacity - 1)].store(job, std::memory_order_relaxed);
+  mBottom.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+JobSystem::Job* JobSystem::JobDeque::Pop()
+{
+  int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+  mBottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = mTop.load(std::memory_order_relaxed);
+
+  if (t > b)
+  {
+    // empty
+    mBottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job* job = mJobs[b & (cCapacity - 1)].load(std::memory_order_relaxed);
+  if (t == b)
+  {
+    // last job, race against the thieves
+    if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+      job = nullptr;
+    }
+    mBottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  return job;
+}
+
+JobSystem::Job* JobSystem::JobDeque::Steal()
+{
+  int64_t t = mTop.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = mBottom.load(std::memory_order_acquire);
+
+  if (t >= b)
+  {
+    return nullptr;
+  }
+
+  Job* job = mJobs[t & (cCapacity - 1)].load(std::memory_order_relaxed);
+  if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+  {
+    // lost the race against another thief or the owner
+    return nullptr;
+  }
+
+  return job;
+}
+
+JobSystem::JobSystem(uint32_t nrWorkers)
+  : mNrThreads(nrWorkers + 1)
+  , mWorkers(new Worker[nrWorkers + 1])
+  , mNrQueuedJobs(0)
+  , mNrSleeping(0)
+  , mStop(false)
+{
+  tJobSystem = this;
+  tWorkerIx = 0;
+
+  mThreads.reserve(nrWorkers);
+  for (uint32_t i = 1; i < mNrThreads; i++)
+  {
+    mThreads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mStop = true;
+  }
+  mSleepCond.notify_all();
+
+  for (auto& thread : mThreads)
+  {
+    thread.join();
+  }
+
+  if (tJobSystem == this)
+  {
+    tJobSystem = nullptr;
+  }
+}
+
+void JobSystem::Push(JobFunc func, const void* data, uint32_t begin, uint32_t end, std::atomic<uint32_t>& counter)
+{
+  counter.fetch_add(1, std::memory_order_relaxed);
+
+  if (tJobSystem != this)
+  {
+    // not one of our threads
+    func(data, begin, end);
+    counter.fetch_sub(1, std::memory_order_release);
+    return;
+  }
+
+  Worker& worker = mWorkers[tWorkerIx];
+  Job* job = &worker.jobs[worker.nrAllocatedJobs & (Worker::cMaxJobs - 1)];
+  if (job->inUse.load(std::memory_order_acquire))
+  {
+    // the ring buffer is full of jobs not started yet
+    func(data, begin, end);
+    counter.fetch_sub(1, std::memory_order_release);
+    return;
+  }
+
+  worker.nrAllocatedJobs++;
+  job->inUse.store(true, std::memory_order_relaxed);
+  job->func = func;
+  job->data = data;
+  job->begin = begin;
+  job->end = end;
+  job->counter = &counter;
+  job->pushTime = NowNs();
+
+  if (!worker.deque.Push(job))
+  {
+    // the deque is full
+    Execute(tWorkerIx, job);
+    return;
+  }
+
+  mNrQueuedJobs.fetch_add(1);
+  WakeWorkers();
+}
+
+void JobSystem::Wait(const std::atomic<uint32_t>& counter)
+{
+  if (tJobSystem != this)
+  {
+    // the jobs already ran in Push()
+    assert(counter.load() == 0);
+    return;
+  }
+
+  const uint32_t workerIx = tWorkerIx;
+  while (counter.load(std::memory_order_acquire) > 0)
+  {
+    if (Job* job = GetJob(workerIx))
+    {
+      Execute(workerIx, job);
+    }
+    else
+    {
+      // the remaining jobs are running on other threads
+      std::this_thread::yield();
+    }
+  }
+}
+
+std::vector<JobStats> JobSystem::GetStats() const
+{
+  std::vector<JobStats> stats(mNrThreads);
+  for (uint32_t i = 0; i < mNrThreads; i++)
+  {
+    const Worker& worker = mWorkers[i];
+    stats[i].nrJobs = worker.nrJobs.load(std::memory_order_relaxed);
+    stats[i].nrStolen = worker.nrStolen.load(std::memory_order_relaxed);
+    stats[i].queueWaitNs = worker.queueWaitNs.load(std::memory_order_relaxed);
+    stats[i].jobNs = worker.jobNs.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void JobSystem::ResetStats()
+{
+  for (uint32_t i = 0; i < mNrThreads; i++)
+  {
+    Worker& worker = mWorkers[i];
+    worker.nrJobs = 0;
+    worker.nrStolen = 0;
+    worker.queueWaitNs = 0;
+    worker.jobNs = 0;
+  }
+}
+
+void JobSystem::WorkerLoop(uint32_t workerIx)
+{
+  tJobSystem = this;
+  tWorkerIx = workerIx;
+
+  uint32_t idleSpins = 0;
+  while (!mStop.load(std::memory_order_relaxed))
+  {
+    if (Job* job = GetJob(workerIx))
+    {
+      Execute(workerIx, job);
+      idleSpins = 0;
+      continue;
+    }
+
+    if (++idleSpins < cIdleSpins)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Sleep until jobs are pushed. mNrSleeping is incremented before checking mNrQueuedJobs,
+    // and Push() increments mNrQueuedJobs before checking mNrSleeping, so no wake up is lost.
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mNrSleeping.fetch_add(1);
+    mSleepCond.wait(lock, [this] { return mStop.load() || (mNrQueuedJobs.load() > 0); });
+    mNrSleeping.fetch_sub(1);
+    idleSpins = 0;
+  }
+}
+
+JobSystem::Job* JobSystem::GetJob(uint32_t workerIx)
+{
+  Worker& worker = mWorkers[workerIx];
+  if (Job* job = worker.deque.Pop())
+  {
+    mNrQueuedJobs.fetch_sub(1);
+    return job;
+  }
+
+  // steal from the other threads, starting with the next one
+  for (uint32_t i = 1; i < mNrThreads; i++)
+  {
+    uint32_t victimIx = (workerIx + i) % mNrThreads;
+    if (Job* job = mWorkers[victimIx].deque.Steal())
+    {
+      mNrQueuedJobs.fetch_sub(1);
+      worker.nrStolen.fetch_add(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::Execute(uint32_t workerIx, Job* job)
+{
+  Worker& worker = mWorkers[workerIx];
+
+  // Copy the job, so its thread can reuse it while it runs
+  const JobFunc func = job->func;
+  const void* const data = job->data;
+  const uint32_t begin = job->begin, end = job->end;
+  std::atomic<uint32_t>* const counter = job->counter;
+  const int64_t pushTime = job->pushTime;
+  job->inUse.store(false, std::memory_order_release);
+
+  int64_t startTime = NowNs();
+  func(data, begin, end);
+  int64_t endTime = NowNs();
+
+  worker.nrJobs.fetch_add(1, std::memory_order_relaxed);
+  worker.queueWaitNs.fetch_add(startTime - pushTime, std::memory_order_relaxed);
+  worker.jobNs.fetch_add(endTime - startTime, std::memory_order_relaxed);
+
+  if (Profiler::IsCapturing())
+  {
+    Profiler::Record("Job", startTime, endTime);
+  }
+
+  counter->fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::WakeWorkers()
+{
+  if (mNrSleeping.load() > 0)
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mSleepCond.notify_all();
+  }
+}
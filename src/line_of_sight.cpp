@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#include "line_of_sight.hpp"
+#include "Q3Map.hpp"
+#include "nav_mesh.hpp"
+#include "binary_stream.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/norm.hpp> // distance2
+
+using namespace shooter;
+using namespace glm;
+
+const float LineOfSight::cCacheMoveDist = 0.25f;
+const float LineOfSight::cEyeHeight = 1.3f;
+const float LineOfSight::cTraceRadius = 0.5f;
+
+namespace
+{
+  /// Smallest power of 2 not lower than the number of pairs of capacity entities, at most cMaxCachedPairs
+  size_t CalcNrCachedPairs(uint32_t capacity)
+  {
+    const size_t nrPairs = std::min(size_t(capacity) * LineOfSight::cCachedPairsPerEntity, size_t(LineOfSight::cMaxCachedPairs));
+    
+    size_t size = 1;
+    while (size < nrPairs)
+    {
+      size <<= 1;
+    }
+
+    return size;
+  }
+}
+
+LineOfSight::LineOfSight(uint32_t capacity)
+  : mCapacity(capacity)
+  , mTick(1)
+  , mPairs(CalcNrCachedPairs(capacity), CachedPair())
+  , mClearTicks(capacity, 0)
+  , mClusters(capacity)
+{}
+
+LineOfSight::~LineOfSight()
+{}
+
+void LineOfSight::Run(Query* queries, uint32_t nrQueries, const Q3Map& map, const NavMesh& navMesh)
+{
+  PROFILER_ZONE("LineOfSight::Run");
+
+  const vec3 eyeOffset(0.f, cEyeHeight, 0.f);
+  const float moveDistSq = cCacheMoveDist * cCacheMoveDist;
+
+  mTraces.clear();
+  mTracedQueries.clear();
+
+  for (uint32_t q = 0; q < nrQueries; q++)
+  {
+    Query& query = queries[q];
+    assert((query.src < mCapacity) && (query.dst < mCapacity));
+
+    const CachedPair& pair = mPairs[FindSlot(query.src, query.dst)];
+    if ((pair.src == query.src) && (pair.dst == query.dst) && IsLive(pair)
+      && (distance2(pair.srcPos, query.srcPos) <= moveDistSq) && (distance2(pair.dstPos, query.dstPos) <= moveDistSq))
+    {
+      query.visible = (pair.visible != 0);
+      continue;
+    }
+
+    const vec3 srcEye = query.srcPos + eyeOffset;
+    const vec3 dstEye = query.dstPos + eyeOffset;
+
+    if (!map.IsClusterVisible(FindCluster(query.src, srcEye, map), FindCluster(query.dst, dstEye, map)))
+    {
+      query.visible = false;
+    }
+    else if (navMesh.IsWalkableLine(query.srcPoly, value_ptr(query.srcPos), query.dstPoly, value_ptr(query.dstPos)))
+    {
+      query.visible = true;
+    }
+    else
+    {
+      mTraces.emplace_back(srcEye, dstEye, cTraceRadius);
+      mTracedQueries.push_back(q);
+      continue;
+    }
+
+    Store(query);
+  }
+
+  if (mTraces.empty()) { return; }
+
+  map.TraceBatch(mTraces.data(), mTraces.size());
+
+  for (uint32_t t = 0; t < mTraces.size(); t++)
+  {
+    Query& query = queries[mTracedQueries[t]];
+    query.visible = !mTraces[t].mCollision;
+    Store(query);
+  }
+}
+
+void LineOfSight::Clear(uint32_t entity)
+{
+  // the results stored until the end of this tick are ignored too, so they are never older than the Clear()
+  mClearTicks[entity] = mTick;
+}
+
+void LineOfSight::SaveState(BinaryWriter& writer) const
+{
+  std::vector<CachedPair> livePairs;
+  for (const CachedPair& pair : mPairs)
+  {
+    if (IsLive(pair))
+    {
+      livePairs.push_back(pair);
+    }
+  }
+
+  writer.Write(mTick);
+  writer.WriteVector(livePairs);
+}
+
+bool LineOfSight::LoadState(BinaryReader& reader)
+{
+  std::vector<CachedPair> livePairs;
+  if (!reader.Read(mTick) || !reader.ReadVector(livePairs))
+  {
+    return false;
+  }
+
+  // the saved pairs were not cleared, and a pair which is not live is never reused
+  std::fill(mPairs.begin(), mPairs.end(), CachedPair());
+  std::fill(mClearTicks.begin(), mClearTicks.end(), 0);
+
+  for (const CachedPair& pair : livePairs)
+  {
+    if ((pair.src >= mCapacity) || (pair.dst >= mCapacity))
+    {
+      return false;
+    }
+
+    mPairs[FindSlot(pair.src, pair.dst)] = pair;
+  }
+
+  return true;
+}
+
+size_t LineOfSight::FindSlot(uint32_t src, uint32_t dst) const
+{
+  const uint32_t hash = (src * 0x9e3779b1u) ^ (dst * 0x85ebca77u);
+  return (hash ^ (hash >> 16)) & (mPairs.size() - 1);
+}
+
+bool LineOfSight::IsLive(const CachedPair& pair) const
+{
+  return (pair.tick != 0) && (mTick - pair.tick < cCacheTicks)
+    && (pair.tick > mClearTicks[pair.src]) && (pair.tick > mClearTicks[pair.dst]);
+}
+
+int32_t LineOfSight::FindCluster(uint32_t entity, const vec3& eyePos, const Q3Map& map)
+{
+  CachedCluster& cached = mClusters[entity];
+  if (!cached.valid || (cached.pos != eyePos))
+  {
+    cached.pos = eyePos;
+    cached.cluster = map.FindCluster(eyePos);
+    cached.valid = true;
+  }
+
+  return cached.cluster;
+}
+
+void LineOfSight::Store(const Query& query)
+{
+  CachedPair& pair = mPairs[FindSlot(query.src, query.dst)];
+  pair.src = query.src;
+  pair.dst = query.dst;
+  pair.srcPos = query.srcPos;
+  pair.dstPos = query.dstPos;
+  pair.tick = mTick;
+  pair.visible = query.visible ? 1 : 0;
+}
@@ -11,30 +11,28 @@
 //
 
 #include "resources.hpp"
+#include "resource_loader.hpp"
 #include "camera_utils.hpp"
 #include "scene.hpp"
 #include "constants.hpp"
 #include "Q3Loader.h"
 #include "Q3Map.hpp"
 #include "nav_mesh.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+#include "simulation_thread.hpp"
+#include "replay.hpp"
 #include "sys_renderer.hpp"
-#include "sys_animation.hpp"
-#include "sys_attack.hpp"
-#include "sys_bullets.hpp"
-#include "sys_evade.hpp"
-#include "sys_patrol.hpp"
-#include "sys_physics.hpp"
-#include "sys_player_shoot.hpp"
-#include "sys_revive.hpp"
-#include "sys_states_time_ints.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 #include <SDL.h>
 #include <SDL_opengl.h>
-#include <ctpl/ctpl_stl.h>
 #include <nanovg.h>
 #define NANOVG_GL3_IMPLEMENTATION
 #include <nanovg_gl.h>
@@ -95,7 +93,7 @@ static void GLAPIENTRY openglCallbackFunction(
   std::cout << "---------------------opengl-callback-end--------------" << std::endl;
 }
 
-void RenderDebugInfo(NVGcontext* vg, int fps, const Scene& scene)
+void RenderDebugInfo(NVGcontext* vg, int fps, const RenderFrame& frame)
 {
   nvgBeginFrame(vg, SCREEN_WIDTH, SCREEN_HEIGHT, 1.f);
   nvgFontSize(vg, 20.0f);
@@ -118,15 +116,57 @@ void RenderDebugInfo(NVGcontext* vg, int fps, const Scene& scene)
   snprintf(buf, sizeof(buf), "FPS: %d", fps);
   nvgText(vg, 10, 10, buf, NULL);
 
-  snprintf(buf, sizeof(buf), "Debugging (F1): %s", (scene.debugging ? "ON" : "OFF"));
+  snprintf(buf, sizeof(buf), "Debugging (F1): %s", (frame.debugging ? "ON" : "OFF"));
   nvgText(vg, 10, 30, buf, NULL);
 
-  snprintf(buf, sizeof(buf), "Multithreading (F2): %s", (scene.multithreading ? "ON" : "OFF"));
+  snprintf(buf, sizeof(buf), "Multithreading (F2): %s", (frame.multithreading ? "ON" : "OFF"));
   nvgText(vg, 10, 50, buf, NULL);
 
+  snprintf(buf, sizeof(buf), "Profiler (F3): %s, trace dump (F4)", (Profiler::IsCapturing() ? "ON" : "OFF"));
+  nvgText(vg, 10, 70, buf, NULL);
+
+  snprintf(buf, sizeof(buf), "Double buffering (F5): %s", (frame.doubleBuffering ? "ON" : "OFF"));
+  nvgText(vg, 10, 90, buf, NULL);
+
+  if (Profiler::IsCapturing() && (Profiler::GetFrame() > 0))
+  {
+    // Breakdown of the previous (complete) frame
+    const unsigned cMaxZones = 16;
+    std::vector<ProfilerZoneStats> zones = Profiler::GetFrameStats(Profiler::GetFrame() - 1);
+
+    float y = 110.f;
+    for (unsigned i = 0; (i < zones.size()) && (i < cMaxZones); i++, y += 20.f)
+    {
+      snprintf(buf, sizeof(buf), "%-32s %7.3f ms %5u", zones[i].name, zones[i].totalNs * 1e-6, zones[i].count);
+      nvgText(vg, 10, y, buf, NULL);
+    }
+  }
+
   nvgEndFrame(vg);
 }
 
+void RenderLoadingScreen(SDL_Window* screen, NVGcontext* vg, float progress, const std::string& name)
+{
+  // Keep the window responsive
+  SDL_PumpEvents();
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+  nvgBeginFrame(vg, SCREEN_WIDTH, SCREEN_HEIGHT, 1.f);
+  nvgFontSize(vg, 20.0f);
+  nvgFontFace(vg, "sans");
+  nvgFillColor(vg, nvgRGBA(0, 255, 0, 128));
+  nvgTextAlign(vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
+
+  char buf[256] = { 0 };
+  snprintf(buf, sizeof(buf), "Loading %3d%%: %s", int(progress * 100.f), name.c_str());
+  nvgText(vg, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2, buf, NULL);
+
+  nvgEndFrame(vg);
+
+  SDL_GL_SwapWindow(screen);
+}
+
 bool InitScreen(SDL_Window*& screen, SDL_GLContext& context, NVGcontext*& vg)
 {
   if (SDL_Init(SDL_INIT_EVERYTHING) == -1)
@@ -204,69 +244,31 @@ bool InitScreen(SDL_Window*& screen, SDL_GLContext& context, NVGcontext*& vg)
   return true;
 }
 
-inline CompDamagebleBone MakeDamagebleBone(
-  const NamesAndIdsMap& bonesMap, 
-  const std::vector<int16_t>& bonesHierarchy, 
-  const std::string& boneName, 
-  float radius, float health)
+bool InitScene(SDL_Window* screen, NVGcontext* vg, Resources& resources, const std::string& modelName, Scene& scene)
 {
-  uint32_t ix = bonesMap.at(boneName);
-  return CompDamagebleBone(ix, bonesHierarchy[ix], radius, health);
-}
+  const int64_t loadStart = Profiler::Now();
 
-bool InitScene(Resources& resources, Scene& scene)
-{
   scene.mapPath = "maps/jof3dm2.zip";
-  const std::string modelName("models/ArmyPilot/ArmyPilot.x");
 
-  if (!resources.LoadPrograms("shaders")) { return false; }
-  if (!resources.LoadModel(modelName)) { return false; }
-  if (!resources.LoadMap(scene.mapPath)) { return false; }
-  if (!resources.LoadSkyBox("skybox/DarkStormy/DarkStormy")) { return false; }
-
-  const Model& playerModel = resources.GetModel(modelName);
-  float playerSize = cPlayerHeight; // meters
-  float playerScale = playerSize * playerModel.normScale;
-
-  CompDamagebleSkeleton damSkeleton;
-  // ToDo: read this from a config file
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Spine2", 0.18f, 1.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Spine3", 0.18f, 1.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Neck1", 0.18f, 5.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "NeckHead", 0.08f, 5.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Rbrow", 0.07f, 5.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Lbrow", 0.07f, 5.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmUpper2", 0.08f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmForearm1", 0.07f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmForearm2", 0.06f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmHand", 0.05f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmUpper2", 0.08f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmForearm1", 0.07f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmForearm2", 0.06f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmHand", 0.05f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegCalf", 0.08f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegAnkle", 0.06f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegToe1", 0.05f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegCalf", 0.08f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegAnkle", 0.06f, 2.f));
-  damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegToe1", 0.05f, 2.f));
-
-  for (unsigned i = 0; i < EnNpcMax; i++)
+  // The programs go first, the map needs them
+  ResourceLoader loader(resources);
+  loader.AddPrograms("shaders");
+  loader.AddSkyBox("skybox/DarkStormy/DarkStormy");
+  loader.AddModel(modelName);
+  loader.AddMap(scene.mapPath);
+
   {
-    scene.renderables[i].modelName = modelName;
-    scene.animations[i].Set("Idle");
-    scene.transforms[i].scale = playerScale;
-    scene.bounds[i].minBound = playerModel.minBound * playerScale;
-    scene.bounds[i].maxBound = playerModel.maxBound * playerScale;
-    glm::vec3 radii = max(abs(playerModel.minBound), abs(playerModel.maxBound)) * playerScale;
-    scene.bounds[i].radiusXZ = std::max(radii.x, radii.z);
-    scene.states[i].state = EStateDead;
-    scene.damagebles[i] = damSkeleton;
+    // Load on all cores, this thread uploads the loaded resources to the GPU
+    JobSystem jobs(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    if (!loader.Run(jobs, [&](float progress, const std::string& name) { RenderLoadingScreen(screen, vg, progress, name); }))
+    {
+      return false;
+    }
   }
 
-  scene.weaponBoneIx = playerModel.nodesMap.at("M4MB");
+  std::cout << "Resources loaded in " << (Profiler::Now() - loadStart) / 1000000 << " ms" << std::endl;
 
-  return true;
+  return InitEntities(resources, modelName, scene.Capacity(), scene);
 }
 
 int main(int argc, char* args[])
@@ -280,28 +282,42 @@ int main(int argc, char* args[])
 
   Scene scene;
   Resources resources("res/");
-  if (!InitScene(resources, scene)) { return 0; }
+  const std::string modelName("models/ArmyPilot/ArmyPilot.x");
+  if (!InitScene(screen, vg, resources, modelName, scene)) { return 0; }
+
+  SysRenderer renderer(resources);
+
+  // Random seed
+  const uint32_t seed = SDL_GetTicks();
+  SeedSimulation(seed, scene);
 
-  SysRenderer renderer;
+  // Record the inputs of each tick, when a replay file is given (see ShooterDemoReplay)
+  ReplayRecorder recorder;
+  if (argc > 1)
+  {
+    ReplayHeader header;
+    header.seed = seed;
+    header.nrEntities = scene.Capacity();
+    header.mapPath = scene.mapPath;
+    header.modelName = modelName;
+    if (!recorder.Open(args[1], header, scene)) { return 0; }
+  }
 
-  // Init the thread pool
-  unsigned nrThreads = std::max(2u, std::thread::hardware_concurrency() - 1);
-  ctpl::thread_pool tp(nrThreads);
+  // Start the simulation thread. Its job system uses the remaining cores: the main thread renders.
+  unsigned nrWorkers = std::max(3u, std::thread::hardware_concurrency()) - 2;
+  SimulationThread simulation(resources, scene, nrWorkers, recorder.IsOpen() ? &recorder : nullptr);
 
   // Event handler
   SDL_Event e;
 
-  // Random seed
-  srand(SDL_GetTicks());
-
-  uint32_t lastTime = SDL_GetTicks() - static_cast<uint32_t>(cFixedTimeStep * 1000.f);
-  float leftOverTime = 0.f;
   int fps = 0, framesCnt = 0;
-  uint32_t fpsTime = lastTime + 1000;
+  uint32_t fpsTime = SDL_GetTicks() + 1000;
 
   bool quit = false;
   while (!quit)
   {
+    Profiler::BeginFrame();
+
     // Handle events on queue
     while (SDL_PollEvent(&e) != 0)
     {
@@ -312,8 +328,7 @@ int main(int argc, char* args[])
       } 
       else 
       {
-        scene.cameraController.HandleEvent(e, scene.camera);
-        scene.playerController.HandleEvent(e, scene);
+        simulation.PushEvent(e);
       }
     }
 
@@ -329,49 +344,25 @@ int main(int argc, char* args[])
 
     framesCnt++;
 
-    float elapsedTime = (currentTime - lastTime) * 0.001f; // seconds
-    lastTime = currentTime;
-
-    // Add time that couldn't be used last frame
-    elapsedTime += leftOverTime;
-
-    // Divide it up in chunks of cTimeStep ms
-    int steps = (int)floor(elapsedTime / cFixedTimeStep);
-
-    // Store time we couldn't use for the next frame.
-    leftOverTime = elapsedTime - steps * cFixedTimeStep;
-
-    for (int i = 0; i < steps; i++) 
-    { 
-      // The Simulation uses a constant time step
-      SysRevive::Update(cFixedTimeStep, resources.GetNavMesh(), scene);
-      SysStatesTimeInts::Update(cFixedTimeStep, &scene.statesTimeInts[0], EnNpcMax);
-      SysPlayerShoot::Update(cFixedTimeStep, resources, scene);
-      SysPatrol::Update(cFixedTimeStep, resources.GetNavMesh(), scene, tp);
-      SysAttack::Update(cFixedTimeStep, resources, scene);
-      SysEvade::Update(cFixedTimeStep, resources.GetNavMesh(), scene, tp);
-      SysPhysics::Update(cFixedTimeStep, resources.GetMap(), resources.GetNavMesh(), scene, tp);
-      SysAnimation::Update(cFixedTimeStep, resources, scene, tp);
-      SysBullets::Update(cFixedTimeStep, resources.GetMap(), scene);
-    }
-
-    glm::vec3 camLookAt = scene.transforms[EnPlayer].position + glm::vec3(0.f, cPlayerHeight, 0.f);
-
-    scene.cameraController.Update(elapsedTime, resources.GetMap(), camLookAt, scene.camera);
+    // Latest frame completed by the simulation thread
+    const RenderFrame& frame = simulation.AcquireFrame();
 
     // Clear screen 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     // Render scene
-    renderer.Render(resources, scene);
+    renderer.Render(resources, frame);
 
     // Render debug info
-    RenderDebugInfo(vg, fps, scene);
+    RenderDebugInfo(vg, fps, frame);
 
     // Update screen
     SDL_GL_SwapWindow(screen);
   }
 
+  simulation.Stop();
+  recorder.Close();
+
   nvgDeleteGL3(vg);
   SDL_GL_DeleteContext(context);
   SDL_DestroyWindow(screen);
@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace shooter {
+
+#ifdef _WIN32
+
+  MappedFile::MappedFile() 
+    : mData(nullptr)
+    , mSize(0)
+    , mFileHandle(INVALID_HANDLE_VALUE)
+    , mMappingHandle(nullptr)
+  {}
+
+  bool MappedFile::Open(const std::string& filePath)
+  {
+    Close();
+
+    mFileHandle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFileHandle == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFileHandle, &size) || (size.QuadPart <= 0) || (uint64_t(size.QuadPart) > SIZE_MAX))
+    {
+      Close();
+      return false;
+    }
+
+    mMappingHandle = CreateFileMappingA(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* data = (mMappingHandle != nullptr) ? MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data == nullptr)
+    {
+      Close();
+      return false;
+    }
+
+    mData = static_cast<const uint8_t*>(data);
+    mSize = size_t(size.QuadPart);
+    return true;
+  }
+
+  void MappedFile::Close()
+  {
+    if (mData != nullptr) { UnmapViewOfFile(mData); }
+    if (mMappingHandle != nullptr) { CloseHandle(mMappingHandle); }
+    if (mFileHandle != INVALID_HANDLE_VALUE) { CloseHandle(mFileHandle); }
+
+    mData = nullptr;
+    mSize = 0;
+    mFileHandle = INVALID_HANDLE_VALUE;
+    mMappingHandle = nullptr;
+  }
+
+#else
+
+  MappedFile::MappedFile() 
+    : mData(nullptr)
+    , mSize(0)
+  {}
+
+  bool MappedFile::Open(const std::string& filePath)
+  {
+    Close();
+
+    const int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+
+    // The mapping stays valid after the file is closed
+    struct stat st;
+    void* data = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+    {
+      data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) { return false; }
+
+    mData = static_cast<const uint8_t*>(data);
+    mSize = size_t(st.st_size);
+    return true;
+  }
+
+  void MappedFile::Close()
+  {
+    if (mData != nullptr) { munmap(const_cast<uint8_t*>(mData), mSize); }
+
+    mData = nullptr;
+    mSize = 0;
+  }
+
+#endif
+
+  MappedFile::~MappedFile()
+  {
+    Close();
+  }
+
+  bool WriteFileAtomically(const std::string& filePath, const void* data, size_t size)
+  {
+    static std::atomic<uint32_t> nrWrites(0);
+
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const unsigned long processId = getpid();
+#endif
+    const std::string tmpFilePath = filePath + "." + std::to_string(processId) + "." + std::to_string(nrWrites++) + ".tmp";
+    {
+      std::ofstream file(tmpFilePath.c_str(), std::ios::binary | std::ios::trunc);
+      file.write(static_cast<const char*>(data), size);
+      if (!file)
+      {
+        file.close();
+        std::remove(tmpFilePath.c_str());
+        return false;
+      }
+    }
+
+#ifdef _WIN32
+    // rename() doesn't replace an existing file on Windows
+    std::remove(filePath.c_str());
+#endif
+    if (std::rename(tmpFilePath.c_str(), filePath.c_str()) != 0)
+    {
+      std::remove(tmpFilePath.c_str());
+      return false;
+    }
+    return true;
+  }
+
+}
@@ -11,7 +11,12 @@
 //
 
 #include "nav_mesh.hpp"
+#include "profiler.hpp"
+#include "binary_stream.hpp"
+#include "mapped_file.hpp"
 
+#include <algorithm>
+#include <iostream>
 #include <unordered_set>
 
 #include <glm/glm.hpp>
@@ -19,16 +24,13 @@
 #include <glm/gtx/intersect.hpp>
 
 #include <Recast.h>
+#include <RecastAlloc.h>
+#include <DetourAlloc.h>
 #include <DetourCommon.h>
 #include <DetourNavMesh.h>
 #include <DetourNavMeshBuilder.h>
 #include <DetourNavMeshQuery.h>
-#include <DebugDraw.h>
-#include <RecastDebugDraw.h>
 #include <RecastDump.h>
-#include <DetourDebugDraw.h>
-
-#include <GL/glew.h>
 
 using namespace shooter;
 
@@ -94,82 +96,22 @@ namespace {
     return 0;
   }
 
-  /// OpenGL debug draw implementation.
-  class DebugDrawGL : public duDebugDraw
-  {
-  public:
-    virtual void depthMask(bool state) { glDepthMask(state ? GL_TRUE : GL_FALSE); }
-
-    virtual void texture(bool state)
-    {
-      if (state)
-      {
-        glEnable(GL_TEXTURE_2D);
-      }
-      else
-      {
-        glDisable(GL_TEXTURE_2D);
-      }
-    }
-
-    virtual void begin(duDebugDrawPrimitives prim, float size = 1.0f)
-    {
-      switch (prim)
-      {
-      case DU_DRAW_POINTS:
-        glPointSize(size);
-        glBegin(GL_POINTS);
-        break;
-      case DU_DRAW_LINES:
-        glLineWidth(size);
-        glBegin(GL_LINES);
-        break;
-      case DU_DRAW_LINE_STRIP:
-        glLineWidth(size);
-        glBegin(GL_LINE_STRIP);
-        break;
-      case DU_DRAW_TRIS:
-        glBegin(GL_TRIANGLES);
-        break;
-      case DU_DRAW_QUADS:
-        glBegin(GL_QUADS);
-        break;
-      };
-    }
-
-    virtual void vertex(const float* pos, unsigned int color)
-    {
-      glColor4ubv((GLubyte*)&color);
-      glVertex3fv(pos);
-    }
-
-    virtual void vertex(const float x, const float y, const float z, unsigned int color)
-    {
-      glColor4ubv((GLubyte*)&color);
-      glVertex3f(x, y, z);
-    }
-
-    virtual void vertex(const float* pos, unsigned int color, const float* uv)
-    {
-      glColor4ubv((GLubyte*)&color);
-      glTexCoord2fv(uv);
-      glVertex3fv(pos);
-    }
-
-    virtual void vertex(const float x, const float y, const float z, unsigned int color, const float u, const float v)
-    {
-      glColor4ubv((GLubyte*)&color);
-      glTexCoord2f(u, v);
-      glVertex3f(x, y, z);
-    }
+  /// NavMesh cache file (see NavMesh::WriteCache()). 
+  /// Bump the version when the build steps or the file layout change.
+  const uint32_t cNavMeshCacheMagic = 0x4d4e4453; // "SDNM"
+  const uint32_t cNavMeshCacheVersion = 1;
 
-    virtual void end()
+  /// Copy the array into Recast memory (to be freed with the Recast structure owning it)
+  template<typename T>
+  T* rcCopyArray(const std::vector<T>& values)
+  {
+    T* copy = (T*)rcAlloc(sizeof(T) * std::max<size_t>(values.size(), 1), RC_ALLOC_PERM);
+    if (copy && !values.empty())
     {
-      glEnd();
-      glLineWidth(1.0f);
-      glPointSize(1.0f);
+      memcpy(copy, values.data(), sizeof(T) * values.size());
     }
-  };
+    return copy;
+  }
 
 }
 
@@ -199,7 +141,8 @@ NavMesh::NavMesh(
   float initialJumpForwardSpeed,
   float initialJumpUpSpeed,
   float idealJumpPointsDist,
-  float maxIntersectionPosHeight
+  float maxIntersectionPosHeight,
+  const std::string& cacheFilePath
 )
   : m_keepInterResults(true)
   , m_totalBuildTimeMs(0)
@@ -213,7 +156,10 @@ NavMesh::NavMesh(
   , m_navMesh(nullptr)
   , m_navQuery(nullptr)
   , m_filter(nullptr)
+  , m_savedBuildTimeMs(0)
 {
+  const int64_t buildStartNs = Profiler::Now();
+
   //
   // Step 1. Initialize build config.
   //
@@ -243,6 +189,35 @@ NavMesh::NavMesh(
   rcVcopy(m_cfg->bmax, maxBound);
   rcCalcGridSize(m_cfg->bmin, m_cfg->bmax, m_cfg->cs, &m_cfg->width, &m_cfg->height);
 
+  // The cache key covers everything the build reads (the normals aren't used)
+  uint64_t cacheKey = 0;
+  if (!cacheFilePath.empty())
+  {
+    const float params[] = {
+      agentHeight, agentRadius, agentMaxClimb, agentWalkableSlopeAngle, 
+      cellSize, cellHeight, maxEdgeLen, maxEdgeError,
+      regionMinSize, regionMergeSize, detailSampleDist, detailSampleMaxError,
+      minBound[0], minBound[1], minBound[2], maxBound[0], maxBound[1], maxBound[2],
+      maxJumpGroundRange, maxJumpDistance, initialJumpForwardSpeed, initialJumpUpSpeed, 
+      idealJumpPointsDist, maxIntersectionPosHeight };
+
+    cacheKey = HashWords(verts, nverts * 3 * sizeof(float));
+    cacheKey = HashWords(tris, ntris * 3 * sizeof(int), cacheKey);
+    cacheKey = HashWords(params, sizeof(params), cacheKey);
+
+    float cachedBuildTimeMs = 0.f;
+    if (ReadCache(cacheFilePath, cacheKey, cachedBuildTimeMs))
+    {
+      InitQuery();
+
+      m_totalBuildTimeMs = (Profiler::Now() - buildStartNs) * 1e-6f;
+      m_savedBuildTimeMs = std::max(cachedBuildTimeMs - m_totalBuildTimeMs, 0.f);
+      std::cout << "NavMesh loaded from " << cacheFilePath << " in " << m_totalBuildTimeMs 
+        << " ms, build time saved: " << m_savedBuildTimeMs << " ms" << std::endl;
+      return;
+    }
+  }
+
   rcContext *m_ctx = new rcContext;
 
   // Reset build times gathering.
@@ -521,6 +496,13 @@ NavMesh::NavMesh(
     return;
   }
 
+  // Copied before dtNavMesh::init(), which links the polygons inside the tile data
+  std::vector<unsigned char> cacheNavData;
+  if (!cacheFilePath.empty())
+  {
+    cacheNavData.assign(navData, navData + navDataSize);
+  }
+
   m_navMesh = dtAllocNavMesh();
   if (!m_navMesh)
   {
@@ -539,31 +521,12 @@ NavMesh::NavMesh(
     return;
   }
 
-  m_navQuery = dtAllocNavMeshQuery();
-  if (!m_navQuery)
-  {
-    dtFree(m_navQuery);
-    m_ctx->log(RC_LOG_ERROR, "Could not create Detour navmesh query");
-    return;
-  }
-
-  status = m_navQuery->init(m_navMesh, 2048);
-  if (dtStatusFailed(status))
+  if (!InitQuery())
   {
     m_ctx->log(RC_LOG_ERROR, "Could not init Detour navmesh query");
     return;
   }
 
-  m_filter = new dtQueryFilter;
-  if (m_filter)
-  {
-    m_filter->setAreaCost(SAMPLE_POLYAREA_GROUND, 1.0f);
-    m_filter->setAreaCost(SAMPLE_POLYAREA_WATER, 10.0f);
-    m_filter->setAreaCost(SAMPLE_POLYAREA_JUMP, 1.5f);
-    m_filter->setIncludeFlags(SAMPLE_POLYFLAGS_ALL ^ SAMPLE_POLYFLAGS_DISABLED);
-    m_filter->setExcludeFlags(0);
-  }
-
   CalcIntersectionPositions(maxIntersectionPosHeight);
 
   m_ctx->stopTimer(RC_TIMER_TOTAL);
@@ -572,7 +535,12 @@ NavMesh::NavMesh(
   duLogBuildTimes(*m_ctx, m_ctx->getAccumulatedTime(RC_TIMER_TOTAL));
   m_ctx->log(RC_LOG_PROGRESS, ">> Polymesh: %d vertices  %d polygons", m_pmesh->nverts, m_pmesh->npolys);
 
-  m_totalBuildTimeMs = m_ctx->getAccumulatedTime(RC_TIMER_TOTAL) / 1000.0f;
+  m_totalBuildTimeMs = (Profiler::Now() - buildStartNs) * 1e-6f;
+
+  if (!cacheFilePath.empty() && m_chf)
+  {
+    WriteCache(cacheFilePath, cacheKey, m_totalBuildTimeMs, cacheNavData);
+  }
 }
 
 shooter::NavMesh::~NavMesh()
@@ -589,56 +557,6 @@ shooter::NavMesh::~NavMesh()
   delete m_cfg;
 }
 
-void NavMesh::DebugRender() const
-{
-  DebugDrawGL dd;
-
-  // Draw bounds
-  const float* bmin = m_cfg->bmin;
-  const float* bmax = m_cfg->bmax;
-  duDebugDrawBoxWire(&dd, bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2], duRGBA(255, 255, 255, 128), 1.0f);
-  dd.begin(DU_DRAW_POINTS, 5.0f);
-  dd.vertex(bmin[0], bmin[1], bmin[2], duRGBA(255, 255, 255, 128));
-  dd.end();
-
-  // Draw mesh
-  //duDebugDrawHeightfieldSolid(&dd, *m_hf);
-  //duDebugDrawHeightfieldWalkable(&dd, *m_hf);
-  //duDebugDrawCompactHeightfieldSolid(&dd, *m_chf);
-  //duDebugDrawCompactHeightfieldDistance(&dd, *m_chf);
-  //duDebugDrawRawContours(&dd, *m_cset, 0.5f);
-  //duDebugDrawContours(&dd, *m_cset);
-  //duDebugDrawRegionConnections(&dd, *m_cset);
-  //duDebugDrawPolyMesh(&dd, *m_pmesh);
-  duDebugDrawPolyMeshDetail(&dd, *m_dmesh);
-  //duDebugDrawNavMesh(&dd, *m_navMesh, 0);
-  //duDebugDrawNavMeshNodes(&dd, *m_navQuery);
-
-  for (const auto& verts : m_DebugOffMeshConVerts)
-  {
-    dd.begin(DU_DRAW_LINE_STRIP, 1.f);
-    for (unsigned i = 0; i < verts.size(); i += 3)
-    {
-      dd.vertex(verts[i], verts[i+1], verts[i+2], duRGBA(255, 0, 0, 255));
-    }
-    dd.end();
-
-    dd.begin(DU_DRAW_POINTS, 2.f);
-    for (unsigned i = 0; i < verts.size(); i += 3)
-    {
-      dd.vertex(verts[i], verts[i + 1], verts[i + 2], duRGBA(0, 255, 0, 255));
-    }
-    dd.end();
-  }
-
-  dd.begin(DU_DRAW_POINTS, 5.f);
-  for (unsigned i = 0; i < m_IntersectionPositions.size(); i += 3)
-  {
-    dd.vertex(m_IntersectionPositions[i], m_IntersectionPositions[i + 1], m_IntersectionPositions[i + 2], duRGBA(0, 255, 0, 255));
-  }
-  dd.end();
-}
-
 bool NavMesh::FindPath(
   const float* startPos,
   const float* endPos,
@@ -647,6 +565,8 @@ bool NavMesh::FindPath(
   dtPolyRef* outPathPolys,
   int& outNrPathPolys) const
 {
+  PROFILER_ZONE("NavMesh::FindPath");
+
   if (!m_navMesh)
     return false;
 
@@ -665,6 +585,26 @@ bool NavMesh::FindPath(
   return false;
 }
 
+bool NavMesh::IsWalkableLine(
+  dtPolyRef startPoly,
+  const float* startPos,
+  dtPolyRef endPoly,
+  const float* endPos) const
+{
+  if (!m_navMesh || !startPoly || !endPoly)
+    return false;
+
+  float t = 0.f;
+  float hitNormal[3];
+  dtPolyRef path[MAX_POLYS];
+  int pathCount = 0;
+
+  dtStatus status = m_navQuery->raycast(startPoly, startPos, endPos, m_filter, &t, hitNormal, path, &pathCount, MAX_POLYS);
+
+  // The line must reach endPos without hitting a wall, on endPoly and not on another floor above or below it
+  return (status == DT_SUCCESS) && (t == FLT_MAX) && (pathCount > 0) && (path[pathCount - 1] == endPoly);
+}
+
 void NavMesh::GetSteerPosOnPath(
   const float* startPos,
   const float* endPos,
@@ -1147,4 +1087,166 @@ void NavMesh::CalcIntersectionPositions(float maxIntersectionPosHeight)
       }
     }
   }
-}
\ No newline at end of file
+}
+bool NavMesh::InitQuery()
+{
+  m_navQuery = dtAllocNavMeshQuery();
+  if (!m_navQuery || dtStatusFailed(m_navQuery->init(m_navMesh, 2048)))
+  {
+    return false;
+  }
+
+  m_filter = new dtQueryFilter;
+  m_filter->setAreaCost(SAMPLE_POLYAREA_GROUND, 1.0f);
+  m_filter->setAreaCost(SAMPLE_POLYAREA_WATER, 10.0f);
+  m_filter->setAreaCost(SAMPLE_POLYAREA_JUMP, 1.5f);
+  m_filter->setIncludeFlags(SAMPLE_POLYFLAGS_ALL ^ SAMPLE_POLYFLAGS_DISABLED);
+  m_filter->setExcludeFlags(0);
+  return true;
+}
+
+bool NavMesh::ReadCache(const std::string& filePath, uint64_t key, float& outBuildTimeMs)
+{
+  MappedFile file;
+  if (!file.Open(filePath)) { return false; }
+
+  BinaryReader reader(file.GetData(), file.GetSize());
+
+  uint32_t magic = 0, version = 0;
+  uint64_t fileKey = 0;
+  if (!reader.Read(magic) || (magic != cNavMeshCacheMagic) || !reader.Read(version) || (version != cNavMeshCacheVersion)
+    || !reader.Read(fileKey) || (fileKey != key))
+  {
+    std::cout << "Stale NavMesh cache: " << filePath << std::endl;
+    return false;
+  }
+
+  float buildTimeMs = 0.f;
+  std::vector<unsigned char> navData;
+  std::vector<float> offMeshConVerts, offMeshConRad;
+  std::vector<unsigned short> offMeshConFlags;
+  std::vector<unsigned char> offMeshConAreas, offMeshConDir;
+  std::vector<unsigned int> offMeshConUserID;
+  uint32_t nrDebugOffMeshCons = 0;
+  std::vector<std::vector<float> > debugOffMeshConVerts;
+  std::vector<float> intersectionPositions;
+  rcCompactHeightfield chf;
+  std::vector<rcCompactCell> cells;
+  std::vector<rcCompactSpan> spans;
+  std::vector<unsigned short> dist;
+  std::vector<unsigned char> areas;
+
+  bool valid = reader.Read(buildTimeMs)
+    && reader.ReadVector(navData)
+    && reader.ReadVector(offMeshConVerts)
+    && reader.ReadVector(offMeshConRad)
+    && reader.ReadVector(offMeshConFlags)
+    && reader.ReadVector(offMeshConAreas)
+    && reader.ReadVector(offMeshConDir)
+    && reader.ReadVector(offMeshConUserID)
+    && reader.Read(nrDebugOffMeshCons);
+  for (uint32_t i = 0; valid && (i < nrDebugOffMeshCons); ++i)
+  {
+    debugOffMeshConVerts.emplace_back();
+    valid = reader.ReadVector(debugOffMeshConVerts.back());
+  }
+  valid = valid
+    && reader.ReadVector(intersectionPositions)
+    && reader.Read(chf)
+    && reader.ReadVector(cells)
+    && reader.ReadVector(spans)
+    && reader.ReadVector(dist)
+    && reader.ReadVector(areas)
+    && reader.IsEnd()
+    && !navData.empty()
+    && (chf.width > 0) && (chf.height > 0) && (cells.size() == size_t(chf.width) * chf.height)
+    && (spans.size() == size_t(chf.spanCount)) && (dist.size() == spans.size()) && (areas.size() == spans.size());
+
+  // Detour checks the tile data header, and takes ownership of the data when the init succeeds
+  dtNavMesh* navMesh = valid ? dtAllocNavMesh() : nullptr;
+  unsigned char* tileData = navMesh ? (unsigned char*)dtAlloc(navData.size(), DT_ALLOC_PERM) : nullptr;
+  if (tileData)
+  {
+    memcpy(tileData, navData.data(), navData.size());
+    if (dtStatusFailed(navMesh->init(tileData, int(navData.size()), DT_TILE_FREE_DATA)))
+    {
+      dtFree(tileData);
+      tileData = nullptr;
+    }
+  }
+  if (!tileData)
+  {
+    dtFreeNavMesh(navMesh);
+    std::cout << "Invalid NavMesh cache: " << filePath << std::endl;
+    return false;
+  }
+
+  m_navMesh = navMesh;
+
+  // The header was written with its arrays set to null
+  m_chf = rcAllocCompactHeightfield();
+  *m_chf = chf;
+  m_chf->cells = rcCopyArray(cells);
+  m_chf->spans = rcCopyArray(spans);
+  m_chf->dist = rcCopyArray(dist);
+  m_chf->areas = rcCopyArray(areas);
+
+  m_OffMeshConVerts.swap(offMeshConVerts);
+  m_OffMeshConRad.swap(offMeshConRad);
+  m_OffMeshConFlags.swap(offMeshConFlags);
+  m_OffMeshConAreas.swap(offMeshConAreas);
+  m_OffMeshConDir.swap(offMeshConDir);
+  m_OffMeshConUserID.swap(offMeshConUserID);
+  m_DebugOffMeshConVerts.swap(debugOffMeshConVerts);
+  m_IntersectionPositions.swap(intersectionPositions);
+
+  outBuildTimeMs = buildTimeMs;
+  return true;
+}
+
+void NavMesh::WriteCache(const std::string& filePath, uint64_t key, float buildTimeMs, const std::vector<unsigned char>& navData) const
+{
+  // GetFloorInfo() reads the compact heightfield, so it's kept with the Detour data
+  rcCompactHeightfield chf = *m_chf;
+  chf.cells = nullptr;
+  chf.spans = nullptr;
+  chf.dist = nullptr;
+  chf.areas = nullptr;
+
+  std::vector<uint8_t> data;
+  BinaryWriter writer(data);
+  writer.Write(cNavMeshCacheMagic);
+  writer.Write(cNavMeshCacheVersion);
+  writer.Write(key);
+  writer.Write(buildTimeMs);
+  writer.WriteVector(navData);
+  writer.WriteVector(m_OffMeshConVerts);
+  writer.WriteVector(m_OffMeshConRad);
+  writer.WriteVector(m_OffMeshConFlags);
+  writer.WriteVector(m_OffMeshConAreas);
+  writer.WriteVector(m_OffMeshConDir);
+  writer.WriteVector(m_OffMeshConUserID);
+  writer.Write(static_cast<uint32_t>(m_DebugOffMeshConVerts.size()));
+  for (const auto& verts : m_DebugOffMeshConVerts)
+  {
+    writer.WriteVector(verts);
+  }
+  writer.WriteVector(m_IntersectionPositions);
+  writer.Write(chf);
+  // Same layout as WriteVector()
+  const uint32_t nrCells = static_cast<uint32_t>(chf.width * chf.height);
+  const uint32_t nrSpans = static_cast<uint32_t>(chf.spanCount);
+  writer.Write(nrCells);
+  writer.WriteBytes(m_chf->cells, nrCells * sizeof(rcCompactCell));
+  writer.Write(nrSpans);
+  writer.WriteBytes(m_chf->spans, nrSpans * sizeof(rcCompactSpan));
+  writer.Write(nrSpans);
+  writer.WriteBytes(m_chf->dist, nrSpans * sizeof(unsigned short));
+  writer.Write(nrSpans);
+  writer.WriteBytes(m_chf->areas, nrSpans * sizeof(unsigned char));
+
+  if (!WriteFileAtomically(filePath, data.data(), data.size()))
+  {
+    std::cout << "Couldn't write the NavMesh cache: " << filePath << std::endl;
+  }
+}
@@ -0,0 +1,160 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// The NavMesh debug rendering, with the OpenGL fixed pipeline. Only the demo links it.
+
+#include "nav_mesh.hpp"
+
+#include <Recast.h>
+#include <DebugDraw.h>
+#include <RecastDebugDraw.h>
+#include <DetourDebugDraw.h>
+
+#include <GL/glew.h>
+
+using namespace shooter;
+
+namespace
+{
+  /// OpenGL debug draw implementation.
+  class DebugDrawGL : public duDebugDraw
+  {
+  public:
+    virtual void depthMask(bool state) { glDepthMask(state ? GL_TRUE : GL_FALSE); }
+
+    virtual void texture(bool state)
+    {
+      if (state)
+      {
+        glEnable(GL_TEXTURE_2D);
+      }
+      else
+      {
+        glDisable(GL_TEXTURE_2D);
+      }
+    }
+
+    virtual void begin(duDebugDrawPrimitives prim, float size = 1.0f)
+    {
+      switch (prim)
+      {
+      case DU_DRAW_POINTS:
+        glPointSize(size);
+        glBegin(GL_POINTS);
+        break;
+      case DU_DRAW_LINES:
+        glLineWidth(size);
+        glBegin(GL_LINES);
+        break;
+      case DU_DRAW_LINE_STRIP:
+        glLineWidth(size);
+        glBegin(GL_LINE_STRIP);
+        break;
+      case DU_DRAW_TRIS:
+        glBegin(GL_TRIANGLES);
+        break;
+      case DU_DRAW_QUADS:
+        glBegin(GL_QUADS);
+        break;
+      };
+    }
+
+    virtual void vertex(const float* pos, unsigned int color)
+    {
+      glColor4ubv((GLubyte*)&color);
+      glVertex3fv(pos);
+    }
+
+    virtual void vertex(const float x, const float y, const float z, unsigned int color)
+    {
+      glColor4ubv((GLubyte*)&color);
+      glVertex3f(x, y, z);
+    }
+
+    virtual void vertex(const float* pos, unsigned int color, const float* uv)
+    {
+      glColor4ubv((GLubyte*)&color);
+      glTexCoord2fv(uv);
+      glVertex3fv(pos);
+    }
+
+    virtual void vertex(const float x, const float y, const float z, unsigned int color, const float u, const float v)
+    {
+      glColor4ubv((GLubyte*)&color);
+      glTexCoord2f(u, v);
+      glVertex3f(x, y, z);
+    }
+
+    virtual void end()
+    {
+      glEnd();
+      glLineWidth(1.0f);
+      glPointSize(1.0f);
+    }
+  };
+}
+
+void NavMesh::DebugRender() const
+{
+  DebugDrawGL dd;
+
+  // Draw bounds
+  const float* bmin = m_cfg->bmin;
+  const float* bmax = m_cfg->bmax;
+  duDebugDrawBoxWire(&dd, bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2], duRGBA(255, 255, 255, 128), 1.0f);
+  dd.begin(DU_DRAW_POINTS, 5.0f);
+  dd.vertex(bmin[0], bmin[1], bmin[2], duRGBA(255, 255, 255, 128));
+  dd.end();
+
+  // Draw mesh
+  //duDebugDrawHeightfieldSolid(&dd, *m_hf);
+  //duDebugDrawHeightfieldWalkable(&dd, *m_hf);
+  //duDebugDrawCompactHeightfieldSolid(&dd, *m_chf);
+  //duDebugDrawCompactHeightfieldDistance(&dd, *m_chf);
+  //duDebugDrawRawContours(&dd, *m_cset, 0.5f);
+  //duDebugDrawContours(&dd, *m_cset);
+  //duDebugDrawRegionConnections(&dd, *m_cset);
+  //duDebugDrawPolyMesh(&dd, *m_pmesh);
+  if (m_dmesh)
+  {
+    duDebugDrawPolyMeshDetail(&dd, *m_dmesh);
+  }
+  else // loaded from the cache file
+  {
+    duDebugDrawNavMesh(&dd, *m_navMesh, 0);
+  }
+  //duDebugDrawNavMeshNodes(&dd, *m_navQuery);
+
+  for (const auto& verts : m_DebugOffMeshConVerts)
+  {
+    dd.begin(DU_DRAW_LINE_STRIP, 1.f);
+    for (unsigned i = 0; i < verts.size(); i += 3)
+    {
+      dd.vertex(verts[i], verts[i+1], verts[i+2], duRGBA(255, 0, 0, 255));
+    }
+    dd.end();
+
+    dd.begin(DU_DRAW_POINTS, 2.f);
+    for (unsigned i = 0; i < verts.size(); i += 3)
+    {
+      dd.vertex(verts[i], verts[i + 1], verts[i + 2], duRGBA(0, 255, 0, 255));
+    }
+    dd.end();
+  }
+
+  dd.begin(DU_DRAW_POINTS, 5.f);
+  for (unsigned i = 0; i < m_IntersectionPositions.size(); i += 3)
+  {
+    dd.vertex(m_IntersectionPositions[i], m_IntersectionPositions[i + 1], m_IntersectionPositions[i + 2], duRGBA(0, 255, 0, 255));
+  }
+  dd.end();
+}
@@ -0,0 +1,186 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+using namespace shooter;
+
+std::atomic<bool> Profiler::sCapturing(false);
+std::atomic<uint32_t> Profiler::sFrame(0);
+
+namespace {
+
+  struct ProfilerEvent
+  {
+    const char* name;
+    int64_t beginNs;
+    int64_t endNs;
+    uint32_t frame; ///< Frame in which the zone ended
+  };
+
+  /// Events recorded by one thread. Only the owner thread writes to it.
+  struct ThreadBuffer
+  {
+    ThreadBuffer(uint32_t threadIx)
+      : threadIx(threadIx)
+      , nrEvents(0)
+      , events(Profiler::cMaxEventsPerThread)
+    {}
+
+    uint32_t threadIx; ///< Order in which the threads recorded their first event
+    std::atomic<uint64_t> nrEvents; ///< Number of events recorded, event i is in events[i % cMaxEventsPerThread]
+    std::vector<ProfilerEvent> events;
+  };
+
+  static_assert((Profiler::cMaxEventsPerThread & (Profiler::cMaxEventsPerThread - 1)) == 0, "cMaxEventsPerThread must be a power of 2");
+  const uint64_t cEventsMask = Profiler::cMaxEventsPerThread - 1;
+
+  /// The buffers live until the program exits, so the events of finished threads can still be read
+  std::mutex gBuffersMutex;
+  std::vector<std::unique_ptr<ThreadBuffer> > gBuffers;
+
+  thread_local ThreadBuffer* tBuffer = nullptr;
+
+  ThreadBuffer& GetThreadBuffer()
+  {
+    if (tBuffer == nullptr)
+    {
+      // Only once per thread
+      std::lock_guard<std::mutex> lock(gBuffersMutex);
+      gBuffers.emplace_back(new ThreadBuffer(gBuffers.size()));
+      tBuffer = gBuffers.back().get();
+    }
+
+    return *tBuffer;
+  }
+
+  /// Call func for the events of buffer recorded in frames [minFrame, maxFrame], newest first
+  template<typename TFunc>
+  void ForEachEvent(const ThreadBuffer& buffer, uint32_t minFrame, uint32_t maxFrame, const TFunc& func)
+  {
+    const uint64_t nrEvents = buffer.nrEvents.load(std::memory_order_acquire);
+    const uint64_t first = (nrEvents > Profiler::cMaxEventsPerThread) ? (nrEvents - Profiler::cMaxEventsPerThread) : 0;
+
+    for (uint64_t i = nrEvents; i > first; i--)
+    {
+      const ProfilerEvent& ev = buffer.events[(i - 1) & cEventsMask];
+      if (ev.frame > maxFrame) { continue; }
+      if (ev.frame < minFrame) { break; }
+
+      func(ev);
+    }
+  }
+
+}
+
+void Profiler::Record(const char* name, int64_t beginNs, int64_t endNs)
+{
+  ThreadBuffer& buffer = GetThreadBuffer();
+
+  const uint64_t ix = buffer.nrEvents.load(std::memory_order_relaxed);
+  ProfilerEvent& ev = buffer.events[ix & cEventsMask];
+  ev.name = name;
+  ev.beginNs = beginNs;
+  ev.endNs = endNs;
+  ev.frame = GetFrame();
+
+  buffer.nrEvents.store(ix + 1, std::memory_order_release);
+}
+
+std::vector<ProfilerZoneStats> Profiler::GetFrameStats(uint32_t frame)
+{
+  std::vector<ProfilerZoneStats> zones;
+
+  std::lock_guard<std::mutex> lock(gBuffersMutex);
+  for (const auto& buffer : gBuffers)
+  {
+    ForEachEvent(*buffer, frame, frame, [&](const ProfilerEvent& ev) {
+      // Few distinct zones, a linear search is enough. The same literal can have different addresses.
+      auto it = std::find_if(zones.begin(), zones.end(), [&](const ProfilerZoneStats& zone) {
+        return (zone.name == ev.name) || (std::strcmp(zone.name, ev.name) == 0);
+      });
+
+      if (it == zones.end())
+      {
+        zones.push_back(ProfilerZoneStats());
+        it = zones.end() - 1;
+        it->name = ev.name;
+      }
+
+      it->count++;
+      it->totalNs += ev.endNs - ev.beginNs;
+    });
+  }
+
+  std::sort(zones.begin(), zones.end(), [](const ProfilerZoneStats& a, const ProfilerZoneStats& b) {
+    return a.totalNs > b.totalNs;
+  });
+
+  return zones;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filePath, uint32_t nrFrames)
+{
+  std::ofstream out(filePath.c_str());
+  if (!out)
+  {
+    std::cout << "Couldn't write the profiler trace: " << filePath << std::endl;
+    return false;
+  }
+
+  const uint32_t maxFrame = GetFrame();
+  const uint32_t minFrame = (nrFrames > 0) && (maxFrame >= nrFrames - 1) ? (maxFrame - (nrFrames - 1)) : 0;
+
+  std::lock_guard<std::mutex> lock(gBuffersMutex);
+
+  // Timestamps are relative to the oldest event
+  int64_t originNs = std::numeric_limits<int64_t>::max();
+  for (const auto& buffer : gBuffers)
+  {
+    ForEachEvent(*buffer, minFrame, maxFrame, [&](const ProfilerEvent& ev) {
+      originNs = std::min(originNs, ev.beginNs);
+    });
+  }
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[" << std::endl;
+
+  bool first = true;
+  for (const auto& buffer : gBuffers)
+  {
+    out << (first ? "" : ",\n")
+      << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadIx
+      << ",\"args\":{\"name\":\"thread " << buffer->threadIx << "\"}}";
+    first = false;
+
+    // Zone names are identifiers, they don't need escaping
+    ForEachEvent(*buffer, minFrame, maxFrame, [&](const ProfilerEvent& ev) {
+      out << ",\n{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadIx
+        << ",\"ts\":" << (ev.beginNs - originNs) * 1e-3
+        << ",\"dur\":" << (ev.endNs - ev.beginNs) * 1e-3
+        << ",\"args\":{\"frame\":" << ev.frame << "}}";
+    });
+  }
+
+  out << std::endl << "]}" << std::endl;
+
+  return out.good();
+}
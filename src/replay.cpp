@@ -0,0 +1,428 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#include "replay.hpp"
+#include "binary_stream.hpp"
+#include "scene.hpp"
+#include "controllers.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <SDL.h>
+
+namespace shooter {
+
+  namespace {
+
+    const uint32_t cReplayMagic = 0x50524453; // "SDRP"
+    const uint32_t cReplayVersion = 4; ///< 2: the keyframes include the LineOfSight cache, 3: only its live results, 4: the dead entities
+
+    /// Flush the recorded data when the buffer gets larger than this
+    const size_t cReplayFlushSize = 1 << 16;
+
+    enum ReplayRecordType : uint8_t
+    {
+      ERecordTick = 0,
+      ERecordKeyframe,
+      ERecordIndex,
+    };
+
+    /// Size of the offset of the index and the magic at the end of the file
+    const size_t cReplayTrailerSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+    bool ReadTickRecord(BinaryReader& reader, ReplayTick& tick)
+    {
+      uint16_t nrEvents = 0;
+      if (!reader.Read(tick.flags) || !reader.Read(nrEvents)) { return false; }
+
+      tick.events.resize(nrEvents);
+      for (InputEvent& input : tick.events)
+      {
+        if (!reader.Read(input)) { return false; }
+      }
+
+      if ((tick.flags & ReplayTick::EFlagCamera) && !reader.Read(tick.camera)) { return false; }
+
+      return reader.Read(tick.checksum);
+    }
+
+    bool SkipKeyframeRecord(BinaryReader& reader)
+    {
+      uint32_t tick = 0, size = 0;
+      return reader.Read(tick) && reader.Read(size) && reader.Seek(reader.GetPos() + size);
+    }
+
+  }
+
+  bool InputEvent::FromSdl(const SDL_Event& e, InputEvent& input)
+  {
+    std::memset(&input, 0, sizeof(input));
+
+    switch (e.type)
+    {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      // The function keys toggle debugging options
+      if ((e.key.keysym.sym >= SDLK_F1) && (e.key.keysym.sym <= SDLK_F12)) { return false; }
+
+      input.type = (e.type == SDL_KEYDOWN) ? EKeyDown : EKeyUp;
+      input.repeat = e.key.repeat;
+      input.key = e.key.keysym.sym;
+      return true;
+
+    case SDL_MOUSEMOTION:
+      input.type = EMouseMotion;
+      input.xrel = e.motion.xrel;
+      input.yrel = e.motion.yrel;
+      return true;
+
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      input.type = (e.type == SDL_MOUSEBUTTONDOWN) ? EMouseButtonDown : EMouseButtonUp;
+      input.button = e.button.button;
+      input.pressed = e.button.state;
+      return true;
+
+    default:
+      return false;
+    }
+  }
+
+  SDL_Event InputEvent::ToSdl() const
+  {
+    SDL_Event e;
+    std::memset(&e, 0, sizeof(e));
+
+    switch (type)
+    {
+    case EKeyDown:
+    case EKeyUp:
+      e.type = (type == EKeyDown) ? SDL_KEYDOWN : SDL_KEYUP;
+      e.key.repeat = repeat;
+      e.key.keysym.sym = key;
+      break;
+
+    case EMouseMotion:
+      e.type = SDL_MOUSEMOTION;
+      e.motion.xrel = xrel;
+      e.motion.yrel = yrel;
+      break;
+
+    case EMouseButtonDown:
+    case EMouseButtonUp:
+      e.type = (type == EMouseButtonDown) ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+      e.button.button = button;
+      e.button.state = pressed;
+      break;
+    }
+
+    return e;
+  }
+
+  void ReplayTick::Apply(Scene& scene) const
+  {
+    for (const InputEvent& input : events)
+    {
+      PlayerController::HandleEvent(input.ToSdl(), scene);
+    }
+
+    if (flags & EFlagCamera)
+    {
+      scene.camera = camera;
+    }
+
+    scene.doubleBuffering = (flags & EFlagDoubleBuffering) != 0;
+  }
+
+  bool ReplayRecorder::Open(const std::string& filePath, const ReplayHeader& header, const Scene& scene)
+  {
+    Close();
+
+    mFile.open(filePath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!mFile)
+    {
+      std::cout << "Couldn't create the replay file: " << filePath << std::endl;
+      return false;
+    }
+
+    mHeader = header;
+    mFileSize = 0;
+    mTick = 0;
+    mCurrent = ReplayTick();
+    mKeyframes.clear();
+
+    BinaryWriter writer(mBuffer);
+    writer.Write(cReplayMagic);
+    writer.Write(cReplayVersion);
+    writer.Write(header.seed);
+    writer.Write(header.nrEntities);
+    writer.Write(header.keyframeInterval);
+    writer.WriteString(header.mapPath);
+    writer.WriteString(header.modelName);
+
+    WriteKeyframe(scene);
+    Flush();
+
+    return true;
+  }
+
+  void ReplayRecorder::AddEvent(const SDL_Event& e)
+  {
+    InputEvent input;
+    if (InputEvent::FromSdl(e, input))
+    {
+      mCurrent.events.push_back(input);
+    }
+  }
+
+  void ReplayRecorder::BeginTick(const Scene& scene)
+  {
+    mCurrent.flags = scene.doubleBuffering ? ReplayTick::EFlagDoubleBuffering : 0;
+
+    // The camera is recorded when it changes, the Systems read it
+    if ((mTick == 0) || (std::memcmp(&scene.camera, &mLastCamera, sizeof(CompCamera)) != 0))
+    {
+      mCurrent.flags |= ReplayTick::EFlagCamera;
+      mCurrent.camera = scene.camera;
+      mLastCamera = scene.camera;
+    }
+  }
+
+  void ReplayRecorder::EndTick(const Scene& scene)
+  {
+    BinaryWriter writer(mBuffer);
+
+    writer.Write(ERecordTick);
+    writer.Write(mCurrent.flags);
+    writer.Write(static_cast<uint16_t>(mCurrent.events.size()));
+    for (const InputEvent& input : mCurrent.events)
+    {
+      writer.Write(input);
+    }
+
+    if (mCurrent.flags & ReplayTick::EFlagCamera)
+    {
+      writer.Write(mCurrent.camera);
+    }
+
+    writer.Write(scene.Checksum());
+
+    mCurrent.events.clear();
+    mTick++;
+
+    // Written before the events of the next tick are handled
+    if ((mHeader.keyframeInterval > 0) && (mTick % mHeader.keyframeInterval == 0))
+    {
+      WriteKeyframe(scene);
+    }
+
+    if (mBuffer.size() > cReplayFlushSize)
+    {
+      Flush();
+    }
+  }
+
+  void ReplayRecorder::Close()
+  {
+    if (!mFile.is_open())
+    {
+      return;
+    }
+
+    const uint64_t indexOffset = mFileSize + mBuffer.size();
+
+    BinaryWriter writer(mBuffer);
+    writer.Write(ERecordIndex);
+    writer.Write(static_cast<uint32_t>(mKeyframes.size()));
+    for (const auto& keyframe : mKeyframes)
+    {
+      writer.Write(keyframe.first);
+      writer.Write(keyframe.second);
+    }
+
+    writer.Write(indexOffset);
+    writer.Write(cReplayMagic);
+
+    Flush();
+    mFile.close();
+  }
+
+  void ReplayRecorder::WriteKeyframe(const Scene& scene)
+  {
+    std::vector<uint8_t> state;
+    BinaryWriter stateWriter(state);
+    scene.SaveState(stateWriter);
+
+    mKeyframes.push_back(std::make_pair(mTick, mFileSize + mBuffer.size()));
+
+    BinaryWriter writer(mBuffer);
+    writer.Write(ERecordKeyframe);
+    writer.Write(mTick);
+    writer.Write(static_cast<uint32_t>(state.size()));
+    writer.WriteBytes(state.data(), state.size());
+  }
+
+  void ReplayRecorder::Flush()
+  {
+    mFile.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+    mFileSize += mBuffer.size();
+    mBuffer.clear();
+  }
+
+  bool ReplayReader::Open(const std::string& filePath)
+  {
+    std::ifstream file(filePath.c_str(), std::ios::binary);
+    if (!file)
+    {
+      std::cout << "Couldn't open the replay file: " << filePath << std::endl;
+      return false;
+    }
+
+    mData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    mKeyframes.clear();
+
+    BinaryReader reader(mData.data(), mData.size());
+
+    uint32_t magic = 0, version = 0;
+    if (!reader.Read(magic) || (magic != cReplayMagic) || !reader.Read(version) || (version != cReplayVersion)
+      || !reader.Read(mHeader.seed)
+      || !reader.Read(mHeader.nrEntities)
+      || !reader.Read(mHeader.keyframeInterval)
+      || !reader.ReadString(mHeader.mapPath)
+      || !reader.ReadString(mHeader.modelName))
+    {
+      std::cout << "Invalid replay file: " << filePath << std::endl;
+      return false;
+    }
+
+    const size_t recordsBegin = reader.GetPos();
+    mPos = recordsBegin;
+    mTick = 0;
+    mRecordsEnd = mData.size();
+
+    // Read the keyframes index, if the recording was closed
+    uint64_t indexOffset = 0;
+    if ((mData.size() >= recordsBegin + cReplayTrailerSize)
+      && reader.Seek(mData.size() - cReplayTrailerSize) && reader.Read(indexOffset) && reader.Read(magic) 
+      && (magic == cReplayMagic) && (indexOffset >= recordsBegin) && reader.Seek(indexOffset))
+    {
+      uint8_t type = 0;
+      uint32_t nrKeyframes = 0;
+      if (reader.Read(type) && (type == ERecordIndex) && reader.Read(nrKeyframes))
+      {
+        mKeyframes.resize(nrKeyframes);
+        bool ok = true;
+        for (auto& keyframe : mKeyframes)
+        {
+          ok = ok && reader.Read(keyframe.first) && reader.Read(keyframe.second);
+        }
+
+        if (ok)
+        {
+          mRecordsEnd = indexOffset;
+          return true;
+        }
+      }
+    }
+
+    // Otherwise find the keyframes reading all the records
+    mKeyframes.clear();
+    reader.Seek(recordsBegin);
+
+    ReplayTick tick;
+    uint8_t type = 0;
+    uint32_t nrTicks = 0;
+    for (size_t pos = reader.GetPos(); reader.Read(type); pos = reader.GetPos())
+    {
+      bool ok = false;
+      if (type == ERecordTick)
+      {
+        ok = ReadTickRecord(reader, tick);
+        nrTicks++;
+      }
+      else if (type == ERecordKeyframe)
+      {
+        mKeyframes.push_back(std::make_pair(nrTicks, pos));
+        ok = SkipKeyframeRecord(reader);
+      }
+
+      if (!ok)
+      {
+        // A recording that didn't finish ends with an incomplete record
+        mRecordsEnd = pos;
+        break;
+      }
+    }
+
+    return true;
+  }
+
+  int64_t ReplayReader::Seek(uint32_t tick, Scene& scene)
+  {
+    // Last keyframe before or at tick
+    auto it = mKeyframes.rbegin();
+    while ((it != mKeyframes.rend()) && (it->first > tick)) { ++it; }
+
+    if (it == mKeyframes.rend())
+    {
+      return -1;
+    }
+
+    BinaryReader reader(mData.data(), mRecordsEnd);
+
+    uint8_t type = 0;
+    uint32_t keyframeTick = 0, size = 0;
+    if (!reader.Seek(it->second) || !reader.Read(type) || (type != ERecordKeyframe)
+      || !reader.Read(keyframeTick) || !reader.Read(size) || (size > mRecordsEnd - reader.GetPos()))
+    {
+      return -1;
+    }
+
+    BinaryReader stateReader(mData.data() + reader.GetPos(), size);
+    if (!scene.LoadState(stateReader))
+    {
+      return -1;
+    }
+
+    mPos = reader.GetPos() + size;
+    mTick = keyframeTick;
+
+    return keyframeTick;
+  }
+
+  bool ReplayReader::ReadTick(ReplayTick& tick)
+  {
+    BinaryReader reader(mData.data(), mRecordsEnd);
+    reader.Seek(mPos);
+
+    uint8_t type = 0;
+    while (reader.Read(type))
+    {
+      if (type == ERecordKeyframe)
+      {
+        if (!SkipKeyframeRecord(reader)) { return false; }
+        continue;
+      }
+
+      if ((type != ERecordTick) || !ReadTickRecord(reader, tick)) { return false; }
+
+      tick.tick = mTick++;
+      mPos = reader.GetPos();
+      return true;
+    }
+
+    return false;
+  }
+
+}
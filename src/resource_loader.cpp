@@ -0,0 +1,196 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#include "resource_loader.hpp"
+#include "job_system.hpp"
+#include "resources.hpp"
+
+#include <cassert>
+#include <iostream>
+
+#include <SDL_image.h>
+
+using namespace shooter;
+
+void ResourceLoader::AddPrograms(const std::string& folderPath)
+{
+  Resources& resources = mResources;
+  AddStep(folderPath,
+    [&resources, folderPath](JobSystem&) { return resources.LoadPrograms(folderPath); },
+    [&resources]() { resources.InitProgramsGL(); },
+    cInvalidId);
+}
+
+void ResourceLoader::AddSkyBox(const std::string& prefix)
+{
+  Resources& resources = mResources;
+  AddStep(prefix,
+    [&resources, prefix](JobSystem&) { return resources.LoadSkyBox(prefix); },
+    [&resources]() { resources.InitSkyBoxGL(); },
+    cInvalidId);
+}
+
+void ResourceLoader::AddModel(const std::string& filePath)
+{
+  Resources& resources = mResources;
+  AddStep(filePath,
+    [&resources, filePath](JobSystem&) { return resources.LoadModel(filePath); },
+    [&resources, filePath]() { resources.InitModelGL(resources.GetModelId(filePath)); },
+    cInvalidId);
+}
+
+void ResourceLoader::AddMap(const std::string& zipFilePath)
+{
+  mArchives.push_back(zipFilePath);
+
+  Resources& resources = mResources;
+  const uint32_t mapStep = AddStep(zipFilePath,
+    [&resources, zipFilePath](JobSystem& jobs) { return resources.LoadMountedMap(zipFilePath, true, &jobs); },
+    [&resources]() { resources.mMap->InitGL(resources); },
+    cInvalidId);
+
+  // The NavMesh is built from the map geometry, while the map is uploaded to the GPU
+  AddStep(zipFilePath + " navigation mesh",
+    [&resources, zipFilePath](JobSystem&) { resources.LoadNavMesh(zipFilePath); return true; },
+    std::function<void()>(),
+    mapStep);
+}
+
+uint32_t ResourceLoader::AddStep(const std::string& name, const std::function<bool(JobSystem&)>& load, const std::function<void()>& initGL, uint32_t after)
+{
+  assert((after == cInvalidId) || (after < mSteps.size()));
+
+  Step step = { name, load, initGL, after };
+  mSteps.push_back(step);
+  return mSteps.size() - 1;
+}
+
+bool ResourceLoader::Run(JobSystem& jobs, const ProgressFunc& progress)
+{
+  // SDL_image initializes its decoders on first use, which isn't thread safe
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  // Mounting changes the file system index, so the archives are mounted before the jobs read it
+  for (const std::string& zipFilePath : mArchives)
+  {
+    if (!mResources.mFileSystem.MountArchive(zipFilePath)) { return false; }
+  }
+
+  const uint32_t nrSteps = mSteps.size();
+  uint32_t nrParts = nrSteps;
+  for (const Step& step : mSteps)
+  {
+    nrParts += step.initGL ? 1 : 0;
+  }
+
+  mLoadStates.assign(nrSteps, ELoadPending);
+  mLoadedSteps.clear();
+
+  std::atomic<uint32_t> counter(0);
+  const RunData data = { this, &jobs, &counter };
+
+  for (uint32_t stepIx = 0; stepIx < nrSteps; stepIx++)
+  {
+    if (mSteps[stepIx].after == cInvalidId)
+    {
+      jobs.Push(LoadStep, &data, stepIx, stepIx + 1, counter);
+    }
+  }
+
+  // Without workers, all the steps are loaded here before the OpenGL steps
+  if (jobs.GetNrThreads() == 1)
+  {
+    jobs.Wait(counter);
+  }
+
+  bool loaded = true;
+  uint32_t nrReported = 0, nrPartsDone = 0;
+  for (uint32_t stepIx = 0; stepIx < nrSteps; )
+  {
+    // Wait for the next step in order, reporting the others as they finish
+    std::vector<uint32_t> newLoadedSteps;
+    ELoadState state = ELoadPending;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mLoadedCond.wait(lock, [&]() { return (mLoadedSteps.size() > nrReported) || (mLoadStates[stepIx] != ELoadPending); });
+
+      newLoadedSteps.assign(mLoadedSteps.begin() + nrReported, mLoadedSteps.end());
+      state = mLoadStates[stepIx];
+    }
+
+    nrReported += newLoadedSteps.size();
+    for (uint32_t loadedIx : newLoadedSteps)
+    {
+      nrPartsDone++;
+      if (progress) { progress(float(nrPartsDone) / nrParts, mSteps[loadedIx].name); }
+    }
+
+    if (state == ELoadPending) { continue; }
+
+    const Step& step = mSteps[stepIx++];
+    if (state == ELoadFailed)
+    {
+      std::cout << "Couldn't load " << step.name << std::endl;
+      loaded = false;
+    }
+    else if (step.initGL)
+    {
+      step.initGL();
+
+      nrPartsDone++;
+      if (progress) { progress(float(nrPartsDone) / nrParts, step.name); }
+    }
+  }
+
+  // All the steps are loaded, the last jobs may still be returning
+  jobs.Wait(counter);
+
+  return loaded;
+}
+
+void ResourceLoader::LoadStep(const void* data, uint32_t stepIx, uint32_t)
+{
+  const RunData& run = *static_cast<const RunData*>(data);
+  ResourceLoader& loader = *run.loader;
+  const uint32_t nrSteps = loader.mSteps.size();
+
+  const bool loaded = loader.mSteps[stepIx].load(*run.jobs);
+
+  std::vector<uint32_t> nextSteps;
+  {
+    std::lock_guard<std::mutex> lock(loader.mMutex);
+    loader.mLoadStates[stepIx] = loaded ? ELoadDone : ELoadFailed;
+    loader.mLoadedSteps.push_back(stepIx);
+
+    // Steps only wait for the steps added before them, so one pass fails the whole chain
+    for (uint32_t nextIx = stepIx + 1; nextIx < nrSteps; nextIx++)
+    {
+      const uint32_t after = loader.mSteps[nextIx].after;
+      if (loaded && (after == stepIx))
+      {
+        nextSteps.push_back(nextIx);
+      }
+      else if ((after != cInvalidId) && (loader.mLoadStates[after] == ELoadFailed) && (loader.mLoadStates[nextIx] == ELoadPending))
+      {
+        loader.mLoadStates[nextIx] = ELoadFailed;
+        loader.mLoadedSteps.push_back(nextIx);
+      }
+    }
+  }
+  loader.mLoadedCond.notify_one();
+
+  for (uint32_t nextIx : nextSteps)
+  {
+    run.jobs->Push(LoadStep, data, nextIx, nextIx + 1, *run.counter);
+  }
+}
@@ -11,15 +11,15 @@
 //
 
 #include "resources.hpp"
-#include "shader_defines.h"
-#include "shader_utils.hpp"
+#include "binary_stream.hpp"
+#include "mapped_file.hpp"
+#include "profiler.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
+#include <cstring>
 #include <experimental/filesystem> // Tested with Visual Studio 2015 and gcc version 5.3.1 20160406 (Red Hat 5.3.1-6) (GCC)
 
-#include <SDL_image.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -27,6 +27,8 @@
 #include <glm/gtx/compatibility.hpp>
 
 #include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <assimp/matrix4x4.h>
@@ -34,21 +36,11 @@
 using namespace std;
 using namespace std::experimental::filesystem;
 using namespace glm;
-using namespace ShaderUtils;
 
 namespace shooter {
 
   namespace {
 
-    /// Changes the path 
-    string GetFixedTexturePath(const char* oldFilePath, const string& altTexFolder)
-    {
-      path newPath = path(altTexFolder);
-      path texName = path(oldFilePath).filename();
-      newPath /= texName;
-      return newPath.string();
-    }
-
     void AddBoneData(uint32_t boneIndex, const aiVertexWeight& vertInfo, VertexBoneData& outVertBoneData)
     {
       for (unsigned i = 0; i < 4; i++)
@@ -68,6 +60,113 @@ namespace shooter {
       assert(0);
     }
 
+    /// Assimp post processing steps applied to the models
+    const unsigned cModelPostProcessSteps = aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs;
+
+    /// Cooked model file (see Resources::WriteCookedModel())
+    const uint32_t cCookedModelMagic = 0x4f4d4453; // "SDMO"
+    const uint32_t cCookedModelVersion = 1;
+
+    /// Key of the cooked model: hash of the model file and of the post processing steps, never 0
+    uint64_t ComputeCookedModelKey(const FileView& modelFile)
+    {
+      const uint64_t key = HashWords(&cModelPostProcessSteps, sizeof(cModelPostProcessSteps), HashWords(modelFile.GetData(), modelFile.GetSize()));
+      return (key != 0) ? key : 1;
+    }
+
+    /// Animation keys are written as two arrays, the times and the values
+    template<typename T>
+    void WriteKeys(BinaryWriter& writer, const vector<pair<float, T> >& keys)
+    {
+      vector<float> times(keys.size());
+      vector<T> values(keys.size());
+      for (size_t i = 0; i < keys.size(); i++)
+      {
+        times[i] = keys[i].first;
+        values[i] = keys[i].second;
+      }
+      writer.WriteVector(times);
+      writer.WriteVector(values);
+    }
+
+    template<typename T>
+    bool ReadKeys(BinaryReader& reader, vector<pair<float, T> >& keys)
+    {
+      vector<float> times;
+      vector<T> values;
+      if (!reader.ReadVector(times) || !reader.ReadVector(values) || (times.size() != values.size())) { return false; }
+
+      keys.resize(times.size());
+      for (size_t i = 0; i < keys.size(); i++)
+      {
+        keys[i] = make_pair(times[i], values[i]);
+      }
+      return true;
+    }
+
+    /// Assimp stream reading a file of the VirtualFileSystem
+    class AssimpFileStream : public Assimp::IOStream
+    {
+    public:
+      explicit AssimpFileStream(const FileView& file) : mFile(file), mPos(0) {}
+
+      virtual size_t Read(void* buffer, size_t size, size_t count)
+      {
+        if (size == 0) { return 0; }
+
+        count = std::min(count, (mFile.GetSize() - mPos) / size);
+        if (count > 0)
+        {
+          memcpy(buffer, mFile.GetData() + mPos, size * count);
+          mPos += size * count;
+        }
+        return count;
+      }
+
+      virtual size_t Write(const void*, size_t, size_t) { return 0; }
+
+      virtual aiReturn Seek(size_t offset, aiOrigin origin)
+      {
+        // The offset from the end wraps around, as a negative value
+        const size_t pos = (origin == aiOrigin_SET) ? offset : (origin == aiOrigin_CUR) ? mPos + offset : mFile.GetSize() + offset;
+        if (pos > mFile.GetSize()) { return aiReturn_FAILURE; }
+
+        mPos = pos;
+        return aiReturn_SUCCESS;
+      }
+
+      virtual size_t Tell() const { return mPos; }
+      virtual size_t FileSize() const { return mFile.GetSize(); }
+      virtual void Flush() {}
+
+    private:
+      FileView mFile;
+      size_t mPos;
+    };
+
+    /// Assimp file system reading the model files, and the files they reference, from the VirtualFileSystem
+    class AssimpIOSystem : public Assimp::IOSystem
+    {
+    public:
+      explicit AssimpIOSystem(const VirtualFileSystem& fileSystem) : mFileSystem(fileSystem) {}
+
+      virtual bool Exists(const char* filePath) const { return mFileSystem.Exists(filePath); }
+      virtual char getOsSeparator() const { return '/'; }
+
+      virtual Assimp::IOStream* Open(const char* filePath, const char* mode = "rb")
+      {
+        FileView file;
+        if ((mode[0] != 'r') || !mFileSystem.Open(filePath, file)) { return nullptr; }
+
+        return new AssimpFileStream(file);
+      }
+
+      virtual void Close(Assimp::IOStream* file) { delete file; }
+
+    private:
+      const VirtualFileSystem& mFileSystem;
+    };
+
     template <class taType, taType(*fnInterp)(const taType&, const taType&, float)>
     taType InterpolateKey(const vector<pair<float, taType> >& keys, float animTime, taType lastVal, float lastAnimTime)
     {
@@ -112,29 +211,38 @@ namespace shooter {
 
   Resources::~Resources() 
   {
-    glDeleteBuffers(mBufferObjects.size(), mBufferObjects.data());
-    for (auto pair : mPrograms) { glDeleteProgram(pair.second); }
-    for (auto pair : mModels) 
-    {
-      glDeleteTextures(pair.second.textures.size(), pair.second.textures.data());
-      for (auto mesh : pair.second.meshes) { glDeleteVertexArrays(1, &mesh.vao); }
-      for (auto mat : pair.second.materialsTex)
-      {
-        for (auto typeAndObj : mat) { glDeleteTextures(1, &typeAndObj.second); }
-      }
-    }
-    glDeleteTextures(1, &mSkyBoxTexture);
+    ReleaseGL();
   }
 
-  bool Resources::LoadMap(const std::string& zipFilePath) 
+  bool Resources::LoadMap(const std::string& zipFilePath, bool decodeTextures, JobSystem* jobs) 
   {
-    mMap.reset(new Q3Map(mResourceFolder + zipFilePath));
+    // The map archive is layered over the resource folder
+    if (!mFileSystem.MountArchive(zipFilePath))
+    {
+      return false;
+    }
 
-    if (!mMap->GetMapQ3().mVertices.size())
+    if (!LoadMountedMap(zipFilePath, decodeTextures, jobs))
     {
       return false;
     }
 
+    LoadNavMesh(zipFilePath);
+    return true;
+  }
+
+  bool Resources::LoadMountedMap(const std::string& zipFilePath, bool decodeTextures, JobSystem* jobs)
+  {
+    // The map caches are written next to the archive. The texture types depend on decodeTextures,
+    // so the headless tools, which don't decode the textures, keep their own cooked map.
+    const string cookedMapPath = mResourceFolder + zipFilePath + (decodeTextures ? ".cooked" : ".nodecode.cooked");
+    mMap.reset(new Q3Map(mFileSystem, zipFilePath, cookedMapPath, decodeTextures, jobs));
+
+    return !mMap->GetMapQ3().mVertices.empty();
+  }
+
+  void Resources::LoadNavMesh(const std::string& zipFilePath)
+  {
     std::vector<int> indices;
     std::vector<float> vertices, normals;
     mMap->GetVerticesAndIndices(vertices, normals, indices);
@@ -152,126 +260,388 @@ namespace shooter {
         indices.data(), indices.size() / 3,
         (const float *)&mMap->GetMapQ3().mNodes[0].mMins,
         (const float *)mMap->GetMapQ3().mNodes[0].mMaxs,
-        6.f, 10.f, 3.f, 4.f, .9f, 18.f));
-
-    return true;
+        6.f, 10.f, 3.f, 4.f, .9f, 18.f,
+        mResourceFolder + zipFilePath + ".navmesh"));
   }
 
-  bool Resources::LoadSkyBox(const std::string& prefix)
+  bool Resources::LoadPrograms(const string& folderPath)
   {
-    std::vector<std::string> extensions = { ".png", ".jpg", ".png", ".tga" };
-    for (const auto& ext : extensions)
+    const string folder = VirtualFileSystem::NormalizePath(folderPath);
+    const vector<string> filePaths = mFileSystem.List(folder);
+
+    // Check for correct path
+    if (filePaths.empty())
+    {
+      cout << "Invalid resource path: " << folderPath << endl;
+      return false;
+    }
+
+    // Group the sources of all files with the same name in the folder (not in its subfolders)
+    unordered_map<string, vector<pair<string, string> > > shadersMap;
+    for (const string& filePath : filePaths)
     {
-      mSkyBoxTexture = ShaderUtils::LoadCubeMapTexture(
-        mResourceFolder + prefix + "_rt" + ext,
-        mResourceFolder + prefix + "_lf" + ext,
-        mResourceFolder + prefix + "_up" + ext,
-        mResourceFolder + prefix + "_dn" + ext,
-        mResourceFolder + prefix + "_bk" + ext,
-        mResourceFolder + prefix + "_ft" + ext);
+      const path p(filePath);
+      FileView file;
+      if ((p.parent_path().string() == folder) && mFileSystem.Open(filePath, file))
+      {
+        shadersMap[p.stem().string()].emplace_back(filePath, string((const char*)file.GetData(), file.GetSize()));
+      }
+    }
 
-      if (mSkyBoxTexture) { break; }
+    auto it = shadersMap.find("shader_defines");
+    if ((it != end(shadersMap)) && !it->second.empty())
+    {
+      mShaderDefines = it->second[0].second;
     }
 
-    if (mSkyBoxTexture) { return true; }
-    
-    return false;
+    // The programs are compiled by InitGL()
+    mProgramsSources.swap(shadersMap);
+
+    if (mProgramsSources.empty()) { return false; }
+
+    return true;
   }
 
-  bool Resources::LoadPrograms(const string& folderPath)
+  bool Resources::LoadModel(const std::string& filePath, bool decodeTextures)
   {
-    path root(mResourceFolder + folderPath);
-
-    // Check for correct path
-    if (!exists(root) || !is_directory(root))
+    FileView modelFile;
+    if (!mFileSystem.Open(filePath, modelFile))
     {
-      cout << "Invalid resource path: " << folderPath << endl;
+      cout << "Couldn't open the model: " << filePath << endl;
       return false;
     }
 
-    // Group all files with the same name in the resourcePath folder
-    unordered_map<string, vector<string> > pathMap;
-    for (directory_iterator it(root), itEnd; it != itEnd; ++it)
+    // The first load imports the model with Assimp and writes the cooked model next to it
+    const string cookedModelPath = mResourceFolder + filePath + ".cooked";
+    const uint64_t cookedModelKey = ComputeCookedModelKey(modelFile);
+
+    // The Model is read unlocked, and added to mModels at the end
+    ImportedModel imported;
+    if (!ReadCookedModel(cookedModelPath, cookedModelKey, imported))
     {
-      const path& p(*it);
-      if (is_regular_file(p))
-      {
-        pathMap[p.stem().string()].push_back(p.string());
-      }
+      if (!ImportModel(mFileSystem, filePath, imported)) { return false; }
+
+      WriteCookedModel(cookedModelPath, cookedModelKey, imported);
     }
 
-    string definesPath;
-    auto it = pathMap.find("shader_defines");
-    if ((it != end(pathMap)) && !it->second.empty())
+    Model& model = imported.model;
+    model.texturesAltPath = path(filePath).parent_path().string();
+
+    // Decode the textures here, so only their upload is left to InitGL()
+    if (decodeTextures)
     {
-      definesPath = it->second[0];
+      DecodeTextures(imported.embeddedTexturesData, model);
     }
 
-    // Load programs
-    for (const auto& pair : pathMap)
+    std::lock_guard<std::mutex> lock(mModelsMutex);
+
+    // Animations are indexed by their global id, so the same AnimationId works for all the Models
+    std::vector<AnimationId> animationIds(imported.animationsNames.size());
+    for (uint32_t i = 0; i < animationIds.size(); i++)
     {
-      uint32_t programId = LoadProgram(pair.second, definesPath);
-      if (programId > 0)
-      {
-        mPrograms[pair.first] = programId;
-      }
+      animationIds[i] = mAnimationsNames.Register(imported.animationsNames[i]);
+    }
+
+    std::vector<Animation> animations;
+    animations.swap(model.animations);
+    model.animations.resize(mAnimationsNames.Size());
+    for (uint32_t i = 0; i < animationIds.size(); i++)
+    {
+      model.animations[animationIds[i]] = std::move(animations[i]);
     }
 
-    if (mPrograms.empty()) { return false; }
+    ModelId modelId = mModelsNames.Register(filePath);
+    if (modelId >= mModels.size()) { mModels.resize(modelId + 1); }
+    mModels[modelId] = std::move(model);
 
     return true;
   }
 
-  bool Resources::LoadModel(const std::string& filePath)
+  bool Resources::ImportModel(const VirtualFileSystem& fileSystem, const std::string& filePath, ImportedModel& outModel)
   {
     Assimp::Importer importer;
+    importer.SetIOHandler(new AssimpIOSystem(fileSystem)); // owned by the importer
 
     // The Assimp scene object
-    const aiScene* scene = importer.ReadFile(mResourceFolder + filePath, aiProcessPreset_TargetRealtime_Quality | aiProcess_FlipUVs);
+    const aiScene* scene = importer.ReadFile(filePath, cModelPostProcessSteps);
     if (!scene)
     {
       cout << importer.GetErrorString() << endl;
       return false;
     }
 
-    Model& model = mModels[filePath];
+    Model& model = outModel.model;
+
+    // Animations in the file order
+    model.animations.resize(scene->mNumAnimations);
+    for (uint i = 0; i < scene->mNumAnimations; i++)
+    {
+      outModel.animationsNames.push_back(scene->mAnimations[i]->mName.C_Str());
+    }
 
     model.globalInvTrans = glm::inverse(glm::transpose(make_mat4(&scene->mRootNode->mTransformation.a1)));
     ProcessNodeHierarchy(scene, scene->mRootNode, model, -1);
-    LoadEmbeddedTextures(scene, model);
-    LoadMaterials(scene, mResourceFolder + path(filePath).parent_path().string(), model);
-    LoadMeshes(scene, path(filePath).parent_path().string(), model, mBufferObjects);
+    LoadEmbeddedTextures(scene, outModel.embeddedTexturesData);
+    LoadMaterials(scene, model);
+    LoadMeshes(scene, model);
 
     // We're done. Everything will be cleaned up by the importer destructor
     return true;
   }
 
-  GLuint Resources::GetProgram(const std::string& programName) const {
-    auto it = mPrograms.find(programName);
-    if (it != mPrograms.end())
+  bool Resources::ReadCookedModel(const std::string& filePath, uint64_t key, ImportedModel& outModel)
+  {
+    MappedFile file;
+    if (!file.Open(filePath)) { return false; }
+
+    BinaryReader reader(file.GetData(), file.GetSize());
+
+    uint32_t magic = 0, version = 0;
+    uint64_t fileKey = 0;
+    if (!reader.Read(magic) || (magic != cCookedModelMagic) || !reader.Read(version) || (version != cCookedModelVersion)
+      || !reader.Read(fileKey) || (fileKey != key))
+    {
+      cout << "Stale cooked model: " << filePath << endl;
+      return false;
+    }
+
+    // The arrays are copied from the mapped file as they are, the counts are checked against the file size by the reads
+    ImportedModel imported;
+    Model& model = imported.model;
+    bool valid = true;
+
+    uint32_t nrNodesNames = 0;
+    valid = valid && reader.Read(nrNodesNames);
+    for (uint32_t i = 0; valid && (i < nrNodesNames); i++)
+    {
+      string name;
+      uint32_t nodeIndex = 0;
+      valid = reader.ReadString(name) && reader.Read(nodeIndex);
+      model.nodesMap[name] = nodeIndex;
+    }
+
+    valid = valid
+      && reader.ReadVector(model.nodesParents)
+      && reader.Read(model.globalInvTrans)
+      && reader.ReadVector(model.nodesTrans)
+      && reader.ReadVector(model.bonesOffsets)
+      && reader.ReadVector(model.invBonesOffsets);
+
+    uint32_t nrAnimations = 0;
+    valid = valid && reader.Read(nrAnimations);
+    for (uint32_t i = 0; valid && (i < nrAnimations); i++)
+    {
+      imported.animationsNames.push_back(string());
+      model.animations.push_back(Animation());
+      Animation& animation = model.animations.back();
+
+      uint32_t nrNodesAnimations = 0;
+      valid = reader.ReadString(imported.animationsNames.back())
+        && reader.Read(animation.durationInTicks)
+        && reader.Read(animation.ticksPerSecond)
+        && reader.Read(nrNodesAnimations);
+      for (uint32_t j = 0; valid && (j < nrNodesAnimations); j++)
+      {
+        animation.nodesAnimation.push_back(NodeAnimation());
+        NodeAnimation& nodeAnim = animation.nodesAnimation.back();
+        valid = reader.Read(nodeAnim.preState)
+          && reader.Read(nodeAnim.postState)
+          && ReadKeys(reader, nodeAnim.translations)
+          && ReadKeys(reader, nodeAnim.rotations)
+          && ReadKeys(reader, nodeAnim.scalings);
+      }
+    }
+
+    uint32_t nrEmbeddedTextures = 0;
+    valid = valid && reader.Read(nrEmbeddedTextures);
+    for (uint32_t i = 0; valid && (i < nrEmbeddedTextures); i++)
+    {
+      imported.embeddedTexturesData.push_back(vector<uint8_t>());
+      valid = reader.ReadVector(imported.embeddedTexturesData.back());
+    }
+
+    uint32_t nrMaterials = 0;
+    valid = valid && reader.Read(nrMaterials);
+    for (uint32_t i = 0; valid && (i < nrMaterials); i++)
+    {
+      model.materialsData.push_back(MaterialData());
+      MaterialData& matData = model.materialsData.back();
+
+      uint32_t nrTextures = 0;
+      valid = reader.Read(nrTextures);
+      for (uint32_t j = 0; valid && (j < nrTextures); j++)
+      {
+        matData.textures.push_back(make_pair(ETextureType_NONE, string()));
+        valid = reader.Read(matData.textures.back().first) && reader.ReadString(matData.textures.back().second);
+      }
+      valid = valid && reader.Read(matData.colors);
+    }
+
+    uint32_t nrMeshes = 0;
+    valid = valid && reader.Read(nrMeshes);
+    for (uint32_t i = 0; valid && (i < nrMeshes); i++)
+    {
+      model.meshesData.push_back(MeshData());
+      MeshData& meshData = model.meshesData.back();
+      valid = reader.Read(meshData.materialIndex)
+        && reader.Read(meshData.numFaces)
+        && reader.ReadVector(meshData.indices)
+        && reader.ReadVector(meshData.positions)
+        && reader.ReadVector(meshData.normals)
+        && reader.ReadVector(meshData.texCoords)
+        && reader.ReadVector(meshData.bonesData);
+    }
+
+    valid = valid
+      && reader.Read(model.minBound)
+      && reader.Read(model.maxBound)
+      && reader.Read(model.normScale)
+      && reader.IsEnd();
+
+    if (!valid)
+    {
+      cout << "Invalid cooked model: " << filePath << endl;
+      return false;
+    }
+
+    outModel = std::move(imported);
+    return true;
+  }
+
+  void Resources::WriteCookedModel(const std::string& filePath, uint64_t key, const ImportedModel& imported)
+  {
+    if (key == 0) { return; }
+
+    const Model& model = imported.model;
+
+    std::vector<uint8_t> data;
+    BinaryWriter writer(data);
+    writer.Write(cCookedModelMagic);
+    writer.Write(cCookedModelVersion);
+    writer.Write(key);
+
+    writer.Write(static_cast<uint32_t>(model.nodesMap.size()));
+    for (const auto& nameAndIndex : model.nodesMap)
+    {
+      writer.WriteString(nameAndIndex.first);
+      writer.Write(nameAndIndex.second);
+    }
+
+    writer.WriteVector(model.nodesParents);
+    writer.Write(model.globalInvTrans);
+    writer.WriteVector(model.nodesTrans);
+    writer.WriteVector(model.bonesOffsets);
+    writer.WriteVector(model.invBonesOffsets);
+
+    writer.Write(static_cast<uint32_t>(model.animations.size()));
+    for (uint32_t i = 0; i < model.animations.size(); i++)
+    {
+      const Animation& animation = model.animations[i];
+      writer.WriteString(imported.animationsNames[i]);
+      writer.Write(animation.durationInTicks);
+      writer.Write(animation.ticksPerSecond);
+      writer.Write(static_cast<uint32_t>(animation.nodesAnimation.size()));
+      for (const NodeAnimation& nodeAnim : animation.nodesAnimation)
+      {
+        writer.Write(nodeAnim.preState);
+        writer.Write(nodeAnim.postState);
+        WriteKeys(writer, nodeAnim.translations);
+        WriteKeys(writer, nodeAnim.rotations);
+        WriteKeys(writer, nodeAnim.scalings);
+      }
+    }
+
+    writer.Write(static_cast<uint32_t>(imported.embeddedTexturesData.size()));
+    for (const vector<uint8_t>& texData : imported.embeddedTexturesData)
+    {
+      writer.WriteVector(texData);
+    }
+
+    writer.Write(static_cast<uint32_t>(model.materialsData.size()));
+    for (const MaterialData& matData : model.materialsData)
+    {
+      writer.Write(static_cast<uint32_t>(matData.textures.size()));
+      for (const auto& typeAndPath : matData.textures)
+      {
+        writer.Write(typeAndPath.first);
+        writer.WriteString(typeAndPath.second);
+      }
+      writer.Write(matData.colors);
+    }
+
+    // The vertex and index arrays are laid out as their OpenGL buffers
+    writer.Write(static_cast<uint32_t>(model.meshesData.size()));
+    for (const MeshData& meshData : model.meshesData)
+    {
+      writer.Write(meshData.materialIndex);
+      writer.Write(meshData.numFaces);
+      writer.WriteVector(meshData.indices);
+      writer.WriteVector(meshData.positions);
+      writer.WriteVector(meshData.normals);
+      writer.WriteVector(meshData.texCoords);
+      writer.WriteVector(meshData.bonesData);
+    }
+
+    writer.Write(model.minBound);
+    writer.Write(model.maxBound);
+    writer.Write(model.normScale);
+
+    if (!WriteFileAtomically(filePath, data.data(), data.size()))
+    {
+      cout << "Couldn't write the cooked model: " << filePath << endl;
+    }
+  }
+
+  uint32_t NamesRegistry::Register(const std::string& name)
+  {
+    auto it = mIds.find(name);
+    if (it != mIds.end())
     {
       return it->second;
     }
 
-    return 0;
+    uint32_t id = mNames.size();
+    mIds[name] = id;
+    mNames.push_back(name);
+    return id;
   }
 
-  const Model& Resources::GetModel(const std::string& modelName) const {
-    auto it = mModels.find(modelName);
-    if (it != mModels.end())
+  uint32_t NamesRegistry::Find(const std::string& name) const
+  {
+    auto it = mIds.find(name);
+    if (it != mIds.end())
     {
       return it->second;
     }
 
+    return cInvalidId;
+  }
+
+  GLuint Resources::GetProgram(ProgramId programId) const 
+  {
+    if (programId < mPrograms.size())
+    {
+      return mPrograms[programId];
+    }
+
+    return 0;
+  }
+
+  const Model& Resources::GetModel(ModelId modelId) const 
+  {
+    if (modelId < mModels.size())
+    {
+      return mModels[modelId];
+    }
+
     return mEmptyModel;
   }
 
-  const Animation& Resources::GetAnimation(const Model& model, const std::string& animationName) const
+  const Animation& Resources::GetAnimation(const Model& model, AnimationId animationId) const
   {
-    auto it = model.animationsMap.find(animationName);
-    if (it != model.animationsMap.end())
+    if (animationId < model.animations.size())
     {
-      return it->second;
+      return model.animations[animationId];
     }
 
     return mEmptyAnimation;
@@ -280,30 +650,27 @@ namespace shooter {
   const Animation& Resources::GetAnimation(const std::string& modelName, const std::string& animationName) const
   {
     const Model& model = GetModel(modelName);
-    return GetAnimation(model, animationName);
+    return GetAnimation(model, GetAnimationId(animationName));
   }
 
   void Resources::GetSkeletonTransforms(
     const Model& model,
-    const std::string& animationName,
+    AnimationId animationId,
     float animationTimeInSeconds,
     float& lastAnimationTimeInSeconds,
-    std::vector<AnimationFrame>& inoutLastAnimationFrames,
-    std::vector<glm::mat4>& outGlobalTransforms) const
+    AnimationFrame* inoutLastAnimationFrames,
+    glm::mat4* outGlobalTransforms) const
   {
-    const auto itAnim = model.animationsMap.find(animationName);
-    if (itAnim == model.animationsMap.end()) 
+    PROFILER_ZONE("Resources::GetSkeletonTransforms");
+
+    const Animation& anim = GetAnimation(model, animationId);
+    if (anim.nodesAnimation.empty()) 
     {
       return;
     }
 
     const int32_t nrNodes = model.nodesParents.size();
 
-    inoutLastAnimationFrames.resize(nrNodes);
-    outGlobalTransforms.resize(nrNodes);
-
-    const Animation& anim(itAnim->second);
-
     float ticksPerSecond = anim.ticksPerSecond != 0 ? anim.ticksPerSecond : 25.0f;
     ticksPerSecond *= 2.f; // tune the animation speed
     float lastTimeInTicks = lastAnimationTimeInSeconds * ticksPerSecond;
@@ -414,7 +781,12 @@ namespace shooter {
     }
   }
 
-  void Resources::ProcessNode(const aiScene* scene, const aiNode* pNode, Model& model, int32_t parentNodeIndex, int32_t nodeIndex)
+  void Resources::ProcessNode(
+    const aiScene* scene, 
+    const aiNode* pNode, 
+    Model& model, 
+    int32_t parentNodeIndex, 
+    int32_t nodeIndex)
   {
     string nodeName(pNode->mName.C_Str());
 
@@ -431,7 +803,7 @@ namespace shooter {
       for (uint i = 0; i < scene->mNumAnimations; i++)
       {
         const aiAnimation* anim = scene->mAnimations[i];
-        Animation& animation = model.animationsMap[anim->mName.C_Str()];
+        Animation& animation = model.animations[i];
 
         assert(animation.nodesAnimation.size() == nodeIndex);
         ProcessNodeAnim(nodeName, anim, animation);
@@ -439,7 +811,11 @@ namespace shooter {
     }
   }
 
-  void Resources::ProcessNodeHierarchy(const aiScene* scene, const aiNode* pNode, Model& model, int32_t parentNodeIndex)
+  void Resources::ProcessNodeHierarchy(
+    const aiScene* scene, 
+    const aiNode* pNode, 
+    Model& model, 
+    int32_t parentNodeIndex)
   {
     uint32 nodeIndex = model.nodesParents.size();
 
@@ -451,66 +827,44 @@ namespace shooter {
     }
   }
 
-  GLuint Resources::LoadTexture(string name, TextureMap& textureMap)
-  {
-    auto it = textureMap.find(name);
-    if (it != textureMap.end())
-    {
-      return it->second;
-    }
-    uint32_t bpp;
-    return ShaderUtils::LoadTexture(name, bpp);
-  }
-
-  void Resources::LoadEmbeddedTextures(const aiScene* scene, Model& model)
+  void Resources::LoadEmbeddedTextures(const aiScene* scene, std::vector<std::vector<uint8_t> >& outTexturesData)
   {
     for_each(scene->mTextures, scene->mTextures + scene->mNumTextures, [&](const aiTexture* tex) {
-      model.textures.push_back(ShaderUtils::LoadTexture(tex));
+      outTexturesData.push_back(vector<uint8_t>());
+      if (tex->mHeight == 0)
+      {
+        // compressed texture, mWidth is the size in bytes
+        const uint8_t* pData = reinterpret_cast<const uint8_t*>(tex->pcData);
+        outTexturesData.back().assign(pData, pData + tex->mWidth);
+      }
     });
   }
 
-  void Resources::LoadMaterials(const aiScene* scene, const string& altPath, Model& model)
+  void Resources::LoadMaterials(const aiScene* scene, Model& model)
   {
     for (uint32_t matIndex = 0; matIndex < scene->mNumMaterials; matIndex++)
     {
       const aiMaterial* mtl = scene->mMaterials[matIndex];
 
+      model.materialsData.push_back(MaterialData());
+      MaterialData& matData = model.materialsData.back();
+
       // process the material's textures
-      model.materialsTex.push_back(MaterialTextures());
-      MaterialTextures& matTex = model.materialsTex.back();
       for (int texType = 0; texType < aiTextureType_UNKNOWN; texType++)
       {
         aiTextureType aiTexType = (aiTextureType)texType;
         int texTypeCnt = mtl->GetTextureCount((aiTextureType)texType);
         for (int texTypeIndex = 0; texTypeIndex < texTypeCnt; texTypeIndex++)
         {
-          GLuint texObj = 0;
           aiString texPath;
           if (AI_SUCCESS == mtl->GetTexture(aiTexType, texTypeIndex, &texPath))
           {
-            if (texPath.data[0] == '*')
-            {
-              // embeded texture
-              GLuint iIndex = atoi(texPath.C_Str() + 1);
-              if (iIndex < model.textures.size())
-              {
-                texObj = model.textures[iIndex];
-              }
-            }
-            else
-            {
-              texObj = LoadTexture(texPath.data, model.textureMap);
-              if (texObj == 0)
-              {
-                texObj = LoadTexture(GetFixedTexturePath(texPath.data, altPath), model.textureMap);
-              }
-            }
-            matTex.push_back(make_pair((TextureType)texType, texObj));
+            matData.textures.push_back(make_pair((TextureType)texType, string(texPath.C_Str())));
           }
         }
       }
 
-      MaterialColors mat;
+      MaterialColors& mat = matData.colors;
       aiColor4D c;
 
       // process the material colors
@@ -539,14 +893,7 @@ namespace shooter {
       aiGetMaterialFloatArray(mtl, AI_MATKEY_SHININESS, &shininess, &max);
       mat.shininess = shininess;
 
-      mat.texCount = model.materialsTex.back().size();
-
-      GLuint buffer = 0;
-      glGenBuffers(1, &buffer);
-      glBindBuffer(GL_UNIFORM_BUFFER, buffer);
-      glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialColors), (void *)(&mat), GL_STATIC_DRAW);
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
-      model.materialsCol.push_back(buffer);
+      mat.texCount = matData.textures.size();
     }
   }
 
@@ -580,12 +927,8 @@ namespace shooter {
     return data;
   }
 
-  void Resources::LoadMeshes(const aiScene* scene, const string& modelPath, Model& model, std::vector<GLuint>& inoutBufferObjs)
+  void Resources::LoadMeshes(const aiScene* scene, Model& model)
   {
-    TextureMap textureMap;
-
-    GLuint buffer = 0;
-
     aiVector3D minBound = { FLT_MAX, FLT_MAX, FLT_MAX };
     aiVector3D maxBound = { FLT_MIN, FLT_MIN, FLT_MIN };
 
@@ -595,11 +938,13 @@ namespace shooter {
     // For each mesh
     for (uint32_t n = 0; n < scene->mNumMeshes; ++n)
     {
-      Mesh aMesh = {};
+      model.meshesData.push_back(MeshData());
+      MeshData& aMesh = model.meshesData.back();
 
       const aiMesh* mesh = scene->mMeshes[n];
 
       aMesh.materialIndex = mesh->mMaterialIndex;
+      aMesh.numFaces = 0;
 
       // update scene's bounding box
       for_each(mesh->mVertices, mesh->mVertices + mesh->mNumVertices, [&](const aiVector3D& v) 
@@ -609,88 +954,47 @@ namespace shooter {
         minBound.z = glm::min(minBound.z, v.z); maxBound.z = glm::max(maxBound.z, v.z);
       });
 
-      // generate Vertex Array for mesh
-      glGenVertexArrays(1, &(aMesh.vao));
-      glBindVertexArray(aMesh.vao);
-
-      // buffer for faces
+      // faces
       if (mesh->HasFaces())
       {
-        std::vector<uint32_t> faceArray;
-        faceArray.reserve(mesh->mNumFaces * 3);
+        aMesh.indices.reserve(mesh->mNumFaces * 3);
         for (uint32_t t = 0; t < mesh->mNumFaces; ++t)
         {
           const aiFace& face = mesh->mFaces[t];
-          faceArray.insert(faceArray.end(), face.mIndices, face.mIndices + face.mNumIndices);
+          aMesh.indices.insert(aMesh.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
         }
-        aMesh.numFaces = scene->mMeshes[n]->mNumFaces;
-
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * faceArray.size(), faceArray.data(), GL_STATIC_DRAW);
-        inoutBufferObjs.push_back(buffer);
+        aMesh.numFaces = mesh->mNumFaces;
       }
 
-      // buffer for vertex positions
+      // vertex positions
       if (mesh->HasPositions())
       {
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * mesh->mNumVertices, mesh->mVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(VERT_POSITION_LOC);
-        glVertexAttribPointer(VERT_POSITION_LOC, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        inoutBufferObjs.push_back(buffer);
+        const vec3* pPositions = reinterpret_cast<const vec3*>(mesh->mVertices);
+        aMesh.positions.assign(pPositions, pPositions + mesh->mNumVertices);
       }
 
-      // buffer for vertex normals
+      // vertex normals
       if (mesh->HasNormals())
       {
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * mesh->mNumVertices, mesh->mNormals, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(VERT_NORMAL_LOC);
-        glVertexAttribPointer(VERT_NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        inoutBufferObjs.push_back(buffer);
+        const vec3* pNormals = reinterpret_cast<const vec3*>(mesh->mNormals);
+        aMesh.normals.assign(pNormals, pNormals + mesh->mNumVertices);
       }
 
-      // buffer for vertex texture coordinates
+      // vertex texture coordinates
       if (mesh->HasTextureCoords(0))
       {
-        std::vector<float> texCoords;
-        texCoords.reserve(2 * mesh->mNumVertices);
+        aMesh.texCoords.reserve(mesh->mNumVertices);
         for (unsigned int k = 0; k < mesh->mNumVertices; ++k)
         {
-          texCoords.push_back(mesh->mTextureCoords[0][k].x);
-          texCoords.push_back(mesh->mTextureCoords[0][k].y);
+          aMesh.texCoords.push_back(vec2(mesh->mTextureCoords[0][k].x, mesh->mTextureCoords[0][k].y));
         }
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 2 * mesh->mNumVertices, texCoords.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(VERT_DIFFUSE_TEX_COORD_LOC);
-        glVertexAttribPointer(VERT_DIFFUSE_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        inoutBufferObjs.push_back(buffer);
       }
 
-      // buffer for vertex bone IDs and Weights
+      // vertex bone IDs and Weights
       if (mesh->HasBones())
       {
-        vector<VertexBoneData> vertexBoneData = LoadBones(mesh, model.nodesMap, model.bonesOffsets, model.invBonesOffsets);
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexBoneData) * vertexBoneData.size(), vertexBoneData.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(VERT_BONE_IDS_LOC);
-        glVertexAttribIPointer(VERT_BONE_IDS_LOC, 4, GL_UNSIGNED_INT, sizeof(VertexBoneData), 0);
-        glEnableVertexAttribArray(VERT_BONE_WEIGHTS_LOC);
-        glVertexAttribPointer(VERT_BONE_WEIGHTS_LOC, 4, GL_FLOAT, GL_TRUE, sizeof(VertexBoneData), (const GLvoid*)16);
-        inoutBufferObjs.push_back(buffer);
+        aMesh.bonesData = LoadBones(mesh, model.nodesMap, model.bonesOffsets, model.invBonesOffsets);
       }
-
-      // unbind buffers
-      glBindVertexArray(0);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-      model.meshes.push_back(aMesh);
     }
 
     model.minBound = make_vec3(&minBound.x);
@@ -710,4 +1014,4 @@ namespace shooter {
     }
   }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,336 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// The parts of Resources that call SDL_image and OpenGL. The targets without a renderer link tools/no_renderer.cpp instead.
+
+#include "resources.hpp"
+#include "shader_defines.h"
+#include "shader_utils.hpp"
+
+#include <iostream>
+#include <experimental/filesystem>
+
+#include <SDL_image.h>
+
+using namespace std;
+using namespace std::experimental::filesystem;
+using namespace glm;
+using namespace ShaderUtils;
+
+namespace shooter {
+
+  namespace {
+
+    /// Changes the path 
+    string GetFixedTexturePath(const char* oldFilePath, const string& altTexFolder)
+    {
+      path newPath = path(altTexFolder);
+      path texName = path(oldFilePath).filename();
+      newPath /= texName;
+      return newPath.string();
+    }
+
+    /// Decode an image file
+    /// @return decoded surface or nullptr if error
+    SDL_Surface* DecodeImage(const VirtualFileSystem& fileSystem, const string& filePath)
+    {
+      FileView file;
+      if (!fileSystem.Open(filePath, file)) { return nullptr; }
+
+      SDL_Surface* surface = IMG_Load_RW(SDL_RWFromConstMem(file.GetData(), int(file.GetSize())), 1);
+      if (surface == nullptr)
+      {
+        cout << "Couldn't load texture " << filePath << endl;
+        cout << SDL_GetError() << endl;
+      }
+      return surface;
+    }
+
+  }
+
+  void Resources::ReleaseGL()
+  {
+    // Free the decoded textures that were not uploaded
+    for (SDL_Surface* surface : mSkyBoxFaces) { SDL_FreeSurface(surface); }
+    for (const auto& model : mModels)
+    {
+      for (SDL_Surface* surface : model.embeddedTextures) { SDL_FreeSurface(surface); }
+      for (const auto& matData : model.materialsData)
+      {
+        for (SDL_Surface* surface : matData.surfaces) { SDL_FreeSurface(surface); }
+      }
+    }
+
+    // Nothing was uploaded to the GPU (headless mode)
+    if (mBufferObjects.empty() && mPrograms.empty() && (mSkyBoxTexture == 0)) { return; }
+
+    glDeleteBuffers(mBufferObjects.size(), mBufferObjects.data());
+    for (auto program : mPrograms) { glDeleteProgram(program); }
+    for (const auto& model : mModels) 
+    {
+      glDeleteTextures(model.textures.size(), model.textures.data());
+      glDeleteBuffers(model.materialsCol.size(), model.materialsCol.data());
+      for (auto mesh : model.meshes) { glDeleteVertexArrays(1, &mesh.vao); }
+      for (auto mat : model.materialsTex)
+      {
+        for (auto typeAndObj : mat) { glDeleteTextures(1, &typeAndObj.second); }
+      }
+    }
+    glDeleteTextures(1, &mSkyBoxTexture);
+  }
+
+  void Resources::InitGL()
+  {
+    // The map needs the programs ids
+    InitProgramsGL();
+    InitSkyBoxGL();
+
+    if (mMap)
+    {
+      mMap->InitGL(*this);
+    }
+
+    for (ModelId modelId = 0; modelId < mModels.size(); modelId++)
+    {
+      InitModelGL(modelId);
+    }
+  }
+
+  void Resources::InitProgramsGL()
+  {
+    for (const auto& pair : mProgramsSources)
+    {
+      uint32_t programId = LoadProgram(pair.second, mShaderDefines);
+      if (programId > 0)
+      {
+        ProgramId id = mProgramsNames.Register(pair.first);
+        if (id >= mPrograms.size()) { mPrograms.resize(id + 1, 0); }
+        mPrograms[id] = programId;
+      }
+    }
+
+    mProgramsSources.clear();
+    mShaderDefines.clear();
+  }
+
+  void Resources::InitSkyBoxGL()
+  {
+    if (mSkyBoxFaces[0] == nullptr) { return; } // not loaded, or already uploaded
+
+    // LoadCubeMapTexture frees the faces
+    mSkyBoxTexture = ShaderUtils::LoadCubeMapTexture(mSkyBoxFaces);
+    std::fill(mSkyBoxFaces, mSkyBoxFaces + 6, nullptr);
+  }
+
+  void Resources::InitModelGL(ModelId modelId)
+  {
+    std::lock_guard<std::mutex> lock(mModelsMutex);
+
+    Model& model = mModels[modelId];
+    if (!model.meshes.empty()) { return; } // already uploaded
+
+    UploadTextures(model);
+    UploadMaterials(model);
+    UploadMeshes(model, mBufferObjects);
+  }
+
+  bool Resources::LoadSkyBox(const std::string& prefix)
+  {
+    std::vector<std::string> extensions = { ".png", ".jpg", ".png", ".tga" };
+    const char* const cFacesSuffixes[6] = { "_rt", "_lf", "_up", "_dn", "_bk", "_ft" };
+    for (const auto& ext : extensions)
+    {
+      if (!mFileSystem.Exists(prefix + cFacesSuffixes[0] + ext)) { continue; }
+
+      bool decoded = true;
+      for (uint32_t i = 0; i < 6; i++)
+      {
+        mSkyBoxFaces[i] = DecodeImage(mFileSystem, prefix + cFacesSuffixes[i] + ext);
+        decoded = decoded && (mSkyBoxFaces[i] != nullptr);
+      }
+
+      if (decoded) { return true; }
+
+      for (SDL_Surface*& face : mSkyBoxFaces)
+      {
+        SDL_FreeSurface(face);
+        face = nullptr;
+      }
+    }
+
+    return false;
+  }
+
+  void Resources::DecodeTextures(const std::vector<std::vector<uint8_t> >& embeddedTexturesData, Model& model) const
+  {
+    for (const vector<uint8_t>& texData : embeddedTexturesData)
+    {
+      SDL_Surface* surface = nullptr;
+      if (!texData.empty())
+      {
+        surface = IMG_Load_RW(SDL_RWFromConstMem((const void *)texData.data(), texData.size()), 1);
+      }
+      model.embeddedTextures.push_back(surface);
+    }
+
+    for (MaterialData& matData : model.materialsData)
+    {
+      matData.surfaces.assign(matData.textures.size(), nullptr);
+
+      for (uint32_t texIx = 0; texIx < matData.textures.size(); texIx++)
+      {
+        const string& texPath = matData.textures[texIx].second;
+        if (texPath[0] == '*') { continue; } // embeded texture, already decoded
+
+        matData.surfaces[texIx] = DecodeImage(mFileSystem, texPath);
+        if (matData.surfaces[texIx] == nullptr)
+        {
+          matData.surfaces[texIx] = DecodeImage(mFileSystem, GetFixedTexturePath(texPath.c_str(), model.texturesAltPath));
+        }
+      }
+    }
+  }
+
+  void Resources::UploadTextures(Model& model)
+  {
+    // LoadTexture frees the surfaces
+    for (SDL_Surface* surface : model.embeddedTextures)
+    {
+      model.textures.push_back(ShaderUtils::LoadTexture(surface));
+    }
+
+    vector<SDL_Surface*>().swap(model.embeddedTextures);
+  }
+
+  void Resources::UploadMaterials(Model& model)
+  {
+    for (MaterialData& matData : model.materialsData)
+    {
+      model.materialsTex.push_back(MaterialTextures());
+      MaterialTextures& matTex = model.materialsTex.back();
+
+      for (uint32_t texIx = 0; texIx < matData.textures.size(); texIx++)
+      {
+        const string& texPath = matData.textures[texIx].second;
+        GLuint texObj = 0;
+
+        if (texPath[0] == '*')
+        {
+          // embeded texture
+          GLuint iIndex = atoi(texPath.c_str() + 1);
+          if (iIndex < model.textures.size())
+          {
+            texObj = model.textures[iIndex];
+          }
+        }
+        else if (texIx < matData.surfaces.size())
+        {
+          // LoadTexture frees the surface
+          texObj = ShaderUtils::LoadTexture(matData.surfaces[texIx]);
+          matData.surfaces[texIx] = nullptr;
+        }
+        matTex.push_back(make_pair(matData.textures[texIx].first, texObj));
+      }
+
+      GLuint buffer = 0;
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+      glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialColors), (void *)(&matData.colors), GL_STATIC_DRAW);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      model.materialsCol.push_back(buffer);
+    }
+
+    vector<MaterialData>().swap(model.materialsData);
+  }
+
+  void Resources::UploadMeshes(Model& model, std::vector<GLuint>& inoutBufferObjs)
+  {
+    GLuint buffer = 0;
+
+    for (const MeshData& meshData : model.meshesData)
+    {
+      Mesh aMesh = {};
+
+      aMesh.materialIndex = meshData.materialIndex;
+      aMesh.numFaces = meshData.numFaces;
+
+      // generate Vertex Array for mesh
+      glGenVertexArrays(1, &(aMesh.vao));
+      glBindVertexArray(aMesh.vao);
+
+      // buffer for faces
+      if (!meshData.indices.empty())
+      {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * meshData.indices.size(), meshData.indices.data(), GL_STATIC_DRAW);
+        inoutBufferObjs.push_back(buffer);
+      }
+
+      // buffer for vertex positions
+      if (!meshData.positions.empty())
+      {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * meshData.positions.size(), meshData.positions.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(VERT_POSITION_LOC);
+        glVertexAttribPointer(VERT_POSITION_LOC, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        inoutBufferObjs.push_back(buffer);
+      }
+
+      // buffer for vertex normals
+      if (!meshData.normals.empty())
+      {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * meshData.normals.size(), meshData.normals.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(VERT_NORMAL_LOC);
+        glVertexAttribPointer(VERT_NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        inoutBufferObjs.push_back(buffer);
+      }
+
+      // buffer for vertex texture coordinates
+      if (!meshData.texCoords.empty())
+      {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * meshData.texCoords.size(), meshData.texCoords.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(VERT_DIFFUSE_TEX_COORD_LOC);
+        glVertexAttribPointer(VERT_DIFFUSE_TEX_COORD_LOC, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        inoutBufferObjs.push_back(buffer);
+      }
+
+      // buffer for vertex bone IDs and Weights
+      if (!meshData.bonesData.empty())
+      {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexBoneData) * meshData.bonesData.size(), meshData.bonesData.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(VERT_BONE_IDS_LOC);
+        glVertexAttribIPointer(VERT_BONE_IDS_LOC, 4, GL_UNSIGNED_INT, sizeof(VertexBoneData), 0);
+        glEnableVertexAttribArray(VERT_BONE_WEIGHTS_LOC);
+        glVertexAttribPointer(VERT_BONE_WEIGHTS_LOC, 4, GL_FLOAT, GL_TRUE, sizeof(VertexBoneData), (const GLvoid*)16);
+        inoutBufferObjs.push_back(buffer);
+      }
+
+      // unbind buffers
+      glBindVertexArray(0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+      model.meshes.push_back(aMesh);
+    }
+
+    vector<MeshData>().swap(model.meshesData);
+  }
+
+}
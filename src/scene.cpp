@@ -0,0 +1,328 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+#include "scene.hpp"
+#include "binary_stream.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace shooter {
+
+  uint32_t NavMeshPathPool::Alloc()
+  {
+    uint32_t pathIx = 0;
+    if (!mFreePaths.empty())
+    {
+      pathIx = mFreePaths.back();
+      mFreePaths.pop_back();
+    }
+    else
+    {
+      pathIx = mPaths.size();
+      mPaths.emplace_back();
+    }
+
+    mPaths[pathIx].nrPathPolys = 0;
+
+    return pathIx;
+  }
+
+  void NavMeshPathPool::Free(uint32_t pathIx)
+  {
+    assert(pathIx < mPaths.size());
+    mFreePaths.push_back(pathIx);
+  }
+
+  void NavMeshPathPool::SaveState(BinaryWriter& writer) const
+  {
+    writer.Write(static_cast<uint32_t>(mPaths.size()));
+    for (const CompNavMeshPath& path : mPaths)
+    {
+      writer.Write(path);
+    }
+
+    writer.WriteVector(mFreePaths);
+  }
+
+  bool NavMeshPathPool::LoadState(BinaryReader& reader)
+  {
+    uint32_t nrPaths = 0;
+    if (!reader.Read(nrPaths)) { return false; }
+
+    mPaths.resize(nrPaths);
+    for (CompNavMeshPath& path : mPaths)
+    {
+      if (!reader.Read(path)) { return false; }
+    }
+
+    return reader.ReadVector(mFreePaths);
+  }
+
+  Scene::Scene(uint32_t capacity)
+    : renderables(capacity)
+    , animations(capacity)
+    , transforms(capacity)
+    , bounds(capacity)
+    , movables(capacity)
+    , navMeshPathRefs(capacity)
+    , navMeshPos(capacity)
+    , states(capacity)
+    , statesTargets(capacity)
+    , statesTimeInts(capacity)
+    , damagebles(capacity)
+    , health(capacity, CompHealth(100.f))
+    , scores(capacity)
+    , randoms(capacity)
+    , nrAnimationNodes(0)
+    , lineOfSight(capacity)
+    , bullets(100)
+    , nrValidBullets(0u)
+    , cameraController(0.1f, 1.f)
+    , debugging(false)
+    , multithreading(true)
+    , doubleBuffering(false)
+    , mEntitiesIx(capacity, -1)
+  {
+    std::fill_n(animationIds, EAnimTypeMax, cInvalidId);
+
+    entities.reserve(capacity);
+    deadEntities.reserve(capacity);
+
+    // Free slots are used starting with the lowest one, so the Player is always spawned first in EnPlayer
+    mFreeEntities.reserve(capacity);
+    for (uint32_t i = capacity; i > 0; i--)
+    {
+      mFreeEntities.push_back(i - 1);
+    }
+
+    // Free slots look like dead entities to the Systems that still access them directly
+    for (CompState& st : states)
+    {
+      st.state = EStateDead;
+    }
+  }
+
+  int32_t Scene::Spawn()
+  {
+    if (mFreeEntities.empty())
+    {
+      return -1;
+    }
+
+    uint32_t en = mFreeEntities.back();
+    mFreeEntities.pop_back();
+
+    mEntitiesIx[en] = entities.size();
+    entities.push_back(en);
+
+    // Reset all the components (the random generator keeps its stream)
+    renderables[en] = CompRenderable();
+    animations[en] = CompAnimation();
+    std::fill_n(GetGlobalTrans(en), nrAnimationNodes, glm::mat4(1.f));
+    std::fill_n(GetLastAnimationFrames(en), nrAnimationNodes, AnimationFrame());
+    transforms[en] = CompTransform();
+    bounds[en] = CompBounds();
+    movables[en] = CompMovable();
+    navMeshPathRefs[en] = CompNavMeshPathRef();
+    navMeshPos[en] = CompNavMeshPos();
+    statesTargets[en] = CompStatesTargets();
+    statesTimeInts[en] = CompStatesTimeIntervals();
+    damagebles[en] = CompDamagebleSkeleton();
+    health[en] = CompHealth(100.f);
+    scores[en] = CompScore();
+    states[en].state = EStateDead;
+    lineOfSight.Clear(en);
+
+    return en;
+  }
+
+  void Scene::Despawn(uint32_t en)
+  {
+    assert(en < Capacity());
+
+    int32_t ix = mEntitiesIx[en];
+    if (ix < 0)
+    {
+      return; // not spawned
+    }
+
+    CompNavMeshPathRef& pathRef = navMeshPathRefs[en];
+    if (pathRef.pathIx >= 0)
+    {
+      navMeshPaths.Free(pathRef.pathIx);
+      pathRef.pathIx = -1;
+    }
+
+    // Other entities might still target it
+    states[en].state = EStateDead;
+
+    // Swap with the last entity, to keep the array dense
+    uint32_t lastEn = entities.back();
+    entities[ix] = lastEn;
+    mEntitiesIx[lastEn] = ix;
+    entities.pop_back();
+
+    mEntitiesIx[en] = -1;
+    mFreeEntities.push_back(en);
+  }
+
+  bool Scene::Respawn(uint32_t en)
+  {
+    assert(en < Capacity());
+
+    auto it = std::find(mFreeEntities.begin(), mFreeEntities.end(), en);
+    if (it == mFreeEntities.end())
+    {
+      return false;
+    }
+    mFreeEntities.erase(it);
+
+    mEntitiesIx[en] = entities.size();
+    entities.push_back(en);
+
+    return true;
+  }
+
+  void Scene::SwapFrames()
+  {
+    // The components are trivially copyable, so these are plain memory copies
+    mPrevFrame.animations.assign(animations.begin(), animations.end());
+    mPrevFrame.animationsGlobalTrans.assign(animationsGlobalTrans.begin(), animationsGlobalTrans.end());
+    mPrevFrame.transforms.assign(transforms.begin(), transforms.end());
+    mPrevFrame.movables.assign(movables.begin(), movables.end());
+    mPrevFrame.navMeshPos.assign(navMeshPos.begin(), navMeshPos.end());
+    mPrevFrame.states.assign(states.begin(), states.end());
+    mPrevFrame.statesTargets.assign(statesTargets.begin(), statesTargets.end());
+  }
+
+  void Scene::SaveState(BinaryWriter& writer) const
+  {
+    writer.WriteVector(entities);
+    writer.WriteVector(mEntitiesIx);
+    writer.WriteVector(mFreeEntities);
+    writer.WriteVector(deadEntities);
+
+    writer.WriteVector(animations);
+    writer.WriteVector(transforms);
+    writer.WriteVector(movables);
+    writer.WriteVector(navMeshPathRefs);
+    writer.WriteVector(navMeshPos);
+    writer.WriteVector(states);
+    writer.WriteVector(statesTargets);
+    writer.WriteVector(statesTimeInts);
+    writer.WriteVector(health);
+    writer.WriteVector(scores);
+    writer.WriteVector(randoms);
+
+    writer.Write(nrAnimationNodes);
+    writer.WriteVector(animationsGlobalTrans);
+    writer.WriteVector(animationsLastFrames);
+
+    navMeshPaths.SaveState(writer);
+    lineOfSight.SaveState(writer);
+
+    writer.WriteVector(bullets);
+    writer.Write(nrValidBullets);
+
+    writer.Write(camera);
+    writer.Write(cameraController.fraction);
+  }
+
+  bool Scene::LoadState(BinaryReader& reader)
+  {
+    const uint32_t capacity = Capacity();
+
+    bool ok = reader.ReadVector(entities) 
+      && reader.ReadVector(mEntitiesIx) 
+      && reader.ReadVector(mFreeEntities)
+      && reader.ReadVector(deadEntities)
+      && reader.ReadVector(animations)
+      && reader.ReadVector(transforms)
+      && reader.ReadVector(movables)
+      && reader.ReadVector(navMeshPathRefs)
+      && reader.ReadVector(navMeshPos)
+      && reader.ReadVector(states)
+      && reader.ReadVector(statesTargets)
+      && reader.ReadVector(statesTimeInts)
+      && reader.ReadVector(health)
+      && reader.ReadVector(scores)
+      && reader.ReadVector(randoms)
+      && reader.Read(nrAnimationNodes)
+      && reader.ReadVector(animationsGlobalTrans)
+      && reader.ReadVector(animationsLastFrames)
+      && navMeshPaths.LoadState(reader)
+      && lineOfSight.LoadState(reader)
+      && reader.ReadVector(bullets)
+      && reader.Read(nrValidBullets)
+      && reader.Read(camera)
+      && reader.Read(cameraController.fraction);
+
+    // The columns must keep the Scene's capacity
+    return ok && (states.size() == capacity) && (mEntitiesIx.size() == capacity) 
+      && (animationsGlobalTrans.size() == capacity * nrAnimationNodes);
+  }
+
+  uint64_t Scene::Checksum() const
+  {
+    uint64_t hash = Hash(entities.data(), entities.size() * sizeof(uint32_t));
+    hash = Hash(deadEntities.data(), deadEntities.size() * sizeof(uint32_t), hash);
+    hash = Hash(animations.data(), animations.size() * sizeof(CompAnimation), hash);
+    hash = Hash(transforms.data(), transforms.size() * sizeof(CompTransform), hash);
+    hash = Hash(movables.data(), movables.size() * sizeof(CompMovable), hash);
+    hash = Hash(navMeshPathRefs.data(), navMeshPathRefs.size() * sizeof(CompNavMeshPathRef), hash);
+    hash = Hash(navMeshPos.data(), navMeshPos.size() * sizeof(CompNavMeshPos), hash);
+    hash = Hash(states.data(), states.size() * sizeof(CompState), hash);
+    hash = Hash(statesTargets.data(), statesTargets.size() * sizeof(CompStatesTargets), hash);
+    hash = Hash(statesTimeInts.data(), statesTimeInts.size() * sizeof(CompStatesTimeIntervals), hash);
+    hash = Hash(health.data(), health.size() * sizeof(CompHealth), hash);
+    hash = Hash(scores.data(), scores.size() * sizeof(CompScore), hash);
+    hash = Hash(randoms.data(), randoms.size() * sizeof(CompRandom), hash);
+    hash = Hash(animationsGlobalTrans.data(), animationsGlobalTrans.size() * sizeof(glm::mat4), hash);
+    hash = Hash(bullets.data(), nrValidBullets * sizeof(CompBullet), hash);
+    return hash;
+  }
+
+  void Scene::CopyRenderFrame(RenderFrame& frame) const
+  {
+    frame.entities.assign(entities.begin(), entities.end());
+    frame.renderables.assign(renderables.begin(), renderables.end());
+    frame.transforms.assign(transforms.begin(), transforms.end());
+    frame.states.assign(states.begin(), states.end());
+
+    if (debugging)
+    {
+      frame.damagebles.assign(damagebles.begin(), damagebles.end());
+    }
+
+    frame.nrAnimationNodes = nrAnimationNodes;
+    frame.animationsGlobalTrans.assign(animationsGlobalTrans.begin(), animationsGlobalTrans.end());
+
+    frame.bullets.assign(bullets.begin(), bullets.begin() + nrValidBullets);
+    frame.nrValidBullets = nrValidBullets;
+
+    frame.camera = camera;
+
+    frame.debugging = debugging;
+    frame.multithreading = multithreading;
+    frame.doubleBuffering = doubleBuffering;
+  }
+
+  void Scene::SetNrAnimationNodes(uint32_t nrNodes)
+  {
+    nrAnimationNodes = nrNodes;
+    animationsGlobalTrans.assign(Capacity() * nrNodes, glm::mat4(1.f));
+    animationsLastFrames.assign(Capacity() * nrNodes, AnimationFrame());
+  }
+
+}
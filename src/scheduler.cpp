@@ -0,0 +1,119 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#include "scheduler.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "scene.hpp"
+
+#include <memory>
+
+using namespace shooter;
+
+void SystemScheduler::Add(const std::string& name, uint32_t reads, uint32_t writes, SystemFunc func)
+{
+  const uint32_t sysIx = mSystems.size();
+
+  System sys = { name, reads, writes, func };
+  mSystems.push_back(sys);
+
+  AddDependencies(mSystems, sysIx, ~0u, mGraph);
+
+  // The previous frame isn't written during a tick, so only the Systems writing 
+  // the same data (write after write hazards) are ordered
+  AddDependencies(mSystems, sysIx, ~cDoubleBufferedAccess, mDoubleBufferedGraph);
+}
+
+void SystemScheduler::AddDependencies(const std::vector<System>& systems, uint32_t sysIx, uint32_t readsMask, Graph& graph)
+{
+  graph.dependents.push_back(std::vector<uint32_t>());
+  graph.nrDeps.push_back(0);
+
+  const uint32_t reads = systems[sysIx].reads & readsMask;
+  const uint32_t writes = systems[sysIx].writes;
+
+  // Read after write, write after read and write after write hazards
+  for (uint32_t i = 0; i < sysIx; i++)
+  {
+    const System& prev = systems[i];
+    if ((prev.writes & (reads | writes)) || (prev.reads & readsMask & writes))
+    {
+      graph.dependents[i].push_back(sysIx);
+      graph.nrDeps[sysIx]++;
+    }
+  }
+}
+
+void SystemScheduler::Run(float dt, const Resources& resources, Scene& scene, JobSystem& jobs) const
+{
+  const uint32_t nrSystems = mSystems.size();
+
+  if (scene.doubleBuffering)
+  {
+    scene.SwapFrames();
+  }
+
+  if (!scene.multithreading)
+  {
+    // Systems were added in the sequential order
+    for (const System& sys : mSystems)
+    {
+      ProfilerZone zone(sys.name.c_str());
+      sys.func(dt, resources, scene, jobs);
+    }
+    return;
+  }
+
+  const Graph& graph = scene.doubleBuffering ? mDoubleBufferedGraph : mGraph;
+
+  std::unique_ptr<std::atomic<uint32_t>[]> nrDeps(new std::atomic<uint32_t>[nrSystems]);
+  for (uint32_t i = 0; i < nrSystems; i++)
+  {
+    nrDeps[i] = graph.nrDeps[i];
+  }
+
+  std::atomic<uint32_t> counter(0);
+  RunData data = { this, &graph, dt, &resources, &scene, &jobs, nrDeps.get(), &counter };
+
+  for (uint32_t i = 0; i < nrSystems; i++)
+  {
+    if (graph.nrDeps[i] == 0)
+    {
+      jobs.Push(RunSystem, &data, i, i + 1, counter);
+    }
+  }
+
+  // The calling thread runs jobs too
+  jobs.Wait(counter);
+}
+
+void SystemScheduler::RunSystem(const void* data, uint32_t sysIx, uint32_t)
+{
+  const RunData& run = *static_cast<const RunData*>(data);
+  const SystemScheduler& scheduler = *run.scheduler;
+
+  {
+    const System& sys = scheduler.mSystems[sysIx];
+    ProfilerZone zone(sys.name.c_str());
+    sys.func(run.dt, *run.resources, *run.scene, *run.jobs);
+  }
+
+  // Start the Systems waiting only for this one. They are pushed before this job's counter
+  // is decremented, so the counter can't reach 0 while Systems are left to run.
+  for (uint32_t dependent : run.graph->dependents[sysIx])
+  {
+    if (run.nrDeps[dependent].fetch_sub(1) == 1)
+    {
+      run.jobs->Push(RunSystem, data, dependent, dependent + 1, *run.counter);
+    }
+  }
+}
@@ -13,7 +13,6 @@
 #include "shader_utils.hpp"
 
 #include <iostream>
-#include <fstream>
 
 #include <assimp/texture.h>
 #include <SDL_image.h>
@@ -100,7 +99,7 @@ namespace ShaderUtils {
   }
 
 
-  uint32_t LoadShader(const string& shaderPath, const std::string& shaderDefines)
+  uint32_t LoadShader(const string& shaderPath, const std::string& source, const std::string& shaderDefines)
   {
     // Get shader type
     string ext = shaderPath.substr(shaderPath.rfind(".") + 1);
@@ -110,18 +109,8 @@ namespace ShaderUtils {
       return 0;
     }
 
-    // Open file
     GLuint shaderID = 0;
-    std::string shaderString;
-    std::ifstream sourceFile(shaderPath);
-    if (!sourceFile)
-    {
-      cout << "Unable to open file " << shaderPath << endl;
-      return 0;
-    }
-
-    // Get shader source
-    shaderString.assign((std::istreambuf_iterator< char >(sourceFile)), std::istreambuf_iterator< char >());
+    std::string shaderString(source);
 
     // Insert the shaderDefines after the #version
     auto pos = shaderString.find( "#version");
@@ -158,26 +147,17 @@ namespace ShaderUtils {
     return shaderID;
   }
 
-  uint32_t LoadProgram(const std::vector<std::string>& shaderPaths, const std::string& definesPath)
+  uint32_t LoadProgram(const std::vector<std::pair<std::string, std::string> >& shaders, const std::string& shaderDefines)
   {
-    // Open file
-    std::string shaderDefines;
-    std::ifstream sourceFile(definesPath);
-    if (sourceFile)
-    {
-      // Get the shader defines
-      shaderDefines.assign((std::istreambuf_iterator< char >(sourceFile)), std::istreambuf_iterator< char >());
-    }
-
     // Generate program
     GLuint programId = glCreateProgram();
 
     // Load all shaders
     vector<uint32_t> shaderIds;
-    for (const string& p : shaderPaths)
+    for (const auto& pathAndSource : shaders)
     {
       // Load shader
-      uint32_t shaderId = LoadShader(p, shaderDefines);
+      uint32_t shaderId = LoadShader(pathAndSource.first, pathAndSource.second, shaderDefines);
       shaderIds.push_back(shaderId);
 
       // Check for errors
@@ -247,31 +227,16 @@ namespace ShaderUtils {
     return texture;
   }
 
-  GLuint LoadTexture(const std::string& filePath, uint32_t& bpp)
+  uint32_t LoadCubeMapTexture(SDL_Surface* const faces[6])
   {
-    SDL_Surface* surface = IMG_Load(filePath.c_str());
-
-    if (surface == NULL) 
+    for (uint32_t i = 0; i < 6; ++i)
     {
-      cout << "Couldn't load texture " << filePath << endl;
-      cout << SDL_GetError() << endl;
-      return 0;
+      if (faces[i] == NULL)
+      {
+        for (uint32_t j = 0; j < 6; ++j) { SDL_FreeSurface(faces[j]); }
+        return 0;
+      }
     }
-    bpp = surface->format->BytesPerPixel;
-    return LoadTexture(surface);
-  }
-
-  uint32_t LoadCubeMapTexture(
-    const std::string& cubeMapRight,
-    const std::string& cubeMapLeft,
-    const std::string& cubeMapUp,
-    const std::string& cubeMapDown,
-    const std::string& cubeMapBack,
-    const std::string& cubeMapFront)
-  {
-    vector<std::string> cubeMapFacesFileNames = {
-      cubeMapRight, cubeMapLeft, cubeMapUp, cubeMapDown, cubeMapBack, cubeMapFront
-    };
 
     GLuint texture = 0;
     glGenTextures(1, &texture);
@@ -284,15 +249,7 @@ namespace ShaderUtils {
 
     for (uint32_t i = 0;i < 6; ++i)
     {
-      SDL_Surface* surface = IMG_Load(cubeMapFacesFileNames[i].c_str());
-
-      if (surface == NULL) 
-      {
-        glDeleteTextures(1, &texture);
-        cout << "Couldn't load texture " << cubeMapFacesFileNames[i] << endl;
-        cout << SDL_GetError() << endl;
-        return 0;
-      }
+      SDL_Surface* surface = faces[i];
 
       int modeTbl[2][2] = { { GL_RGB , GL_BGR },{ GL_RGBA, GL_BGRA } };
       const SDL_PixelFormat* f = surface->format;
@@ -0,0 +1,226 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+#include "simulation.hpp"
+#include "resources.hpp"
+#include "scene.hpp"
+#include "constants.hpp"
+#include "job_system.hpp"
+#include "math_utils.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+#include "sys_animation.hpp"
+#include "sys_attack.hpp"
+#include "sys_bullets.hpp"
+#include "sys_evade.hpp"
+#include "sys_patrol.hpp"
+#include "sys_physics.hpp"
+#include "sys_player_shoot.hpp"
+#include "sys_revive.hpp"
+#include "sys_states_time_ints.hpp"
+
+#include <algorithm>
+
+namespace shooter {
+
+  namespace {
+
+    inline CompDamagebleBone MakeDamagebleBone(
+      const NamesAndIdsMap& bonesMap, 
+      const std::vector<int16_t>& bonesHierarchy, 
+      const std::string& boneName, 
+      float radius, float health)
+    {
+      uint32_t ix = bonesMap.at(boneName);
+      return CompDamagebleBone(ix, bonesHierarchy[ix], radius, health);
+    }
+
+    /// Adapters from the Systems Update functions to SystemScheduler::SystemFunc
+
+    void UpdateRevive(float dt, const Resources& resources, Scene& scene, JobSystem& /*jobs*/)
+    {
+      SysRevive::Update(dt, resources.GetNavMesh(), scene);
+    }
+
+    void UpdateStatesTimeInts(float dt, const Resources& /*resources*/, Scene& scene, JobSystem& /*jobs*/)
+    {
+      SysStatesTimeInts::Update(dt, &scene.statesTimeInts[0], scene.Capacity());
+    }
+
+    void UpdatePlayerShoot(float dt, const Resources& resources, Scene& scene, JobSystem& /*jobs*/)
+    {
+      SysPlayerShoot::Update(dt, resources, scene);
+    }
+
+    void UpdatePatrol(float dt, const Resources& resources, Scene& scene, JobSystem& jobs)
+    {
+      SysPatrol::Update(dt, resources.GetNavMesh(), scene, jobs);
+    }
+
+    void UpdateAttack(float dt, const Resources& resources, Scene& scene, JobSystem& /*jobs*/)
+    {
+      SysAttack::Update(dt, resources, scene);
+    }
+
+    void UpdateEvade(float dt, const Resources& resources, Scene& scene, JobSystem& jobs)
+    {
+      SysEvade::Update(dt, resources.GetNavMesh(), scene, jobs);
+    }
+
+    void UpdatePhysics(float dt, const Resources& resources, Scene& scene, JobSystem& jobs)
+    {
+      SysPhysics::Update(dt, resources.GetMap(), resources.GetNavMesh(), scene, jobs);
+    }
+
+    void UpdateAnimation(float dt, const Resources& resources, Scene& scene, JobSystem& jobs)
+    {
+      SysAnimation::Update(dt, resources, scene, jobs);
+    }
+
+    void UpdateBullets(float dt, const Resources& resources, Scene& scene, JobSystem& /*jobs*/)
+    {
+      SysBullets::Update(dt, resources.GetMap(), scene);
+    }
+
+    /// Declare the inputs and outputs of all the Systems, in their sequential order.
+    SystemScheduler CreateScheduler()
+    {
+      SystemScheduler scheduler;
+
+      scheduler.Add("Revive",
+        0,
+        EAccessEntities | EAccessNavMeshPaths | EAccessStates | EAccessStatesTimeInts | EAccessTransforms | EAccessHealth | EAccessRandoms,
+        UpdateRevive);
+
+      scheduler.Add("StatesTimeInts",
+        0,
+        EAccessStatesTimeInts,
+        UpdateStatesTimeInts);
+
+      scheduler.Add("PlayerShoot",
+        EAccessEntities | EAccessCamera | EAccessRenderables | EAccessAnimations | EAccessMovables | EAccessBounds | EAccessDamagebles | EAccessTransforms,
+        EAccessStates | EAccessStatesTimeInts | EAccessHealth | EAccessScores | EAccessBullets,
+        UpdatePlayerShoot);
+
+      scheduler.Add("Patrol",
+        EAccessEntities | EAccessStates | EAccessNavMeshPos,
+        EAccessTransforms | EAccessStatesTargets | EAccessNavMeshPaths | EAccessMovables | EAccessRandoms | EAccessNavMeshQuery,
+        UpdatePatrol);
+
+      scheduler.Add("Attack",
+        EAccessEntities | EAccessRenderables | EAccessAnimations | EAccessBounds | EAccessDamagebles | EAccessNavMeshPos,
+        EAccessStates | EAccessStatesTargets | EAccessStatesTimeInts | EAccessTransforms | EAccessHealth | EAccessScores | EAccessRandoms | EAccessBullets 
+          | EAccessNavMeshQuery | EAccessLineOfSight,
+        UpdateAttack);
+
+      scheduler.Add("Evade",
+        EAccessEntities | EAccessTransforms | EAccessStatesTargets,
+        EAccessStates | EAccessStatesTimeInts | EAccessMovables | EAccessHealth | EAccessScores | EAccessRandoms,
+        UpdateEvade);
+
+      scheduler.Add("Physics",
+        EAccessEntities | EAccessBounds,
+        EAccessStates | EAccessTransforms | EAccessMovables | EAccessNavMeshPos | EAccessNavMeshQuery,
+        UpdatePhysics);
+
+      scheduler.Add("Animation",
+        EAccessEntities | EAccessStates | EAccessRenderables | EAccessMovables | EAccessCamera,
+        EAccessAnimations,
+        UpdateAnimation);
+
+      scheduler.Add("Bullets",
+        0,
+        EAccessBullets,
+        UpdateBullets);
+
+      return scheduler;
+    }
+
+  }
+
+  bool InitEntities(const Resources& resources, const std::string& modelName, uint32_t nrEntities, Scene& scene)
+  {
+    const ModelId playerModelId = resources.GetModelId(modelName);
+    const Model& playerModel = resources.GetModel(playerModelId);
+    if (playerModel.nodesParents.empty()) { return false; }
+
+    // Resolve the animation names once, the Systems only use the ids
+    for (uint32_t type = 0; type < EAnimTypeMax; type++)
+    {
+      scene.animationIds[type] = resources.GetAnimationId(SysAnimation::GetAnimationName(AnimationType(type)));
+    }
+
+    float playerSize = cPlayerHeight; // meters
+    float playerScale = playerSize * playerModel.normScale;
+
+    CompDamagebleSkeleton damSkeleton;
+    // ToDo: read this from a config file
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Spine2", 0.18f, 1.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Spine3", 0.18f, 1.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Neck1", 0.18f, 5.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "NeckHead", 0.08f, 5.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Rbrow", 0.07f, 5.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "Lbrow", 0.07f, 5.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmUpper2", 0.08f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmForearm1", 0.07f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmForearm2", 0.06f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RArmHand", 0.05f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmUpper2", 0.08f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmForearm1", 0.07f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmForearm2", 0.06f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LArmHand", 0.05f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegCalf", 0.08f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegAnkle", 0.06f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "LLegToe1", 0.05f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegCalf", 0.08f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegAnkle", 0.06f, 2.f));
+    damSkeleton.skeleton.push_back(MakeDamagebleBone(playerModel.nodesMap, playerModel.nodesParents, "RLegToe1", 0.05f, 2.f));
+
+    scene.SetNrAnimationNodes(playerModel.nodesParents.size());
+
+    for (unsigned n = 0; n < nrEntities; n++)
+    {
+      int32_t i = scene.Spawn();
+      if (i < 0) { break; }
+
+      scene.renderables[i].modelId = playerModelId;
+      scene.animations[i].Set(scene.animationIds[EAnimIdle]);
+      scene.transforms[i].scale = playerScale;
+      scene.bounds[i].minBound = playerModel.minBound * playerScale;
+      scene.bounds[i].maxBound = playerModel.maxBound * playerScale;
+      glm::vec3 radii = max(abs(playerModel.minBound), abs(playerModel.maxBound)) * playerScale;
+      scene.bounds[i].radiusXZ = std::max(radii.x, radii.z);
+      scene.damagebles[i] = damSkeleton;
+    }
+
+    scene.weaponBoneIx = playerModel.nodesMap.at("M4MB");
+
+    return true;
+  }
+
+  void SeedSimulation(uint64_t seed, Scene& scene)
+  {
+    for (uint32_t i = 0; i < scene.randoms.size(); i++)
+    {
+      RandSeed(scene.randoms[i], seed, i);
+    }
+  }
+
+  void UpdateSimulation(float dt, const Resources& resources, Scene& scene, JobSystem& jobs)
+  {
+    PROFILER_ZONE("UpdateSimulation");
+
+    static const SystemScheduler scheduler = CreateScheduler();
+    scheduler.Run(dt, resources, scene, jobs);
+  }
+
+}
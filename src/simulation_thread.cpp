@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+
+#include "simulation_thread.hpp"
+#include "resources.hpp"
+#include "constants.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "simulation.hpp"
+
+#include <chrono>
+#include <cmath>
+
+#include <SDL.h>
+
+namespace shooter {
+
+  namespace {
+
+    /// Place the camera behind the player
+    void UpdateCamera(float dt, const Resources& resources, Scene& scene)
+    {
+      glm::vec3 camLookAt = scene.transforms[EnPlayer].position + glm::vec3(0.f, cPlayerHeight, 0.f);
+      scene.cameraController.Update(dt, resources.GetMap(), camLookAt, scene.camera);
+    }
+
+  }
+
+  SimulationThread::SimulationThread(const Resources& resources, Scene& scene, uint32_t nrWorkers, ReplayRecorder* recorder)
+    : mResources(resources)
+    , mScene(scene)
+    , mNrWorkers(nrWorkers)
+    , mRecorder(recorder)
+    , mStop(false)
+  {
+    // The render thread has a frame to draw before the first simulation step
+    UpdateCamera(0.f, mResources, mScene);
+    mScene.CopyRenderFrame(mFrames.GetWriteBuffer());
+    mFrames.Publish();
+
+    mThread = std::thread(&SimulationThread::Run, this);
+  }
+
+  SimulationThread::~SimulationThread()
+  {
+    Stop();
+  }
+
+  void SimulationThread::Stop()
+  {
+    if (mThread.joinable())
+    {
+      mStop.store(true, std::memory_order_release);
+      mThread.join();
+    }
+  }
+
+  void SimulationThread::PushEvent(const SDL_Event& e)
+  {
+    // Dropping events would lose key releases, so wait for the simulation to catch up
+    while (!mEvents.TryPush(e))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  const RenderFrame& SimulationThread::AcquireFrame()
+  {
+    mFrames.Acquire();
+    return mFrames.GetReadBuffer();
+  }
+
+  void SimulationThread::Run()
+  {
+    // Created on this thread, which becomes the JobSystem's thread 0
+    JobSystem jobs(mNrWorkers);
+
+    uint32_t lastTime = SDL_GetTicks() - static_cast<uint32_t>(cFixedTimeStep * 1000.f);
+    float leftOverTime = 0.f;
+
+    while (!mStop.load(std::memory_order_acquire))
+    {
+      bool changed = false;
+
+      // Handle the events forwarded by the render thread
+      SDL_Event e;
+      while (mEvents.TryPop(e))
+      {
+        mScene.cameraController.HandleEvent(e, mScene.camera);
+        mScene.playerController.HandleEvent(e, mScene);
+        changed = true;
+
+        if (mRecorder != nullptr)
+        {
+          mRecorder->AddEvent(e);
+        }
+      }
+
+      uint32_t currentTime = SDL_GetTicks();
+
+      float elapsedTime = (currentTime - lastTime) * 0.001f; // seconds
+      lastTime = currentTime;
+
+      // Add time that couldn't be used last frame
+      elapsedTime += leftOverTime;
+
+      // Divide it up in chunks of cTimeStep ms
+      int steps = (int)floor(elapsedTime / cFixedTimeStep);
+
+      // Store time we couldn't use for the next frame.
+      leftOverTime = elapsedTime - steps * cFixedTimeStep;
+
+      for (int i = 0; i < steps; i++)
+      {
+        if (mRecorder != nullptr) { mRecorder->BeginTick(mScene); }
+
+        // The Simulation uses a constant time step
+        UpdateSimulation(cFixedTimeStep, mResources, mScene, jobs);
+
+        if (mRecorder != nullptr) { mRecorder->EndTick(mScene); }
+      }
+
+      if ((steps > 0) || changed)
+      {
+        PROFILER_ZONE("SimulationThread::Publish");
+
+        UpdateCamera(elapsedTime, mResources, mScene);
+
+        mScene.CopyRenderFrame(mFrames.GetWriteBuffer());
+        mFrames.Publish();
+      }
+      else
+      {
+        // Nothing to do until the next step
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+}
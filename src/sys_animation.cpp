@@ -14,13 +14,37 @@
 #include "resources.hpp"
 #include "scene.hpp"
 #include "constants.hpp" // cMaxShootingPitch
+#include "job_system.hpp"
 
 using namespace glm;
 using namespace shooter;
 
-std::string SysAnimation::GetAnimation(const glm::vec3& vel, uint32_t state, float absCamPitch, bool isNPC)
+const char* SysAnimation::GetAnimationName(AnimationType type)
 {
-  std::string animName;
+  // Animation names of the ArmyPilot model, indexed by AnimationType
+  static const char* const cAnimationNames[EAnimTypeMax] = {
+    "Idle",
+    "Idle_Firing",
+    "Walk",
+    "Walk_Firing",
+    "Walk_Backwards",
+    "Run_Forwards",
+    "Run_Firing",
+    "Run_backwards",
+    "Strafe_Left",
+    "Left_Fire",
+    "Strafe_Right",
+    "Right_FIre",
+    "Jump",
+    "Standing_2",
+  };
+
+  return cAnimationNames[type];
+}
+
+AnimationType SysAnimation::GetAnimation(const glm::vec3& vel, uint32_t state, float absCamPitch, bool isNPC)
+{
+  AnimationType animType = EAnimIdle;
 
   float ax = abs(vel.x), az = abs(vel.z);
   float speed = sqrt(ax*ax + az*az);
@@ -35,52 +59,51 @@ std::string SysAnimation::GetAnimation(const glm::vec3& vel, uint32_t state, flo
   // The order of the ifs matters !
   if (state & EStateDead)
   {
-    animName = "Standing_2";
+    animType = EAnimStanding2;
   }
   else if (state & EStateOffGround)
   {
-    animName = "Jump";
+    animType = EAnimJump;
   }
   else if (moveForward)
   {
     if (run)
     {
-      animName = shoot ? "Run_Firing" : "Run_Forwards";
+      animType = shoot ? EAnimRunFiring : EAnimRunForwards;
     }
     else
     {
-      animName = shoot ? "Walk_Firing" : "Walk";
+      animType = shoot ? EAnimWalkFiring : EAnimWalk;
     }
   }
   else if (moveBackwards)
   {
     if (run)
     {
-      animName = "Run_backwards";
+      animType = EAnimRunBackwards;
     }
     else
     {
-      animName = "Walk_Backwards";
+      animType = EAnimWalkBackwards;
     }
   }
   else if (moveLeft)
   {
-    animName = shoot ? "Left_Fire" : "Strafe_Left";
+    animType = shoot ? EAnimLeftFire : EAnimStrafeLeft;
   }
   else if (moveRight)
   {
-    animName = shoot ? "Right_FIre" : "Strafe_Right";
+    animType = shoot ? EAnimRightFire : EAnimStrafeRight;
   }
   else
   {
-    animName = shoot ? "Idle_Firing" : "Idle";
+    animType = shoot ? EAnimIdleFiring : EAnimIdle;
   }
 
-  return animName;
+  return animType;
 }
 
 void SysAnimation::UpdateEntity(
-  int /*ThreadId*/,
   float timeInSeconds, 
   uint32_t entity,
   const Resources& resources,
@@ -88,68 +111,62 @@ void SysAnimation::UpdateEntity(
   const CompRenderable& renderable,
   const CompMovable& movable,
   const CompCamera& camera,
-  CompAnimation& anim)
+  const AnimationId* animationIds,
+  CompAnimation& anim,
+  AnimationFrame* lastAnimationFrames,
+  glm::mat4* globalTrans)
 {
   anim.timeInSeconds += timeInSeconds;
 
-  std::string animName = GetAnimation(movable.velocity, state.state, abs(camera.orientation.x), entity > 0);
+  AnimationId animId = animationIds[GetAnimation(movable.velocity, state.state, abs(camera.orientation.x), entity > 0)];
 
-  if (anim.name != animName)
+  if (anim.id != animId)
   {
-    anim.Set(animName, -cAnimationTransitionTime);
+    anim.Set(animId, -cAnimationTransitionTime);
   }
 
   resources.GetSkeletonTransforms(
-    resources.GetModel(renderable.modelName),
-    anim.name,
+    resources.GetModel(renderable.modelId),
+    anim.id,
     anim.timeInSeconds,
     anim.lastTimeInSeconds,
-    anim.lastAnimationFrames,
-    anim.globalTrans);
+    lastAnimationFrames,
+    globalTrans);
 }
 
-void SysAnimation::Update(float timeInSeconds, const Resources& resources, Scene& scene, ctpl::thread_pool& tp)
+void SysAnimation::Update(float timeInSeconds, const Resources& resources, Scene& scene, JobSystem& jobs)
 {
-  uint32_t nrEntities = scene.transforms.size();
+  const std::vector<uint32_t>& entities = scene.entities;
 
-  if (scene.multithreading)
+  const std::vector<CompState>& states = scene.ReadStates();
+  const std::vector<CompMovable>& movables = scene.ReadMovables();
+
+  auto updateEntity = [&](uint32_t k)
   {
-    // Add the jobs to the Thread Pool
-    std::vector<std::future <void> > results(nrEntities);
-    for (unsigned i = 0; i < nrEntities; i++)
-    {
-      results[i] = tp.push(
-        UpdateEntity,
-        timeInSeconds,
-        i,
-        std::cref(resources),
-        std::cref(scene.states[i]),
-        std::cref(scene.renderables[i]),
-        std::cref(scene.movables[i]),
-        std::cref(scene.camera),
-        std::ref(scene.animations[i]));
-    }
+    const uint32_t i = entities[k];
+    UpdateEntity(
+      timeInSeconds,
+      i,
+      resources,
+      states[i],
+      scene.renderables[i],
+      movables[i],
+      scene.camera,
+      scene.animationIds,
+      scene.animations[i],
+      scene.GetLastAnimationFrames(i),
+      scene.GetGlobalTrans(i));
+  };
 
-    // Wait for the jobs to finish
-    for (auto& res : results)
-    {
-      res.wait();
-    }
+  if (scene.multithreading)
+  {
+    jobs.ParallelFor(0, entities.size(), cAnimationJobGrain, updateEntity);
   }
   else
   {
-    for (unsigned i = 0; i < nrEntities; i++)
+    for (uint32_t k = 0; k < entities.size(); k++)
     {
-        UpdateEntity(
-          0,
-          timeInSeconds,
-          i,
-          resources,
-          scene.states[i],
-          scene.renderables[i],
-          scene.movables[i],
-          scene.camera,
-          scene.animations[i]);
+      updateEntity(k);
     }
   }
 }
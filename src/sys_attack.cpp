@@ -34,17 +34,31 @@ float SysAttack::CalcPriority(float dist, float cosAlfa1, float cosAlfa2)
   return 10.f * (1.f - dist) + 3.f * cosAlfa1 + 6.f * cosAlfa2;
 }
 
-int32_t SysAttack::FindTarget(int32_t srcEntity, const Q3Map& map, const CompTransform* transforms, const CompState* states, uint32_t nrEntities)
+int32_t SysAttack::FindTarget(
+  int32_t srcEntity, 
+  const Q3Map& map, 
+  const NavMesh& navMesh, 
+  LineOfSight& lineOfSight, 
+  const CompTransform* transforms, 
+  const CompState* states, 
+  const CompNavMeshPos* navMeshPos, 
+  const uint32_t* entities, 
+  uint32_t nrEntities)
 {
   typedef std::pair<int32_t, float> TIndexAndPriority;
   std::vector<std::pair<int32_t, float> > priorities;
-  priorities.reserve(nrEntities - 1);
+  if (nrEntities > 0)
+  {
+    priorities.reserve(nrEntities - 1);
+  }
 
+  const uint32_t srcIx = uint32_t(srcEntity);
   vec3 srcPos = transforms[srcEntity].position;
 
-  for (uint32_t i = 0; i < nrEntities; i++)
+  for (uint32_t k = 0; k < nrEntities; k++)
   {
-    if (i == srcEntity) 
+    const uint32_t i = entities[k];
+    if (i == srcIx) 
     { 
       continue; 
     }
@@ -81,22 +95,38 @@ int32_t SysAttack::FindTarget(int32_t srcEntity, const Q3Map& map, const CompTra
   // Optimization: Minimize the number of ray casts by ordering the priorities in deacreasing order 
   // and returning the index of the first target found visible
   std::stable_sort(begin(priorities), end(priorities), [](const auto& it1, const auto& it2) { return it1.second > it2.second; });
-  for (const auto& pr : priorities)
+
+  // The candidates are queried in packets, so the ones not answered by the early outs are traced together
+  LineOfSight::Query queries[Q3Map::cTracePacketSize];
+
+  for (size_t first = 0; first < priorities.size(); first += Q3Map::cTracePacketSize)
   {
-    vec3 dH(0.f, 1.3f, 0.f);
-    TraceData data(srcPos + dH, transforms[pr.first].position + dH, .5f);
-    if (!map.Trace(data))
+    const uint32_t nrQueries = uint32_t(std::min(priorities.size() - first, size_t(Q3Map::cTracePacketSize)));
+
+    for (uint32_t k = 0; k < nrQueries; k++)
+    {
+      const uint32_t dst = priorities[first + k].first;
+      LineOfSight::Query query = { srcIx, dst, srcPos, transforms[dst].position, navMeshPos[srcEntity].poly, navMeshPos[dst].poly, false };
+      queries[k] = query;
+    }
+
+    lineOfSight.Run(queries, nrQueries, map, navMesh);
+
+    for (uint32_t k = 0; k < nrQueries; k++)
     {
-      return pr.first;
+      if (queries[k].visible)
+      {
+        return queries[k].dst;
+      }
     }
   }
 
   return -1;
 }
 
-vec3 SysAttack::WeaponMuzzlePos(uint32_t weaponBoneIx, const Model& model, const CompTransform& trans, const CompAnimation& anim)
+vec3 SysAttack::WeaponMuzzlePos(uint32_t weaponBoneIx, const Model& model, const CompTransform& trans, const mat4* globalTrans)
 {
-  return vec3(CalcTransMat(trans) * anim.globalTrans[weaponBoneIx] * model.invBonesOffsets[weaponBoneIx] * vec4(-1.f, -67.f, -11.f, 1.f));
+  return vec3(CalcTransMat(trans) * globalTrans[weaponBoneIx] * model.invBonesOffsets[weaponBoneIx] * vec4(-1.f, -67.f, -11.f, 1.f));
 }
 
 void SysAttack::KillEntity(
@@ -130,8 +160,10 @@ void SysAttack::IntersectRayEntities(
   const CompRenderable* renderables,
   const CompTransform* transforms,
   const CompBounds* bounds,
-  const CompAnimation* anim,
+  const mat4* animGlobalTrans,
+  uint32_t nrAnimNodes,
   const CompDamagebleSkeleton* damSkeleton,
+  const uint32_t* entities,
   uint32_t nrEntities,
   int32_t& outIntersectEntity,
   float& outIntersectDistance,
@@ -152,12 +184,17 @@ void SysAttack::IntersectRayEntities(
 
   typedef std::pair<uint32_t, float> TIndexAndDistance;
   std::vector<TIndexAndDistance> sphereIntersectedObjs;
-  sphereIntersectedObjs.reserve(nrEntities - 1);
+  if (nrEntities > 0)
+  {
+    sphereIntersectedObjs.reserve(nrEntities - 1);
+  }
 
   // do a rejection test using the entities bounding spheres
-  for (uint32_t i = 0; i < nrEntities; i++)
+  const uint32_t srcIx = uint32_t(srcEntity); // -1 matches no entity
+  for (uint32_t k = 0; k < nrEntities; k++)
   {
-    if (i == srcEntity)
+    const uint32_t i = entities[k];
+    if (i == srcIx)
     {
       // same Entity as the shooter
       continue;
@@ -182,15 +219,16 @@ void SysAttack::IntersectRayEntities(
   {
     uint32_t en = item.first;
     mat4 modelMat = CalcTransMat(transforms[en]);
-    const Model& model = resources.GetModel(renderables[en].modelName);
+    const Model& model = resources.GetModel(renderables[en].modelId);
+    const mat4* globalTrans = animGlobalTrans + en * nrAnimNodes;
 
     float damageMul = 0.f;
     float minIntersectDist = rayMaxDist;
     // Intersect ray with all the cylinders in the damageble skeleton
     for (const CompDamagebleBone& damBone : damSkeleton[en].skeleton)
     {
-      vec3 cylA(modelMat * anim[en].globalTrans[damBone.boneIx1] * model.invBonesOffsets[damBone.boneIx1][3]);
-      vec3 cylB(modelMat * anim[en].globalTrans[damBone.boneIx2] * model.invBonesOffsets[damBone.boneIx2][3]);
+      vec3 cylA(modelMat * globalTrans[damBone.boneIx1] * model.invBonesOffsets[damBone.boneIx1][3]);
+      vec3 cylB(modelMat * globalTrans[damBone.boneIx2] * model.invBonesOffsets[damBone.boneIx2][3]);
 
       float cylinderIntersectDist = rayMaxDist;
       if (shooter::intersectRayCylinder(rayOrigin, rayDir, cylA, cylB, damBone.radius, cylinderIntersectDist)
@@ -214,8 +252,8 @@ void SysAttack::IntersectRayEntities(
 void SysAttack::CheckTarget(int32_t enNewTarget, CompState& st, CompStatesTargets& stTargets, CompStatesTimeIntervals& stTimeInts)
 {
   uint32_t& state = st.state;
-  TStateTargets& stateTargets = stTargets.targets;
-  TStateTimeInts& stateTimeInts = stTimeInts.timeInts;
+  int32_t* stateTargets = stTargets.targets;
+  float* stateTimeInts = stTimeInts.timeInts;
 
   int32_t& enOldTarget = stateTargets[EStateAttackTargetIx];
   const float& huntTimeInt = stateTimeInts[EStateHuntTimeIntIx];
@@ -299,10 +337,10 @@ bool SysAttack::TryShootingAtTarget(uint32_t& state, float& shootTimeInt, bool l
   return false;
 }
 
-vec3 SysAttack::BulletDirection(vec3 bulletOrigin, const CompTransform& attackerTrans, const CompTransform& targetTrans)
+vec3 SysAttack::BulletDirection(vec3 bulletOrigin, const CompTransform& attackerTrans, const CompTransform& targetTrans, CompRandom& attackerRnd)
 {
-  float x = RandRange(-1.f, 1.f);
-  float y = RandRange(-1.f, 1.f);
+  float x = RandRange(attackerRnd, -1.f, 1.f);
+  float y = RandRange(attackerRnd, -1.f, 1.f);
   vec3 side = cross(attackerTrans.front, cWorldUp);
   vec3 bulletPos = targetTrans.position + cWorldUp * (1 + y * 0.5f) + side * (x * 0.5f);
   return normalize(bulletPos - bulletOrigin);
@@ -311,12 +349,21 @@ vec3 SysAttack::BulletDirection(vec3 bulletOrigin, const CompTransform& attacker
 void SysAttack::Update(float dt, const Resources& resources, Scene& scene)
 {
   const Q3Map& map = resources.GetMap();
-  uint32_t objCount = scene.transforms.size();
+  const std::vector<uint32_t>& entities = scene.entities;
+
+  scene.lineOfSight.BeginTick();
 
   bool fireBullet = false;
-  for (uint32_t i = EnNpcMin; i < objCount; i++)
+  for (uint32_t i : entities)
   {
-    int32_t newTarget = FindTarget(i, map, scene.transforms.data(), scene.states.data(), objCount);
+    if (i < EnNpcMin)
+    {
+      continue;
+    }
+
+    // Other entities are read from the previous frame when double buffering, so all see the same world
+    int32_t newTarget = FindTarget(i, map, resources.GetNavMesh(), scene.lineOfSight, 
+      scene.ReadTransforms().data(), scene.ReadStates().data(), scene.ReadNavMeshPos().data(), entities.data(), entities.size());
     CheckTarget(newTarget, scene.states[i], scene.statesTargets[i], scene.statesTimeInts[i]);
 
     uint32_t& state = scene.states[i].state;
@@ -336,16 +383,16 @@ void SysAttack::Update(float dt, const Resources& resources, Scene& scene)
     assert((state & EStateAttack) && (target >= 0));
 
     CompTransform& trans = scene.transforms[i];
-    const CompTransform& targetTrans = scene.transforms[target];
+    const CompTransform& targetTrans = scene.ReadTransforms()[target];
     float& shootTimeInt = scene.statesTimeInts[i].timeInts[EStateShootTimeIntIx];
 
     bool lookingAtTarget = AimAtTarget(state, trans, scene.bounds[i], targetTrans);
 
     if (TryShootingAtTarget(state, shootTimeInt, lookingAtTarget))
     {
-      const Model& model = resources.GetModel(scene.renderables[i].modelName);
-      vec3 bulletOrigin = WeaponMuzzlePos(scene.weaponBoneIx, model, trans, scene.animations[i]);
-      vec3 bulletDir = BulletDirection(bulletOrigin, trans, targetTrans);
+      const Model& model = resources.GetModel(scene.renderables[i].modelId);
+      vec3 bulletOrigin = WeaponMuzzlePos(scene.weaponBoneIx, model, trans, scene.ReadGlobalTrans(i));
+      vec3 bulletDir = BulletDirection(bulletOrigin, trans, targetTrans, scene.randoms[i]);
 
       // intersect bullet with the Map and all Entities
       int32_t intersectEntity = -1;
@@ -355,11 +402,13 @@ void SysAttack::Update(float dt, const Resources& resources, Scene& scene)
         i, bulletOrigin, bulletDir,
         resources,
         scene.renderables.data(),
-        scene.transforms.data(),
+        scene.ReadTransforms().data(),
         scene.bounds.data(),
-        scene.animations.data(),
+        scene.ReadGlobalTrans(0),
+        scene.nrAnimationNodes,
         scene.damagebles.data(),
-        scene.transforms.size(),
+        entities.data(),
+        entities.size(),
         intersectEntity, intersectDistance, damageMultiplier);
 
       if (intersectEntity >= 0)
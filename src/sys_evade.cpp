@@ -16,6 +16,7 @@
 #include "nav_mesh.hpp"
 #include "constants.hpp"
 #include "math_utils.hpp"
+#include "job_system.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -65,7 +66,7 @@ bool SysEvade::GetSidewaysWalkableDir(const NavMesh& navMesh, const vec3& pos, c
   return true;
 }
 
-void SysEvade::Evade(float targetDist, float borderDist, vec3& vel, float& timeInt)
+void SysEvade::Evade(float targetDist, float borderDist, CompRandom& rnd, vec3& vel, float& timeInt)
 {
   if (targetDist < cEvadeBackAwayDist
     // allow the NPC to exit a concave portion of the NavMesh border 
@@ -73,7 +74,7 @@ void SysEvade::Evade(float targetDist, float borderDist, vec3& vel, float& timeI
     && borderDist > 0.07f)
   {
     // move away from the target
-    vel.z = -RandRange(cMinEvadeVelZ, cMaxEvadeVelZ);
+    vel.z = -RandRange(rnd, cMinEvadeVelZ, cMaxEvadeVelZ);
   }
   else if (targetDist > cEvadeApproachDist
     // allow the NPC to exit a concave portion of the NavMesh border 
@@ -81,22 +82,24 @@ void SysEvade::Evade(float targetDist, float borderDist, vec3& vel, float& timeI
     && borderDist > 0.07f)
   {
     // move towards the target
-    vel.z = RandRange(cMinEvadeVelZ, cMaxEvadeVelZ);
+    vel.z = RandRange(rnd, cMinEvadeVelZ, cMaxEvadeVelZ);
   }
   else if (timeInt < FLT_EPSILON)
   {
-    vel.z = RandSgn() * RandRange(cMinEvadeVelZ, cMaxEvadeVelZ);
+    // draw the numbers in separate statements, so the order is the same with any compiler
+    float sgn = RandSgn(rnd);
+    vel.z = sgn * RandRange(rnd, cMinEvadeVelZ, cMaxEvadeVelZ);
   }
 
   if (timeInt < FLT_EPSILON)
   {
-    vel.x = RandSgn() * RandRange(cMinEvadeVelX, cMaxEvadeVelX);
-    timeInt = RandRange(.5f, 1.5f); //seconds
+    float sgn = RandSgn(rnd);
+    vel.x = sgn * RandRange(rnd, cMinEvadeVelX, cMaxEvadeVelX);
+    timeInt = RandRange(rnd, .5f, 1.5f); //seconds
   }
 }
 
 void SysEvade::UpdateEntity(
-  int /*ThreadId*/,
   const NavMesh& navMesh,
   const vec3& targetPos,
   const CompTransform& trans, 
@@ -105,7 +108,8 @@ void SysEvade::UpdateEntity(
   CompStatesTimeIntervals& stTimeInt,
   CompMovable& movable,
   CompHealth& health,
-  CompScore& score)
+  CompScore& score,
+  CompRandom& rnd)
 {
   const uint32_t& state = st.state;
   float& timeInt = stTimeInt.timeInts[EStateEvadeTimeIntIx];
@@ -121,7 +125,7 @@ void SysEvade::UpdateEntity(
   bool haveFloorInfo = navMesh.GetFloorInfo(value_ptr(pos), 1.f, h, floorDist, &walkable, &borderDist);
   bool nearBorder = haveFloorInfo && (!walkable || borderDist < 0.001f);
 
-  Evade(targetDist, borderDist, vel, timeInt);
+  Evade(targetDist, borderDist, rnd, vel, timeInt);
 
   // If run into the edge of the walkable area
   if (nearBorder)
@@ -142,22 +146,28 @@ void SysEvade::UpdateEntity(
 
     // the Bot will remain oriented towards the target and  
     // change the velocity so it starts moving towards newDir
-    vec3 newVel = RandRange(cMinEvadeVelX, cMaxEvadeVelX) * newDir;
+    vec3 newVel = RandRange(rnd, cMinEvadeVelX, cMaxEvadeVelX) * newDir;
     vel.z = dot(front, newVel);
     vel.x = dot(side, newVel);
-    timeInt = RandRange(.5f, 1.5f); //seconds
+    timeInt = RandRange(rnd, .5f, 1.5f); //seconds
   }
 }
 
-void SysEvade::Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp)
+void SysEvade::Update(float dt, const NavMesh& navMesh, Scene& scene, JobSystem& jobs)
 {
-  uint32_t nrEntities = scene.transforms.size();
+  const std::vector<uint32_t>& entities = scene.entities;
 
-  std::vector<std::future <void> > results;
-  results.reserve(nrEntities);
+  // Do all the early outs first, and update only the evading entities in the jobs
+  std::vector<uint32_t> evading;
+  evading.reserve(entities.size());
 
-  for (uint32_t i = EnNpcMin; i < nrEntities; i++)
+  for (uint32_t i : entities)
   {
+    if (i < EnNpcMin)
+    {
+      continue;
+    }
+
     const uint32_t& state = scene.states[i].state;
 
     if (state & (EStateOffGround|EStateDead))
@@ -166,57 +176,47 @@ void SysEvade::Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thre
       continue;
     }
 
-    vec3& vel = scene.movables[i].velocity;
-
     if (!(state & EStateEvade))
     {
-      vel.x = 0;
+      scene.movables[i].velocity.x = 0;
       continue;
     }
 
-    const int32_t& targetIx = scene.statesTargets[i].targets[EStateAttackTargetIx];
+    evading.push_back(i);
+  }
 
-    // the positions don't get modified by UpdateEntity, so it's safe to access without syncronization
-    const vec3& targetPos = scene.transforms[targetIx].position;
+  // The transforms and the targets are only read, so the jobs can access them without syncronization
+  const std::vector<CompTransform>& transforms = scene.ReadTransforms();
+  const std::vector<CompStatesTargets>& statesTargets = scene.ReadStatesTargets();
 
-    if (scene.multithreading)
-    {
-      // Add the job to the Thread Pool
-      results.push_back(
-        tp.push(
-          UpdateEntity,
-          std::cref(navMesh),
-          std::cref(targetPos),
-          std::cref(scene.transforms[i]),
-          std::cref(scene.statesTargets[i]),
-          std::ref(scene.states[i]),
-          std::ref(scene.statesTimeInts[i]),
-          std::ref(scene.movables[i]),
-          std::ref(scene.health[i]),
-          std::ref(scene.scores[i])));
-    }
-    else
-    {
-      UpdateEntity(i,
-        navMesh,
-        targetPos,
-        scene.transforms[i],
-        scene.statesTargets[i],
-        scene.states[i],
-        scene.statesTimeInts[i],
-        scene.movables[i],
-        scene.health[i],
-        scene.scores[i]);
-    }
-  }
+  auto updateEntity = [&](uint32_t k)
+  {
+    const uint32_t i = evading[k];
+    const int32_t& targetIx = statesTargets[i].targets[EStateAttackTargetIx];
+    const vec3& targetPos = transforms[targetIx].position;
+
+    UpdateEntity(
+      navMesh,
+      targetPos,
+      transforms[i],
+      statesTargets[i],
+      scene.states[i],
+      scene.statesTimeInts[i],
+      scene.movables[i],
+      scene.health[i],
+      scene.scores[i],
+      scene.randoms[i]);
+  };
 
   if (scene.multithreading)
   {
-    // Wait for the jobs to finish
-    for (auto& res : results)
+    jobs.ParallelFor(0, evading.size(), cEvadeJobGrain, updateEntity);
+  }
+  else
+  {
+    for (uint32_t k = 0; k < evading.size(); k++)
     {
-      res.wait();
+      updateEntity(k);
     }
   }
-
 }
@@ -23,7 +23,6 @@ using namespace shooter;
 using namespace glm;
 
 void SysPatrol::UpdateEntity(
-  int /*ThreadId*/,
   const NavMesh& navMesh,
   vec3 huntTargetPos,
   const CompState& st, 
@@ -31,8 +30,9 @@ void SysPatrol::UpdateEntity(
   vec3& front,
   CompStatesTargets& stTargets, 
   CompNavMeshPath& patrol, 
-  CompNavMeshPos& navMeshPos, 
-  CompMovable& movable
+  const CompNavMeshPos& navMeshPos, 
+  CompMovable& movable,
+  CompRandom& rnd
 )
 {
   if (!patrol.nrPathPolys)
@@ -46,14 +46,14 @@ void SysPatrol::UpdateEntity(
     else
     {
       const std::vector<float>& patrolPos = navMesh.GetIntersectionPositions();
-      int posIx = rand() % (patrolPos.size() / 3);
+      int posIx = RandIndex(rnd, patrolPos.size() / 3);
       pathEnd = make_vec3(&patrolPos[posIx * 3]);
     }
 
     navMesh.FindPath(glm::value_ptr(pos), glm::value_ptr(pathEnd),
       glm::value_ptr(patrol.pathStartPos), glm::value_ptr(patrol.pathEndPos), patrol.pathPolys, patrol.nrPathPolys);
 
-    movable.velocity = vec3(0.f, 0.f, RandRange(cMinPatrolVelZ, cMaxPatrolVelZ));
+    movable.velocity = vec3(0.f, 0.f, RandRange(rnd, cMinPatrolVelZ, cMaxPatrolVelZ));
   }
 
   // Update the steering position
@@ -87,18 +87,14 @@ void SysPatrol::UpdateEntity(
   }
 }
 
-void SysPatrol::Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp)
+void SysPatrol::Update(float dt, const NavMesh& navMesh, Scene& scene, JobSystem& /*jobs*/)
 {
-  uint32_t nrEntities = scene.transforms.size();
+  const std::vector<uint32_t>& entities = scene.entities;
+  const std::vector<CompState>& states = scene.ReadStates();
 
-  std::vector<std::future <void> > results;
-  results.reserve(nrEntities);
-
-  for (uint32_t i = 0; i < nrEntities; i++)
+  for (uint32_t i : entities)
   {
-    // Do all the early outs in the current thread to avoid the overhead 
-    // when calling UpdateEntity in a new thread
-    uint32_t state = scene.states[i].state;
+    uint32_t state = states[i].state;
 
     if (state & (EStateOffGround | EStateDead)) 
     { 
@@ -107,7 +103,13 @@ void SysPatrol::Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thr
 
     if (!(state & (EStatePatrol | EStateHunt)))
     {
-      scene.navMeshPath[i].nrPathPolys = 0;
+      // release the path back to the pool
+      int32_t& pathIx = scene.navMeshPathRefs[i].pathIx;
+      if (pathIx >= 0)
+      {
+        scene.navMeshPaths.Free(pathIx);
+        pathIx = -1;
+      }
       continue;
     }
 
@@ -117,54 +119,32 @@ void SysPatrol::Update(float dt, const NavMesh& navMesh, Scene& scene, ctpl::thr
       int32_t targetIx = scene.statesTargets[i].targets[EStateHuntTargetIx];
       assert(targetIx >= 0);
 
-      uint32_t huntTargetState = scene.states[targetIx].state;
-      if (scene.states[targetIx].state & EStateOffGround) 
+      if (states[targetIx].state & EStateOffGround) 
       { 
         continue; 
       }
 
-      // the positions don't get modified by UpdateEntity, so it's safe to access without syncronization
-      huntTargetPos = scene.transforms[targetIx].position;
+      huntTargetPos = scene.ReadTransforms()[targetIx].position;
     }
 
-    // Unfortunately, Detour is not thread safe (https://groups.google.com/forum/#!topic/recastnavigation/r7gL4F552m4)
-    if (false/*scene.multithreading*/)
-    {
-      results.push_back(
-        tp.push(
-          UpdateEntity,
-          std::cref(navMesh),
-          std::cref(huntTargetPos),
-          std::cref(scene.states[i]),
-          std::cref(scene.transforms[i].position),
-          std::ref(scene.transforms[i].front),
-          std::ref(scene.statesTargets[i]),
-          std::ref(scene.navMeshPath[i]),
-          std::ref(scene.navMeshPos[i]),
-          std::ref(scene.movables[i])));
-    }
-    else
+    int32_t& pathIx = scene.navMeshPathRefs[i].pathIx;
+    if (pathIx < 0)
     {
-      UpdateEntity(
-        0,
-        navMesh,
-        huntTargetPos,
-        scene.states[i],
-        scene.transforms[i].position,
-        scene.transforms[i].front,
-        scene.statesTargets[i],
-        scene.navMeshPath[i],
-        scene.navMeshPos[i],
-        scene.movables[i]);
+      pathIx = scene.navMeshPaths.Alloc();
     }
-  }
 
-  if (scene.multithreading)
-  {
-    // Wait for the jobs to finish
-    for (auto& res : results)
-    {
-      res.wait();
-    }
+    // Unfortunately, Detour is not thread safe (https://groups.google.com/forum/#!topic/recastnavigation/r7gL4F552m4),
+    // so the entities are updated on the current thread
+    UpdateEntity(
+      navMesh,
+      huntTargetPos,
+      states[i],
+      scene.transforms[i].position,
+      scene.transforms[i].front,
+      scene.statesTargets[i],
+      scene.navMeshPaths[pathIx],
+      scene.ReadNavMeshPos()[i],
+      scene.movables[i],
+      scene.randoms[i]);
   }
 }
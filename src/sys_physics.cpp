@@ -118,20 +118,22 @@ void SysPhysics::VelocityVerlet(float dt, const glm::vec3& vel, const glm::vec3&
   dVel = dt * acc;
 }
 
-void SysPhysics::FixEntityCollisions(const CompBounds* bounds, CompTransform* transforms, uint32_t nrEntities)
+void SysPhysics::FixEntityCollisions(const CompBounds* bounds, CompTransform* transforms, const uint32_t* entities, uint32_t nrEntities)
 {
   // Find Collisions
 
   // This has n square complexity but, because of the low number of entities, it's not a performance problem
   typedef std::pair<unsigned, unsigned> TCollision;
   std::vector<TCollision> collisions;
-  for (unsigned i = 0; i < nrEntities - 1; ++i)
+  for (unsigned k = 0; k + 1 < nrEntities; ++k)
   {
+    const uint32_t i = entities[k];
     float r1 = bounds[i].radiusXZ;
     vec3 p1 = transforms[i].position;
 
-    for (unsigned j = i + 1; j < nrEntities; ++j)
+    for (unsigned l = k + 1; l < nrEntities; ++l)
     {
+      const uint32_t j = entities[l];
       float r = r1 + bounds[j].radiusXZ;
       const vec3& p2 = transforms[j].position;
 
@@ -165,7 +167,6 @@ void SysPhysics::FixEntityCollisions(const CompBounds* bounds, CompTransform* tr
 }
 
 void SysPhysics::UpdateEntity(
-  int /*ThreadId*/,
   float dt, 
   const Q3Map& map, 
   const NavMesh& navMesh, 
@@ -254,14 +255,11 @@ void SysPhysics::UpdateEntity(
   }
 }
 
-void SysPhysics::Update(float dt, const Q3Map& map, const NavMesh& navMesh, Scene& scene, ctpl::thread_pool& tp)
+void SysPhysics::Update(float dt, const Q3Map& map, const NavMesh& navMesh, Scene& scene, JobSystem& /*jobs*/)
 {
-  const uint32_t nrEntities = scene.transforms.size();
+  const std::vector<uint32_t>& entities = scene.entities;
 
-  std::vector<std::future <void> > results;
-  results.reserve(nrEntities);
-
-  for (uint32_t i = 0; i < nrEntities; i++)
+  for (uint32_t i : entities)
   {
     const uint32_t& state = scene.states[i].state;
 
@@ -270,36 +268,10 @@ void SysPhysics::Update(float dt, const Q3Map& map, const NavMesh& navMesh, Scen
       continue;
     }
 
-    // Unfortunately, Detour is not thread safe (https://groups.google.com/forum/#!topic/recastnavigation/r7gL4F552m4)
-    if (false/*scene.multithreading*/)
-    {
-      results.push_back(
-        tp.push(
-          UpdateEntity,
-          dt,
-          std::cref(map),
-          std::cref(navMesh),
-          std::cref(scene.bounds[i]),
-          std::ref(scene.states[i]), 
-          std::ref(scene.transforms[i]), 
-          std::ref(scene.movables[i]), 
-          std::ref(scene.navMeshPos[i])
-        ));
-    }
-    else
-    {
-      UpdateEntity(0, dt, map, navMesh, scene.bounds[i], scene.states[i], scene.transforms[i], scene.movables[i], scene.navMeshPos[i]);
-    } 
-  }
-
-  if (scene.multithreading)
-  {
-    // Wait for the jobs to finish
-    for (auto& res : results)
-    {
-      res.wait();
-    }
+    // Unfortunately, Detour is not thread safe (https://groups.google.com/forum/#!topic/recastnavigation/r7gL4F552m4),
+    // so the entities are updated on the current thread
+    UpdateEntity(dt, map, navMesh, scene.bounds[i], scene.states[i], scene.transforms[i], scene.movables[i], scene.navMeshPos[i]);
   }
 
-  FixEntityCollisions(scene.bounds.data(), scene.transforms.data(), nrEntities);
+  FixEntityCollisions(scene.bounds.data(), scene.transforms.data(), entities.data(), entities.size());
 }
@@ -41,14 +41,14 @@ void SysPlayerShoot::Update(float dt, const Resources& resources, Scene& scene)
     return;
   }
 
-  float animTime = scene.animations[EnPlayer].timeInSeconds;
+  float animTime = scene.ReadAnimations()[EnPlayer].timeInSeconds;
   if (animTime < FLT_EPSILON)
   {
     // don't shoot when interpolating from the last animation
     return;
   }
 
-  const vec3& vel = scene.movables[EnPlayer].velocity;
+  const vec3& vel = scene.ReadMovables()[EnPlayer].velocity;
   if ((vel.z < -FLT_EPSILON) && (abs(vel.z) > abs(vel.x)))
   {
     // We have no animation for shooting while moving backwards
@@ -61,8 +61,8 @@ void SysPlayerShoot::Update(float dt, const Resources& resources, Scene& scene)
     return;
   }
 
-  const Model& model = resources.GetModel(scene.renderables[EnPlayer].modelName);
-  vec3 bulletOrigin = SysAttack::WeaponMuzzlePos(scene.weaponBoneIx, model, scene.transforms[EnPlayer], scene.animations[EnPlayer]);
+  const Model& model = resources.GetModel(scene.renderables[EnPlayer].modelId);
+  vec3 bulletOrigin = SysAttack::WeaponMuzzlePos(scene.weaponBoneIx, model, scene.ReadTransforms()[EnPlayer], scene.ReadGlobalTrans(EnPlayer));
   vec3 bulletDir = scene.camera.trans.front;
 
   // intersect bullet with all game objects
@@ -73,11 +73,13 @@ void SysPlayerShoot::Update(float dt, const Resources& resources, Scene& scene)
     EnPlayer, bulletOrigin, bulletDir,
     resources,
     scene.renderables.data(),
-    scene.transforms.data(),
+    scene.ReadTransforms().data(),
     scene.bounds.data(),
-    scene.animations.data(),
+    scene.ReadGlobalTrans(0),
+    scene.nrAnimationNodes,
     scene.damagebles.data(),
-    scene.transforms.size(),
+    scene.entities.data(),
+    scene.entities.size(),
     intersectEntity, intersectDistance, damageMultiplier);
 
   if (intersectEntity >= 0)
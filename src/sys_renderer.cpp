@@ -15,6 +15,7 @@
 #include "shader_defines.h"
 #include "scene.hpp"
 #include "camera_utils.hpp"
+#include "profiler.hpp"
 #include "sys_animation.hpp"
 
 #include <iostream>
@@ -32,12 +33,15 @@ using namespace glm;
 
 namespace shooter {
 
-  SysRenderer::SysRenderer()
+  SysRenderer::SysRenderer(const Resources& resources)
     : mMVPUniBuf(0)
     , mLightUniBuf(0)
     , mBonesUniBuf(0)
     , mBulletVao(0)
     , mSkyBoxVao(0)
+    , mSimpleProgram(resources.GetProgramId("simple"))
+    , mFlameProgram(resources.GetProgramId("flame"))
+    , mSkyBoxProgram(resources.GetProgramId("skyBox"))
   {
     glGenBuffers(1, &mMVPUniBuf);
     glBindBuffer(GL_UNIFORM_BUFFER, mMVPUniBuf);
@@ -177,7 +181,7 @@ namespace shooter {
     const mat4& proj, 
     const Model& model,
     const CompTransform& trans,
-    const CompAnimation& anim, 
+    const mat4* globalTrans, 
     const CompDamagebleSkeleton& damSkeleton)
   {
     unsigned colGreen = ((unsigned int)0) | ((unsigned int)255 << 8) | ((unsigned int)0 << 16) | ((unsigned int)255 << 24);
@@ -195,8 +199,8 @@ namespace shooter {
 
     for (const CompDamagebleBone& damBone : damSkeleton.skeleton)
     {
-      vec3 cylA(modelMat * anim.globalTrans[damBone.boneIx1] * model.invBonesOffsets[damBone.boneIx1][3]);
-      vec3 cylB(modelMat * anim.globalTrans[damBone.boneIx2] * model.invBonesOffsets[damBone.boneIx2][3]);
+      vec3 cylA(modelMat * globalTrans[damBone.boneIx1] * model.invBonesOffsets[damBone.boneIx1][3]);
+      vec3 cylB(modelMat * globalTrans[damBone.boneIx2] * model.invBonesOffsets[damBone.boneIx2][3]);
       
       const glm::vec3 worldUp(0.f, 1.f, 1.f);
       float cylH = distance(cylA, cylB);
@@ -251,24 +255,28 @@ namespace shooter {
     const mat4& projMat,
     uint32_t glMVPUniBuf,
     uint32_t glBonesUniBuf,
+    uint32_t glProgram,
     const Resources& resources,
     const CompTransform* transforms,
     const CompRenderable* renderables, 
-    const CompAnimation* animations, 
+    const mat4* animGlobalTrans,
+    uint32_t nrAnimNodes,
     const CompState* states,
-    uint32_t nrModels)
+    const uint32_t* entities,
+    uint32_t nrEntities)
   {
     glBindBufferRange(GL_UNIFORM_BUFFER, MATRICES_BINDING, glMVPUniBuf, 0, cMatricesUniBufferSize);
     glBufferSubData(GL_UNIFORM_BUFFER, cProjMatrixOffset, cMatrixSize, value_ptr(projMat));
     glBufferSubData(GL_UNIFORM_BUFFER, cViewMatrixOffset, cMatrixSize, value_ptr(viewMat));
 
-    glUseProgram(resources.GetProgram("simple"));
+    glUseProgram(glProgram);
 
     glActiveTexture(GL_TEXTURE0 + DIFFUSE_TEX_UNIT);
 
-    for (uint32_t i = 0; i < nrModels; i++)
+    for (uint32_t k = 0; k < nrEntities; k++)
     {
-      const Model& model = resources.GetModel(renderables[i].modelName);
+      const uint32_t i = entities[k];
+      const Model& model = resources.GetModel(renderables[i].modelId);
       if (model.meshes.empty())
       {
         continue;
@@ -298,9 +306,10 @@ namespace shooter {
       glBufferSubData(GL_UNIFORM_BUFFER, cNormalMatrixOffset, cMatrixSize, value_ptr(normalMatrix));
 
       // upload the bones global transformations
-      auto &globalTrans = animations[i].globalTrans;
-      glBindBufferRange(GL_UNIFORM_BUFFER, BONES_BINDING, glBonesUniBuf, 0, globalTrans.size() * sizeof(mat4));
-      glBufferSubData(GL_UNIFORM_BUFFER, 0, globalTrans.size() * sizeof(mat4), globalTrans.data());
+      const mat4* globalTrans = animGlobalTrans + i * nrAnimNodes;
+      const uint32_t nrBones = model.nodesParents.size();
+      glBindBufferRange(GL_UNIFORM_BUFFER, BONES_BINDING, glBonesUniBuf, 0, nrBones * sizeof(mat4));
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, nrBones * sizeof(mat4), globalTrans);
 
       for (const Mesh& mesh : model.meshes)
       {
@@ -336,13 +345,16 @@ namespace shooter {
     const Resources& resources,
     const CompTransform* transforms,
     const CompRenderable* renderables,
-    const CompAnimation* animations,
+    const mat4* animGlobalTrans,
+    uint32_t nrAnimNodes,
     const CompDamagebleSkeleton* damSkeletons,
-    uint32_t nrModels)
+    const uint32_t* entities,
+    uint32_t nrEntities)
   {
-    for (uint32_t i = 0; i < nrModels; i++)
+    for (uint32_t k = 0; k < nrEntities; k++)
     {
-      const Model& model = resources.GetModel(renderables[i].modelName);
+      const uint32_t i = entities[k];
+      const Model& model = resources.GetModel(renderables[i].modelId);
       if (model.meshes.empty())
       {
         continue;
@@ -358,15 +370,15 @@ namespace shooter {
         continue;
       }
 
-      auto &globalTrans = animations[i].globalTrans;
+      const mat4* globalTrans = animGlobalTrans + i * nrAnimNodes;
 
-      DebugRenderSkeleton(modelViewMat, projMat, model, globalTrans.data(), globalTrans.size());
+      DebugRenderSkeleton(modelViewMat, projMat, model, globalTrans, model.nodesParents.size());
 
       DebugRenderDamagebleSkeleton(
         viewMat, projMat,
         model,
         transforms[i],
-        animations[i],
+        globalTrans,
         damSkeletons[i]);
     }
   }
@@ -400,11 +412,13 @@ namespace shooter {
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
   }
 
-  void SysRenderer::Render(const Resources& resources, const Scene& scene) const
+  void SysRenderer::Render(const Resources& resources, const RenderFrame& frame) const
   {
+    PROFILER_ZONE("SysRenderer::Render");
+
     const mat4 mat4Identity(1.f);
-    mat4 projMat = CalcProjMat(scene.camera.frustum);
-    mat4 viewMat = CalcViewMat(scene.camera.trans);
+    mat4 projMat = CalcProjMat(frame.camera.frustum);
+    mat4 viewMat = CalcViewMat(frame.camera.trans);
 
     glEnable(GL_MULTISAMPLE);
     glEnable(GL_DEPTH_TEST);
@@ -412,35 +426,38 @@ namespace shooter {
     glEnable(GL_CULL_FACE);
     
     glFrontFace(GL_CW);
-    RenderEntities(viewMat, projMat, mMVPUniBuf, mBonesUniBuf, resources,
-      scene.transforms.data(), scene.renderables.data(), scene.animations.data(), 
-      scene.states.data(), scene.transforms.size());
+    RenderEntities(viewMat, projMat, mMVPUniBuf, mBonesUniBuf, resources.GetProgram(mSimpleProgram), resources,
+      frame.transforms.data(), frame.renderables.data(), 
+      frame.animationsGlobalTrans.data(), frame.nrAnimationNodes, 
+      frame.states.data(), frame.entities.data(), frame.entities.size());
 
     glFrontFace(GL_CCW);
-    resources.GetMap().Render(resources, viewMat, projMat, scene.camera.trans.position, mMVPUniBuf);
+    resources.GetMap().Render(resources, viewMat, projMat, frame.camera.trans.position, mMVPUniBuf);
 
     RenderBullets(
-      resources.GetProgram("flame"),
+      resources.GetProgram(mFlameProgram),
       mBulletVao,
-      scene.camera.trans.position,
-      scene.bullets.data(),
-      scene.nrValidBullets);
+      frame.camera.trans.position,
+      frame.bullets.data(),
+      frame.nrValidBullets);
 
     RenderSkyBox(viewMat, projMat, mMVPUniBuf, mSkyBoxVao,
-      resources.GetProgram("skyBox"), resources.GetSkyBoxTexture());
+      resources.GetProgram(mSkyBoxProgram), resources.GetSkyBoxTexture());
 
-    if (scene.debugging)
+    if (frame.debugging)
     {
       glUseProgram(0);
 
       DebugRenderModels(
         viewMat, projMat, 
         resources,
-        scene.transforms.data(), 
-        scene.renderables.data(), 
-        scene.animations.data(), 
-        scene.damagebles.data(), 
-        scene.transforms.size());
+        frame.transforms.data(), 
+        frame.renderables.data(), 
+        frame.animationsGlobalTrans.data(), 
+        frame.nrAnimationNodes, 
+        frame.damagebles.data(), 
+        frame.entities.data(),
+        frame.entities.size());
 
       DebugRenderNavMesh(viewMat, projMat, resources.GetNavMesh());
     }
@@ -13,6 +13,7 @@
 #include "sys_revive.hpp"
 #include "scene.hpp"
 #include "nav_mesh.hpp"
+#include "math_utils.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/norm.hpp> // distance2
@@ -24,35 +25,43 @@ void SysRevive::Update(float dt, const NavMesh& navMesh, Scene& scene)
 {
   const std::vector<float>& revivePositions = navMesh.GetIntersectionPositions();
 
-  uint32_t objCount = scene.transforms.size();
-  // for each dead game entity
-  for (uint32_t i = 0; i < objCount; i++)
+  // despawn the entities killed since the last update, so the other Systems don't iterate them while they're dead
+  std::vector<uint32_t>& entities = scene.entities;
+  for (uint32_t k = 0; k < entities.size(); )
   {
-    uint32_t& state = scene.states[i].state;
-    if (!(state & EStateDead))
+    const uint32_t i = entities[k];
+    if (scene.states[i].state & EStateDead)
     {
-      continue;
+      scene.Despawn(i); // moves the last entity to k
+      scene.deadEntities.push_back(i);
     }
+    else
+    {
+      k++;
+    }
+  }
+
+  // for each dead game entity
+  std::vector<uint32_t>& deadEntities = scene.deadEntities;
+  for (uint32_t k = 0; k < deadEntities.size(); )
+  {
+    const uint32_t i = deadEntities[k];
 
     float& deadTimeInt = scene.statesTimeInts[i].timeInts[EStateDeadTimeIntIx];
     if (deadTimeInt > FLT_EPSILON)
     {
+      k++;
       continue;
     }
 
     // choose a random revive position
     bool validRevivePos = true;
-    int posIx = rand() % (revivePositions.size() / 3);
+    int posIx = RandIndex(scene.randoms[i], revivePositions.size() / 3);
     vec3 revivePos = make_vec3(&revivePositions[posIx * 3]);
 
     // check if the revivePos is valid
-    for (uint32_t j = 0; j < objCount; j++)
+    for (uint32_t j : entities)
     {
-      if ((scene.states[j].state & EStateDead) && (j != i))
-      {
-        continue;
-      }
-
       if (distance2(revivePos, scene.transforms[j].position) < 25.f)
       {
         validRevivePos = false;
@@ -60,19 +69,28 @@ void SysRevive::Update(float dt, const NavMesh& navMesh, Scene& scene)
       }
     }
 
-    if (validRevivePos)
+    if (!validRevivePos)
     {
-      state = EStateOffGround;
-      if (i != EnPlayer)
-      {
-        state |= EStatePatrol;
-      }
-      scene.transforms[i].position = revivePos;
-      scene.health[i].health = 100.f;
+      deadTimeInt = 0.2f; // recheck later
+      k++;
+      continue;
     }
-    else
+
+    // Spawn() might have given the slot to a new entity, which replaces the dead one
+    deadEntities[k] = deadEntities.back();
+    deadEntities.pop_back();
+    if (!scene.Respawn(i))
     {
-      deadTimeInt = 0.2f; // recheck later
+      continue;
+    }
+
+    uint32_t& state = scene.states[i].state;
+    state = EStateOffGround;
+    if (i != EnPlayer)
+    {
+      state |= EStatePatrol;
     }
+    scene.transforms[i].position = revivePos;
+    scene.health[i].health = 100.f;
   }
 }
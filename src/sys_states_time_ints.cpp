@@ -13,24 +13,42 @@
 #include "sys_states_time_ints.hpp"
 #include "components.hpp"
 
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SHOOTER_SSE
+#include <xmmintrin.h>
+#endif
+
 using namespace shooter;
 
 void SysStatesTimeInts::Update(float dt, CompStatesTimeIntervals* statesTimeInts, uint32_t enCount)
 {
-  // Update the Time Intervals state params 
-  for (uint32_t i = 0; i < enCount; i++)
+  if (!enCount)
+  {
+    return;
+  }
+
+  // The time intervals of all the entities are one contiguous float array
+  float* timeInts = statesTimeInts[0].timeInts;
+  const uint32_t count = enCount * EStateTimeIntMax;
+
+  // Update the Time Intervals state params. Only the positive time intervals are decreased,
+  // max(timeInt - dt, 0) is the same as (timeInt > dt) ? timeInt - dt : 0
+  uint32_t i = 0;
+
+#ifdef SHOOTER_SSE
+  const __m128 vDt = _mm_set1_ps(dt);
+  const __m128 vZero = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 t = _mm_loadu_ps(timeInts + i);
+    _mm_storeu_ps(timeInts + i, _mm_max_ps(_mm_sub_ps(t, vDt), vZero));
+  }
+#endif
+
+  for (; i < count; i++)
   {
-    for (uint32_t j = 0; j < EStateTimeIntMax; j++)
-    {
-      float& timeInt = statesTimeInts[i].timeInts[j];
-      if (timeInt > dt)
-      { // only update the states with a positive time interval
-        timeInt -= dt;
-      }
-      else
-      {
-        timeInt = 0.f;
-      }
-    }
+    timeInts[i] = std::max(timeInts[i] - dt, 0.f);
   }
 }
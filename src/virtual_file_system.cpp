@@ -0,0 +1,448 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the
+// product documentation would be appreciated but is not required.
+//
+
+#include "virtual_file_system.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <experimental/filesystem>
+#include <iostream>
+#include <mutex>
+
+#include <zlib.h>
+
+namespace fs = std::experimental::filesystem;
+
+namespace shooter {
+
+  namespace {
+
+    /// Zip format records (see the PKWARE APPNOTE.TXT)
+    const uint32_t cZipEndOfCentralDirSignature = 0x06054b50;
+    const uint32_t cZipCentralDirHeaderSignature = 0x02014b50;
+    const uint32_t cZipLocalHeaderSignature = 0x04034b50;
+    const size_t cZipEndOfCentralDirSize = 22;
+    const size_t cZipMaxCommentSize = 0xffff;
+    const size_t cZipCentralDirHeaderSize = 46;
+    const size_t cZipLocalHeaderSize = 30;
+    const uint16_t cZipMethodStored = 0;
+    const uint16_t cZipMethodDeflated = 8;
+    const uint16_t cZipFlagEncrypted = 1;
+    const uint32_t cZip64Size = 0xffffffff; ///< Size stored in the zip64 extra field
+
+    /// Little endian integers of the zip records
+    inline uint16_t ReadU16(const uint8_t* p) 
+    { 
+      return uint16_t(p[0] | (p[1] << 8)); 
+    }
+
+    inline uint32_t ReadU32(const uint8_t* p) 
+    { 
+      return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); 
+    }
+
+    inline bool EndsWith(const std::string& str, const std::string& suffix)
+    {
+      return (str.size() >= suffix.size()) && (str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0);
+    }
+
+  }
+
+  /// Reuses the buffers of the inflated entries. 
+  /// A buffer goes back to the pool when the last FileView using it is destroyed.
+  class VirtualFileSystem::BufferPool : public std::enable_shared_from_this<VirtualFileSystem::BufferPool>
+  {
+  public:
+    BufferPool() : mFreeBytes(0) {}
+
+    /// Buffer of size bytes
+    std::shared_ptr<std::vector<uint8_t> > Acquire(size_t size)
+    {
+      std::vector<uint8_t>* buffer = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        // The smallest free buffer large enough, otherwise the largest one
+        auto itBest = mFreeBuffers.end();
+        for (auto it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it)
+        {
+          if (itBest == mFreeBuffers.end()) 
+          { 
+            itBest = it; 
+            continue; 
+          }
+
+          const size_t capacity = (*it)->capacity();
+          const size_t bestCapacity = (*itBest)->capacity();
+          if ((capacity >= size) ? ((bestCapacity < size) || (capacity < bestCapacity)) 
+            : ((bestCapacity < size) && (capacity > bestCapacity)))
+          {
+            itBest = it;
+          }
+        }
+
+        if (itBest != mFreeBuffers.end())
+        {
+          buffer = itBest->release();
+          mFreeBytes -= buffer->capacity();
+          mFreeBuffers.erase(itBest);
+        }
+      }
+
+      if (buffer == nullptr)
+      {
+        buffer = new std::vector<uint8_t>();
+      }
+      buffer->resize(size);
+
+      std::weak_ptr<BufferPool> pool = shared_from_this();
+      return std::shared_ptr<std::vector<uint8_t> >(buffer, [pool](std::vector<uint8_t>* buffer) {
+        std::shared_ptr<BufferPool> lockedPool = pool.lock();
+        if (lockedPool)
+        {
+          lockedPool->Release(buffer);
+        }
+        else
+        {
+          delete buffer;
+        }
+      });
+    }
+
+  private:
+
+    /// Maximum memory kept by the free buffers
+    static const size_t cMaxFreeBytes = 64 << 20;
+
+    void Release(std::vector<uint8_t>* buffer)
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mFreeBytes + buffer->capacity() > cMaxFreeBytes)
+      {
+        delete buffer;
+        return;
+      }
+
+      mFreeBytes += buffer->capacity();
+      mFreeBuffers.emplace_back(buffer);
+    }
+
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<std::vector<uint8_t> > > mFreeBuffers;
+    size_t mFreeBytes; ///< Total capacity of mFreeBuffers
+  };
+
+  VirtualFileSystem::VirtualFileSystem()
+    : mBufferPool(std::make_shared<BufferPool>())
+  {}
+
+  bool VirtualFileSystem::Mount(const std::string& diskPath)
+  {
+    std::error_code error;
+    if (!fs::is_directory(diskPath, error))
+    {
+      std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+      if (!file->Open(diskPath))
+      {
+        std::cout << "Couldn't mount " << diskPath << std::endl;
+        return false;
+      }
+
+      FileView archive;
+      archive.mData = file->GetData();
+      archive.mSize = file->GetSize();
+      archive.mOwner = file;
+      return AddArchive(diskPath, archive);
+    }
+
+    mMounts.emplace_back();
+    mMounts.back().path = diskPath;
+
+    const uint32_t mountIx = mMounts.size() - 1;
+    const size_t rootSize = fs::path(diskPath).string().size();
+    for (fs::recursive_directory_iterator it(diskPath, error), itEnd; !error && (it != itEnd); it.increment(error))
+    {
+      if (!fs::is_regular_file(it->status())) { continue; }
+
+      Entry entry = { mountIx, EEntryFile, 0, 0, size_t(fs::file_size(it->path(), error)) };
+      AddEntry(NormalizePath(it->path().string().substr(rootSize)), entry);
+    }
+
+    return true;
+  }
+
+  bool VirtualFileSystem::MountArchive(const std::string& path)
+  {
+    FileView archive;
+    if (!Open(path, archive))
+    {
+      std::cout << "Couldn't mount " << path << std::endl;
+      return false;
+    }
+
+    return AddArchive(NormalizePath(path), archive);
+  }
+
+  bool VirtualFileSystem::AddArchive(const std::string& path, const FileView& archive)
+  {
+    const uint8_t* data = archive.GetData();
+    const size_t size = archive.GetSize();
+
+    // The end of central directory record is at the end of the archive, followed by the archive comment
+    size_t eocdPos = (size >= cZipEndOfCentralDirSize) ? size - cZipEndOfCentralDirSize : 0;
+    const size_t minEocdPos = (eocdPos > cZipMaxCommentSize) ? eocdPos - cZipMaxCommentSize : 0;
+    while ((size >= cZipEndOfCentralDirSize) && (ReadU32(data + eocdPos) != cZipEndOfCentralDirSignature) && (eocdPos > minEocdPos))
+    {
+      eocdPos--;
+    }
+    if ((size < cZipEndOfCentralDirSize) || (ReadU32(data + eocdPos) != cZipEndOfCentralDirSignature))
+    {
+      std::cout << "Invalid archive " << path << std::endl;
+      return false;
+    }
+
+    const uint32_t mountIx = mMounts.size();
+    const uint32_t nrEntries = ReadU16(data + eocdPos + 10);
+    const size_t centralDirSize = ReadU32(data + eocdPos + 12);
+    const size_t centralDirPos = ReadU32(data + eocdPos + 16);
+    if ((centralDirPos > eocdPos) || (centralDirSize > eocdPos - centralDirPos))
+    {
+      std::cout << "Invalid archive " << path << std::endl;
+      return false;
+    }
+
+    // The entries are added once the whole central directory is valid
+    std::vector<std::pair<std::string, Entry> > entries;
+    entries.reserve(nrEntries);
+
+    const size_t centralDirEnd = centralDirPos + centralDirSize;
+    size_t pos = centralDirPos;
+    for (uint32_t i = 0; i < nrEntries; i++)
+    {
+      const uint8_t* header = data + pos;
+      if ((cZipCentralDirHeaderSize > centralDirEnd - pos) || (ReadU32(header) != cZipCentralDirHeaderSignature))
+      {
+        std::cout << "Invalid archive " << path << std::endl;
+        return false;
+      }
+
+      const uint16_t flags = ReadU16(header + 8);
+      const uint16_t method = ReadU16(header + 10);
+      const uint32_t compressedSize = ReadU32(header + 20);
+      const uint32_t uncompressedSize = ReadU32(header + 24);
+      const size_t nameSize = ReadU16(header + 28);
+      const size_t headerSize = cZipCentralDirHeaderSize + nameSize + ReadU16(header + 30) + ReadU16(header + 32);
+      const size_t localHeaderPos = ReadU32(header + 42);
+      if (headerSize > centralDirEnd - pos)
+      {
+        std::cout << "Invalid archive " << path << std::endl;
+        return false;
+      }
+
+      const std::string name(reinterpret_cast<const char*>(header + cZipCentralDirHeaderSize), nameSize);
+      pos += headerSize;
+
+      // Folder
+      if (name.empty() || (name.back() == '/')) { continue; }
+
+      if ((flags & cZipFlagEncrypted) || ((method != cZipMethodStored) && (method != cZipMethodDeflated))
+        || (compressedSize == cZip64Size) || (uncompressedSize == cZip64Size) 
+        || ((method == cZipMethodStored) && (compressedSize != uncompressedSize)))
+      {
+        std::cout << "Unsupported archive entry " << path << "/" << name << std::endl;
+        continue;
+      }
+
+      const uint8_t* localHeader = data + localHeaderPos;
+      if ((localHeaderPos > centralDirPos) || (cZipLocalHeaderSize > centralDirPos - localHeaderPos) 
+        || (ReadU32(localHeader) != cZipLocalHeaderSignature))
+      {
+        std::cout << "Invalid archive " << path << std::endl;
+        return false;
+      }
+
+      // The local header extra field can differ from the central directory one
+      const size_t dataPos = localHeaderPos + cZipLocalHeaderSize + ReadU16(localHeader + 26) + ReadU16(localHeader + 28);
+      if ((dataPos > centralDirPos) || (compressedSize > centralDirPos - dataPos))
+      {
+        std::cout << "Invalid archive " << path << std::endl;
+        return false;
+      }
+
+      Entry entry = { mountIx, (method == cZipMethodStored) ? EEntryStored : EEntryDeflated, dataPos, compressedSize, uncompressedSize };
+      entries.push_back(std::make_pair(NormalizePath(name), entry));
+    }
+
+    mMounts.emplace_back();
+    mMounts.back().path = path;
+    mMounts.back().archive = archive;
+    for (const auto& pathAndEntry : entries)
+    {
+      AddEntry(pathAndEntry.first, pathAndEntry.second);
+    }
+
+    return true;
+  }
+
+  void VirtualFileSystem::AddEntry(const std::string& path, const Entry& entry)
+  {
+    mMounts.back().paths.push_back(path);
+    mIndex[path] = entry;
+  }
+
+  bool VirtualFileSystem::Exists(const std::string& path) const
+  {
+    return mIndex.find(NormalizePath(path)) != mIndex.end();
+  }
+
+  bool VirtualFileSystem::Open(const std::string& path, FileView& outView) const
+  {
+    const std::string normPath = NormalizePath(path);
+    auto it = mIndex.find(normPath);
+    if (it == mIndex.end()) { return false; }
+
+    const Entry& entry = it->second;
+    const MountInfo& mount = mMounts[entry.mountIx];
+    outView = FileView();
+
+    switch (entry.type)
+    {
+    case EEntryFile:
+    {
+      std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+      if (!file->Open(mount.path + "/" + normPath))
+      {
+        return entry.size == 0; // empty files can't be mapped
+      }
+
+      outView.mData = file->GetData();
+      outView.mSize = file->GetSize();
+      outView.mOwner = file;
+      return true;
+    }
+
+    case EEntryStored:
+      outView.mData = mount.archive.GetData() + entry.offset;
+      outView.mSize = entry.size;
+      outView.mOwner = mount.archive.mOwner;
+      return true;
+
+    case EEntryDeflated:
+    {
+      if (entry.size == 0) { return true; }
+
+      std::shared_ptr<std::vector<uint8_t> > buffer = mBufferPool->Acquire(entry.size);
+
+      z_stream stream;
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) { return false; } // raw deflate data, without the zlib header
+
+      stream.next_in = const_cast<Bytef*>(mount.archive.GetData() + entry.offset);
+      stream.avail_in = uInt(entry.compressedSize);
+      stream.next_out = buffer->data();
+      stream.avail_out = uInt(entry.size);
+      const int result = inflate(&stream, Z_FINISH);
+      inflateEnd(&stream);
+
+      if ((result != Z_STREAM_END) || (stream.total_out != entry.size))
+      {
+        std::cout << "Couldn't inflate " << mount.path << "/" << normPath << std::endl;
+        return false;
+      }
+
+      outView.mData = buffer->data();
+      outView.mSize = entry.size;
+      outView.mOwner = buffer;
+      return true;
+    }
+    }
+
+    return false;
+  }
+
+  std::vector<std::string> VirtualFileSystem::List(
+    const std::string& folder,
+    const std::string& extension,
+    const std::string& mountPath) const
+  {
+    std::string prefix = NormalizePath(folder);
+    if (!prefix.empty()) { prefix += '/'; }
+
+    std::vector<std::string> paths;
+    auto addPath = [&](const std::string& path)
+    {
+      if ((path.compare(0, prefix.size(), prefix) == 0) && EndsWith(path, extension))
+      {
+        paths.push_back(path);
+      }
+    };
+
+    if (mountPath.empty())
+    {
+      for (const auto& pathAndEntry : mIndex)
+      {
+        addPath(pathAndEntry.first);
+      }
+    }
+    else
+    {
+      // The last mount of mountPath
+      const std::string normMountPath = NormalizePath(mountPath);
+      auto it = std::find_if(mMounts.rbegin(), mMounts.rend(), [&](const MountInfo& mount) { 
+        return (mount.path == mountPath) || (mount.path == normMountPath); 
+      });
+      if (it != mMounts.rend())
+      {
+        for (const std::string& path : it->paths)
+        {
+          addPath(path);
+        }
+      }
+    }
+
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+    return paths;
+  }
+
+  std::string VirtualFileSystem::NormalizePath(const std::string& path)
+  {
+    std::string result;
+    result.reserve(path.size());
+
+    size_t begin = 0;
+    while (begin <= path.size())
+    {
+      size_t end = path.find_first_of("/\\", begin);
+      if (end == std::string::npos) { end = path.size(); }
+
+      const size_t partSize = end - begin;
+      if ((partSize == 2) && (path[begin] == '.') && (path[begin + 1] == '.'))
+      {
+        // Remove the last part
+        const size_t lastSep = result.rfind('/');
+        result.resize((lastSep == std::string::npos) ? 0 : lastSep);
+      }
+      else if ((partSize > 0) && !((partSize == 1) && (path[begin] == '.')))
+      {
+        if (!result.empty()) { result += '/'; }
+        result.append(path, begin, partSize);
+      }
+
+      begin = end + 1;
+    }
+
+    return result;
+  }
+
+}
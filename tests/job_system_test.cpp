@@ -0,0 +1,89 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+
+// Checks that the JobSystem runs every job exactly once, also when more jobs are pushed
+// than its ring buffers hold (the jobs that don't fit run inside Push()).
+
+#include "job_system.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+using namespace shooter;
+
+namespace {
+
+  /// Run ParallelFor over nrIndices indices and check that each one was visited exactly once
+  bool CheckParallelFor(uint32_t nrWorkers, uint32_t nrIndices, uint32_t grain)
+  {
+    JobSystem jobs(nrWorkers);
+
+    std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[nrIndices]);
+    for (uint32_t i = 0; i < nrIndices; i++) { visits[i] = 0; }
+
+    jobs.ParallelFor(0, nrIndices, grain, [&](uint32_t i) { visits[i].fetch_add(1, std::memory_order_relaxed); });
+
+    uint32_t nrWrong = 0;
+    for (uint32_t i = 0; i < nrIndices; i++)
+    {
+      nrWrong += (visits[i].load() != 1) ? 1 : 0;
+    }
+
+    std::cout << "workers: " << nrWorkers << " indices: " << nrIndices << " grain: " << grain
+      << " wrong: " << nrWrong << std::endl;
+    return nrWrong == 0;
+  }
+
+  /// Each job of the outer ParallelFor pushes its own chunks, from the worker threads
+  bool CheckNestedParallelFor(uint32_t nrWorkers, uint32_t nrOuter, uint32_t nrInner)
+  {
+    JobSystem jobs(nrWorkers);
+
+    const uint32_t nrIndices = nrOuter * nrInner;
+    std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[nrIndices]);
+    for (uint32_t i = 0; i < nrIndices; i++) { visits[i] = 0; }
+
+    jobs.ParallelFor(0, nrOuter, 1, [&](uint32_t outer) {
+      jobs.ParallelFor(0, nrInner, 1, [&](uint32_t inner) {
+        visits[outer * nrInner + inner].fetch_add(1, std::memory_order_relaxed);
+      });
+    });
+
+    uint32_t nrWrong = 0;
+    for (uint32_t i = 0; i < nrIndices; i++)
+    {
+      nrWrong += (visits[i].load() != 1) ? 1 : 0;
+    }
+
+    std::cout << "workers: " << nrWorkers << " nested: " << nrOuter << "x" << nrInner
+      << " wrong: " << nrWrong << std::endl;
+    return nrWrong == 0;
+  }
+
+}
+
+int main()
+{
+  bool ok = true;
+
+  // More chunks than JobSystem::Worker::cMaxJobs and the deque capacity (4096)
+  ok = CheckParallelFor(0, 10000, 1) && ok;
+  ok = CheckParallelFor(3, 10000, 1) && ok;
+  ok = CheckParallelFor(3, 100000, 2) && ok;
+  ok = CheckParallelFor(7, 20000, 1) && ok;
+  ok = CheckNestedParallelFor(3, 16, 5000) && ok;
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
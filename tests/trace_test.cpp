@@ -0,0 +1,178 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+
+
+// Checks that the Q3Map::Trace() backends and Q3Map::TraceBatch() return the same TraceData as the reference 
+// BSP walk (ETraceBackendMapData), on random traces through the shipped map.
+// The map is downloaded with the resources, the test is skipped if it's missing.
+
+#include "Q3Map.hpp"
+#include "virtual_file_system.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace shooter;
+
+namespace {
+
+  const char* cMapPath = "maps/jof3dm2.zip";
+  const uint32_t cNrTraces = 100000;
+
+  /// ctest SKIP_RETURN_CODE
+  const int cSkipped = 77;
+
+  bool IsSame(const TraceData& a, const TraceData& b)
+  {
+    if ((a.mCollision != b.mCollision) || (a.mStartsOut != b.mStartsOut) || (a.mAllSolid != b.mAllSolid)
+      || (a.mFraction != b.mFraction) || (a.mPlaneIndex != b.mPlaneIndex))
+    {
+      return false;
+    }
+
+    // mContents and mPlaneProj are only set on collisions
+    return !a.mCollision || ((a.mContents == b.mContents) && (a.mPlaneProj == b.mPlaneProj));
+  }
+
+  /// Random traces inside the map bounds: points, spheres and boxes, long and short ones, along the axes or not, 
+  /// not moving, and on the brush planes the map data is aligned with. Each trace is followed by one starting 
+  /// where it hits the map, in contact with the brush.
+  std::vector<TraceData> MakeTraces(const Q3Map& map, uint32_t nrTraces)
+  {
+    const TNode& root = map.GetMapQ3().mNodes[0];
+    const glm::vec3 corner0(root.mMins[0], root.mMins[1], root.mMins[2]);
+    const glm::vec3 corner1(root.mMaxs[0], root.mMaxs[1], root.mMaxs[2]);
+    const glm::vec3 minBounds = glm::min(corner0, corner1), maxBounds = glm::max(corner0, corner1);
+
+    std::mt19937 rng(12345);
+    auto uniform = [&](float a, float b) { return std::uniform_real_distribution<float>(a, b)(rng); };
+    auto randomPos = [&](bool snapped) {
+      glm::vec3 pos(uniform(minBounds.x, maxBounds.x), uniform(minBounds.y, maxBounds.y), uniform(minBounds.z, maxBounds.z));
+      return snapped ? glm::floor(pos * 8.f) / 8.f : pos;
+    };
+
+    std::vector<TraceData> traces;
+    traces.reserve(nrTraces);
+
+    for (uint32_t i = 0; traces.size() < nrTraces; i++)
+    {
+      const bool snapped = (i % 2) != 0;
+      const glm::vec3 start = randomPos(snapped);
+      glm::vec3 end;
+      switch (i % 4)
+      {
+      case 0: end = randomPos(snapped); break;
+      case 1: end = start + glm::vec3(uniform(-2.f, 2.f), uniform(-2.f, 2.f), uniform(-2.f, 2.f)); break;
+      case 2: end = start; end[i % 3] += snapped ? std::floor(uniform(-50.f, 50.f)) : uniform(-50.f, 50.f); break;
+      default: end = start; break;
+      }
+
+      const uint32_t type = (i / 4) % 3;
+      const float radius = snapped ? .5f : uniform(.1f, 1.f);
+      auto addTrace = [&](const glm::vec3& traceStart, const glm::vec3& traceEnd) {
+        switch (type)
+        {
+        case 0: traces.emplace_back(traceStart, traceEnd); break;
+        case 1: traces.emplace_back(traceStart, traceEnd, radius); break;
+        default: traces.emplace_back(traceStart, traceEnd, glm::vec3(-.4f, -.9f, -.4f), glm::vec3(.4f, .9f, .4f)); break;
+        }
+      };
+
+      addTrace(start, end);
+
+      TraceData data = traces.back();
+      if (map.Trace(data) && (traces.size() < nrTraces))
+      {
+        const glm::vec3 hitPos = start + (end - start) * data.mFraction;
+        addTrace(hitPos, hitPos + (end - start));
+      }
+    }
+
+    return traces;
+  }
+
+  /// Trace with each backend, one by one and in batches, and count the results different from the reference ones
+  bool CheckBackends(Q3Map& map, const std::vector<TraceData>& traces)
+  {
+    map.SetTraceBackend(ETraceBackendMapData);
+    std::vector<TraceData> reference = traces;
+    uint32_t nrCollisions = 0, nrStartsIn = 0;
+    for (TraceData& data : reference)
+    {
+      nrCollisions += map.Trace(data) ? 1 : 0;
+      nrStartsIn += data.mStartsOut ? 0 : 1;
+    }
+
+    std::cout << "traces: " << traces.size() << " collisions: " << nrCollisions << " starting in a brush: " << nrStartsIn << std::endl;
+
+    const TraceBackend backends[] = { ETraceBackendMapData, ETraceBackendCollisionMap, ETraceBackendBvh };
+    const char* backendNames[] = { "map_data", "collision_map", "bvh" };
+
+    bool ok = true;
+    for (uint32_t b = 0; b < 3; b++)
+    {
+      map.SetTraceBackend(backends[b]);
+
+      std::vector<TraceData> single = traces;
+      uint32_t nrWrong = 0;
+      for (uint32_t i = 0; i < traces.size(); i++)
+      {
+        map.Trace(single[i]);
+        nrWrong += IsSame(single[i], reference[i]) ? 0 : 1;
+      }
+
+      // The packets of TraceBatch() against cTracePacketSize calls to Trace(), then some partial packets
+      std::vector<TraceData> batch = traces;
+      uint32_t nrWrongBatch = 0;
+      for (uint32_t first = 0, i = 0; first < traces.size(); i++)
+      {
+        const uint32_t count = std::min<uint32_t>(traces.size() - first, (i % 2) ? Q3Map::cTracePacketSize : 1 + i % 7);
+        map.TraceBatch(&batch[first], count);
+        first += count;
+      }
+      for (uint32_t i = 0; i < traces.size(); i++)
+      {
+        nrWrongBatch += IsSame(batch[i], single[i]) ? 0 : 1;
+      }
+
+      std::cout << backendNames[b] << ": Trace wrong: " << nrWrong << " TraceBatch wrong: " << nrWrongBatch << std::endl;
+      ok = ok && (nrWrong == 0) && (nrWrongBatch == 0);
+    }
+
+    return ok;
+  }
+
+}
+
+int main()
+{
+  // Run from the binaries folder, like the demo
+  VirtualFileSystem fileSystem;
+  if (!fileSystem.Mount("res/") || !fileSystem.MountArchive(cMapPath))
+  {
+    std::cout << "skipped, " << cMapPath << " not found in res/" << std::endl;
+    return cSkipped;
+  }
+
+  Q3Map map(fileSystem, cMapPath, std::string("res/") + cMapPath + ".nodecode.cooked", false);
+
+  const bool ok = CheckBackends(map, MakeTraces(map, cNrTraces));
+
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,544 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// Micro-benchmarks of the engine's hot kernels.
+// A match is simulated first (seeded, so it's the same match on every run) and the NPCs positions,
+// orientations and animations are recorded. Each benchmark runs its kernel over the recorded samples,
+// on the calling thread and then split in jobs over all the JobSystem threads.
+// Kernels using Detour's dtNavMeshQuery only run serially (the query object is not thread safe).
+//
+// One JSON object is printed per line:
+//   {"benchmark":"...","threads":1,"ops":2400,"min_ns_per_op":...,"median_ns_per_op":...,"checksum":"..."}
+// checksum hashes the kernel results. It's the same for the serial and multithreaded runs, and changes
+// between builds only if the results change.
+//
+// Usage: ShooterDemoBench [nrThreads] [repetitions=5] [filter] [seed=0] [nrTicks=3000]
+
+#include "resources.hpp"
+#include "scene.hpp"
+#include "constants.hpp"
+#include "camera_utils.hpp"
+#include "intersect_utils.hpp"
+#include "math_utils.hpp"
+#include "job_system.hpp"
+#include "simulation.hpp"
+#include "sys_attack.hpp"
+#include "Q3Loader.h"
+#include "Q3Map.hpp"
+#include "nav_mesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+
+using namespace shooter;
+
+namespace {
+
+  typedef std::chrono::steady_clock Clock;
+
+  /// Number of ticks between 2 recorded samples
+  const unsigned cSampleInterval = 10;
+
+  /// Height of the rays origins above the entities positions
+  const glm::vec3 cEyeOffset(0.f, cPlayerHeight * .9f, 0.f);
+
+  /// Entity state recorded during the match
+  struct MatchSample
+  {
+    glm::vec3 position;
+    glm::vec3 front;
+    uint32_t entity;
+    AnimationId animationId;
+    float animationTime;
+  };
+
+  /// Simulate a match and record the NPCs every cSampleInterval ticks
+  std::vector<MatchSample> RecordMatch(const Resources& resources, Scene& scene, JobSystem& jobs, unsigned nrTicks)
+  {
+    std::vector<MatchSample> samples;
+
+    for (unsigned tick = 0; tick < nrTicks; tick++)
+    {
+      UpdateSimulation(cFixedTimeStep, resources, scene, jobs);
+
+      if ((tick % cSampleInterval) != 0) { continue; }
+
+      for (uint32_t i : scene.entities)
+      {
+        if (i < EnNpcMin) { continue; }
+
+        MatchSample sample = {
+          scene.transforms[i].position,
+          scene.transforms[i].front,
+          i,
+          scene.animations[i].id,
+          scene.animations[i].timeInSeconds };
+        samples.push_back(sample);
+      }
+    }
+
+    return samples;
+  }
+
+  /// BSP file of a map archive mounted in the file system
+  FileView ReadBsp(const VirtualFileSystem& fileSystem, const std::string& mapZipPath)
+  {
+    FileView bsp;
+    const std::vector<std::string> bspPaths = fileSystem.List("", ".bsp", mapZipPath);
+    if (!bspPaths.empty()) 
+    { 
+      fileSystem.Open(bspPaths.front(), bsp); 
+    }
+    return bsp;
+  }
+
+  /// Runs the benchmarks and prints their results
+  class Bench
+  {
+  public:
+
+    Bench(JobSystem& jobs, unsigned repetitions, const std::string& filter)
+      : mJobs(jobs)
+      , mRepetitions(std::max(1u, repetitions))
+      , mFilter(filter)
+    {}
+
+    /// Run kernel(begin, end) over nrOps ops, which writes the result of op i in results[i].
+    /// TResult must not have padding bytes, they are hashed.
+    /// If threadSafe, the ops are also split in jobs over all the threads.
+    template<typename TKernel, typename TResult>
+    void Run(const std::string& name, uint32_t nrOps, bool threadSafe, const TKernel& kernel, std::vector<TResult>& results)
+    {
+      if (!mFilter.empty() && (name.find(mFilter) == std::string::npos)) { return; }
+      if (nrOps == 0) { return; }
+
+      results.assign(nrOps, TResult());
+
+      Report(name, 1, nrOps, Measure([&]() { kernel(0u, nrOps); }), results);
+
+      if (threadSafe && (mJobs.GetNrThreads() > 1))
+      {
+        // A few chunks per thread, so the work stealing can balance them
+        const uint32_t nrChunks = std::min(nrOps, mJobs.GetNrThreads() * 4);
+        auto runChunk = [&](uint32_t chunk) {
+          kernel(uint32_t(uint64_t(nrOps) * chunk / nrChunks), uint32_t(uint64_t(nrOps) * (chunk + 1) / nrChunks));
+        };
+
+        results.assign(nrOps, TResult());
+
+        Report(name, mJobs.GetNrThreads(), nrOps, Measure([&]() { mJobs.ParallelFor(0, nrChunks, 1, runChunk); }), results);
+      }
+    }
+
+  private:
+
+    /// Times of the repetitions, in ns, sorted. The first (warm up) run is not timed.
+    template<typename TFunc>
+    std::vector<double> Measure(const TFunc& func)
+    {
+      func();
+
+      std::vector<double> times;
+      for (unsigned r = 0; r < mRepetitions; r++)
+      {
+        Clock::time_point start = Clock::now();
+        func();
+        times.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+      }
+
+      std::sort(times.begin(), times.end());
+      return times;
+    }
+
+    template<typename TResult>
+    void Report(const std::string& name, uint32_t nrThreads, uint32_t nrOps, const std::vector<double>& times, const std::vector<TResult>& results)
+    {
+      const double medianTime = times[times.size() / 2];
+      printf("{\"benchmark\":\"%s\",\"threads\":%u,\"ops\":%u,\"min_ns_per_op\":%.1f,\"median_ns_per_op\":%.1f,\"ops_per_second\":%.0f,\"checksum\":\"%016llx\"}\n",
+        name.c_str(), nrThreads, nrOps,
+        times.front() / nrOps,
+        medianTime / nrOps,
+        (medianTime > 0.) ? nrOps * 1e9 / medianTime : 0.,
+        (unsigned long long)Hash(results.data(), results.size() * sizeof(TResult)));
+      fflush(stdout);
+    }
+
+    JobSystem& mJobs;
+    unsigned mRepetitions;
+    std::string mFilter;
+  };
+
+  struct TraceResult
+  {
+    float fraction;
+    int32_t planeIndex;
+  };
+
+  struct PathResult
+  {
+    glm::vec3 endPos;
+    int32_t nrPolys;
+  };
+
+  struct SteerResult
+  {
+    glm::vec3 steerPos;
+    int32_t flags; ///< bit 0: off mesh connection, bit 1: end of path
+  };
+
+  struct FloorResult
+  {
+    float y;
+    float distY;
+    float borderDist;
+    int32_t flags; ///< bit 0: found, bit 1: walkable
+  };
+
+  struct RayEntitiesResult
+  {
+    int32_t entity;
+    float distance;
+    float damageMultiplier;
+  };
+
+  struct CylinderResult
+  {
+    int32_t hit;
+    float distance;
+  };
+
+  struct MapResult
+  {
+    int32_t nrVertices;
+    int32_t nrFaces;
+    int32_t nrBrushes;
+  };
+
+  struct VisibleFacesResult
+  {
+    int32_t nrFaces;
+    uint32_t facesHash;
+  };
+
+}
+
+int main(int argc, char* args[])
+{
+  const unsigned nrThreads = (argc > 1) ? std::strtoul(args[1], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency() - 1);
+  const unsigned repetitions = (argc > 2) ? std::strtoul(args[2], nullptr, 10) : 5u;
+  const std::string filter = (argc > 3) ? args[3] : "";
+  const unsigned seed = (argc > 4) ? std::strtoul(args[4], nullptr, 10) : 0u;
+  const unsigned nrTicks = (argc > 5) ? std::strtoul(args[5], nullptr, 10) : 3000u;
+
+  Scene scene;
+  scene.mapPath = "maps/jof3dm2.zip";
+  const std::string modelName("models/ArmyPilot/ArmyPilot.x");
+
+  JobSystem jobs(nrThreads);
+
+  // Only the CPU side data is loaded. Textures are not decoded.
+  Resources resources("res/");
+  if (!resources.LoadModel(modelName, false)) { return 1; }
+  if (!resources.LoadMap(scene.mapPath, false, &jobs)) { return 1; }
+  if (!InitEntities(resources, modelName, scene.Capacity(), scene)) { return 1; }
+
+  // The match is always simulated with the same settings, so the samples don't depend on nrThreads
+  SeedSimulation(seed, scene);
+  const std::vector<MatchSample> samples = RecordMatch(resources, scene, jobs, nrTicks);
+  const uint32_t nrSamples = samples.size();
+  if (nrSamples == 0) { return 1; }
+
+  const Q3Map& map = resources.GetMap();
+  const NavMesh& navMesh = resources.GetNavMesh();
+  const Model& model = resources.GetModel(scene.renderables[EnPlayer].modelId);
+
+  // Pairs of samples, far apart in the match
+  auto otherSample = [&](uint32_t i) -> const MatchSample& { return samples[(i * 7919u + nrSamples / 2) % nrSamples]; };
+
+  Bench bench(jobs, repetitions, filter);
+
+  // Q3Map::Trace, with each backend. The default backend keeps the plain kernel names.
+  {
+    const CompBounds& bounds = scene.bounds[EnPlayer];
+    const float lengths[] = { 1.f, 50.f };
+    const char* lengthNames[] = { "short", "long" };
+    const TraceBackend backends[] = { ETraceBackendMapData, ETraceBackendCollisionMap, ETraceBackendBvh };
+    const char* backendNames[] = { "", "/collision_map", "/bvh" };
+    std::vector<TraceResult> results;
+
+    for (uint32_t l = 0; l < 2; l++)
+    {
+      const float len = lengths[l];
+      const std::string suffix = std::string("/") + lengthNames[l];
+
+      for (uint32_t b = 0; b < 3; b++)
+      {
+        resources.GetMap().SetTraceBackend(backends[b]);
+        const std::string traceSuffix = suffix + backendNames[b];
+
+        bench.Run("Q3Map::Trace/point" + traceSuffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+          for (uint32_t i = begin; i < end; i++)
+          {
+            glm::vec3 start = samples[i].position + cEyeOffset;
+            TraceData data(start, start + samples[i].front * len);
+            map.Trace(data);
+            results[i].fraction = data.mFraction;
+            results[i].planeIndex = data.mPlaneIndex;
+          }
+        }, results);
+
+        bench.Run("Q3Map::Trace/sphere" + traceSuffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+          for (uint32_t i = begin; i < end; i++)
+          {
+            glm::vec3 start = samples[i].position + cEyeOffset;
+            TraceData data(start, start + samples[i].front * len, .5f);
+            map.Trace(data);
+            results[i].fraction = data.mFraction;
+            results[i].planeIndex = data.mPlaneIndex;
+          }
+        }, results);
+
+        bench.Run("Q3Map::Trace/box" + traceSuffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+          for (uint32_t i = begin; i < end; i++)
+          {
+            glm::vec3 start = samples[i].position;
+            TraceData data(start, start + samples[i].front * len, bounds.minBound, bounds.maxBound);
+            map.Trace(data);
+            results[i].fraction = data.mFraction;
+            results[i].planeIndex = data.mPlaneIndex;
+          }
+        }, results);
+      }
+
+      // Same traces as above, in packets walking the collision map. The checksums match the Q3Map::Trace ones.
+      resources.GetMap().SetTraceBackend(ETraceBackendCollisionMap);
+
+      auto runBatch = [&](uint32_t begin, uint32_t end, const std::function<void(std::vector<TraceData>&, uint32_t)>& addTrace) {
+        std::vector<TraceData> traces;
+        traces.reserve(Q3Map::cTracePacketSize);
+        for (uint32_t first = begin; first < end; first += Q3Map::cTracePacketSize)
+        {
+          const uint32_t last = std::min(end, first + Q3Map::cTracePacketSize);
+
+          traces.clear();
+          for (uint32_t i = first; i < last; i++)
+          {
+            addTrace(traces, i);
+          }
+
+          map.TraceBatch(traces.data(), traces.size());
+
+          for (uint32_t i = first; i < last; i++)
+          {
+            results[i].fraction = traces[i - first].mFraction;
+            results[i].planeIndex = traces[i - first].mPlaneIndex;
+          }
+        }
+      };
+
+      bench.Run("Q3Map::TraceBatch/point" + suffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+        runBatch(begin, end, [&](std::vector<TraceData>& traces, uint32_t i) {
+          glm::vec3 start = samples[i].position + cEyeOffset;
+          traces.emplace_back(start, start + samples[i].front * len);
+        });
+      }, results);
+
+      bench.Run("Q3Map::TraceBatch/sphere" + suffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+        runBatch(begin, end, [&](std::vector<TraceData>& traces, uint32_t i) {
+          glm::vec3 start = samples[i].position + cEyeOffset;
+          traces.emplace_back(start, start + samples[i].front * len, .5f);
+        });
+      }, results);
+
+      bench.Run("Q3Map::TraceBatch/box" + suffix, nrSamples, true, [&](uint32_t begin, uint32_t end) {
+        runBatch(begin, end, [&](std::vector<TraceData>& traces, uint32_t i) {
+          glm::vec3 start = samples[i].position;
+          traces.emplace_back(start, start + samples[i].front * len, bounds.minBound, bounds.maxBound);
+        });
+      }, results);
+
+      resources.GetMap().SetTraceBackend(ETraceBackendMapData);
+    }
+  }
+
+  // NavMesh::FindPath (serial only)
+  std::vector<CompNavMeshPath> paths(nrSamples);
+  {
+    std::vector<PathResult> results;
+    bench.Run("NavMesh::FindPath", nrSamples, false, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        CompNavMeshPath& path = paths[i];
+        navMesh.FindPath(glm::value_ptr(samples[i].position), glm::value_ptr(otherSample(i).position),
+          glm::value_ptr(path.pathStartPos), glm::value_ptr(path.pathEndPos), path.pathPolys, path.nrPathPolys);
+        results[i].endPos = path.pathEndPos;
+        results[i].nrPolys = path.nrPathPolys;
+      }
+    }, results);
+  }
+
+  // NavMesh::GetSteerPosOnPath, along the paths found above (serial only)
+  {
+    std::vector<SteerResult> results;
+    bench.Run("NavMesh::GetSteerPosOnPath", nrSamples, false, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        // The path is modified, work on a copy
+        CompNavMeshPath path = paths[i];
+        glm::vec3 steerPos;
+        bool offMeshConn = false, endOfPath = false;
+        navMesh.GetSteerPosOnPath(glm::value_ptr(samples[i].position), glm::value_ptr(path.pathEndPos), nullptr, 0,
+          path.pathPolys, path.nrPathPolys, 0.1f, glm::value_ptr(steerPos), offMeshConn, endOfPath);
+        results[i].steerPos = steerPos;
+        results[i].flags = (offMeshConn ? 1 : 0) | (endOfPath ? 2 : 0);
+      }
+    }, results);
+  }
+
+  // NavMesh::GetFloorInfo
+  {
+    std::vector<FloorResult> results;
+    bench.Run("NavMesh::GetFloorInfo", nrSamples, true, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        FloorResult& res = results[i];
+        bool walkable = false;
+        res.y = res.distY = res.borderDist = 0.f;
+        bool found = navMesh.GetFloorInfo(glm::value_ptr(samples[i].position), 1.f, res.y, res.distY, &walkable, &res.borderDist);
+        res.flags = (found ? 1 : 0) | (walkable ? 2 : 0);
+      }
+    }, results);
+  }
+
+  // Resources::GetSkeletonTransforms
+  {
+    const uint32_t nrNodes = model.nodesParents.size();
+    const uint32_t resultBone = std::min<uint32_t>(scene.weaponBoneIx, nrNodes - 1);
+    std::vector<glm::mat4> results;
+
+    bench.Run("Resources::GetSkeletonTransforms", nrSamples, true, [&](uint32_t begin, uint32_t end) {
+      std::vector<AnimationFrame> lastFrames(nrNodes);
+      std::vector<glm::mat4> globalTrans(nrNodes);
+      for (uint32_t i = begin; i < end; i++)
+      {
+        // Same previous frames for all the ops, so the results don't depend on the ops order
+        std::fill(lastFrames.begin(), lastFrames.end(), AnimationFrame());
+        float lastTime = samples[i].animationTime - cFixedTimeStep;
+        resources.GetSkeletonTransforms(model, samples[i].animationId, samples[i].animationTime, lastTime, lastFrames.data(), globalTrans.data());
+        results[i] = globalTrans[resultBone];
+      }
+    }, results);
+  }
+
+  // SysAttack::IntersectRayEntities, against the entities at the end of the match
+  {
+    std::vector<RayEntitiesResult> results;
+    bench.Run("SysAttack::IntersectRayEntities", nrSamples, true, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        RayEntitiesResult& res = results[i];
+        SysAttack::IntersectRayEntities(samples[i].entity, samples[i].position + cEyeOffset, samples[i].front, resources,
+          scene.renderables.data(), scene.transforms.data(), scene.bounds.data(),
+          scene.animationsGlobalTrans.data(), scene.nrAnimationNodes, scene.damagebles.data(),
+          scene.entities.data(), scene.entities.size(),
+          res.entity, res.distance, res.damageMultiplier);
+      }
+    }, results);
+  }
+
+  // intersectRayCylinder
+  {
+    std::vector<CylinderResult> results;
+    bench.Run("intersectRayCylinder", nrSamples, true, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        const MatchSample& target = otherSample(i);
+        glm::vec3 rayOrigin = samples[i].position + cEyeOffset;
+        glm::vec3 rayDir = glm::normalize(target.position + cEyeOffset - rayOrigin + glm::vec3(0.f, 0.f, 1e-3f));
+        float dist = 0.f;
+        results[i].hit = shooter::intersectRayCylinder(rayOrigin, rayDir, target.position, target.position + cEyeOffset, .3f, dist) ? 1 : 0;
+        results[i].distance = results[i].hit ? dist : 0.f;
+      }
+    }, results);
+  }
+
+  // readMap
+  {
+    const FileView bspFile = ReadBsp(resources.GetFileSystem(), scene.mapPath);
+    const char* bsp = (const char*)bspFile.GetData();
+    const uint32_t nrMaps = 2 * jobs.GetNrThreads();
+    std::vector<MapResult> results;
+
+    bench.Run("readMap", (bspFile.GetSize() == 0) ? 0 : nrMaps, true, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        // Same settings as the Q3Map constructor
+        TMapQ3 mapQ3;
+        readMap(bsp, bspFile.GetSize(), mapQ3, 0.03f, PostProcess_CoordSysOpenGL | PostProcess_FlipWindingOrder | PostProcess_TriangulateBezierPatches);
+        results[i].nrVertices = mapQ3.mVertices.size();
+        results[i].nrFaces = mapQ3.mFaces.size();
+        results[i].nrBrushes = mapQ3.mBrushes.size();
+      }
+    }, results);
+
+    // One map at a time, with its lumps read on jobs (as the Q3Map constructor does)
+    bench.Run("readMap/parallel_lumps", (bspFile.GetSize() == 0) ? 0 : nrMaps, false, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        TMapQ3 mapQ3;
+        readMap(bsp, bspFile.GetSize(), mapQ3, 0.03f, PostProcess_CoordSysOpenGL | PostProcess_FlipWindingOrder | PostProcess_TriangulateBezierPatches, 
+          &jobs);
+        results[i].nrVertices = mapQ3.mVertices.size();
+        results[i].nrFaces = mapQ3.mFaces.size();
+        results[i].nrBrushes = mapQ3.mBrushes.size();
+      }
+    }, results);
+  }
+
+  // Q3Map::FindVisibleFaces (CPU part of the map rendering)
+  {
+    const glm::mat4 projMat = CalcProjMat(CompFrustum());
+    std::vector<VisibleFacesResult> results;
+
+    bench.Run("Q3Map::FindVisibleFaces", nrSamples, true, [&](uint32_t begin, uint32_t end) {
+      for (uint32_t i = begin; i < end; i++)
+      {
+        CompTransform camTrans;
+        camTrans.position = samples[i].position + cEyeOffset;
+        camTrans.front = samples[i].front;
+
+        Q3Map::VisibleFacesByType faces = map.FindVisibleFaces(camTrans.position, projMat * CalcViewMat(camTrans));
+
+        results[i].nrFaces = 0;
+        results[i].facesHash = 0;
+        for (const auto& facesOfType : faces)
+        {
+          results[i].nrFaces += facesOfType.size();
+          for (const auto& face : facesOfType)
+          {
+            results[i].facesHash = results[i].facesHash * 31u + face.first;
+          }
+        }
+      }
+    }, results);
+  }
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// Headless simulation: loads the map, NavMesh and model data (no window, no OpenGL context),
+// then runs the fixed step simulation as fast as possible and reports the ticks per second.
+//
+// Usage: ShooterDemoHeadless [nrTicks] [nrThreads] [seed] [nrEntities] [traceFile] [doubleBuffering]
+//
+// With traceFile, the profiler captures the run and the last cProfilerTraceFrames ticks
+// are written as Chrome trace JSON.
+
+#include "resources.hpp"
+#include "scene.hpp"
+#include "constants.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace shooter;
+
+namespace {
+
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double SecondsSince(const Clock::time_point& start)
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  /// Peak resident set size of the process so far, in MB (0 if not available)
+  double PeakRssMegabytes()
+  {
+#ifdef _WIN32
+    return 0.;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0.; }
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024. * 1024.); // in bytes
+#else
+    return usage.ru_maxrss / 1024.; // in KB
+#endif
+#endif
+  }
+
+}
+
+int main(int argc, char* args[])
+{
+  const unsigned nrTicks = (argc > 1) ? std::strtoul(args[1], nullptr, 10) : 10000u;
+  const unsigned nrThreads = (argc > 2) ? std::strtoul(args[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency() - 1);
+  const unsigned seed = (argc > 3) ? std::strtoul(args[3], nullptr, 10) : 0u;
+  const unsigned nrEntities = (argc > 4) ? std::strtoul(args[4], nullptr, 10) : cDefaultEntitiesCapacity;
+  const std::string traceFile = (argc > 5) ? args[5] : "";
+  const bool doubleBuffering = (argc > 6) ? (std::strtoul(args[6], nullptr, 10) != 0) : false;
+
+  Clock::time_point loadStart = Clock::now();
+
+  Scene scene(nrEntities);
+  scene.mapPath = "maps/jof3dm2.zip";
+  scene.multithreading = (nrThreads > 0);
+  scene.doubleBuffering = doubleBuffering;
+  const std::string modelName("models/ArmyPilot/ArmyPilot.x");
+
+  // Init the job system, nrThreads workers besides the main thread. The map is loaded on it too.
+  JobSystem jobs(nrThreads);
+
+  // Only the CPU side data is loaded. Textures are not decoded.
+  Resources resources("res/");
+  if (!resources.LoadModel(modelName, false)) { return 1; }
+
+  Clock::time_point mapLoadStart = Clock::now();
+  if (!resources.LoadMap(scene.mapPath, false, &jobs)) { return 1; }
+  const double mapLoadTime = SecondsSince(mapLoadStart);
+
+  if (!InitEntities(resources, modelName, nrEntities, scene)) { return 1; }
+
+  const double loadTime = SecondsSince(loadStart);
+  const double loadPeakRss = PeakRssMegabytes();
+
+  // Random seed
+  SeedSimulation(seed, scene);
+
+  Profiler::SetCapturing(!traceFile.empty());
+
+  Clock::time_point runStart = Clock::now();
+
+  for (unsigned i = 0; i < nrTicks; i++)
+  {
+    Profiler::BeginFrame();
+    UpdateSimulation(cFixedTimeStep, resources, scene, jobs);
+  }
+
+  const double runTime = SecondsSince(runStart);
+
+  if (!traceFile.empty() && !Profiler::WriteChromeTrace(traceFile, cProfilerTraceFrames)) { return 1; }
+
+  std::cout << "threads: " << nrThreads << std::endl;
+  std::cout << "double_buffering: " << doubleBuffering << std::endl;
+  std::cout << "entities: " << scene.entities.size() << std::endl;
+  std::cout << "nav_mesh_paths: " << scene.navMeshPaths.Size() << std::endl;
+  std::cout << "load_seconds: " << loadTime << std::endl;
+  std::cout << "map_load_seconds: " << mapLoadTime << std::endl;
+  std::cout << "nav_mesh_build_ms: " << resources.GetNavMesh().GetBuildTimeMs() << std::endl;
+  std::cout << "nav_mesh_saved_build_ms: " << resources.GetNavMesh().GetSavedBuildTimeMs() << std::endl;
+  std::cout << "load_peak_rss_mb: " << loadPeakRss << std::endl;
+  std::cout << "ticks: " << nrTicks << std::endl;
+  std::cout << "run_seconds: " << runTime << std::endl;
+  std::cout << "ticks_per_second: " << (runTime > 0. ? nrTicks / runTime : 0.) << std::endl;
+  std::cout << "simulated_seconds_per_second: " << (runTime > 0. ? nrTicks * cFixedTimeStep / runTime : 0.) << std::endl;
+
+  // Job statistics, summed over all threads
+  JobStats total;
+  for (const JobStats& stats : jobs.GetStats())
+  {
+    total.nrJobs += stats.nrJobs;
+    total.nrStolen += stats.nrStolen;
+    total.queueWaitNs += stats.queueWaitNs;
+    total.jobNs += stats.jobNs;
+  }
+
+  const double nrJobs = static_cast<double>(std::max<uint64_t>(total.nrJobs, 1));
+  std::cout << "jobs: " << total.nrJobs << std::endl;
+  std::cout << "jobs_stolen: " << total.nrStolen << std::endl;
+  std::cout << "job_queue_wait_us: " << total.queueWaitNs / nrJobs * 1e-3 << std::endl;
+  std::cout << "job_duration_us: " << total.jobNs / nrJobs * 1e-3 << std::endl;
+
+  return 0;
+}
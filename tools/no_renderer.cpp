@@ -0,0 +1,45 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// Stand-ins for the parts of Q3Map and Resources that call SDL_image and OpenGL (src/Q3Map_gl.cpp and src/resources_gl.cpp),
+// for the targets linked without a renderer. Nothing is decoded or uploaded, so there is nothing to release.
+
+#include "Q3Map.hpp"
+#include "resources.hpp"
+
+#include <iostream>
+
+using namespace shooter;
+
+std::vector<SDL_Surface*> Q3Map::DecodeTextures(
+  const std::vector<TTexture>& textures, 
+  const VirtualFileSystem& /*fileSystem*/, 
+  JobSystem* /*jobs*/, 
+  uint64_t& outSourcesKey)
+{
+  std::cout << "The map textures can't be decoded without SDL_image" << std::endl;
+  outSourcesKey = 0;
+  return std::vector<SDL_Surface*>(textures.size(), nullptr);
+}
+
+void Q3Map::ReleaseGL()
+{
+}
+
+void Resources::DecodeTextures(const std::vector<std::vector<uint8_t> >& /*embeddedTexturesData*/, Model& /*model*/) const
+{
+  std::cout << "The model textures can't be decoded without SDL_image" << std::endl;
+}
+
+void Resources::ReleaseGL()
+{
+}
@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2016 Iulian Marinescu Ghetau giulian2003@gmail.com
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely.  If you use this software in a product, an acknowledgment in the 
+// product documentation would be appreciated but is not required.
+//
+
+// Replay: re-simulates a recording made with `ShooterDemo <replayFile>` as fast as possible,
+// without a window, and compares the Scene checksum after each tick with the recorded one.
+// Replaying with different thread counts or builds finds the first tick where they diverge.
+//
+// Usage: ShooterDemoReplay <replayFile> [nrThreads] [startTick=0] [nrTicks=all]
+//
+// The replay starts from the last keyframe before startTick.
+
+#include "resources.hpp"
+#include "scene.hpp"
+#include "job_system.hpp"
+#include "replay.hpp"
+#include "simulation.hpp"
+#include "constants.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+
+using namespace shooter;
+
+namespace {
+
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double SecondsSince(const Clock::time_point& start)
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+}
+
+int main(int argc, char* args[])
+{
+  if (argc < 2)
+  {
+    std::cout << "Usage: ShooterDemoReplay <replayFile> [nrThreads] [startTick=0] [nrTicks=all]" << std::endl;
+    return 1;
+  }
+
+  const std::string replayFile(args[1]);
+  const unsigned nrThreads = (argc > 2) ? std::strtoul(args[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency() - 1);
+  const unsigned startTick = (argc > 3) ? std::strtoul(args[3], nullptr, 10) : 0u;
+  const uint64_t nrTicks = (argc > 4) ? std::strtoul(args[4], nullptr, 10) : std::numeric_limits<uint32_t>::max();
+
+  ReplayReader replay;
+  if (!replay.Open(replayFile)) { return 1; }
+
+  const ReplayHeader& header = replay.GetHeader();
+
+  Scene scene(header.nrEntities);
+  scene.mapPath = header.mapPath;
+  scene.multithreading = (nrThreads > 0);
+
+  JobSystem jobs(nrThreads);
+
+  // Only the CPU side data is loaded
+  Resources resources("res/");
+  if (!resources.LoadModel(header.modelName, false)) { return 1; }
+  if (!resources.LoadMap(scene.mapPath, false, &jobs)) { return 1; }
+  if (!InitEntities(resources, header.modelName, header.nrEntities, scene)) { return 1; }
+
+  SeedSimulation(header.seed, scene);
+
+  // Start from the closest keyframe
+  const int64_t keyframeTick = replay.Seek(startTick, scene);
+  if (keyframeTick < 0)
+  {
+    std::cout << "No keyframe before tick " << startTick << std::endl;
+    return 1;
+  }
+
+  int64_t firstDivergentTick = -1;
+  unsigned nrReplayedTicks = 0;
+
+  Clock::time_point runStart = Clock::now();
+
+  // The ticks between the keyframe and startTick are replayed too
+  const uint64_t endTick = static_cast<uint64_t>(startTick) + nrTicks;
+
+  ReplayTick tick;
+  while (replay.ReadTick(tick) && (tick.tick < endTick))
+  {
+    tick.Apply(scene);
+    UpdateSimulation(cFixedTimeStep, resources, scene, jobs);
+    nrReplayedTicks++;
+
+    if (scene.Checksum() != tick.checksum)
+    {
+      firstDivergentTick = tick.tick;
+      break;
+    }
+  }
+
+  const double runTime = SecondsSince(runStart);
+
+  std::cout << "threads: " << nrThreads << std::endl;
+  std::cout << "keyframe_tick: " << keyframeTick << std::endl;
+  std::cout << "ticks: " << nrReplayedTicks << std::endl;
+  std::cout << "run_seconds: " << runTime << std::endl;
+  std::cout << "ticks_per_second: " << (runTime > 0. ? nrReplayedTicks / runTime : 0.) << std::endl;
+  std::cout << "first_divergent_tick: " << firstDivergentTick << std::endl;
+
+  return (firstDivergentTick < 0) ? 0 : 2;
+}